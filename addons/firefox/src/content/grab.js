@@ -44,13 +44,16 @@ function grab(size, region, req_id, sections)
 
   var image_data = context.getImageData(0, 0, canvas.width, canvas.height).data;
   var len = image_data.length;
-  var bytearray = new Uint8Array(len + 2);
+  var bytearray = new Uint8Array(len + 5);
   
-  bytearray[0] = 1;      // type
-  bytearray[1] = req_id; // id
+  bytearray[0] = 1 | 0x80; // type (raw, 32bit id)
+  bytearray[1] = req_id & 0xff; // id (little endian)
+  bytearray[2] = (req_id >>> 8) & 0xff;
+  bytearray[3] = (req_id >>> 16) & 0xff;
+  bytearray[4] = (req_id >>> 24) & 0xff;
 
   for( var i = 0; i < len; ++i )
-    bytearray[i + 2] = image_data[i];
+    bytearray[i + 5] = image_data[i];
 
   return bytearray.buffer;
 }
@@ -0,0 +1,249 @@
+#ifndef LR_COSTMAPDAMAGE
+#define LR_COSTMAPDAMAGE
+
+#include "slotdata/damage.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace LinksRouting
+{
+  /**
+   * Bookkeeping of the changed parts of the saliency and cost map.
+   *
+   * Damage is collected on a coarse grid over the saliency map and merged
+   * into a few rectangular regions before processing. After the regions
+   * (grown by the apron of the filters) have been processed, all affected
+   * tiles of the cost map get a new version.
+   */
+  class CostMapDamage
+  {
+    public:
+
+      /** Size of grid cells used to collect damage (saliency map pixels) */
+      static const int GRID_SIZE = 16;
+
+      struct Region
+      {
+        int x0, y0, x1, y1; //!< [x0, x1) x [y0, y1)
+
+        Region(int _x0, int _y0, int _x1, int _y1):
+          x0(_x0), y0(_y0), x1(_x1), y1(_y1)
+        { }
+
+        bool empty() const
+        {
+          return x0 >= x1 || y0 >= y1;
+        }
+
+        /**
+         * Grow by the given margin and clip to [0, width) x [0, height)
+         */
+        Region expanded(int dx, int dy, int width, int height) const
+        {
+          return Region( std::max(x0 - dx, 0),
+                         std::max(y0 - dy, 0),
+                         std::min(x1 + dx, width),
+                         std::min(y1 + dy, height) );
+        }
+
+        /**
+         * Get the region covering this region in an image downsampled by the
+         * given factor
+         */
+        Region downsampled(int ds, int width, int height) const
+        {
+          return Region( x0 / ds,
+                         y0 / ds,
+                         std::min((x1 + ds - 1) / ds, width),
+                         std::min((y1 + ds - 1) / ds, height) );
+        }
+      };
+      typedef std::vector<Region> Regions;
+
+      CostMapDamage():
+        _width(0),
+        _height(0),
+        _cols(0),
+        _rows(0),
+        _dirty(false)
+      {}
+
+      /**
+       * Set the size of the saliency map and the layout of the version tiles.
+       * Marks everything as damaged if anything has changed.
+       *
+       * @param width       Width of the saliency map
+       * @param height      Height of the saliency map
+       * @param ds_to_cost  Downsampling factor from saliency to cost map
+       * @param tile_size   Size of version tiles (cost map pixels)
+       */
+      void resize( int width,
+                   int height,
+                   int ds_to_cost,
+                   int tile_size,
+                   SlotType::TileVersions& versions )
+      {
+        const int width_cost = width / ds_to_cost,
+                  height_cost = height / ds_to_cost;
+        tile_size = std::max(tile_size, 1);
+
+        if(    width == _width && height == _height
+            && versions.tile_size == static_cast<unsigned int>(tile_size)
+            && versions.cols == static_cast<unsigned int>
+                                ((width_cost + tile_size - 1) / tile_size)
+            && versions.rows == static_cast<unsigned int>
+                                ((height_cost + tile_size - 1) / tile_size) )
+          return;
+
+        _width = width;
+        _height = height;
+        _cols = (width + GRID_SIZE - 1) / GRID_SIZE;
+        _rows = (height + GRID_SIZE - 1) / GRID_SIZE;
+        _grid.assign(_cols * _rows, 0);
+
+        versions.tile_size = tile_size;
+        versions.cols = (width_cost + tile_size - 1) / tile_size;
+        versions.rows = (height_cost + tile_size - 1) / tile_size;
+        versions.versions.assign(versions.cols * versions.rows, 0);
+
+        addAll();
+      }
+
+      /**
+       * Mark the whole map as damaged
+       */
+      void addAll()
+      {
+        add(Region(0, 0, _width, _height));
+      }
+
+      /**
+       * Mark a region as damaged
+       *
+       * @param region  Damaged region (saliency map pixels)
+       */
+      void add(const Region& region)
+      {
+        const Region r = region.expanded(0, 0, _width, _height);
+        if( r.empty() )
+          return;
+
+        for(int row = r.y0 / GRID_SIZE; row <= (r.y1 - 1) / GRID_SIZE; ++row)
+          for(int col = r.x0 / GRID_SIZE; col <= (r.x1 - 1) / GRID_SIZE; ++col)
+            _grid[row * _cols + col] = 1;
+        _dirty = true;
+      }
+
+      /**
+       * Add damage of the source image (eg. the desktop)
+       *
+       * @param damage  Damaged regions (source image pixels)
+       * @param ds      Downsampling from source image to saliency map
+       */
+      void add(const SlotType::Damage& damage, int ds)
+      {
+        for(auto const& rect: damage.rects)
+          add( Region( rect.x,
+                       rect.y,
+                       rect.x + rect.width,
+                       rect.y + rect.height ).downsampled(ds, _width, _height) );
+      }
+
+      bool empty() const
+      {
+        return !_dirty;
+      }
+
+      /**
+       * Get damaged regions (saliency map pixels) covering all damaged grid
+       * cells. Neighbouring cells are merged into as few regions as possible.
+       */
+      Regions getRegions() const
+      {
+        Regions regions;
+        if( !_dirty )
+          return regions;
+
+        for(int row = 0; row < _rows; ++row)
+        {
+          const int y0 = row * GRID_SIZE,
+                    y1 = std::min(y0 + GRID_SIZE, _height);
+
+          for(int col = 0; col < _cols; ++col)
+          {
+            if( !_grid[row * _cols + col] )
+              continue;
+
+            // Horizontal run of damaged cells...
+            const int first = col;
+            while( col + 1 < _cols && _grid[row * _cols + col + 1] )
+              ++col;
+
+            const int x0 = first * GRID_SIZE,
+                      x1 = std::min((col + 1) * GRID_SIZE, _width);
+
+            // ...extending a run of the previous row or starting a new region
+            auto prev = std::find_if(
+              regions.begin(),
+              regions.end(),
+              [&](const Region& r)
+              {
+                return r.y1 == y0 && r.x0 == x0 && r.x1 == x1;
+              }
+            );
+            if( prev != regions.end() )
+              prev->y1 = y1;
+            else
+              regions.push_back(Region(x0, y0, x1, y1));
+          }
+        }
+
+        return regions;
+      }
+
+      /**
+       * Start a new revision, set it as version of all cost map tiles affected
+       * by the given regions and clear the damage.
+       *
+       * @param regions     Updated regions (cost map pixels)
+       * @return Whether a new revision has been started
+       */
+      bool commit( const Regions& regions,
+                   SlotType::TileVersions& versions )
+      {
+        if( !_dirty )
+          return false;
+
+        const int size = versions.tile_size;
+        for(auto const& r: regions)
+        {
+          if( r.empty() )
+            continue;
+
+          const int row_end = std::min<int>((r.y1 - 1) / size + 1, versions.rows),
+                    col_end = std::min<int>((r.x1 - 1) / size + 1, versions.cols);
+          for(int row = r.y0 / size; row < row_end; ++row)
+            for(int col = r.x0 / size; col < col_end; ++col)
+              versions.versions[row * versions.cols + col] =
+                versions.revision + 1;
+        }
+
+        versions.revision += 1;
+        std::fill(_grid.begin(), _grid.end(), 0);
+        _dirty = false;
+        return true;
+      }
+
+    protected:
+
+      int   _width,
+            _height,
+            _cols,
+            _rows;
+      bool  _dirty;
+      std::vector<uint8_t> _grid;
+  };
+} // namespace LinksRouting
+
+#endif //LR_COSTMAPDAMAGE
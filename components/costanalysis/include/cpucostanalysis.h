@@ -0,0 +1,113 @@
+#ifndef LR_CPUCOSTANALYSIS
+#define LR_CPUCOSTANALYSIS
+
+#include "costanalysis.h"
+#include "costmapdamage.h"
+#include "common/componentarguments.h"
+
+#include "slots.hpp"
+#include "slotdata/damage.hpp"
+#include "slotdata/image.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace LinksRouting
+{
+  /**
+   * Cost analysis running on the CPU (same pipeline as GlCostAnalysis).
+   *
+   * Takes the desktop as RGBA8 image from memory and publishes the cost map
+   * as ImageGray32F, so it can be used without an OpenGL context and read by
+   * CPU routers without waiting for the GPU.
+   *
+   * Only regions of the desktop which have changed since the last call are
+   * processed again. Damage is taken from /desktop/damage if available,
+   * otherwise it is detected by comparing with the previous desktop image.
+   * The version of every tile of the cost map is published on
+   * /costmap/tiles.
+   */
+  class CpuCostAnalysis:
+    public CostAnalysis,
+    public ComponentArguments
+  {
+    protected:
+
+      int _downsampleSaliency;
+      int _downsampleCost;
+      int _downsampleSaliencyToCost;
+      int _num_threads;         //!< Worker threads (0 = number of cores)
+      int _tile_size;           //!< Size of version tiles (cost map pixels)
+
+    public:
+
+      CpuCostAnalysis();
+      virtual ~CpuCostAnalysis();
+
+      void publishSlots(SlotCollector& slots);
+      void subscribeSlots(SlotSubscriber& slot_subscriber);
+
+      bool supports(unsigned int type) const
+      {
+        return (type & Component::Costanalysis);
+      }
+
+      uint32_t process(unsigned int type) override;
+
+    protected:
+
+      typedef CostMapDamage::Region Region;
+      typedef CostMapDamage::Regions Regions;
+
+      /** Size of the saliency map (desktop size / DownsampleSaliency) */
+      size_t  _width,
+              _height,
+
+      /** Size of the cost map (saliency map size / DownsampleCost) */
+              _width_cost,
+              _height_cost;
+
+      std::vector<float>  _feature_map,   //!< CIELab (+ padding) per pixel
+                          _filter_a,      //!< Center filter (horizontal pass)
+                          _filter_b,      //!< Surround filter (horizontal pass)
+                          _saliency_map,
+                          _cost_map;
+
+      CostMapDamage         _damage;
+      std::vector<uint8_t>  _prev_desktop;  //!< Copy of the last desktop image
+
+      void resize(size_t width, size_t height);
+
+      /**
+       * Mark all grid cells which differ from the previous desktop image as
+       * damaged and update the copy of the desktop.
+       */
+      void diffDesktop(const SlotType::Image& desktop);
+
+      void computeFeatureMap( const uint8_t* desktop,
+                              size_t desktop_width,
+                              const Region& region );
+      void filterRows(const Region& region);
+      void filterColumns(const Region& region);
+      void downsampleCost(const Region& region);
+
+      /**
+       * Split regions into bands of rows and process the bands in parallel.
+       * func must only write to the rows of the given region.
+       *
+       * @param func  void(const Region& band)
+       */
+      template<class Func>
+      void forEachBand(const Regions& regions, const Func& func);
+
+    private:
+
+      slot_t<SlotType::Image>::type         _slot_costmap;
+      slot_t<SlotType::TileVersions>::type  _slot_costmap_tiles;
+      slot_t<SlotType::Image>::type         _subscribe_desktop;
+      slot_t<SlotType::Damage>::type        _subscribe_desktop_damage;
+      slot_t<uint32_t>::type                _subscribe_links_revision;
+  };
+} // namespace LinksRouting
+
+#endif //LR_CPUCOSTANALYSIS
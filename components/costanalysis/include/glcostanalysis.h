@@ -2,11 +2,13 @@
 #define LR_GLCOSTANALYSIS
 
 #include "costanalysis.h"
+#include "costmapdamage.h"
 #include "common/componentarguments.h"
 
 #include "glsl/glsl.h"
 #include "fbo.h"
 #include "slots.hpp"
+#include "slotdata/damage.hpp"
 #include "slotdata/image.hpp"
 
 #include <string>
@@ -22,6 +24,7 @@ namespace LinksRouting
       int _downsampleSaliency;
       int _downsampleCost;
       int _downsampleSaliencyToCost;
+      int _tile_size;           //!< Size of version tiles (cost map pixels)
 
     public:
 
@@ -54,6 +57,11 @@ namespace LinksRouting
       slot_t<SlotType::Image>::type _slot_featuremap;
       slot_t<SlotType::Image>::type _slot_downsampledinput;
       slot_t<SlotType::Image>::type _subscribe_desktop;
+      slot_t<SlotType::Damage>::type _subscribe_desktop_damage;
+      slot_t<uint32_t>::type _subscribe_links_revision;
+      slot_t<SlotType::TileVersions>::type _slot_costmap_tiles;
+
+      CostMapDamage _damage;
 
       gl::FBO   _feature_map_fbo;
       gl::FBO   _saliency_map_fbo;
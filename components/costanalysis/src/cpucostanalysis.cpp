@@ -0,0 +1,532 @@
+#include "cpucostanalysis.h"
+#include "log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+namespace LinksRouting
+{
+  namespace
+  {
+    // Same filters as used by saliencyFilter.glsl ("default trimmed")
+    const int FILTER_SAMPLES = 7;
+    const float GAUSS_A[FILTER_SAMPLES] = {
+      0.71999999999999997000f, 0.07588744168454231200f, 0.00008885505894240928f,
+      0.00000000115576419973f, 0.00000000000000016701f, 0.f, 0.f
+    };
+    const float GAUSS_B[FILTER_SAMPLES] = {
+      0.08555807038943835700f, 0.08391941157579190000f, 0.07918934964643750700f,
+      0.07189091646601346300f, 0.06278908601128568900f, 0.05275907832970361900f,
+      0.04264942067529771400f
+    };
+    const float SALIENCY_SCALE = 15 * 0.333333333f * 0.005f;
+
+    /** Pixels affected by a change of a single pixel (per filter pass) */
+    const int FILTER_APRON = FILTER_SAMPLES - 1;
+
+    const size_t LUT_SIZE = 4096;
+    const float LAB_LUT_MAX = 1.25f;
+
+    /**
+     * Lookup tables for sRGB -> CIELab (as in featureMap.glsl)
+     */
+    struct LabTables
+    {
+      float linear[LUT_SIZE + 1], //!< sRGB [0, 1] -> linear RGB [0, 100]
+            cbrt[LUT_SIZE + 2];   //!< XYZ/white [0, LAB_LUT_MAX] -> f(t)
+
+      LabTables()
+      {
+        for(size_t i = 0; i <= LUT_SIZE; ++i)
+        {
+          double c = static_cast<double>(i) / LUT_SIZE;
+          linear[i] = 100 * ( c > 0.04045
+                            ? std::pow((c + 0.055) / 1.055, 2.4)
+                            : c / 12.92 );
+        }
+
+        for(size_t i = 0; i < LUT_SIZE + 2; ++i)
+        {
+          double t = LAB_LUT_MAX * i / LUT_SIZE;
+          cbrt[i] = t > 0.008856 ? std::pow(t, 1 / 3.)
+                                 : 7.787 * t + 16 / 116.;
+        }
+      }
+
+      float f(float t) const
+      {
+        float pos = std::min(std::max(t, 0.f), LAB_LUT_MAX)
+                  * (LUT_SIZE / LAB_LUT_MAX);
+        size_t i = static_cast<size_t>(pos);
+        float frac = pos - i;
+        return cbrt[i] + frac * (cbrt[i + 1] - cbrt[i]);
+      }
+    };
+
+    const LabTables& labTables()
+    {
+      static const LabTables tables;
+      return tables;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  CpuCostAnalysis::CpuCostAnalysis():
+    Configurable("CPUCostAnalysis"),
+    _width(0),
+    _height(0),
+    _width_cost(0),
+    _height_cost(0)
+  {
+    registerArg("DownsampleSaliency", _downsampleSaliency = 2);
+    registerArg("DownsampleCost", _downsampleCost = 4);
+    registerArg("NumThreads", _num_threads = 0);
+    registerArg("TileSize", _tile_size = 16);
+  }
+
+  //----------------------------------------------------------------------------
+  CpuCostAnalysis::~CpuCostAnalysis()
+  {
+
+  }
+
+  //------------------------------------------------------------------------------
+  void CpuCostAnalysis::publishSlots(SlotCollector& slots)
+  {
+    _slot_costmap = slots.create<SlotType::Image>("/costmap");
+    _slot_costmap_tiles =
+      slots.create<SlotType::TileVersions>("/costmap/tiles");
+  }
+
+  //----------------------------------------------------------------------------
+  void CpuCostAnalysis::subscribeSlots(SlotSubscriber& slot_subscriber)
+  {
+    _subscribe_desktop =
+      slot_subscriber.getSlot<LinksRouting::SlotType::Image>("/desktop");
+    _subscribe_desktop_damage =
+      slot_subscriber.getSlot<LinksRouting::SlotType::Damage>("/desktop/damage");
+    _subscribe_links_revision =
+      slot_subscriber.getSlot<uint32_t>("/links/revision");
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t CpuCostAnalysis::process(unsigned int type)
+  {
+    _slot_costmap->setValid(false);
+
+    const SlotType::Image& desktop = *_subscribe_desktop->_data;
+    if( !_subscribe_desktop->isValid() || !desktop.width || !desktop.height )
+      return 0;
+
+    if( desktop.type != SlotType::Image::ImageRGBA8 || !desktop.pdata )
+    {
+      LOG_WARN("CPU cost analysis requires the desktop as RGBA8 image.");
+      return 0;
+    }
+
+    resize(desktop.width, desktop.height);
+    if( !_width || !_height )
+      return 0;
+
+    if( _subscribe_desktop_damage->isValid() )
+    {
+      _damage.add( *_subscribe_desktop_damage->_data,
+                   std::max(1, _downsampleSaliency) );
+
+      // Copy is not updated anymore, so do not use it for the next diff
+      _prev_desktop.clear();
+    }
+    else
+      diffDesktop(desktop);
+
+    if( !_damage.empty() )
+    {
+      // Every filter pass spreads changes by its apron, so grow the damaged
+      // regions accordingly for each step
+      const int w = static_cast<int>(_width),
+                h = static_cast<int>(_height);
+      const Regions damage = _damage.getRegions();
+      Regions damage_rows,
+              damage_saliency,
+              damage_cost;
+      for(auto const& r: damage)
+      {
+        damage_rows.push_back( r.expanded(FILTER_APRON, 0, w, h) );
+        damage_saliency.push_back( r.expanded(FILTER_APRON, FILTER_APRON, w, h) );
+        damage_cost.push_back( damage_saliency.back().downsampled(
+          _downsampleSaliencyToCost,
+          static_cast<int>(_width_cost),
+          static_cast<int>(_height_cost)
+        ));
+      }
+
+      forEachBand(damage, [&](const Region& band)
+      {
+        computeFeatureMap(desktop.pdata, desktop.width, band);
+      });
+      forEachBand(damage_rows, [&](const Region& band)
+      {
+        filterRows(band);
+      });
+      forEachBand(damage_saliency, [&](const Region& band)
+      {
+        filterColumns(band);
+      });
+      if( _downsampleSaliencyToCost > 1 )
+        forEachBand(damage_cost, [&](const Region& band)
+        {
+          downsampleCost(band);
+        });
+
+      // Routes follow the cost map, so the links have changed as well
+      if( _damage.commit(damage_cost, *_slot_costmap_tiles->_data) )
+        *_subscribe_links_revision->_data += 1;
+    }
+    _slot_costmap_tiles->setValid(true);
+
+    if( _downsampleSaliencyToCost > 1 )
+    {
+      *_slot_costmap->_data = SlotType::Image(
+        _width_cost,
+        _height_cost,
+        reinterpret_cast<unsigned char*>(_cost_map.data()),
+        SlotType::Image::ImageGray32F
+      );
+    }
+    else
+      *_slot_costmap->_data = SlotType::Image(
+        _width,
+        _height,
+        reinterpret_cast<unsigned char*>(_saliency_map.data()),
+        SlotType::Image::ImageGray32F
+      );
+
+    _slot_costmap->setValid(true);
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  void CpuCostAnalysis::resize(size_t width, size_t height)
+  {
+    const int ds = std::max(1, _downsampleSaliency);
+    _downsampleSaliencyToCost = std::max(1, _downsampleCost / ds);
+
+    _width = width / ds;
+    _height = height / ds;
+    _width_cost = _width / _downsampleSaliencyToCost;
+    _height_cost = _height / _downsampleSaliencyToCost;
+
+    // Four floats per pixel to allow processing a whole pixel with a single
+    // SIMD instruction
+    _feature_map.resize(4 * _width * _height);
+    _filter_a.resize(4 * _width * _height);
+    _filter_b.resize(4 * _width * _height);
+    _saliency_map.resize(_width * _height);
+    _cost_map.resize(_width_cost * _height_cost);
+
+    _damage.resize( static_cast<int>(_width),
+                    static_cast<int>(_height),
+                    _downsampleSaliencyToCost,
+                    _tile_size,
+                    *_slot_costmap_tiles->_data );
+  }
+
+  //----------------------------------------------------------------------------
+  void CpuCostAnalysis::diffDesktop(const SlotType::Image& desktop)
+  {
+    const size_t size = 4 * desktop.width * desktop.height;
+    if( _prev_desktop.size() != size )
+    {
+      _prev_desktop.assign(desktop.pdata, desktop.pdata + size);
+      _damage.addAll();
+      return;
+    }
+
+    // Compare whole grid cells to keep the number of regions low
+    const size_t ds = std::max(1, _downsampleSaliency),
+                 cell = CostMapDamage::GRID_SIZE * ds,
+                 stride = 4 * desktop.width,
+                 width = _width * ds,
+                 height = _height * ds;
+
+    for(size_t y0 = 0; y0 < height; y0 += cell)
+    {
+      const size_t y1 = std::min(y0 + cell, height);
+      for(size_t x0 = 0; x0 < width; x0 += cell)
+      {
+        const size_t offset = 4 * x0,
+                     span = 4 * (std::min(x0 + cell, width) - x0);
+
+        size_t y = y0;
+        while(    y < y1
+               && !std::memcmp( &_prev_desktop[y * stride + offset],
+                                desktop.pdata + y * stride + offset,
+                                span ) )
+          ++y;
+
+        if( y == y1 )
+          continue;
+
+        for(; y < y1; ++y)
+          std::memcpy( &_prev_desktop[y * stride + offset],
+                       desktop.pdata + y * stride + offset,
+                       span );
+
+        _damage.add( Region( static_cast<int>(x0 / ds),
+                             static_cast<int>(y0 / ds),
+                             static_cast<int>((x0 + cell) / ds),
+                             static_cast<int>(y1 / ds) ) );
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CpuCostAnalysis::computeFeatureMap( const uint8_t* desktop,
+                                           size_t desktop_width,
+                                           const Region& region )
+  {
+    const LabTables& lut = labTables();
+    const size_t ds = std::max(1, _downsampleSaliency);
+    const float to_lut = static_cast<float>(LUT_SIZE) / (255 * ds * ds);
+
+    for(size_t y = region.y0; y < static_cast<size_t>(region.y1); ++y)
+    {
+      float* out = &_feature_map[4 * (y * _width + region.x0)];
+      for(size_t x = region.x0; x < static_cast<size_t>(region.x1); ++x, out += 4)
+      {
+        // Average each block of the desktop
+        unsigned int sum[3] = {0, 0, 0};
+        for(size_t sy = 0; sy < ds; ++sy)
+        {
+          const uint8_t* in = desktop + 4 * ((y * ds + sy) * desktop_width
+                                           + x * ds);
+          for(size_t sx = 0; sx < ds; ++sx, in += 4)
+          {
+            sum[0] += in[0];
+            sum[1] += in[1];
+            sum[2] += in[2];
+          }
+        }
+
+        const float r = lut.linear[static_cast<size_t>(sum[0] * to_lut + .5f)],
+                    g = lut.linear[static_cast<size_t>(sum[1] * to_lut + .5f)],
+                    b = lut.linear[static_cast<size_t>(sum[2] * to_lut + .5f)];
+
+        // sRGB -> XYZ (Observer = 2°, Illuminant = D65) -> CIELab
+        const float fx = lut.f( (0.4124564f * r + 0.3575761f * g
+                                               + 0.1804375f * b) / 95.047f ),
+                    fy = lut.f( (0.2126729f * r + 0.7151522f * g
+                                               + 0.0721750f * b) / 100.000f ),
+                    fz = lut.f( (0.0193339f * r + 0.1191920f * g
+                                               + 0.9503041f * b) / 108.883f );
+
+        // Gray is neutral
+        out[0] = 116 * fy - 16 - 50;
+        out[1] = 500 * (fx - fy);
+        out[2] = 200 * (fy - fz);
+        out[3] = 0;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CpuCostAnalysis::filterRows(const Region& region)
+  {
+    const int w = static_cast<int>(_width);
+    for(size_t y = region.y0; y < static_cast<size_t>(region.y1); ++y)
+    {
+      const float* in = &_feature_map[4 * y * _width];
+      float *out_a = &_filter_a[4 * (y * _width + region.x0)],
+            *out_b = &_filter_b[4 * (y * _width + region.x0)];
+
+      for(int x = region.x0; x < region.x1; ++x, out_a += 4, out_b += 4)
+      {
+#ifdef __SSE2__
+        __m128 a = _mm_setzero_ps(),
+               b = _mm_setzero_ps();
+        for(int i = -FILTER_SAMPLES + 1; i < FILTER_SAMPLES; ++i)
+        {
+          const int sx = std::min(std::max(x + i, 0), w - 1);
+          const __m128 sample = _mm_loadu_ps(in + 4 * sx);
+          a = _mm_add_ps(a, _mm_mul_ps(_mm_set1_ps(GAUSS_A[std::abs(i)]), sample));
+          b = _mm_add_ps(b, _mm_mul_ps(_mm_set1_ps(GAUSS_B[std::abs(i)]), sample));
+        }
+        _mm_storeu_ps(out_a, a);
+        _mm_storeu_ps(out_b, b);
+#else
+        float a[4] = {0, 0, 0, 0},
+              b[4] = {0, 0, 0, 0};
+        for(int i = -FILTER_SAMPLES + 1; i < FILTER_SAMPLES; ++i)
+        {
+          const int sx = std::min(std::max(x + i, 0), w - 1);
+          for(int c = 0; c < 4; ++c)
+          {
+            a[c] += GAUSS_A[std::abs(i)] * in[4 * sx + c];
+            b[c] += GAUSS_B[std::abs(i)] * in[4 * sx + c];
+          }
+        }
+        std::copy(a, a + 4, out_a);
+        std::copy(b, b + 4, out_b);
+#endif
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CpuCostAnalysis::filterColumns(const Region& region)
+  {
+    const int h = static_cast<int>(_height);
+    const size_t stride = 4 * _width,
+                 offset = 4 * region.x0,
+                 row_size = 4 * (region.x1 - region.x0);
+
+    // Accumulate whole rows to access memory linearly
+    std::vector<float> acc_a(row_size),
+                       acc_b(row_size);
+
+    for(size_t y = region.y0; y < static_cast<size_t>(region.y1); ++y)
+    {
+      std::fill(acc_a.begin(), acc_a.end(), 0.f);
+      std::fill(acc_b.begin(), acc_b.end(), 0.f);
+
+      for(int i = -FILTER_SAMPLES + 1; i < FILTER_SAMPLES; ++i)
+      {
+        const int sy = std::min(std::max(static_cast<int>(y) + i, 0), h - 1);
+        const float *in_a = &_filter_a[sy * stride + offset],
+                    *in_b = &_filter_b[sy * stride + offset];
+        const float wa = GAUSS_A[std::abs(i)],
+                    wb = GAUSS_B[std::abs(i)];
+
+#ifdef __SSE2__
+        const __m128 va = _mm_set1_ps(wa),
+                     vb = _mm_set1_ps(wb);
+        for(size_t j = 0; j < row_size; j += 4)
+        {
+          _mm_storeu_ps( &acc_a[j],
+                         _mm_add_ps( _mm_loadu_ps(&acc_a[j]),
+                                     _mm_mul_ps(va, _mm_loadu_ps(in_a + j)) ) );
+          _mm_storeu_ps( &acc_b[j],
+                         _mm_add_ps( _mm_loadu_ps(&acc_b[j]),
+                                     _mm_mul_ps(vb, _mm_loadu_ps(in_b + j)) ) );
+        }
+#else
+        for(size_t j = 0; j < row_size; ++j)
+        {
+          acc_a[j] += wa * in_a[j];
+          acc_b[j] += wb * in_b[j];
+        }
+#endif
+      }
+
+      // Center-surround difference (padding channel is always zero)
+      float* out = &_saliency_map[y * _width + region.x0];
+      for(size_t x = 0; x < row_size / 4; ++x)
+      {
+        const float* a = &acc_a[4 * x];
+        const float* b = &acc_b[4 * x];
+        out[x] = SALIENCY_SCALE * ( std::fabs(a[0] - b[0])
+                                  + std::fabs(a[1] - b[1])
+                                  + std::fabs(a[2] - b[2]) );
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CpuCostAnalysis::downsampleCost(const Region& region)
+  {
+    const size_t ds = _downsampleSaliencyToCost;
+    const float norm = 1.f / (ds * ds);
+    const size_t x0 = region.x0,
+                 x1 = region.x1;
+
+    for(size_t y = region.y0; y < static_cast<size_t>(region.y1); ++y)
+    {
+      float* out = &_cost_map[y * _width_cost];
+      std::fill(out + x0, out + x1, 0.f);
+
+      for(size_t sy = 0; sy < ds; ++sy)
+      {
+        const float* in = &_saliency_map[(y * ds + sy) * _width];
+        for(size_t x = x0; x < x1; ++x)
+          for(size_t sx = 0; sx < ds; ++sx)
+            out[x] += in[x * ds + sx];
+      }
+
+      for(size_t x = x0; x < x1; ++x)
+        out[x] *= norm;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  template<class Func>
+  void CpuCostAnalysis::forEachBand(const Regions& regions, const Func& func)
+  {
+    int y_min = std::numeric_limits<int>::max(),
+        y_max = 0;
+    for(auto const& r: regions)
+      if( !r.empty() )
+      {
+        y_min = std::min(y_min, r.y0);
+        y_max = std::max(y_max, r.y1);
+      }
+    if( y_min >= y_max )
+      return;
+
+    const size_t num_rows = y_max - y_min;
+
+    size_t num_threads = _num_threads > 0
+                       ? _num_threads
+                       : std::thread::hardware_concurrency();
+    num_threads = std::max<size_t>(1, std::min(num_threads, num_rows));
+
+    // A few bands per thread to balance the load if regions differ in width
+    const int band = static_cast<int>
+    (
+      (num_rows + 2 * num_threads - 1) / (2 * num_threads)
+    );
+
+    // All (possibly overlapping) regions inside a band of rows are processed
+    // by the same thread, so no row is written by two threads at once.
+    std::vector<Regions> bands;
+    for(int y = y_min; y < y_max; y += band)
+    {
+      Regions clipped;
+      for(auto const& r: regions)
+      {
+        const Region c(r.x0, std::max(r.y0, y), r.x1, std::min(r.y1, y + band));
+        if( !c.empty() )
+          clipped.push_back(c);
+      }
+
+      if( !clipped.empty() )
+        bands.push_back(clipped);
+    }
+
+    std::atomic<size_t> next_band(0);
+    auto worker = [&]()
+    {
+      for(size_t i = next_band++; i < bands.size(); i = next_band++)
+        for(auto const& r: bands[i])
+          func(r);
+    };
+
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < std::min(num_threads, bands.size()); ++i)
+      threads.emplace_back(worker);
+
+    // Also work in the calling thread
+    worker();
+
+    for(auto& thread: threads)
+      thread.join();
+  }
+
+} // namespace LinksRouting
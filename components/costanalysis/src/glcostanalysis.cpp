@@ -6,6 +6,40 @@
 
 namespace LinksRouting
 {
+  namespace
+  {
+    /** Pixels affected by a change of a single pixel (samples - 1 of
+     *  saliencyFilter.glsl, per pass) */
+    const int FILTER_APRON = 6;
+
+    /**
+     * Call draw once for every region with drawing limited to the region.
+     *
+     * @param height    Height of the render target
+     * @param flipped   Whether the render target is flipped vertically
+     *                  relative to the desktop (every FBO::draw flips)
+     */
+    template<class Func>
+    void drawRegions( const CostMapDamage::Regions& regions,
+                      int height,
+                      bool flipped,
+                      const Func& draw )
+    {
+      glEnable(GL_SCISSOR_TEST);
+      for(auto const& r: regions)
+      {
+        if( r.empty() )
+          continue;
+
+        glScissor( r.x0,
+                   flipped ? height - r.y1 : r.y0,
+                   r.x1 - r.x0,
+                   r.y1 - r.y0 );
+        draw();
+      }
+      glDisable(GL_SCISSOR_TEST);
+    }
+  }
 
   //----------------------------------------------------------------------------
   GlCostAnalysis::GlCostAnalysis():
@@ -13,6 +47,7 @@ namespace LinksRouting
   {
     registerArg("DownsampleSaliency", _downsampleSaliency = 2);
     registerArg("DownsampleCost", _downsampleCost = 4);
+    registerArg("TileSize", _tile_size = 16);
   }
 
   //----------------------------------------------------------------------------
@@ -27,6 +62,7 @@ namespace LinksRouting
     _slot_costmap = slots.create<SlotType::Image>("/costmap");
     _slot_featuremap = slots.create<SlotType::Image>("/featuremap");
     _slot_downsampledinput = slots.create<SlotType::Image>("/downsampled_desktop");
+    _slot_costmap_tiles = slots.create<SlotType::TileVersions>("/costmap/tiles");
   }
 
   //----------------------------------------------------------------------------
@@ -34,6 +70,10 @@ namespace LinksRouting
   {
     _subscribe_desktop =
       slot_subscriber.getSlot<LinksRouting::SlotType::Image>("/desktop");
+    _subscribe_desktop_damage =
+      slot_subscriber.getSlot<LinksRouting::SlotType::Damage>("/desktop/damage");
+    _subscribe_links_revision =
+      slot_subscriber.getSlot<uint32_t>("/links/revision");
   }
 
   //----------------------------------------------------------------------------
@@ -69,6 +109,12 @@ namespace LinksRouting
     *_slot_downsampledinput->_data = SlotType::Image(widthSaliency, heightSaliency, _downsampled_input_fbo.colorBuffers.at(0));
     *_slot_featuremap->_data = SlotType::Image(widthSaliency, heightSaliency, _feature_map_fbo.colorBuffers.at(0));
 
+    _damage.resize( widthSaliency,
+                    heightSaliency,
+                    _downsampleSaliencyToCost,
+                    _tile_size,
+                    *_slot_costmap_tiles->_data );
+
     _feature_map_shader = _shader_manager.loadfromFile(0, "featureMap.glsl");
     _saliency_map_shader = _shader_manager.loadfromFile(0, "saliencyFilter.glsl");
     _downsample_shader = _shader_manager.loadfromFile(0, "downSample.glsl");
@@ -90,6 +136,42 @@ namespace LinksRouting
     size_t width = _downsampled_input_fbo.width,
            height = _downsampled_input_fbo.height;
 
+    //---------------------------------
+    // collect damage
+    //---------------------------------
+
+    // Without knowing what has changed everything needs to be updated
+    if( _subscribe_desktop_damage->isValid() )
+      _damage.add( *_subscribe_desktop_damage->_data,
+                   std::max(1, _downsampleSaliency) );
+    else
+      _damage.addAll();
+
+    _slot_costmap_tiles->setValid(true);
+    if( _damage.empty() )
+    {
+      _slot_costmap->setValid(true);
+      return 0;
+    }
+
+    // Every filter pass spreads changes by its apron
+    const int w = static_cast<int>(width),
+              h = static_cast<int>(height);
+    const CostMapDamage::Regions damage = _damage.getRegions();
+    CostMapDamage::Regions damage_rows,
+                           damage_saliency,
+                           damage_cost;
+    for(auto const& r: damage)
+    {
+      damage_rows.push_back( r.expanded(FILTER_APRON, 0, w, h) );
+      damage_saliency.push_back( r.expanded(FILTER_APRON, FILTER_APRON, w, h) );
+      damage_cost.push_back( damage_saliency.back().downsampled(
+        _downsampleSaliencyToCost,
+        static_cast<int>(_cost_map_fbo.width),
+        static_cast<int>(_cost_map_fbo.height)
+      ));
+    }
+
     //---------------------------------
     // downsample
     //---------------------------------
@@ -109,7 +191,10 @@ namespace LinksRouting
       glBindTexture(GL_TEXTURE_2D, inputtex);
 
       glColor3f(1,1,1);
-      _downsampled_input_fbo.draw(width, height, 0,0, -1, true, true);
+      drawRegions(damage, h, true, [&]
+      {
+        _downsampled_input_fbo.draw(width, height, 0,0, -1, true, true);
+      });
 
        glDisable(GL_TEXTURE_2D);
 
@@ -136,7 +221,10 @@ namespace LinksRouting
     glBindTexture(GL_TEXTURE_2D, inputtex);
 
     glColor3f(1,1,1);
-    _feature_map_fbo.draw(width, height, 0,0, -1, true, true);
+    drawRegions(damage, h, false, [&]
+    {
+      _feature_map_fbo.draw(width, height, 0,0, -1, true, true);
+    });
 
     glDisable(GL_TEXTURE_2D);
 
@@ -165,7 +253,10 @@ namespace LinksRouting
 
 
      glColor3f(1,1,1);
-     _feature_map_fbo.draw(width, height, 0,0, 0, true, true);
+     drawRegions(damage_rows, h, true, [&]
+     {
+       _feature_map_fbo.draw(width, height, 0,0, 0, true, true);
+     });
 
     //------------
     // second pass
@@ -180,7 +271,10 @@ namespace LinksRouting
     _saliency_map_shader->setUniform1i("step", 1);
 
     glColor3f(1,1,1);
-    _feature_map_fbo.draw(width, height, 0,0, -1, true, true);
+    drawRegions(damage_saliency, h, false, [&]
+    {
+      _feature_map_fbo.draw(width, height, 0,0, -1, true, true);
+    });
 
     glDisable(GL_TEXTURE_2D);
 
@@ -206,14 +300,22 @@ namespace LinksRouting
 
       glColor3f(1,1,1);
 
-      _cost_map_fbo.draw(_cost_map_fbo.width, _cost_map_fbo.height, 0,0, -1, true, true);
+      drawRegions(damage_cost, static_cast<int>(_cost_map_fbo.height), true, [&]
+      {
+        _cost_map_fbo.draw(_cost_map_fbo.width, _cost_map_fbo.height, 0,0, -1, true, true);
+      });
 
       glDisable(GL_TEXTURE_2D);
 
       _downsample_shader->end();
       _cost_map_fbo.unbind();
     }
+    else
+      damage_cost = damage_saliency;
 
+    // Routes follow the cost map, so the links have changed as well
+    if( _damage.commit(damage_cost, *_slot_costmap_tiles->_data) )
+      *_subscribe_links_revision->_data += 1;
 
     _slot_costmap->setValid(true);
     return 0;
@@ -94,6 +94,14 @@ namespace LinksRouting
 
     void setScrollPos(const QPoint& offset);
 
+    /**
+     * Scroll to the given position. Regions are kept in document coordinates,
+     * so only regions crossing the viewport, desktop or an overlapping window
+     * are reclassified and existing popups and previews are moved. Falls back
+     * to a full update if the visualization of any region changes.
+     */
+    bool scroll(const QPoint& offset, const WindowRegions& windows);
+
     /**
      * Parse regions from JSON and replace current regions in node if given
      */
@@ -124,6 +132,12 @@ namespace LinksRouting
      */
     void removeLink(LinkDescription::HyperEdge* hedge);
 
+    /**
+     * Force updating the links of this client with the next update(), eg.
+     * after settings affecting all links have changed
+     */
+    void setLinksDirty();
+
     /**
      * Check if client is connected to the given link
      */
@@ -188,7 +202,8 @@ namespace LinksRouting
         VISIBLITY       = REGIONS << 1,
         SCROLL_POS      = VISIBLITY << 1,
         SCROLL_SIZE     = SCROLL_POS << 1,
-        MATCH           = SCROLL_SIZE << 1
+        MATCH           = SCROLL_SIZE << 1,
+        LINKS           = MATCH << 1
       };
 
       /**
@@ -249,6 +264,8 @@ namespace LinksRouting
       uint32_t                      _dirty;
       IPCServer                    *_ipc_server;
       WindowInfo                    _window_info;
+      uint64_t                      _windows_generation; //!< Last processed
+                                                         //   window snapshot
       LinkDescription::nodes_t      _nodes;
       LinkDescription::NodePtr      _minimized_icon,
                                     _covered_outline;
@@ -259,6 +276,10 @@ namespace LinksRouting
 
       std::unique_ptr<PreviewWindow>_semantic_preview;
 
+      /** Regions sorted by the y coordinate of their center (local coords) */
+      typedef std::pair<float, LinkDescription::NodePtr> RegionIndexEntry;
+      std::vector<RegionIndexEntry> _regions_by_y;
+
       float2 getPreviewSize() const;
       void createPopup( const float2& pos,
                         const float2& normal,
@@ -272,6 +293,14 @@ namespace LinksRouting
                         LabelAlign align = LabelAlign::NORMAL );
 
       void updateRegions(const WindowRegions& windows);
+
+      /**
+       * Try to update regions after scrolling vertically by @a dy without
+       * recreating popups and previews.
+       *
+       * @return Whether the incremental update was possible
+       */
+      bool scrollRegions(int dy, const WindowRegions& windows);
       bool updateNode( LinkDescription::Node& hedge,
                        const QRect& desktop, ///<! desktop in local coords
                        const QRect& view,    ///<! viewport in local coords
@@ -288,8 +317,7 @@ namespace LinksRouting
       bool updateChildren( LinkDescription::HyperEdge& hedge,
                            WId hover_wid,
                            const Rect& preview_region ); /// <! in absolute coords
-      void updateHedges( LinkDescription::hedges_t& hedges,
-                         bool first = true );
+      void updateHedges(LinkDescription::hedges_t& hedges);
       bool updateNode(LinkDescription::Node& node);
 
       /**
@@ -0,0 +1,55 @@
+/*
+ * hover_grid.hpp
+ *
+ * Uniform grid over absolute desktop coordinates for finding the popups and
+ * previews which can be hit by the mouse, without visiting all of them.
+ */
+
+#ifndef HOVER_GRID_HPP_
+#define HOVER_GRID_HPP_
+
+#include "float2.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace LinksRouting
+{
+  class HoverGrid
+  {
+    public:
+
+      explicit HoverGrid(float cell_size = 128);
+
+      void clear();
+
+      /**
+       * Add an item covering the given region
+       *
+       * @param region  Region in absolute coordinates (including margins)
+       * @param id      Id returned by query()
+       */
+      void insert(const Rect& region, uint32_t id);
+
+      /**
+       * Append the ids of all items whose region possibly contains the given
+       * position. Every id is appended at most once.
+       */
+      void query(const float2& pos, std::vector<uint32_t>& ids) const;
+
+    private:
+
+      typedef std::vector<uint32_t> Cell;
+
+      float _cell_size;
+      std::unordered_map<uint64_t, Cell> _cells;
+      Cell  _large; //!< Items spanning too many cells (always returned)
+
+      int32_t cellCoord(float v) const;
+      static uint64_t cellKey(int32_t x, int32_t y);
+  };
+
+} // namespace LinksRouting
+
+#endif /* HOVER_GRID_HPP_ */
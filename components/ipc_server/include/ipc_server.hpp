@@ -25,6 +25,9 @@
 #include "slotdata/Preview.hpp"
 #include "slotdata/text_popup.hpp"
 #include "slotdata/TileHandler.hpp"
+#include "hover_grid.hpp"
+#include "tile_dumper.hpp"
+#include "tile_pyramid.hpp"
 #include "window_monitor.hpp"
 
 #include "datatypes.h"
@@ -99,9 +102,28 @@ namespace LinksRouting
                                       const QRect& viewport,
                                       const QRect& scroll_region,
                                       bool extend = false );
+      /**
+       * Update preview after the viewport or scroll region has changed
+       */
+      void updateCoveredPreview( const XRayIterator& preview,
+                                 const QRect& viewport,
+                                 const QRect& scroll_region,
+                                 bool extend = false );
       void removeCoveredPreview(const XRayIterator& preview);
       void removeCoveredPreviews(const std::list<XRayIterator>& previews);
 
+      /**
+       * Rebuild the spatial index of popups and previews before the next
+       * mouse event (call if their position has changed)
+       */
+      void invalidateHoverIndex();
+
+      /**
+       * Rebuild the client lookup tables before the next lookup (call if the
+       * window or id of a client has changed)
+       */
+      void invalidateClientIndex();
+
       typedef SlotType::CoveredOutline::List::iterator OutlineIterator;
 
       OutlineIterator addOutline(const ClientInfo& client_info);
@@ -123,6 +145,7 @@ namespace LinksRouting
       void onClientConnection();
       void onTextReceived(QString data);
       void onBinaryReceived(QByteArray data);
+      void onTilesBuilt();
       void onClientDisconnection();
 
       void onStatusClientConnect();
@@ -212,6 +235,20 @@ namespace LinksRouting
                                   const QStringList& filter_strings,
                                   const WindowRegions& windows );
 
+      /**
+       * Store decoded pixels for the given tile request and remove the request
+       */
+      void setTileData( uint32_t req_id,
+                        const QByteArray& data,
+                        int offset = 0 );
+
+      /**
+       * Queue building the tile of the next lower zoom level covering the
+       * given tile, if it has no data yet (see TilePyramid)
+       */
+      void buildParentTile( const HierarchicTileMapPtr& tile_map,
+                            size_t level, size_t x, size_t y );
+
       void regionsChanged(const WindowRegions& regions);
       ClientInfos::iterator findClientInfo(WId wid);
       ClientInfos::iterator findClientInfoById(QString const& cid);
@@ -244,6 +281,23 @@ namespace LinksRouting
                                   ClientInfo& )> preview_callback_t;
       bool foreachPreview(const preview_callback_t& cb);
 
+      /**
+       * Call @a cb (in list order) only for the popups/previews which can
+       * react to the mouse at @a pos: all visible or animated ones and the
+       * hidden ones close to @a pos. If @a pos is NULL only visible or
+       * animated ones are visited.
+       */
+      bool foreachPopupAt(const float2* pos, const popup_callback_t& cb);
+      bool foreachPreviewAt(const float2* pos, const preview_callback_t& cb);
+
+      bool callPopup( SlotType::TextPopup::Popup& popup,
+                      const popup_callback_t& cb );
+      bool callPreview( SlotType::XRayPopup::HoverRect& preview,
+                        const preview_callback_t& cb );
+
+      static bool isActive(const SlotType::AnimatedPopup& popup);
+      void updateHoverIndex();
+
       /** Send message to all clients (respecting white and black list) */
       void distributeMessage( LinkDescription::LinkDescription const& link,
                               const QJsonObject& msg ) const;
@@ -333,6 +387,9 @@ namespace LinksRouting
       /* List of all open searches */
       slot_t<LinkDescription::LinkList>::type _slot_links;
 
+      /* Incremented on every change of the links or their routes */
+      slot_t<uint32_t>::type _slot_links_revision;
+
       /* Outside x-ray popup */
       slot_t<SlotType::XRayPopup>::type _slot_xray;
       slot_t<SlotType::CoveredOutline>::type _slot_outlines;
@@ -377,16 +434,51 @@ namespace LinksRouting
       void abortAll(uint8_t ptr_id = 0);
 
       std::string   _debug_regions,
-                    _debug_full_preview_path;
+                    _debug_full_preview_path,
+                    _debug_tile_dump_dir; //!< Write received tiles to this
+                                          //   directory (if not empty)
+      int           _debug_tile_dump_rate; //!< Max. dumped tiles per second
       QImage        _full_preview_img;
       int           _preview_width,
                     _preview_height,
-                    _autosave_interval;
+                    _autosave_interval,
+                    _tile_cache_size, //!< Max. memory for tiles [MiB]
+                                      //   (0 = unlimited)
+                    _tile_texture_cache_size, //!< Max. texture memory for
+                                              //   tiles of all preview
+                                              //   windows [MiB]
+                    _tile_request_window, //!< Max. tile requests in flight
+                                          //   per client
+                    _tile_prefetch_rate;  //!< Bandwidth for prefetching tiles
+                                          //   [KiB/s] (0 = disabled)
       bool          _preview_auto_width,
-                    _outside_see_through;
+                    _outside_see_through,
+                    _tile_cache_compress,  //!< Keep cold tiles compressed
+                    _tile_pyramid_enabled; //!< Build lower zoom levels from
+                                           //   higher ones on the server
 
       class TileHandler;
       TileHandler  *_tile_handler;
+      TileDumper    _tile_dumper;
+      TilePyramid   _tile_pyramid;
+
+      /* Spatial index of popups and previews (absolute coordinates) */
+      HoverGrid                   _popup_grid,
+                                  _preview_grid;
+      std::vector<PopupIterator>  _grid_popups;   //!< Grid id -> popup
+      std::vector<XRayIterator>   _grid_previews; //!< Grid id -> preview
+      std::vector<uint32_t>       _active_popups, //!< Visible or animated
+                                  _active_previews;
+      bool                        _hover_index_dirty;
+
+      /* Lookup tables for clients (rebuilt lazily) and links */
+      QHash<WId, ClientInfos::iterator>     _clients_by_wid;
+      QHash<QString, ClientInfos::iterator> _clients_by_id;
+      bool                                  _client_index_dirty;
+      QHash<QString, LinkDescription::LinkList::iterator>
+                                            _links_by_id; //!< Case folded id
+
+      void updateClientIndex();
   };
 
 } // namespace LinksRouting
@@ -0,0 +1,81 @@
+/*
+ * tile_dumper.hpp
+ *
+ * Debug sink writing received preview tiles as images to disk. Images are
+ * written from a background thread and the number of written tiles is rate
+ * limited, so that enabling it does not stall the tile ingest path.
+ */
+
+#ifndef TILE_DUMPER_HPP_
+#define TILE_DUMPER_HPP_
+
+#include "clock.hxx"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <cstdint>
+#include <deque>
+
+namespace LinksRouting
+{
+  class TileDumper:
+    public QThread
+  {
+    public:
+
+      struct Tile
+      {
+        QByteArray  data;   //!< ARGB32 pixels (possibly with a header)
+        int         offset; //!< Start of pixels inside data
+        int         width,
+                    height;
+        size_t      x, y;
+        int         zoom;
+      };
+
+      TileDumper();
+      virtual ~TileDumper();
+
+      /**
+       * Set output directory (Empty to disable dumping)
+       */
+      void setDirectory(const QString& dir);
+
+      /**
+       * Set maximum number of tiles written per second
+       */
+      void setMaxRate(int tiles_per_second);
+
+      bool isEnabled() const;
+
+      /**
+       * Queue tile for writing. Tiles exceeding the rate limit or the queue
+       * size are dropped.
+       *
+       * @return Whether the tile has been queued
+       */
+      bool enqueue(const Tile& tile);
+
+      void stop();
+
+    protected:
+
+      mutable QMutex    _mutex;
+      QWaitCondition    _cond_tiles;
+      std::deque<Tile>  _tiles;
+      QString           _dir;
+      int               _max_rate;
+      clock::time_point _last_enqueue;
+      size_t            _num_written;
+      bool              _stop;
+
+      virtual void run();
+  };
+
+} // namespace LinksRouting
+
+#endif /* TILE_DUMPER_HPP_ */
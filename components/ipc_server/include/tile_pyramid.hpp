@@ -0,0 +1,102 @@
+/*
+ * tile_pyramid.hpp
+ *
+ * Build lower zoom levels of preview tile maps from the tiles of the next
+ * higher level (2x2 box filter) in a background thread, instead of requesting
+ * them from the client again.
+ */
+
+#ifndef TILE_PYRAMID_HPP_
+#define TILE_PYRAMID_HPP_
+
+#include "HierarchicTileMap.hpp"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <cstdint>
+#include <deque>
+#include <set>
+#include <tuple>
+#include <vector>
+
+namespace LinksRouting
+{
+  class TilePyramid:
+    public QThread
+  {
+    Q_OBJECT
+
+    public:
+
+      struct Job
+      {
+        HierarchicTileMapWeakPtr tile_map;
+        unsigned int map_id;
+        size_t      level, x, y;        //!< Tile to build
+        size_t      width, height;      //!< Size of tile to build
+        QByteArray  children[2][2];     //!< Pixels of tiles (2x + i, 2y + j)
+                                        //   of level + 1 (empty if outside)
+        size_t      child_width[2],     //!< Width of both child columns
+                    child_height[2];    //!< Height of both child rows
+      };
+
+      struct Result
+      {
+        HierarchicTileMapWeakPtr tile_map;
+        unsigned int map_id;
+        size_t      level, x, y;
+        QByteArray  pixels;
+      };
+      typedef std::vector<Result> Results;
+
+      TilePyramid();
+      virtual ~TilePyramid();
+
+      /**
+       * Queue building the given tile, if all its (existing) children of the
+       * next level are available (compressed children are decompressed).
+       * tilesBuilt() is emitted once the result is available.
+       *
+       * @param level   Layer index of the tile to build
+       * @return Whether the tile is being built (also if queued before)
+       */
+      bool enqueue( const HierarchicTileMapPtr& tile_map,
+                    size_t level, size_t x, size_t y );
+
+      /**
+       * Get (and remove) all available results
+       */
+      Results takeResults();
+
+      void stop();
+
+      /**
+       * Build the tile of the given job in the current thread
+       */
+      static QByteArray downsample(const Job& job);
+
+    signals:
+
+      void tilesBuilt();
+
+    protected:
+
+      /** Tiles queued or being built (see HierarchicTileMap::getMapId) */
+      typedef std::tuple<unsigned int, size_t, size_t, size_t> TileKey;
+
+      QMutex            _mutex;
+      QWaitCondition    _cond_jobs;
+      std::deque<Job>   _jobs;
+      Results           _results;
+      std::set<TileKey> _pending;
+      bool              _stop;
+
+      virtual void run();
+  };
+
+} // namespace LinksRouting
+
+#endif /* TILE_PYRAMID_HPP_ */
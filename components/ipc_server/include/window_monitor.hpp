@@ -9,12 +9,14 @@
 #define WINDOW_MONITOR_HPP_
 
 #include <QxtGui/qxtwindowsystem.h>
+#include <QMutex>
 #include <QThread>
 #include <QTimer>
 
 #include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 
 #include "float2.hpp"
 
@@ -72,12 +74,27 @@ namespace LinksRouting
     }
   };
   typedef std::vector<WindowInfo> WindowInfos;
+  typedef std::shared_ptr<const WindowInfos> WindowInfosPtr;
   typedef std::vector<WindowInfos::const_iterator> WindowInfoIterators;
 
+  /**
+   * Immutable snapshot of all windows (cheap to copy, as the window list is
+   * shared between all copies of the same snapshot).
+   */
   class WindowRegions
   {
     public:
-      WindowRegions(const WindowInfos& windows);
+      /**
+       * @param windows     Window list (never modified after publishing)
+       * @param generation  Snapshot number (increased with every change)
+       */
+      WindowRegions( const WindowInfosPtr& windows,
+                     uint64_t generation = 0 );
+
+      /**
+       * Snapshots with the same generation contain the same windows
+       */
+      uint64_t generation() const;
 
       WindowInfos::const_iterator find(WId wid) const;
       WindowInfos::const_iterator find(uint32_t pid, const QString& title) const;
@@ -104,7 +121,8 @@ namespace LinksRouting
                 WId* wid = 0 ) const;
 
     private:
-      const WindowInfos _windows;
+      WindowInfosPtr  _windows;
+      uint64_t        _generation;
   };
 
   class WindowMonitor:
@@ -125,8 +143,12 @@ namespace LinksRouting
 
       /**
        * Get all visible windows in stacking order and filtered by minimum size
+       * (last snapshot taken by the periodic check).
+       *
+       * @param refresh   Query the window system to ensure the snapshot is up
+       *                  to date (eg. for matching newly opened windows)
        */
-      WindowRegions getWindows() const;
+      WindowRegions getWindows(bool refresh = false) const;
 
       /**
        * Set dimensions and position of visible/drawable desktop area
@@ -146,11 +168,22 @@ namespace LinksRouting
       mutable int    _launcher_size;
       QStringList    _launchers;
 
+      mutable QMutex          _snapshot_mutex;
+      mutable WindowInfosPtr  _snapshot;
+      mutable uint64_t        _generation;
+
       /**
        * Get all visible windows in stacking order and filtered by minimum size
        */
       WindowInfos getWindowInfos() const;
 
+      /**
+       * Create a new snapshot if @a windows differs from the current one
+       *
+       * @return The current snapshot
+       */
+      WindowRegions publish(const WindowInfos& windows) const;
+
 	protected slots:
       void check();
 
@@ -11,6 +11,7 @@
 #include "ClientInfo.hxx"
 #include "ipc_server.hpp"
 
+#include <algorithm>
 #include <cassert>
 
 namespace LinksRouting
@@ -45,6 +46,20 @@ namespace LinksRouting
     return clean_str;
   }
 
+  /**
+   * Move all points (vertices and link points) of a node
+   */
+  static void translateNode( LinkDescription::Node& node,
+                             const float2& offset )
+  {
+    for(auto& p: node.getVertices())
+      p += offset;
+    for(auto& p: node.getLinkPoints())
+      p += offset;
+    for(auto& p: node.getLinkPointsChildren())
+      p += offset;
+  }
+
   //----------------------------------------------------------------------------
   ClientInfo::ClientInfo(QWebSocket* socket, IPCServer* ipc_server, WId wid):
     socket(socket),
@@ -52,8 +67,9 @@ namespace LinksRouting
     _dirty(~0),
     _ipc_server(ipc_server),
     _window_info(wid),
-    _minimized_icon(std::make_shared<LinkDescription::Node>()),
-    _covered_outline(std::make_shared<LinkDescription::Node>()),
+    _windows_generation(0),
+    _minimized_icon(make_pooled<LinkDescription::Node>()),
+    _covered_outline(make_pooled<LinkDescription::Node>()),
     _avg_region_height(0)
   {
     _minimized_icon->set("filled", true);
@@ -84,6 +100,8 @@ namespace LinksRouting
   void ClientInfo::setWindowId(WId wid)
   {
     _window_info.id = wid;
+    if( _ipc_server )
+      _ipc_server->invalidateClientIndex();
   }
 
   //----------------------------------------------------------------------------
@@ -102,6 +120,8 @@ namespace LinksRouting
   void ClientInfo::setId(const QString& id)
   {
     _id = id;
+    if( _ipc_server )
+      _ipc_server->invalidateClientIndex();
   }
 
   //----------------------------------------------------------------------------
@@ -234,6 +254,24 @@ namespace LinksRouting
       popup->hover_region.offset = -offset;
   }
 
+  //----------------------------------------------------------------------------
+  bool ClientInfo::scroll(const QPoint& offset, const WindowRegions& windows)
+  {
+    const QPoint delta = offset - scroll_region.topLeft();
+    setScrollPos(offset);
+
+    if(    (_dirty & ~SCROLL_POS)
+        || delta.x() != 0
+        || !scrollRegions(delta.y(), windows) )
+      return update(windows);
+
+    for(auto& node: _nodes)
+      updateHedges( node->getChildren() );
+
+    _dirty = 0;
+    return true;
+  }
+
   //----------------------------------------------------------------------------
   LinkDescription::NodePtr ClientInfo::parseRegions
   (
@@ -251,7 +289,7 @@ namespace LinksRouting
       if( node )
         node->getChildren().front()->getNodes().clear();
       else
-        node = std::make_shared<LinkDescription::Node>();
+        node = make_pooled<LinkDescription::Node>();
 
       node->set("display-num", 0);
       return node;
@@ -343,7 +381,7 @@ namespace LinksRouting
 
       nodes.push_back
       (
-        std::make_shared<LinkDescription::Node>(points, link_points, region_props)
+        make_pooled<LinkDescription::Node>(points, link_points, region_props)
       );
     }
 
@@ -361,7 +399,7 @@ namespace LinksRouting
 
     if( !node )
     {
-      node = std::make_shared<LinkDescription::Node>(hedge);
+      node = make_pooled<LinkDescription::Node>(hedge);
       _nodes.push_back(node);
     }
     else
@@ -413,6 +451,7 @@ namespace LinksRouting
 
       _window_info = winfo;
       _dirty |= WINDOW;
+      _ipc_server->invalidateClientIndex();
 
       return true;
     };
@@ -488,6 +527,10 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   bool ClientInfo::update(const WindowRegions& windows)
   {
+    // Nothing to do if neither the client nor any window has changed
+    if( !_dirty && windows.generation() == _windows_generation )
+      return false;
+
     if( !updateWindowInfo(windows) )
     {
       qDebug() << "Failed to get a matching window info." << id() << title();
@@ -508,6 +551,7 @@ namespace LinksRouting
     }
 
     updateRegions(windows);
+    _windows_generation = windows.generation();
 
     if( !_dirty )
       return false;
@@ -575,6 +619,14 @@ namespace LinksRouting
       else
         ++preview;
     }
+
+    _dirty |= LINKS;
+  }
+
+  //----------------------------------------------------------------------------
+  void ClientInfo::setLinksDirty()
+  {
+    _dirty |= LINKS;
   }
 
   //----------------------------------------------------------------------------
@@ -767,6 +819,7 @@ namespace LinksRouting
     bool create_hidden_vis = _ipc_server->routingActive();
 
     clear();
+    _regions_by_y.clear();
     if( true ) //_dirty & WINDOW )
     {
       LinkDescription::points_t& icon = _minimized_icon->getVertices();
@@ -874,12 +927,23 @@ namespace LinksRouting
             modified |= updateChildren( *child,
                                         desktop, local_view,
                                         windows, first_above );
+
+            for(auto const& child_region: child->getNodes())
+              if( !child_region->getVertices().empty() )
+                _regions_by_y.push_back(RegionIndexEntry(
+                  child_region->getCenter().y, child_region
+                ));
           }
 
           modified |= updateNode( **region,
                                   desktop, local_view,
                                   windows, first_above );
 
+          if( !(*region)->getVertices().empty() )
+            _regions_by_y.push_back(RegionIndexEntry(
+              (*region)->getCenter().y, *region
+            ));
+
           if( !(*region)->getVertices().empty() )
           {
             if( a300_client && (*region)->get<bool>("search-preview") )
@@ -986,7 +1050,7 @@ namespace LinksRouting
             points.push_back(pos -= 10 * out.normal + 12 * out.normal.normal());
             points.push_back(pos += 10 * out.normal - 12 * out.normal.normal());
 
-            auto new_node = std::make_shared<LinkDescription::Node>(points, link_points, link_points_children);
+            auto new_node = make_pooled<LinkDescription::Node>(points, link_points, link_points_children);
             new_node->set("outside-scroll", "side[" + std::to_string(static_cast<unsigned long long>(i)) + "]");
             new_node->set("filled", true);
             new_node->set("show-in-preview", false);
@@ -1047,10 +1111,136 @@ namespace LinksRouting
       }
     }
 
+    std::sort( _regions_by_y.begin(),
+               _regions_by_y.end(),
+               [](const RegionIndexEntry& lhs, const RegionIndexEntry& rhs)
+               {
+                 return lhs.first < rhs.first;
+               } );
+
     if( modified )
       _dirty |= VISIBLITY;
   }
 
+  //----------------------------------------------------------------------------
+  bool ClientInfo::scrollRegions(int dy, const WindowRegions& windows)
+  {
+    if( !dy )
+      return true;
+
+    // Regions not crossing any border keep the state they had for the last
+    // processed window snapshot
+    if( windows.generation() != _windows_generation || _window_info.minimized )
+      return false;
+
+    auto window_info = windows.find(_window_info.id);
+    if( window_info == windows.end() )
+      return false;
+
+    // Popups of outside indicators above/below the viewport stay at the same
+    // screen position. All other popups move with the document (or depend on
+    // the regions scrolled outside) and need to be recreated.
+    for(auto const& popup: _popups)
+    {
+      const std::string side =
+        popup->node ? popup->node->get<std::string>("outside-scroll") : "";
+      if( side != "side[0]" && side != "side[1]" )
+        return false;
+    }
+
+    auto first_above = window_info + 1;
+    const QRect desktop_abs = _ipc_server->desktopRect().toQRect(),
+                viewport_abs = getViewportAbs(),
+                scroll_abs = getScrollRegionAbs();
+
+    // Screen rows where a region can change between on-/off-screen,
+    // inside/outside the viewport and covered/not covered
+    std::vector<int> borders = {
+      desktop_abs.top(), desktop_abs.bottom(),
+      viewport_abs.top(), viewport_abs.bottom()
+    };
+    for(auto window = first_above; window != windows.end(); ++window)
+    {
+      borders.push_back(window->region.top());
+      borders.push_back(window->region.bottom());
+    }
+
+    // Only regions which have crossed any border (+1 pixel for rounding) since
+    // the last update need to be checked
+    const int top_new = scroll_abs.top(),
+              top_old = top_new - dy,
+              top_min = std::min(top_new, top_old),
+              top_max = std::max(top_new, top_old);
+
+    std::vector<LinkDescription::Node*> candidates;
+    for(int border: borders)
+    {
+      auto entry = std::lower_bound
+      (
+        _regions_by_y.begin(),
+        _regions_by_y.end(),
+        static_cast<float>(border - top_max - 1),
+        [](const RegionIndexEntry& region, float y)
+        {
+          return region.first < y;
+        }
+      );
+
+      for(; entry != _regions_by_y.end()
+            && entry->first <= border - top_min + 1; ++entry)
+        candidates.push_back(entry->second.get());
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase( std::unique(candidates.begin(), candidates.end()),
+                      candidates.end() );
+
+    QRect desktop = desktop_abs.translated( -scroll_abs.topLeft() ),
+          local_view(-scroll_region.topLeft(), viewport.size());
+    local_view = local_view.intersected(desktop);
+
+    for(auto node: candidates)
+    {
+      const bool on_screen = node->get<bool>("on-screen"),
+                 covered = node->get<bool>("covered"),
+                 outside = node->get<bool>("outside");
+      const WId covering_wid = node->get<WId>("covering-wid");
+
+      updateNode(*node, desktop, local_view, windows, first_above);
+
+      if(    node->get<bool>("on-screen") != on_screen
+          || node->get<bool>("covered") != covered
+          || node->get<bool>("outside") != outside
+          || node->get<WId>("covering-wid") != covering_wid )
+        return false;
+    }
+
+    // Nothing has changed, besides elements fixed on the screen moving
+    // relative to the document.
+    const float2 offset(0, -dy);
+    for(auto& node: _nodes)
+      for(auto& hedge: node->getChildren())
+        for(auto& region: hedge->getNodes())
+          if( !region->get<std::string>("outside-scroll").empty() )
+            translateNode(*region, offset);
+
+    translateNode(*_covered_outline, offset);
+
+    for(auto const& preview: _xray_previews)
+      _ipc_server->updateCoveredPreview( preview,
+                                         viewport_abs,
+                                         scroll_abs,
+                                         preview->node->get<bool>("outside") );
+
+    for(auto const& outline: _outlines)
+      if( outline->preview_valid )
+        _ipc_server->updateCoveredPreview( outline->preview,
+                                           viewport_abs,
+                                           scroll_abs );
+
+    return true;
+  }
+
   //----------------------------------------------------------------------------
   bool ClientInfo::updateNode(
     LinkDescription::Node& node,
@@ -1149,8 +1339,7 @@ namespace LinksRouting
   }
 
   //----------------------------------------------------------------------------
-  void ClientInfo::updateHedges( LinkDescription::hedges_t& hedges,
-                                 bool first )
+  void ClientInfo::updateHedges(LinkDescription::hedges_t& hedges)
   {
     for(auto& hedge: hedges)
     {
@@ -1161,16 +1350,11 @@ namespace LinksRouting
         offset = getScrollRegionAbs().topLeft();
 
       hedge->set("client_wid", _window_info.id);
-      hedge->set("screen-offset", offset);
-
-      if( first )
-      {
-        hedge->set("partitions_src", to_string(tile_map->partitions_src));
-        hedge->set("partitions_dest", to_string(tile_map->partitions_dest));
-      }
+      if( hedge->set("screen-offset", offset) )
+        _ipc_server->invalidateHoverIndex();
 
       for(auto& node: hedge->getNodes())
-        updateHedges(node->getChildren(), false);
+        updateHedges(node->getChildren());
     }
   }
 
@@ -1204,7 +1388,7 @@ namespace LinksRouting
 
     if( do_partitions )
     {
-      PartitionHelper part;
+      std::vector<float2> intervals;
       for(auto const& node: _nodes)
         for(auto const& hedge: node->getChildren())
           for(auto const& region: hedge->getNodes())
@@ -1214,10 +1398,12 @@ namespace LinksRouting
               continue;
 
             const Rect& bb = region->getBoundingBox();
-            part.add( float2( bb.t() - 3 * _avg_region_height,
-                              bb.b() + 3 * _avg_region_height ) );
+            intervals.push_back( float2( bb.t() - 3 * _avg_region_height,
+                                         bb.b() + 3 * _avg_region_height ) );
           }
 
+      PartitionHelper part;
+      part.assign(std::move(intervals));
       part.clip(0, scroll_region.height(), 2 * _avg_region_height);
       partitions_src = part.getPartitions();
 
@@ -1225,6 +1411,7 @@ namespace LinksRouting
       {
         const int compress_size = _avg_region_height * 1.5;
         float cur_pos = 0;
+        partitions_dest.reserve(partitions_src.size());
         for( auto part = partitions_src.begin();
                   part != partitions_src.end();
                 ++part )
@@ -1271,8 +1458,8 @@ namespace LinksRouting
                                            preview_width,
                                            preview_height );
 
-    tile_map->partitions_src = partitions_src;
-    tile_map->partitions_dest = partitions_dest;
+    tile_map->partitions_src = std::move(partitions_src);
+    tile_map->partitions_dest = std::move(partitions_dest);
     tile_map->margin_left = margin_left;
     tile_map->margin_right = margin_right;
 
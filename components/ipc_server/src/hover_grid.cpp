@@ -0,0 +1,71 @@
+/*
+ * hover_grid.cpp
+ *
+ * Uniform grid for hit testing popups and previews.
+ */
+
+#include "hover_grid.hpp"
+
+#include <cmath>
+
+namespace LinksRouting
+{
+  /** Items spanning more cells are not split up */
+  static const int64_t MAX_CELLS_PER_ITEM = 256;
+
+  //----------------------------------------------------------------------------
+  HoverGrid::HoverGrid(float cell_size):
+    _cell_size(cell_size)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  void HoverGrid::clear()
+  {
+    _cells.clear();
+    _large.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  void HoverGrid::insert(const Rect& region, uint32_t id)
+  {
+    const int32_t x0 = cellCoord(region.l()),
+                  x1 = cellCoord(region.r()),
+                  y0 = cellCoord(region.t()),
+                  y1 = cellCoord(region.b());
+
+    if( int64_t(x1 - x0 + 1) * (y1 - y0 + 1) > MAX_CELLS_PER_ITEM )
+    {
+      _large.push_back(id);
+      return;
+    }
+
+    for(int32_t y = y0; y <= y1; ++y)
+      for(int32_t x = x0; x <= x1; ++x)
+        _cells[ cellKey(x, y) ].push_back(id);
+  }
+
+  //----------------------------------------------------------------------------
+  void HoverGrid::query(const float2& pos, std::vector<uint32_t>& ids) const
+  {
+    ids.insert(ids.end(), _large.begin(), _large.end());
+
+    auto cell = _cells.find( cellKey(cellCoord(pos.x), cellCoord(pos.y)) );
+    if( cell != _cells.end() )
+      ids.insert(ids.end(), cell->second.begin(), cell->second.end());
+  }
+
+  //----------------------------------------------------------------------------
+  int32_t HoverGrid::cellCoord(float v) const
+  {
+    return static_cast<int32_t>(std::floor(v / _cell_size));
+  }
+
+  //----------------------------------------------------------------------------
+  uint64_t HoverGrid::cellKey(int32_t x, int32_t y)
+  {
+    return (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+  }
+
+} // namespace LinksRouting
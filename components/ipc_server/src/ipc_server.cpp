@@ -8,9 +8,12 @@
 
 #include "ipc_server.hpp"
 #include "log.hpp"
+#include "qt_helper.hxx"
 #include "ClientInfo.hxx"
 #include "JSON.hpp"
 #include "common/PreviewWindow.hpp"
+#include "GLTileCache.hpp"
+#include "TileCache.hpp"
 
 #include <QGuiApplication>
 #include <QHostInfo>
@@ -29,6 +32,25 @@ namespace LinksRouting
   const QString SAVE_FILE_EXT = "concept-local.json",
                 LOG_FILE_EXT = "concept-log.json";
 
+  /** Type of binary tile messages (uncompressed ARGB32 pixels) */
+  const uint8_t TILE_TYPE_RAW = 1;
+
+  /** Flag in the type byte of binary tile messages marking a 32bit request id
+   *  (instead of the legacy 8bit id) */
+  const uint8_t TILE_HEADER_ID32 = 0x80;
+
+  /** Forget tile requests not answered within this time */
+  const std::chrono::seconds TILE_REQUEST_TIMEOUT(5);
+
+  /** Prefetch tiles expected to be visible within this time [s] */
+  const float PREFETCH_LOOKAHEAD = 0.5f;
+
+  /** Treat popups not moved for this time [s] as standing still */
+  const double PREFETCH_MAX_MOTION_DT = 0.5;
+
+  /** Prefetch previews once the mouse is closer than this to a region [px] */
+  const float PREFETCH_HOVER_DISTANCE = 64;
+
   QJsonArray to_json(ClientWeakList const& clients)
   {
     QJsonArray json;
@@ -104,6 +126,46 @@ namespace LinksRouting
                          });
   }
 
+  //----------------------------------------------------------------------------
+  static void onTileCacheSizeChanged(const std::string&, int& size_mb, void*)
+  {
+    if( size_mb < 0 )
+      size_mb = 0;
+    TileCache::instance().setMaxBytes(static_cast<size_t>(size_mb) << 20);
+  }
+
+  //----------------------------------------------------------------------------
+  static void onTileTextureCacheSizeChanged( const std::string&,
+                                             int& size_mb,
+                                             void* )
+  {
+    if( size_mb < 0 )
+      size_mb = 0;
+    GLTileCache::setMaxBytes(static_cast<size_t>(size_mb) << 20);
+  }
+
+  //----------------------------------------------------------------------------
+  static void onTileCacheCompressChanged(const std::string&, bool& val, void*)
+  {
+    TileCache::instance().setCompressCold(val);
+  }
+
+  //----------------------------------------------------------------------------
+  static void onDebugTileDumpChanged( const std::string&,
+                                      std::string& dir,
+                                      void* dumper )
+  {
+    static_cast<TileDumper*>(dumper)->setDirectory(QString::fromStdString(dir));
+  }
+
+  //----------------------------------------------------------------------------
+  static void onDebugTileDumpRateChanged( const std::string&,
+                                          int& rate,
+                                          void* dumper )
+  {
+    static_cast<TileDumper*>(dumper)->setMaxRate(rate);
+  }
+
   class IPCServer::TileHandler:
     public SlotType::TileHandler
   {
@@ -117,26 +179,130 @@ namespace LinksRouting
       virtual bool updateTileMap( const HierarchicTileMapPtr& tile_map,
                                   ClientRef client,
                                   const Rect& rect,
-                                  int zoom );
+                                  int zoom,
+                                  const void* owner = nullptr );
+      virtual void cancelRequests(const void* owner);
+
+      /**
+       * Request tiles of a (not yet visible) popup/preview ahead of time, eg.
+       * if the mouse approaches the according region.
+       */
+      void prefetchRegion(SlotType::TextPopup::Popup& popup);
+      void prefetchRegion(SlotType::XRayPopup::HoverRect& preview);
+
+      void printStats(std::ostream& strm) const;
 
     protected:
       friend class IPCServer;
       IPCServer* _ipc_server;
 
+      /** Identifies a tile to avoid requesting it more than once */
+      struct TileKey
+      {
+        const HierarchicTileMap* tile_map;
+        size_t level, x, y;
+
+        bool operator<(const TileKey& rhs) const
+        {
+          return std::tie(tile_map, level, x, y)
+               < std::tie(rhs.tile_map, rhs.level, rhs.x, rhs.y);
+        }
+      };
+
       struct TileRequest
       {
         QWebSocket* socket;
         HierarchicTileMapWeakPtr tile_map;
+        TileKey key;
         int zoom;
         size_t x, y;
         float2 tile_size;
+        float priority;     //!< Distance to center of requested region
+                            //   (smaller values are sent first)
+        const void* owner;
+        bool sent,
+             prefetch;      //!< Not (yet) required for rendering
+        clock::time_point time_stamp;
+      };
+
+      /** Recent movement of the source region of a popup */
+      struct Motion
+      {
+        float2 pos,
+               velocity;    //!< [px/s] in source coordinates
+        int zoom,
+            zoom_dir;       //!< Direction of last zoom change
         clock::time_point time_stamp;
       };
 
-      typedef std::map<uint8_t, TileRequest> TileRequests;
-      TileRequests  _tile_requests;
-      uint8_t       _tile_request_id;
-      int           _new_request;
+      typedef std::map<uint32_t, TileRequest> TileRequests;
+      typedef std::map<TileKey, uint32_t> TileRequestIds;
+      typedef std::map<const void*, Motion> Motions;
+      TileRequests    _tile_requests;
+      TileRequestIds  _tile_request_ids;
+      uint32_t        _tile_request_id;
+      Motions         _motions;
+
+      double            _prefetch_budget;   //!< Available bytes for prefetching
+      clock::time_point _prefetch_refill;
+      size_t            _num_prefetch_sent,
+                        _num_prefetch_hits;
+
+      /**
+       * Update source region (and popup size) for the current zoom level
+       *
+       * @return Client to request the tiles from (nullptr if invalid)
+       */
+      ClientRef layoutPopup( SlotType::TextPopup::Popup& popup,
+                             float2 center = float2(-9999, -9999),
+                             float2 rel_pos = float2() );
+
+      /**
+       * Add requests for all missing tiles of the given region
+       *
+       * @param req_ids   Receives ids of all requests covering the region
+       * @return Whether new requests have been added
+       */
+      bool requestTiles( const HierarchicTileMapPtr& tile_map,
+                         const ClientRef& client,
+                         const Rect& src,
+                         int zoom,
+                         const void* owner,
+                         bool prefetch,
+                         std::set<uint32_t>& req_ids );
+
+      /**
+       * Drop pending requests of the owner not contained in req_ids
+       */
+      void dropRequests( const void* owner,
+                         bool prefetch,
+                         const std::set<uint32_t>& req_ids );
+
+      /**
+       * Prefetch neighbouring tiles (ahead in direction of movement) and the
+       * tiles of the next zoom level
+       */
+      void prefetchAround( SlotType::TextPopup::Popup& popup,
+                           const HierarchicTileMapPtr& tile_map,
+                           const ClientRef& client );
+
+      uint32_t nextRequestId();
+      TileRequests::iterator eraseRequest(TileRequests::iterator req);
+      void eraseRequest(uint32_t req_id);
+
+      /**
+       * Find request answered with a legacy (8bit) id. Only requests already
+       * sent to the given socket are taken into account.
+       */
+      TileRequests::iterator findLegacyRequest( QWebSocket* socket,
+                                                uint8_t req_id );
+
+      /**
+       * Send pending requests (highest priority first) as long as the
+       * according client has less than the allowed number of requests in
+       * flight.
+       */
+      void sendRequests();
   };
 
   //----------------------------------------------------------------------------
@@ -149,18 +315,43 @@ namespace LinksRouting
     _mutex_slot_links(mutex),
     _cond_data_ready(cond_data),
     _dirty_flags(0),
-    _last_autosave(clock::now())
+    _last_autosave(clock::now()),
+    _hover_index_dirty(true),
+    _client_index_dirty(true)
   {
     assert(_mutex_slot_links);
     assert(_mutex_slot_links->isRecursive());
 
     registerArg("DebugRegions", _debug_regions);
     registerArg("DebugFullPreview", _debug_full_preview_path);
+    registerArg( "DebugTileDump",
+                 _debug_tile_dump_dir,
+                 &onDebugTileDumpChanged,
+                 &_tile_dumper );
+    registerArg( "DebugTileDumpRate",
+                 _debug_tile_dump_rate = 2,
+                 &onDebugTileDumpRateChanged,
+                 &_tile_dumper );
     registerArg("PreviewWidth", _preview_width = 800);
     registerArg("PreviewHeight", _preview_height = 400);
     registerArg("AutoSaveInterval", _autosave_interval = 60);
     registerArg("PreviewAutoWidth", _preview_auto_width = true);
     registerArg("OutsideSeeThrough", _outside_see_through = true);
+    registerArg( "TileCacheSize",
+                 _tile_cache_size = TileCache::instance().getMaxBytes() >> 20,
+                 &onTileCacheSizeChanged );
+    registerArg( "TileTextureCacheSize",
+                 _tile_texture_cache_size = GLTileCache::getMaxBytes() >> 20,
+                 &onTileTextureCacheSizeChanged );
+    registerArg( "TileCacheCompress",
+                 _tile_cache_compress = TileCache::instance().getCompressCold(),
+                 &onTileCacheCompressChanged );
+    registerArg("TileRequestWindow", _tile_request_window = 4);
+    registerArg("TilePrefetchRate", _tile_prefetch_rate = 2048);
+    registerArg("TilePyramid", _tile_pyramid_enabled = true);
+
+    connect( &_tile_pyramid, &TilePyramid::tilesBuilt,
+             this, &IPCServer::onTilesBuilt );
 
     _msg_handlers["ABORT"] =
       std::bind(&IPCServer::onLinkAbort, this, _1, _2, _3);
@@ -226,6 +417,9 @@ namespace LinksRouting
   void IPCServer::publishSlots(SlotCollector& slot_collector)
   {
     _slot_links = slot_collector.create<LinkDescription::LinkList>("/links");
+    _slot_links_revision = slot_collector.create<uint32_t>("/links/revision");
+    *_slot_links_revision->_data = 0;
+    _slot_links_revision->setValid(true);
     _slot_xray = slot_collector.create<SlotType::XRayPopup>("/xray");
     _slot_outlines =
       slot_collector.create<SlotType::CoveredOutline>("/covered-outlines");
@@ -298,6 +492,8 @@ namespace LinksRouting
   bool IPCServer::startup(Core* core, unsigned int type)
   {
     _window_monitor.start();
+    _tile_dumper.start();
+    _tile_pyramid.start();
     return true;
   }
 
@@ -380,7 +576,8 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   void IPCServer::shutdown()
   {
-
+    _tile_dumper.stop();
+    _tile_pyramid.stop();
   }
 
   //----------------------------------------------------------------------------
@@ -402,51 +599,7 @@ namespace LinksRouting
       _debug_full_preview_path.clear();
     }
 
-    if( _tile_handler->_new_request > 0 )
-      --_tile_handler->_new_request;
-    else
-    {
-      int allowed_request = 6;
-      for(auto req =  _tile_handler->_tile_requests.rbegin();
-               req != _tile_handler->_tile_requests.rend();
-             ++req )
-      {
-        if( !req->second.socket )
-          continue;
-
-        HierarchicTileMapPtr tile_map = req->second.tile_map.lock();
-        if( !tile_map )
-        {
-          // TODO req = _tile_handler->_tile_requests.erase(req);
-          continue;
-        }
-
-        float scale = 1/tile_map->getLayerScale(req->second.zoom);
-        Rect src( float2( req->second.x * tile_map->getTileWidth(),
-                          req->second.y * tile_map->getTileHeight() ),
-                  req->second.tile_size );
-        src *= scale;
-        src.pos.x += tile_map->margin_left;
-
-        std::cout << "request tile " << src.toString(true) << std::endl;
-        req->second.socket->sendTextMessage(QString(
-        "{"
-          "\"task\": \"GET\","
-          "\"id\": \"preview-tile\","
-          "\"size\": [" + QString::number(req->second.tile_size.x)
-                  + "," + QString::number(req->second.tile_size.y)
-                  + "],"
-          "\"sections_src\":" + to_string(tile_map->partitions_src).c_str() + ","
-          "\"sections_dest\":" + to_string(tile_map->partitions_dest).c_str() + ","
-          "\"src\": " + src.toString(true).c_str() + ","
-          "\"req_id\": " + QString::number(req->first) +
-        "}"));
-
-        req->second.socket = 0;
-        if( --allowed_request <= 0 )
-          break;
-      }
-    }
+    _tile_handler->sendRequests();
 
     static clock::time_point last_time = clock::now();
     clock::time_point now = clock::now();
@@ -573,6 +726,11 @@ namespace LinksRouting
 
     uint32_t flags = _dirty_flags;
     _dirty_flags = 0;
+
+    // Renderers only rebuild the geometry of the links if this changes
+    if( flags & (LINKS_DIRTY | RENDER_DIRTY) )
+      *_slot_links_revision->_data += 1;
+
     return flags;
   }
 
@@ -598,6 +756,7 @@ namespace LinksRouting
   {
     auto& popups = _subscribe_popups->_data->popups;
     auto popup_it = popups.insert(popups.end(), popup);
+    invalidateHoverIndex();
 
     auto client = std::find_if
     (
@@ -619,7 +778,9 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   void IPCServer::removePopup(const PopupIterator& popup)
   {
+    _tile_handler->cancelRequests(&*popup);
     _subscribe_popups->_data->popups.erase(popup);
+    invalidateHoverIndex();
   }
 
   //----------------------------------------------------------------------------
@@ -627,7 +788,11 @@ namespace LinksRouting
   {
     auto& popups = _subscribe_popups->_data->popups;
     for(auto const& it: popups_remove)
+    {
+      _tile_handler->cancelRequests(&*it);
       popups.erase(it);
+    }
+    invalidateHoverIndex();
   }
 
   //----------------------------------------------------------------------------
@@ -639,6 +804,27 @@ namespace LinksRouting
                                 const QRect& viewport,
                                 const QRect& scroll_region,
                                 bool extend )
+  {
+    node->setOrClear("hover", false);
+
+    SlotType::XRayPopup::HoverRect xray;
+    xray.link_id = link_id;
+    xray.node = node;
+    xray.tile_map = tile_map;
+    xray.client_socket = client_info.socket;
+
+    auto& previews = _slot_xray->_data->popups;
+    auto preview = previews.insert(previews.end(), xray);
+    updateCoveredPreview(preview, viewport, scroll_region, extend);
+
+    return preview;
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::updateCoveredPreview( const XRayIterator& preview,
+                                        const QRect& viewport,
+                                        const QRect& scroll_region,
+                                        bool extend )
   {
     QRect preview_region =
       scroll_region.intersected(extend ? desktopRect().toQRect() : viewport);
@@ -648,9 +834,9 @@ namespace LinksRouting
       preview_region.size()
     );
 
+    auto const& node = preview->node;
     node->set("covered-region", to_string(viewport));
     node->set("covered-preview-region", to_string(preview_region));
-    node->setOrClear("hover", false);
 
     Rect bb;
     for( auto vert = node->getVertices().begin();
@@ -658,17 +844,11 @@ namespace LinksRouting
             ++vert )
       bb.expand(*vert);
 
-    SlotType::XRayPopup::HoverRect xray;
-    xray.link_id = link_id;
-    xray.region = bb;
-    xray.preview_region = preview_region;
-    xray.source_region = source_region;
-    xray.node = node;
-    xray.tile_map = tile_map;
-    xray.client_socket = client_info.socket;
+    preview->region = bb;
+    preview->preview_region = preview_region;
+    preview->source_region = source_region;
 
-    auto& previews = _slot_xray->_data->popups;
-    return previews.insert(previews.end(), xray);
+    invalidateHoverIndex();
   }
 
   //----------------------------------------------------------------------------
@@ -676,7 +856,9 @@ namespace LinksRouting
   {
     if( preview->node )
       preview->node->setOrClear("alpha", false);
+    _tile_handler->cancelRequests(&*preview);
     _slot_xray->_data->popups.erase(preview);
+    invalidateHoverIndex();
   }
 
   //----------------------------------------------------------------------------
@@ -687,8 +869,10 @@ namespace LinksRouting
     {
       if( it->node )
         it->node->setOrClear("alpha", false);
+      _tile_handler->cancelRequests(&*it);
       popups.erase(it);
     }
+    invalidateHoverIndex();
   }
 
   //----------------------------------------------------------------------------
@@ -886,6 +1070,7 @@ namespace LinksRouting
     connect(client, &QWebSocket::disconnected, this, &IPCServer::onClientDisconnection);
 
     _clients[ client ].reset(new ClientInfo(client, this));
+    invalidateClientIndex();
 
     qDebug() << "Client connected:" << client->peerAddress().toString()
                                     << ":" << client->peerPort();
@@ -908,7 +1093,13 @@ namespace LinksRouting
         QJsonObject msg = parseJson(data.toLocal8Bit());
         QString task = msg.value("task").toString();
 
-        qDebug() << "Message from" << client_info->getWindowInfo().id << msg;
+        LOG_FIELDS(
+          Log::LEVEL_DEBUG,
+          "Message from client",
+          ("wid", client_info->getWindowInfo().id)
+          ("task", task)
+          ("msg", QJsonDocument(msg).toJson(QJsonDocument::Compact).constData())
+        );
 
         auto msg_handler = _msg_handlers.find(task);
         if( msg_handler == _msg_handlers.end() )
@@ -933,67 +1124,176 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   void IPCServer::onBinaryReceived(QByteArray data)
   {
-    if( data.size() < 3 )
+    uint8_t type = data.size() ? data.at(0) : 0;
+    bool id32 = type & TILE_HEADER_ID32;
+    int offset = id32 ? 5 : 2;
+    type &= ~TILE_HEADER_ID32;
+
+    if( data.size() <= offset )
     {
       LOG_WARN("Binary message too small (" << data.size() << "byte)");
       return;
     }
 
-    uint8_t type = data.at(0),
-            seq_id = data.at(1);
-
-    std::cout << "Binary data received: "
-              << ((data.size() / 1024) / 1024.f) << "MB"
-              << " type=" << (int)type
-              << " seq=" << (int)seq_id << std::endl;
+    if( type != TILE_TYPE_RAW )
+    {
+      LOG_WARN("Invalid binary data!");
+      return;
+    }
 
+    QWebSocket* socket = qobject_cast<QWebSocket*>(sender());
     QMutexLocker lock_links(_mutex_slot_links);
 
-    if( type != 1 )
+    auto request = _tile_handler->_tile_requests.end();
+    if( id32 )
     {
-      LOG_WARN("Invalid binary data!");
-      return;
+      // little endian
+      uint32_t req_id = 0;
+      for(int i = 0; i < 4; ++i)
+        req_id |= static_cast<uint32_t>(static_cast<uint8_t>(data.at(1 + i)))
+               << (8 * i);
+      request = _tile_handler->_tile_requests.find(req_id);
     }
+    else
+      request = _tile_handler->findLegacyRequest(socket, data.at(1));
 
-    auto request = _tile_handler->_tile_requests.find(seq_id);
-    if( request == _tile_handler->_tile_requests.end() )
+    if(    request == _tile_handler->_tile_requests.end()
+        || !request->second.sent
+        || request->second.socket != socket )
     {
       LOG_WARN("Received unknown tile request.");
       return;
     }
 
-    auto req_ms =
-      std::chrono::duration_cast<std::chrono::milliseconds>
-      (
-        clock::now() - request->second.time_stamp
-      ).count();
+    uint32_t req_id = request->first;
+    if( request->second.tile_map.expired() )
+    {
+      LOG_WARN("Received tile request for expired map.");
+      _tile_handler->eraseRequest(request);
+      return;
+    }
 
-    std::cout << "request #" << (int)seq_id << " " << req_ms << "ms"
-              << std::endl;
+    size_t num_bytes = request->second.tile_size.x
+                     * request->second.tile_size.y
+                     * 4;
+    if( static_cast<size_t>(data.size() - offset) != num_bytes )
+    {
+      LOG_WARN( "Invalid tile size (" << (data.size() - offset) << " bytes, "
+                "expected " << num_bytes << ")" );
+      _tile_handler->eraseRequest(request);
+      return;
+    }
 
-    HierarchicTileMapPtr tile_map = request->second.tile_map.lock();
-    if( !tile_map )
+    setTileData(req_id, data, offset);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::setTileData( uint32_t req_id,
+                               const QByteArray& data,
+                               int offset )
+  {
+    auto request = _tile_handler->_tile_requests.find(req_id);
+    if( request == _tile_handler->_tile_requests.end() )
     {
-      LOG_WARN("Received tile request for expired map.");
-      _tile_handler->_tile_requests.erase(request);
+      LOG_WARN("Tile request #" << req_id << " has vanished.");
       return;
     }
 
-    tile_map->setTileData( request->second.x,
-                           request->second.y,
-                           request->second.zoom,
-                           data.constData() + 2,
-                           data.size() - 2 );
+    HierarchicTileMapPtr tile_map = request->second.tile_map.lock();
+    if( tile_map )
+    {
+      tile_map->setTileData( request->second.x,
+                             request->second.y,
+                             request->second.zoom,
+                             data.constData() + offset,
+                             data.size() - offset,
+                             request->second.prefetch );
+
+      if( request->second.zoom >= 0 )
+        buildParentTile( tile_map,
+                         request->second.key.level,
+                         request->second.x,
+                         request->second.y );
+
+      TileDumper::Tile tile = {
+        data,
+        offset,
+        static_cast<int>(request->second.tile_size.x),
+        static_cast<int>(request->second.tile_size.y),
+        request->second.x,
+        request->second.y,
+        request->second.zoom
+      };
+      _tile_dumper.enqueue(tile);
+    }
+
+    // Request is fulfilled. Also allows requesting the tile again if it gets
+    // evicted from the tile cache.
+    _tile_handler->eraseRequest(request);
+
+    dirtyRender();
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::onTilesBuilt()
+  {
+    TilePyramid::Results results = _tile_pyramid.takeResults();
+    if( results.empty() )
+      return;
+
+    QMutexLocker lock_links(_mutex_slot_links);
+    for(auto const& result: results)
+    {
+      HierarchicTileMapPtr tile_map = result.tile_map.lock();
+      if( !tile_map || result.pixels.isEmpty() )
+        continue;
+
+      // Keep data received from the client in the meantime
+      Tile* tile = tile_map->findTile(result.x, result.y, result.level);
+      if( !tile || tile->hasData() )
+        continue;
+
+      tile_map->setTileData( result.x,
+                             result.y,
+                             result.level,
+                             result.pixels.constData(),
+                             result.pixels.size() );
+
+      // Drop request not yet sent to the client
+      TileHandler::TileKey key = {
+        tile_map.get(),
+        result.level,
+        result.x,
+        result.y
+      };
+      auto req_id = _tile_handler->_tile_request_ids.find(key);
+      if( req_id != _tile_handler->_tile_request_ids.end() )
+      {
+        auto req = _tile_handler->_tile_requests.find(req_id->second);
+        if(    req != _tile_handler->_tile_requests.end()
+            && !req->second.sent
+            && req->second.tile_map.lock() == tile_map )
+          _tile_handler->eraseRequest(req);
+      }
 
-    QImage img( (const uchar*)data.constData() + 2,
-                request->second.tile_size.x,
-                request->second.tile_size.y,
-                QImage::Format_ARGB32 );
-    img.save( QString("tile-%1-%2").arg(request->second.x).arg(request->second.y));
+      buildParentTile(tile_map, result.level, result.x, result.y);
+    }
 
     dirtyRender();
   }
 
+  //----------------------------------------------------------------------------
+  void IPCServer::buildParentTile( const HierarchicTileMapPtr& tile_map,
+                                   size_t level, size_t x, size_t y )
+  {
+    if( !_tile_pyramid_enabled || !level )
+      return;
+
+    Tile* parent = tile_map->findTile(x / 2, y / 2, level - 1);
+    if( parent && !parent->hasData() )
+      _tile_pyramid.enqueue(tile_map, level - 1, x / 2, y / 2);
+  }
+
   //----------------------------------------------------------------------------
   void IPCServer::onClientDisconnection()
   {
@@ -1022,6 +1322,7 @@ namespace LinksRouting
     logWrite(msg);
 
     _clients.erase(client);
+    invalidateClientIndex();
     socket->deleteLater();
 
     LOG_INFO("Client disconnected");
@@ -1050,15 +1351,24 @@ namespace LinksRouting
 
     QByteArray data = client->readAll(); // clear read queue
     //qDebug() << data;
+
+    std::stringstream stats;
+    {
+      QMutexLocker lock_links(_mutex_slot_links);
+      _tile_handler->printStats(stats);
+    }
+
+    QByteArray body = QByteArray::fromStdString(stats.str());
     QString response(
       "HTTP/1.0 200 OK\r\n"
       "Access-Control-Allow-Origin: *\r\n"
       "Connection: close\r\n"
       "Content-Type: text/plain\r\n"
-      "Content-Size: 0\r\n"
+      "Content-Length: " + QString::number(body.size()) + "\r\n"
       "\r\n"
     );
     client->write(response.toLocal8Bit());
+    client->write(body);
     client->disconnectFromHost();
   }
 
@@ -1080,7 +1390,7 @@ namespace LinksRouting
 
     // Identify window
 
-    const WindowRegions& windows = _window_monitor.getWindows();
+    const WindowRegions& windows = _window_monitor.getWindows(true);
     if( msg.contains("wid") )
     {
       LOG_DEBUG("Use window id from message.");
@@ -1190,8 +1500,8 @@ namespace LinksRouting
 
       QMutexLocker lock_links(_mutex_slot_links);
 
-      client->setScrollPos( from_json<QPoint>(msg.value("pos")) );
-      client->update(_window_monitor.getWindows());
+      client->scroll( from_json<QPoint>(msg.value("pos")),
+                      _window_monitor.getWindows() );
 
       // Forward scroll events to clients which support this (eg. for
       // synchronized scrolling)
@@ -1850,6 +2160,10 @@ namespace LinksRouting
       }
     }
 
+    // Settings affect links of all clients (eg. OutsideSeeThrough)
+    for(auto& cinfo: _clients)
+      cinfo.second->setLinksDirty();
+
     dirtyLinks();
   }
 
@@ -1984,8 +2298,11 @@ namespace LinksRouting
     {
       qDebug() << "New link for" << link_id;
 
-      _slot_links->_data->push_back(LinkDescription::LinkDescription(link_id));
-      new_link = &_slot_links->_data->back();
+      auto& links = *_slot_links->_data;
+      auto new_link_it = links.insert( links.end(),
+                                       LinkDescription::LinkDescription(link_id) );
+      _links_by_id.insert(link_id.toCaseFolded(), new_link_it);
+      new_link = &*new_link_it;
     }
 
     new_link->_stamp = from_json<uint32_t>(msg.value("stamp"));
@@ -2465,7 +2782,7 @@ namespace LinksRouting
           points.push_back(center += 9 * normal);
         }
 
-        auto node = std::make_shared<LinkDescription::Node>(
+        auto node = make_pooled<LinkDescription::Node>(
           points,
           link_points,
           link_points_children
@@ -2480,30 +2797,49 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   IPCServer::ClientInfos::iterator IPCServer::findClientInfo(WId wid)
   {
-    return std::find_if
-    (
-      _clients.begin(),
-      _clients.end(),
-      [wid](const ClientInfos::value_type& it)
-      {
-        return it.second->getWindowInfo().id == wid;
-      }
-    );
+    updateClientIndex();
+
+    auto client = _clients_by_wid.constFind(wid);
+    return client != _clients_by_wid.constEnd() ? *client : _clients.end();
   }
 
   //----------------------------------------------------------------------------
   IPCServer::ClientInfos::iterator
   IPCServer::findClientInfoById(QString const& id)
   {
-    return std::find_if
-    (
-      _clients.begin(),
-      _clients.end(),
-      [id](const ClientInfos::value_type& it)
-      {
-        return it.second->id() == id;
-      }
-    );
+    updateClientIndex();
+
+    auto client = _clients_by_id.constFind(id);
+    return client != _clients_by_id.constEnd() ? *client : _clients.end();
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::invalidateClientIndex()
+  {
+    _client_index_dirty = true;
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::updateClientIndex()
+  {
+    if( !_client_index_dirty )
+      return;
+
+    _client_index_dirty = false;
+    _clients_by_wid.clear();
+    _clients_by_id.clear();
+
+    for(auto client = _clients.begin(); client != _clients.end(); ++client)
+    {
+      // Keep the first client for duplicate keys (like a linear search)
+      WId wid = client->second->getWindowInfo().id;
+      if( !_clients_by_wid.contains(wid) )
+        _clients_by_wid.insert(wid, client);
+
+      const QString& id = client->second->id();
+      if( !_clients_by_id.contains(id) )
+        _clients_by_id.insert(id, client);
+    }
   }
 
   //----------------------------------------------------------------------------
@@ -2516,15 +2852,8 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   LinkDescription::LinkList::iterator IPCServer::findLink(const QString& id)
   {
-    return std::find_if
-    (
-      _slot_links->_data->begin(),
-      _slot_links->_data->end(),
-      [&id](const LinkDescription::LinkDescription& desc)
-      {
-        return desc._id.compare(id, Qt::CaseInsensitive) == 0;
-      }
-    );
+    auto link = _links_by_id.constFind(id.toCaseFolded());
+    return link != _links_by_id.constEnd() ? *link : _slot_links->_data->end();
   }
 
   //----------------------------------------------------------------------------
@@ -2637,10 +2966,11 @@ namespace LinksRouting
   void IPCServer::onClick(int x, int y)
   {
     QMutexLocker lock_links(_mutex_slot_links);
+    const float2 mouse_pos(x, y);
 
-    bool changed = foreachPopup([&]( SlotType::TextPopup::Popup& popup,
-                                     QWebSocket& socket,
-                                     ClientInfo& client_info ) -> bool
+    bool changed = foreachPopupAt(&mouse_pos, [&]( SlotType::TextPopup::Popup& popup,
+                                                   QWebSocket& socket,
+                                                   ClientInfo& client_info ) -> bool
     {
       if( popup.region.contains(x, y) )
       {
@@ -2655,6 +2985,7 @@ namespace LinksRouting
         return false;
 
       popup.hover_region.fadeOut();
+      _tile_handler->cancelRequests(&popup);
 
       QSize preview_size = client_info.preview_size;
       float scale = (preview_size.height()
@@ -2664,19 +2995,11 @@ namespace LinksRouting
       float dy = y - popup.hover_region.region.pos.y,
             scroll_y = scale * dy + popup.hover_region.src_region.pos.y;
 
-      for( auto part_src = client_info.tile_map->partitions_src.begin(),
-                part_dst = client_info.tile_map->partitions_dest.begin();
-                part_src != client_info.tile_map->partitions_src.end()
-             && part_dst != client_info.tile_map->partitions_dest.end();
-              ++part_src,
-              ++part_dst )
-      {
-        if( scroll_y <= part_dst->y )
-        {
-          scroll_y = part_src->x + (scroll_y - part_dst->x);
-          break;
-        }
-      }
+      const Partitions& parts_src = client_info.tile_map->partitions_src;
+      const Partitions& parts_dest = client_info.tile_map->partitions_dest;
+      const size_t i = findPartition(parts_dest, scroll_y) - parts_dest.begin();
+      if( i < parts_src.size() )
+        scroll_y = parts_src[i].x + (scroll_y - parts_dest[i].x);
 
       socket.sendTextMessage(QString(
       "{"
@@ -2688,9 +3011,9 @@ namespace LinksRouting
       return true;
     });
 
-    changed |= foreachPreview([&]( SlotType::XRayPopup::HoverRect& preview,
-                                   QWebSocket& socket,
-                                   ClientInfo& client_info ) -> bool
+    changed |= foreachPreviewAt(&mouse_pos, [&]( SlotType::XRayPopup::HoverRect& preview,
+                                                 QWebSocket& socket,
+                                                 ClientInfo& client_info ) -> bool
     {
       float2 offset = preview.node->getParent()->get<float2>("screen-offset");
       if(    !preview.region.contains(float2(x, y) - offset)
@@ -2700,6 +3023,7 @@ namespace LinksRouting
       preview.node->getParent()->setOrClear("hover", false);
       preview.node->setOrClear("hover", false);
       preview.fadeOut();
+      _tile_handler->cancelRequests(&preview);
       client_info.activateWindow();
 
       if( !preview.node->get<bool>("outside") )
@@ -2776,12 +3100,13 @@ namespace LinksRouting
   void IPCServer::onMouseMove(int x, int y)
   {
     QMutexLocker lock_links(_mutex_slot_links);
+    const float2 mouse_pos(x, y);
 
     bool popup_visible = false;
     SlotType::TextPopup::Popup* hide_popup = nullptr;
-    bool changed = foreachPopup([&]( SlotType::TextPopup::Popup& popup,
-                                     QWebSocket& socket,
-                                     ClientInfo& client_info ) -> bool
+    bool changed = foreachPopupAt(&mouse_pos, [&]( SlotType::TextPopup::Popup& popup,
+                                                   QWebSocket& socket,
+                                                   ClientInfo& client_info ) -> bool
     {
       auto& reg = popup.hover_region;
       if(    !popup_visible // Only one popup at the same time
@@ -2805,7 +3130,10 @@ namespace LinksRouting
       else if( reg.isVisible() )
       {
         if( !popup.hover_region.isFadeOut() )
+        {
           popup.hover_region.delayedFadeOut();
+          _tile_handler->cancelRequests(&popup);
+        }
         else
           // timeout already started, so store to be able hiding if other
           // popup is shown before hiding this one.
@@ -2814,15 +3142,18 @@ namespace LinksRouting
       else if( reg.isFadeIn() )
       {
         reg.hide();
+        _tile_handler->cancelRequests(&popup);
       }
+      else if( popup.region.region.contains(x, y, PREFETCH_HOVER_DISTANCE) )
+        _tile_handler->prefetchRegion(popup);
 
       return false;
     });
 
     bool preview_visible = false;
-    changed |= foreachPreview([&]( SlotType::XRayPopup::HoverRect& preview,
-                                   QWebSocket& socket,
-                                   ClientInfo& client_info ) -> bool
+    changed |= foreachPreviewAt(&mouse_pos, [&]( SlotType::XRayPopup::HoverRect& preview,
+                                                 QWebSocket& socket,
+                                                 ClientInfo& client_info ) -> bool
     {
       auto const& p = preview.node->getParent();
 
@@ -2848,12 +3179,20 @@ namespace LinksRouting
       else if( preview.isVisible() )
       {
         if( !preview.isFadeOut() && !preview_visible )
+        {
           preview.delayedFadeOut();
+          _tile_handler->cancelRequests(&preview);
+        }
       }
       else if( preview.isFadeIn() )
       {
         preview.hide();
+        _tile_handler->cancelRequests(&preview);
       }
+      else if( preview.region.contains( float2(x, y)
+                                      - p->get<float2>("screen-offset"),
+                                        PREFETCH_HOVER_DISTANCE ) )
+        _tile_handler->prefetchRegion(preview);
 
       return false;
     });
@@ -2870,9 +3209,9 @@ namespace LinksRouting
     float preview_aspect = _preview_width
                          / static_cast<float>(_preview_height);
 
-    if( foreachPopup([&]( SlotType::TextPopup::Popup& popup,
-                      QWebSocket& socket,
-                      ClientInfo& client_info ) -> bool
+    if( foreachPopupAt(nullptr, [&]( SlotType::TextPopup::Popup& popup,
+                                     QWebSocket& socket,
+                                     ClientInfo& client_info ) -> bool
     {
       if( !popup.hover_region.isVisible() )
         return false;
@@ -2938,9 +3277,9 @@ namespace LinksRouting
     float preview_aspect = _preview_width
                          / static_cast<float>(_preview_height);
 
-    if( foreachPopup([&]( SlotType::TextPopup::Popup& popup,
-                          QWebSocket& socket,
-                          ClientInfo& client_info ) -> bool
+    if( foreachPopupAt(nullptr, [&]( SlotType::TextPopup::Popup& popup,
+                                     QWebSocket& socket,
+                                     ClientInfo& client_info ) -> bool
     {
       if( !popup.hover_region.isVisible() )
         return false;
@@ -2963,93 +3302,208 @@ namespace LinksRouting
   bool IPCServer::foreachPopup(const IPCServer::popup_callback_t& cb)
   {
     bool changed = false;
-    for( auto popup = _subscribe_popups->_data->popups.begin();
-              popup != _subscribe_popups->_data->popups.end(); )
-    {
-      if( !popup->client_socket )
-      {
-        ++popup;
-        continue;
-      }
-
-      QWebSocket* client_socket = static_cast<QWebSocket*>(popup->client_socket);
-      ClientInfos::iterator client = _clients.find(client_socket);
-
-      if( client == _clients.end() )
-      {
-        LOG_WARN("Popup without valid client_socket");
-        popup->client_socket = 0;
-        // deleting would result in invalid iterators inside ClientInfo, so
-        // just let it be and wait for the according ClientInfo to remove it.
-        //popup = _subscribe_popups->_data->popups.erase(popup);
-        ++popup;
-        changed = true;
-        continue;
-      }
-
-      changed |= cb(*popup, *client_socket, *client->second);
-      ++popup;
-    }
+    for(auto& popup: _subscribe_popups->_data->popups)
+      changed |= callPopup(popup, cb);
 
     return changed;
   }
 
-
   //----------------------------------------------------------------------------
-  bool IPCServer::foreachPreview(const IPCServer::preview_callback_t& cb)
+  bool IPCServer::foreachPopupAt( const float2* pos,
+                                  const IPCServer::popup_callback_t& cb )
   {
-    bool changed = false;
-    for( auto preview = _slot_xray->_data->popups.begin();
-              preview != _slot_xray->_data->popups.end(); )
-    {
-      if( !preview->client_socket )
-      {
-        ++preview;
-        continue;
-      }
+    updateHoverIndex();
 
-      auto const& p = preview->node->getParent();
-      if( !p )
-      {
-        LOG_WARN("xray preview: parent lost");
+    std::vector<uint32_t> ids = _active_popups;
+    if( pos )
+      _popup_grid.query(*pos, ids);
 
-        // Hide preview if parent has somehow been lost
-        changed |= preview->node->setOrClear("hover", false);
+    // Keep the order of the popup list
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
 
-        // deleting would result in invalid iterators inside ClientInfo, so
-        // just let it be and wait for the according ClientInfo to remove it.
-        //preview = _slot_xray->_data->popups.erase(preview);
-        ++preview;
-        continue;
-      }
+    bool changed = false;
+    _active_popups.clear();
+    for(uint32_t id: ids)
+    {
+      auto& popup = *_grid_popups[id];
+      changed |= callPopup(popup, cb);
 
-      QWebSocket* client_socket = static_cast<QWebSocket*>(preview->client_socket);
-      ClientInfos::iterator client = _clients.find(client_socket);
+      if( isActive(popup.hover_region) )
+        _active_popups.push_back(id);
+    }
 
-      if( client == _clients.end() )
-      {
-        LOG_WARN("Preview without valid client_socket");
-        preview->client_socket = 0;
+    return changed;
+  }
 
-        // Hide preview if socket has somehow been lost
-        changed |= preview->node->setOrClear("hover", false);
+  //----------------------------------------------------------------------------
+  bool IPCServer::callPopup( SlotType::TextPopup::Popup& popup,
+                             const IPCServer::popup_callback_t& cb )
+  {
+    if( !popup.client_socket )
+      return false;
 
-        // deleting would result in invalid iterators inside ClientInfo, so
-        // just let it be and wait for the according ClientInfo to remove it.
-        //preview = _slot_xray->_data->popups.erase(preview);
-        ++preview;
-        continue;
-      }
+    QWebSocket* client_socket = static_cast<QWebSocket*>(popup.client_socket);
+    ClientInfos::iterator client = _clients.find(client_socket);
 
-      changed |= cb(*preview, *client_socket, *client->second);
-      ++preview;
+    if( client == _clients.end() )
+    {
+      LOG_WARN("Popup without valid client_socket");
+      popup.client_socket = 0;
+      // deleting would result in invalid iterators inside ClientInfo, so
+      // just let it be and wait for the according ClientInfo to remove it.
+      return true;
     }
 
-    return changed;
+    return cb(popup, *client_socket, *client->second);
   }
 
+
   //----------------------------------------------------------------------------
-  void IPCServer::distributeMessage(
+  bool IPCServer::foreachPreview(const IPCServer::preview_callback_t& cb)
+  {
+    bool changed = false;
+    for(auto& preview: _slot_xray->_data->popups)
+      changed |= callPreview(preview, cb);
+
+    return changed;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IPCServer::foreachPreviewAt( const float2* pos,
+                                    const IPCServer::preview_callback_t& cb )
+  {
+    updateHoverIndex();
+
+    std::vector<uint32_t> ids = _active_previews;
+    if( pos )
+      _preview_grid.query(*pos, ids);
+
+    // Keep the order of the preview list
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    bool changed = false;
+    _active_previews.clear();
+    for(uint32_t id: ids)
+    {
+      auto& preview = *_grid_previews[id];
+      changed |= callPreview(preview, cb);
+
+      if( isActive(preview) )
+        _active_previews.push_back(id);
+    }
+
+    return changed;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IPCServer::callPreview( SlotType::XRayPopup::HoverRect& preview,
+                               const IPCServer::preview_callback_t& cb )
+  {
+    if( !preview.client_socket )
+      return false;
+
+    auto const& p = preview.node->getParent();
+    if( !p )
+    {
+      LOG_WARN("xray preview: parent lost");
+
+      // Hide preview if parent has somehow been lost
+      // (deleting would result in invalid iterators inside ClientInfo, so
+      //  just let it be and wait for the according ClientInfo to remove it.)
+      return preview.node->setOrClear("hover", false);
+    }
+
+    QWebSocket* client_socket = static_cast<QWebSocket*>(preview.client_socket);
+    ClientInfos::iterator client = _clients.find(client_socket);
+
+    if( client == _clients.end() )
+    {
+      LOG_WARN("Preview without valid client_socket");
+      preview.client_socket = 0;
+
+      // Hide preview if socket has somehow been lost
+      return preview.node->setOrClear("hover", false);
+    }
+
+    return cb(preview, *client_socket, *client->second);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::invalidateHoverIndex()
+  {
+    _hover_index_dirty = true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IPCServer::isActive(const SlotType::AnimatedPopup& popup)
+  {
+    return popup.isVisible() || popup.isTransient();
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::updateHoverIndex()
+  {
+    if( !_hover_index_dirty )
+      return;
+
+    _hover_index_dirty = false;
+    _popup_grid.clear();
+    _preview_grid.clear();
+    _grid_popups.clear();
+    _grid_previews.clear();
+    _active_popups.clear();
+    _active_previews.clear();
+
+    // Hidden popups and previews only react to the mouse inside their region
+    // (or close to it for prefetching). Visible or animated ones are always
+    // visited, as they also react if the mouse moves away.
+    auto& popups = _subscribe_popups->_data->popups;
+    for(auto popup = popups.begin(); popup != popups.end(); ++popup)
+    {
+      uint32_t id = _grid_popups.size();
+      _grid_popups.push_back(popup);
+
+      const float margin = std::max( popup->region.border,
+                                     PREFETCH_HOVER_DISTANCE );
+      Rect region = popup->region.region;
+      region.pos -= float2(margin, margin);
+      region.size += 2 * float2(margin, margin);
+      _popup_grid.insert(region, id);
+
+      if( isActive(popup->hover_region) )
+        _active_popups.push_back(id);
+    }
+
+    auto& previews = _slot_xray->_data->popups;
+    for(auto preview = previews.begin(); preview != previews.end(); ++preview)
+    {
+      uint32_t id = _grid_previews.size();
+      _grid_previews.push_back(preview);
+
+      if( isActive(*preview) )
+        _active_previews.push_back(id);
+
+      auto const& p = preview->node ? preview->node->getParent()
+                                    : LinkDescription::HyperEdgePtr();
+      if( !p )
+      {
+        // Let the callback handle lost parents
+        _active_previews.push_back(id);
+        continue;
+      }
+
+      const float margin = PREFETCH_HOVER_DISTANCE;
+      Rect region = preview->region + p->get<float2>("screen-offset");
+      region.pos -= float2(margin, margin);
+      region.size += 2 * float2(margin, margin);
+      _preview_grid.insert(region, id);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::distributeMessage(
       LinkDescription::LinkDescription const& link,
       const QJsonObject& msg
   ) const
@@ -3065,8 +3519,9 @@ namespace LinksRouting
   ) const
   {
     QByteArray msg_data = QJsonDocument(msg).toJson(QJsonDocument::Compact);
-    qDebug() << "distributeMessage" << link._id
-             << QString::fromLocal8Bit(msg_data);
+    LOG_FIELDS( Log::LEVEL_DEBUG,
+                "distributeMessage",
+                ("link", link._id)("msg", msg_data.constData()) );
 
     // Send info message (eg. about link initiating) also to clients which are
     // not part of the link so that they can show information about it.
@@ -3495,6 +3950,9 @@ namespace LinksRouting
       return link;
 
     qDebug() << "delete link" << _slot_links->_data->size() << link->_id;
+    auto index = _links_by_id.find(link->_id.toCaseFolded());
+    if( index != _links_by_id.end() && *index == link )
+      _links_by_id.erase(index);
     return _slot_links->_data->erase(link);
   }
 
@@ -3530,7 +3988,10 @@ namespace LinksRouting
   IPCServer::TileHandler::TileHandler(IPCServer* ipc_server):
     _ipc_server(ipc_server),
     _tile_request_id(0),
-    _new_request(0)
+    _prefetch_budget(0),
+    _prefetch_refill(clock::now()),
+    _num_prefetch_sent(0),
+    _num_prefetch_hits(0)
   {
 
   }
@@ -3539,6 +4000,143 @@ namespace LinksRouting
   bool IPCServer::TileHandler::updateRegion( SlotType::TextPopup::Popup& popup,
                                              float2 center,
                                              float2 rel_pos )
+  {
+    bool had_socket = popup.client_socket;
+    ClientRef client = layoutPopup(popup, center, rel_pos);
+    if( !client )
+      return had_socket;
+
+    HierarchicTileMapPtr tile_map = popup.hover_region.tile_map.lock();
+    bool new_requests = updateTileMap( tile_map,
+                                       client,
+                                       popup.hover_region.src_region,
+                                       popup.hover_region.zoom,
+                                       &popup );
+    prefetchAround(popup, tile_map, client);
+
+    return !new_requests;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IPCServer::TileHandler::updateRegion(
+    SlotType::XRayPopup::HoverRect& popup
+  )
+  {
+    auto client = _ipc_server->_clients.find(
+      static_cast<QWebSocket*>(popup.client_socket)
+    );
+    if( client == _ipc_server->_clients.end() )
+      return false;
+
+    return updateTileMap( popup.tile_map.lock(),
+                          client->second,
+                          popup.source_region,
+                          -1,
+                          &popup );
+  }
+
+  //----------------------------------------------------------------------------
+  bool IPCServer::TileHandler::updateTileMap(
+    const HierarchicTileMapPtr& tile_map,
+    ClientRef client,
+    const Rect& src,
+    int zoom,
+    const void* owner )
+  {
+    std::set<uint32_t> req_ids;
+    bool sent =
+      requestTiles(tile_map, client, src, zoom, owner, false, req_ids);
+
+    // Drop pending requests no longer covered by the region of this owner
+    // (eg. tiles scrolled past before they have been sent)
+    if( owner )
+      dropRequests(owner, false, req_ids);
+
+    return sent;
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::prefetchRegion(
+    SlotType::TextPopup::Popup& popup
+  )
+  {
+    if( !_ipc_server->_tile_prefetch_rate || popup.hover_region.isVisible() )
+      return;
+
+    HierarchicTileMapPtr tile_map = popup.hover_region.tile_map.lock();
+    if( !tile_map )
+      return;
+
+    ClientRef client = layoutPopup(popup);
+    if( !client )
+      return;
+
+    std::set<uint32_t> req_ids;
+    requestTiles( tile_map,
+                  client,
+                  popup.hover_region.src_region,
+                  popup.hover_region.zoom,
+                  &popup,
+                  true,
+                  req_ids );
+    dropRequests(&popup, true, req_ids);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::prefetchRegion(
+    SlotType::XRayPopup::HoverRect& preview
+  )
+  {
+    if( !_ipc_server->_tile_prefetch_rate || preview.isVisible() )
+      return;
+
+    auto client = _ipc_server->_clients.find(
+      static_cast<QWebSocket*>(preview.client_socket)
+    );
+    HierarchicTileMapPtr tile_map = preview.tile_map.lock();
+    if( client == _ipc_server->_clients.end() || !tile_map )
+      return;
+
+    std::set<uint32_t> req_ids;
+    requestTiles( tile_map,
+                  client->second,
+                  preview.source_region,
+                  -1,
+                  &preview,
+                  true,
+                  req_ids );
+    dropRequests(&preview, true, req_ids);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::printStats(std::ostream& strm) const
+  {
+    size_t num_pending = 0;
+    for(auto const& req: _tile_requests)
+      num_pending += !req.second.sent;
+
+    strm << "tile-cache-bytes: " << TileCache::instance().getUsedBytes() << "\n"
+         << "tile-cache-max-bytes: " << TileCache::instance().getMaxBytes()
+                                     << "\n"
+         << "tile-texture-bytes: " << GLTileCache::getUsedBytes() << "\n"
+         << "tile-texture-max-bytes: " << GLTileCache::getMaxBytes() << "\n"
+         << "tile-requests-pending: " << num_pending << "\n"
+         << "tile-requests-in-flight: " << (_tile_requests.size() - num_pending)
+                                        << "\n"
+         << "tile-prefetch-sent: " << _num_prefetch_sent << "\n"
+         << "tile-prefetch-hits: " << _num_prefetch_hits << "\n"
+         << "tile-prefetch-hit-rate: "
+         << ( _num_prefetch_sent
+            ? static_cast<double>(_num_prefetch_hits) / _num_prefetch_sent
+            : 0. )
+         << "\n";
+  }
+
+  //----------------------------------------------------------------------------
+  ClientRef
+  IPCServer::TileHandler::layoutPopup( SlotType::TextPopup::Popup& popup,
+                                       float2 center,
+                                       float2 rel_pos )
   {
     HierarchicTileMapPtr tile_map = popup.hover_region.tile_map.lock();
     float scale = 1/tile_map->getLayerScale(popup.hover_region.zoom);
@@ -3597,7 +4195,7 @@ namespace LinksRouting
     if( !popup.client_socket )
     {
       LOG_WARN("Popup without active socket.");
-      return false;
+      return nullptr;
     }
 
     QWebSocket* socket = static_cast<QWebSocket*>(popup.client_socket);
@@ -3608,40 +4206,21 @@ namespace LinksRouting
       LOG_WARN("Popup without valid client_socket");
       popup.client_socket = 0;
 
-      return true;
+      return nullptr;
     }
 
-    return !updateTileMap(
-      tile_map,
-      client->second,
-      src,
-      popup.hover_region.zoom
-    );
+    return client->second;
   }
 
   //----------------------------------------------------------------------------
-  bool IPCServer::TileHandler::updateRegion(
-    SlotType::XRayPopup::HoverRect& popup
-  )
-  {
-    auto client = _ipc_server->_clients.find(
-      static_cast<QWebSocket*>(popup.client_socket)
-    );
-    if( client == _ipc_server->_clients.end() )
-      return false;
-
-    return updateTileMap( popup.tile_map.lock(),
-                          client->second,
-                          popup.source_region,
-                          -1 );
-  }
-
-  //----------------------------------------------------------------------------
-  bool IPCServer::TileHandler::updateTileMap(
+  bool IPCServer::TileHandler::requestTiles(
     const HierarchicTileMapPtr& tile_map,
-    ClientRef client,
+    const ClientRef& client,
     const Rect& src,
-    int zoom )
+    int zoom,
+    const void* owner,
+    bool prefetch,
+    std::set<uint32_t>& req_ids )
   {
     if( !tile_map )
     {
@@ -3663,45 +4242,401 @@ namespace LinksRouting
 
     bool sent = false;
     MapRect rect = tile_map->requestRect(src, zoom);
+    float2 center( 0.5f * (rect.min[0] + rect.max[0]),
+                   0.5f * (rect.min[1] + rect.max[1]) );
+
     rect.foreachTile([&](Tile& tile, size_t x, size_t y)
     {
-      if( tile.type == Tile::NONE )
+      if( tile.hasData() )
       {
-        auto req = std::find_if
-        (
-          _tile_requests.begin(),
-          _tile_requests.end(),
-          //TODO VS FIX
-          [&](const std::map<uint8_t, TileRequest>::value_type& tile_req)
-          //[&](const TileRequests::value_type& tile_req)
+        if( !prefetch && tile.prefetched )
+        {
+          tile.prefetched = false;
+          ++_num_prefetch_hits;
+        }
+        return;
+      }
+
+      // Build from the tiles of the next zoom level if they are available
+      if(    zoom >= 0
+          && _ipc_server->_tile_pyramid_enabled
+          && _ipc_server->_tile_pyramid.enqueue( tile_map,
+                                                 rect.layer.getLevel(),
+                                                 x, y ) )
+        return;
+
+      float2 tile_center( x * tile_map->getTileWidth() + 0.5f * tile.width,
+                          y * tile_map->getTileHeight() + 0.5f * tile.height );
+      float priority = (tile_center - center).length();
+
+      TileKey key = {tile_map.get(), rect.layer.getLevel(), x, y};
+      auto req_id = _tile_request_ids.find(key);
+      if( req_id != _tile_request_ids.end() )
+      {
+        TileRequest& req = _tile_requests[req_id->second];
+        if( req.tile_map.lock() == tile_map )
+        {
+          if( prefetch && !req.prefetch )
+            // Already required for rendering -> keep it that way
+            return;
+
+          if( !prefetch && req.prefetch )
           {
-            return (tile_req.second.tile_map.lock() == tile_map)
-                && (tile_req.second.zoom == zoom)
-                && (tile_req.second.x == x)
-                && (tile_req.second.y == y);
+            // Prefetched tile is now actually required
+            if( req.sent )
+              ++_num_prefetch_hits;
+            req.prefetch = false;
+            req.priority = priority;
           }
-        );
 
-        if( req != _tile_requests.end() )
-          // already sent
+          // already requested -> just update priority and take over
+          req.priority = req.sent ? req.priority
+                                  : std::min(req.priority, priority);
+          if( owner )
+            req.owner = owner;
+          req_ids.insert(req_id->second);
           return;
+        }
 
-        TileRequest tile_req = {
-          client->socket,
-          tile_map,
-          zoom,
-          x, y,
-          float2(tile.width, tile.height),
-          clock::now()
-        };
-        uint8_t req_id = ++_tile_request_id;
-        _tile_requests[req_id] = tile_req;
-        sent = true;
+        // Stale request of a previous map at the same address
+        eraseRequest(req_id->second);
       }
+
+      TileRequest tile_req = {
+        client->socket,
+        tile_map,
+        key,
+        zoom,
+        x, y,
+        float2(tile.width, tile.height),
+        priority,
+        owner,
+        false,
+        prefetch,
+        clock::now()
+      };
+      uint32_t new_id = nextRequestId();
+      _tile_requests[new_id] = tile_req;
+      _tile_request_ids[key] = new_id;
+      req_ids.insert(new_id);
+      sent = true;
     });
-    if( sent )
-      _new_request = 2;
+
     return sent;
   }
 
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::dropRequests( const void* owner,
+                                             bool prefetch,
+                                             const std::set<uint32_t>& req_ids )
+  {
+    for(auto req = _tile_requests.begin(); req != _tile_requests.end();)
+    {
+      if(    req->second.owner == owner
+          && req->second.prefetch == prefetch
+          && !req->second.sent
+          && !req_ids.count(req->first) )
+        req = eraseRequest(req);
+      else
+        ++req;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::prefetchAround(
+    SlotType::TextPopup::Popup& popup,
+    const HierarchicTileMapPtr& tile_map,
+    const ClientRef& client )
+  {
+    if( !_ipc_server->_tile_prefetch_rate || !tile_map )
+      return;
+
+    const Rect& src = popup.hover_region.src_region;
+    const int zoom = popup.hover_region.zoom;
+    clock::time_point now = clock::now();
+
+    // Estimate velocity of the source region (changed by scrolling/dragging)
+    auto motion_it = _motions.find(&popup);
+    if( motion_it == _motions.end() )
+    {
+      Motion motion = { src.pos, float2(0, 0), zoom, 1, now };
+      motion_it = _motions.insert(std::make_pair(&popup, motion)).first;
+    }
+    else
+    {
+      Motion& motion = motion_it->second;
+      double dt = std::chrono::duration_cast<std::chrono::microseconds>
+      (
+        now - motion.time_stamp
+      ).count() / 1000000.;
+
+      if( motion.zoom != zoom )
+      {
+        motion.zoom_dir = zoom > motion.zoom ? 1 : -1;
+        motion.velocity = float2(0, 0);
+      }
+      else if( dt > 0 && dt < PREFETCH_MAX_MOTION_DT )
+        motion.velocity = 0.5f * motion.velocity
+                        + (0.5f / dt) * (src.pos - motion.pos);
+      else
+        motion.velocity = float2(0, 0);
+
+      motion.pos = src.pos;
+      motion.zoom = zoom;
+      motion.time_stamp = now;
+    }
+    const Motion& motion = motion_it->second;
+
+    auto clampToMap = [&tile_map](float2& min, float2& max)
+    {
+      clamp<float>(min.x, 0, tile_map->getWidth());
+      clamp<float>(min.y, 0, tile_map->getHeight());
+      clamp<float>(max.x, 0, tile_map->getWidth());
+      clamp<float>(max.y, 0, tile_map->getHeight());
+    };
+
+    // Current region extended by one tile in each direction and the region
+    // expected to be visible shortly
+    float2 ahead = PREFETCH_LOOKAHEAD * motion.velocity,
+           tile_size = float2( tile_map->getTileWidth(),
+                               tile_map->getTileHeight() )
+                     / tile_map->getLayerScale(zoom),
+           min = src.topLeft() - tile_size,
+           max = src.bottomRight() + tile_size;
+
+    min.x = std::min(min.x, min.x + ahead.x);
+    min.y = std::min(min.y, min.y + ahead.y);
+    max.x = std::max(max.x, max.x + ahead.x);
+    max.y = std::max(max.y, max.y + ahead.y);
+    clampToMap(min, max);
+
+    std::set<uint32_t> req_ids;
+    requestTiles( tile_map,
+                  client,
+                  Rect(min, max - min),
+                  zoom,
+                  &popup,
+                  true,
+                  req_ids );
+
+    // Next zoom level (in the direction of the last zoom change)
+    const float2& scroll_size = popup.hover_region.scroll_region.size;
+    int max_zoom = log2(scroll_size.y / _ipc_server->_preview_height / 0.9)
+                 + 0.7,
+        next_zoom = zoom + motion.zoom_dir;
+    if( next_zoom >= 0 && next_zoom <= max_zoom )
+    {
+      float2 size = pow(2.0f, static_cast<float>(zoom - next_zoom)) * src.size;
+      min = src.pos + 0.5f * (src.size - size);
+      max = min + size;
+      clampToMap(min, max);
+
+      requestTiles( tile_map,
+                    client,
+                    Rect(min, max - min),
+                    next_zoom,
+                    &popup,
+                    true,
+                    req_ids );
+    }
+
+    dropRequests(&popup, true, req_ids);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::cancelRequests(const void* owner)
+  {
+    if( !owner )
+      return;
+
+    _motions.erase(owner);
+
+    for(auto req = _tile_requests.begin(); req != _tile_requests.end();)
+    {
+      if( req->second.owner == owner && !req->second.sent )
+        req = eraseRequest(req);
+      else
+      {
+        // Answers of already sent requests are still stored in the tile map,
+        // but must not be associated with a (possibly reused) owner anymore.
+        if( req->second.owner == owner )
+          req->second.owner = nullptr;
+        ++req;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t IPCServer::TileHandler::nextRequestId()
+  {
+    // Skip 0 and ids still in use after wrapping around
+    do
+    {
+      ++_tile_request_id;
+    } while( !_tile_request_id || _tile_requests.count(_tile_request_id) );
+
+    return _tile_request_id;
+  }
+
+  //----------------------------------------------------------------------------
+  IPCServer::TileHandler::TileRequests::iterator
+  IPCServer::TileHandler::eraseRequest(TileRequests::iterator req)
+  {
+    auto req_id = _tile_request_ids.find(req->second.key);
+    if( req_id != _tile_request_ids.end() && req_id->second == req->first )
+      _tile_request_ids.erase(req_id);
+
+    return _tile_requests.erase(req);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::eraseRequest(uint32_t req_id)
+  {
+    auto req = _tile_requests.find(req_id);
+    if( req != _tile_requests.end() )
+      eraseRequest(req);
+  }
+
+  //----------------------------------------------------------------------------
+  IPCServer::TileHandler::TileRequests::iterator
+  IPCServer::TileHandler::findLegacyRequest( QWebSocket* socket,
+                                             uint8_t req_id )
+  {
+    // Clients answer requests in order, so if the lower bits are ambiguous
+    // take the oldest request.
+    auto found = _tile_requests.end();
+    for(auto req = _tile_requests.begin(); req != _tile_requests.end(); ++req)
+    {
+      if(    req->second.socket != socket
+          || !req->second.sent
+          || static_cast<uint8_t>(req->first) != req_id )
+        continue;
+
+      if(    found == _tile_requests.end()
+          || req->second.time_stamp < found->second.time_stamp )
+        found = req;
+    }
+
+    return found;
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::sendRequests()
+  {
+    if( _tile_requests.empty() )
+      return;
+
+    clock::time_point now = clock::now();
+
+    std::map<QWebSocket*, int> num_in_flight;
+    std::vector<TileRequests::iterator> pending;
+    for(auto req = _tile_requests.begin(); req != _tile_requests.end();)
+    {
+      if(    req->second.tile_map.expired()
+          || !_ipc_server->_clients.count(req->second.socket) )
+      {
+        req = eraseRequest(req);
+        continue;
+      }
+
+      if( !req->second.sent )
+        pending.push_back(req);
+      else if( now - req->second.time_stamp > TILE_REQUEST_TIMEOUT )
+      {
+        // Forget to allow requesting the tile again
+        LOG_WARN("Tile request #" << req->first << " timed out.");
+        req = eraseRequest(req);
+        continue;
+      }
+      else
+        ++num_in_flight[req->second.socket];
+
+      ++req;
+    }
+
+    if( pending.empty() )
+      return;
+
+    // Required tiles first, prefetching only afterwards
+    std::stable_sort
+    (
+      pending.begin(),
+      pending.end(),
+      [](const TileRequests::iterator& lhs, const TileRequests::iterator& rhs)
+      {
+        return std::tie(lhs->second.prefetch, lhs->second.priority)
+             < std::tie(rhs->second.prefetch, rhs->second.priority);
+      }
+    );
+
+    // Refill bandwidth budget for prefetching (allow bursts of up to one
+    // second, but at least of the largest pending tile, which would never be
+    // prefetched otherwise)
+    double max_tile_bytes = 0;
+    for(auto const& req: pending)
+      if( req->second.prefetch )
+        max_tile_bytes = std::max( max_tile_bytes,
+                                   4. * req->second.tile_size.x
+                                      * req->second.tile_size.y );
+
+    const double prefetch_rate = 1024. * _ipc_server->_tile_prefetch_rate;
+    _prefetch_budget = std::min
+    (
+      std::max(prefetch_rate, max_tile_bytes),
+      _prefetch_budget
+      + prefetch_rate
+      * std::chrono::duration_cast<std::chrono::microseconds>
+        (
+          now - _prefetch_refill
+        ).count() / 1000000.
+    );
+    _prefetch_refill = now;
+
+    const int max_in_flight = std::max(1, _ipc_server->_tile_request_window),
+              // Always keep a slot free for required tiles
+              max_prefetch = std::max(1, max_in_flight - 1);
+    for(auto const& req: pending)
+    {
+      int& in_flight = num_in_flight[req->second.socket];
+      if( in_flight >= max_in_flight )
+        continue;
+
+      if( req->second.prefetch )
+      {
+        double num_bytes = 4. * req->second.tile_size.x
+                              * req->second.tile_size.y;
+        if( in_flight >= max_prefetch || _prefetch_budget < num_bytes )
+          continue;
+
+        _prefetch_budget -= num_bytes;
+        ++_num_prefetch_sent;
+      }
+
+      HierarchicTileMapPtr tile_map = req->second.tile_map.lock();
+      float scale = 1/tile_map->getLayerScale(req->second.zoom);
+      Rect src( float2( req->second.x * tile_map->getTileWidth(),
+                        req->second.y * tile_map->getTileHeight() ),
+                req->second.tile_size );
+      src *= scale;
+      src.pos.x += tile_map->margin_left;
+
+      req->second.socket->sendTextMessage(QString(
+      "{"
+        "\"task\": \"GET\","
+        "\"id\": \"preview-tile\","
+        "\"size\": [" + QString::number(req->second.tile_size.x)
+                + "," + QString::number(req->second.tile_size.y)
+                + "],"
+        "\"sections_src\":" + to_string(tile_map->partitions_src).c_str() + ","
+        "\"sections_dest\":" + to_string(tile_map->partitions_dest).c_str() + ","
+        "\"src\": " + src.toString(true).c_str() + ","
+        "\"req_id\": " + QString::number(req->first) +
+      "}"));
+
+      req->second.sent = true;
+      req->second.time_stamp = now;
+      ++in_flight;
+    }
+  }
+
 } // namespace LinksRouting
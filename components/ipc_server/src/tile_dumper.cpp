@@ -0,0 +1,124 @@
+/*
+ * tile_dumper.cpp
+ *
+ * Debug sink writing received preview tiles as images to disk.
+ */
+
+#include "tile_dumper.hpp"
+#include "log.hpp"
+
+#include <QDir>
+#include <QImage>
+
+namespace LinksRouting
+{
+  /** Maximum number of tiles waiting to be written */
+  static const size_t MAX_QUEUED_TILES = 8;
+
+  //----------------------------------------------------------------------------
+  TileDumper::TileDumper():
+    _max_rate(2),
+    _num_written(0),
+    _stop(false)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  TileDumper::~TileDumper()
+  {
+    stop();
+  }
+
+  //----------------------------------------------------------------------------
+  void TileDumper::setDirectory(const QString& dir)
+  {
+    QMutexLocker lock(&_mutex);
+    _dir = dir;
+
+    if( !_dir.isEmpty() && !QDir().mkpath(_dir) )
+    {
+      LOG_WARN("Failed to create tile dump directory: " << _dir.toStdString());
+      _dir.clear();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void TileDumper::setMaxRate(int tiles_per_second)
+  {
+    QMutexLocker lock(&_mutex);
+    _max_rate = tiles_per_second;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TileDumper::isEnabled() const
+  {
+    QMutexLocker lock(&_mutex);
+    return !_dir.isEmpty() && _max_rate > 0;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TileDumper::enqueue(const Tile& tile)
+  {
+    QMutexLocker lock(&_mutex);
+    if( _dir.isEmpty() || _max_rate <= 0 || _tiles.size() >= MAX_QUEUED_TILES )
+      return false;
+
+    clock::time_point now = clock::now();
+    if( now - _last_enqueue < std::chrono::microseconds(1000000 / _max_rate) )
+      return false;
+
+    _last_enqueue = now;
+    _tiles.push_back(tile);
+    _cond_tiles.wakeOne();
+
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void TileDumper::stop()
+  {
+    {
+      QMutexLocker lock(&_mutex);
+      _stop = true;
+      _cond_tiles.wakeAll();
+    }
+    wait();
+  }
+
+  //----------------------------------------------------------------------------
+  void TileDumper::run()
+  {
+    QMutexLocker lock(&_mutex);
+    while( !_stop )
+    {
+      if( _tiles.empty() )
+      {
+        _cond_tiles.wait(&_mutex);
+        continue;
+      }
+
+      Tile tile = _tiles.front();
+      _tiles.pop_front();
+
+      QString file_name =
+        QString("%1/tile-%2-%3-%4-%5.png").arg(_dir)
+                                          .arg(_num_written++)
+                                          .arg(tile.zoom)
+                                          .arg(tile.x)
+                                          .arg(tile.y);
+      lock.unlock();
+
+      QImage img( reinterpret_cast<const uchar*>(tile.data.constData())
+                    + tile.offset,
+                  tile.width,
+                  tile.height,
+                  QImage::Format_ARGB32 );
+      if( !img.save(file_name) )
+        LOG_WARN("Failed to write tile: " << file_name.toStdString());
+
+      lock.relock();
+    }
+  }
+
+} // namespace LinksRouting
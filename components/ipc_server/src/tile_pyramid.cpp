@@ -0,0 +1,286 @@
+/*
+ * tile_pyramid.cpp
+ *
+ * Build lower zoom levels of preview tile maps from the tiles of the next
+ * higher level (2x2 box filter) in a background thread, instead of requesting
+ * them from the client again.
+ */
+
+#include "tile_pyramid.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || _M_IX86_FP >= 2
+# include <emmintrin.h>
+# define TILE_PYRAMID_SSE2
+#endif
+
+namespace LinksRouting
+{
+  //----------------------------------------------------------------------------
+  /**
+   * Average 2x2 blocks of two rows of 4 byte pixels
+   *
+   * @param num_pixels  Number of output pixels (input rows have twice as many)
+   */
+  static void boxFilterRows( const uint8_t* row0,
+                             const uint8_t* row1,
+                             uint8_t* out,
+                             size_t num_pixels )
+  {
+    size_t i = 0;
+
+#ifdef TILE_PYRAMID_SSE2
+    const __m128i zero = _mm_setzero_si128(),
+                  two = _mm_set1_epi16(2);
+
+    // Sum of both pixels in lanes 0-3 and 4-7 -> (p0 + p1) in lanes 0-3
+    auto sumPairs = [&zero](__m128i a, __m128i b, bool hi) -> __m128i
+    {
+      __m128i v = hi ? _mm_add_epi16( _mm_unpackhi_epi8(a, zero),
+                                      _mm_unpackhi_epi8(b, zero) )
+                     : _mm_add_epi16( _mm_unpacklo_epi8(a, zero),
+                                      _mm_unpacklo_epi8(b, zero) );
+      return _mm_add_epi16(v, _mm_srli_si128(v, 8));
+    };
+
+    // 4 output pixels from 8 input pixels per row
+    for(; i + 4 <= num_pixels; i += 4)
+    {
+      const __m128i* src0 = reinterpret_cast<const __m128i*>(row0 + 8 * i),
+                   * src1 = reinterpret_cast<const __m128i*>(row1 + 8 * i);
+      __m128i a0 = _mm_loadu_si128(src0),
+              a1 = _mm_loadu_si128(src1),
+              b0 = _mm_loadu_si128(src0 + 1),
+              b1 = _mm_loadu_si128(src1 + 1);
+
+      __m128i out01 = _mm_unpacklo_epi64( sumPairs(a0, a1, false),
+                                          sumPairs(a0, a1, true) ),
+              out23 = _mm_unpacklo_epi64( sumPairs(b0, b1, false),
+                                          sumPairs(b0, b1, true) );
+      out01 = _mm_srli_epi16(_mm_add_epi16(out01, two), 2);
+      out23 = _mm_srli_epi16(_mm_add_epi16(out23, two), 2);
+
+      _mm_storeu_si128( reinterpret_cast<__m128i*>(out + 4 * i),
+                        _mm_packus_epi16(out01, out23) );
+    }
+#endif
+
+    for(; i < num_pixels; ++i)
+      for(size_t c = 0; c < 4; ++c)
+        out[4 * i + c] = ( row0[8 * i + c] + row0[8 * i + 4 + c]
+                         + row1[8 * i + c] + row1[8 * i + 4 + c]
+                         + 2 ) >> 2;
+  }
+
+  //----------------------------------------------------------------------------
+  TilePyramid::TilePyramid():
+    _stop(false)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  TilePyramid::~TilePyramid()
+  {
+    stop();
+  }
+
+  //----------------------------------------------------------------------------
+  bool TilePyramid::enqueue( const HierarchicTileMapPtr& tile_map,
+                             size_t level, size_t x, size_t y )
+  {
+    if( !tile_map )
+      return false;
+
+    TileKey key(tile_map->getMapId(), level, x, y);
+
+    QMutexLocker lock(&_mutex);
+    if( _pending.count(key) )
+      return true;
+    lock.unlock();
+
+    Tile* tile = tile_map->findTile(x, y, level);
+    if( !tile || !tile->width || !tile->height )
+      return false;
+
+    Job job;
+    job.tile_map = tile_map;
+    job.map_id = tile_map->getMapId();
+    job.level = level;
+    job.x = x;
+    job.y = y;
+    job.width = tile->width;
+    job.height = tile->height;
+
+    for(size_t i = 0; i < 2; ++i)
+      for(size_t j = 0; j < 2; ++j)
+      {
+        Tile* child = tile_map->findTile(2 * x + i, 2 * y + j, level + 1);
+        if( !child )
+        {
+          // Outside of the next level (only possible at the right/bottom
+          // border), but the top left child is always required.
+          if( !i && !j )
+            return false;
+          continue;
+        }
+
+        // Cold tiles only need to be decompressed instead of requesting the
+        // parent from the client again
+        if( child->type == Tile::NONE && !child->compressed.empty() )
+          tile_map->decompressTile(*child, 2 * x + i, 2 * y + j, level + 1);
+
+        if( child->type != Tile::ImageRGBA8 )
+          return false;
+
+        job.children[i][j] = QByteArray(
+          reinterpret_cast<const char*>(child->pdata),
+          child->width * child->height * 4
+        );
+        if( !j )
+          job.child_width[i] = child->width;
+        if( !i )
+          job.child_height[j] = child->height;
+      }
+
+    if( job.children[1][0].isEmpty() )
+      job.child_width[1] = 0;
+    if( job.children[0][1].isEmpty() )
+      job.child_height[1] = 0;
+
+    lock.relock();
+    _pending.insert(key);
+    _jobs.push_back(job);
+    _cond_jobs.wakeOne();
+
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  TilePyramid::Results TilePyramid::takeResults()
+  {
+    Results results;
+
+    QMutexLocker lock(&_mutex);
+    results.swap(_results);
+
+    for(auto const& result: results)
+      _pending.erase(TileKey(result.map_id, result.level, result.x, result.y));
+
+    return results;
+  }
+
+  //----------------------------------------------------------------------------
+  void TilePyramid::stop()
+  {
+    {
+      QMutexLocker lock(&_mutex);
+      _stop = true;
+      _cond_jobs.wakeAll();
+    }
+    wait();
+  }
+
+  //----------------------------------------------------------------------------
+  QByteArray TilePyramid::downsample(const Job& job)
+  {
+    // Combine all children into a single image of twice the size of the tile
+    // to build, with the last column/row repeated if the children are smaller
+    // (eg. the next level is not exactly twice as large due to rounding).
+    const size_t src_width = 2 * job.width,
+                 src_height = 2 * job.height,
+                 src_stride = 4 * src_width;
+    const size_t width = std::min(src_width,
+                                  job.child_width[0] + job.child_width[1]),
+                 height = std::min(src_height,
+                                   job.child_height[0] + job.child_height[1]);
+    if( !width || !height )
+      return QByteArray();
+
+    std::vector<uint8_t> src(src_stride * src_height);
+    for(size_t i = 0; i < 2; ++i)
+      for(size_t j = 0; j < 2; ++j)
+      {
+        const QByteArray& child = job.children[i][j];
+        if( child.isEmpty() )
+          continue;
+
+        const size_t child_width = job.child_width[i],
+                     child_height = job.child_height[j],
+                     x = i * job.child_width[0],
+                     y = j * job.child_height[0];
+        if(    x >= width || y >= height
+            || static_cast<size_t>(child.size())
+               != 4 * child_width * child_height )
+          continue;
+
+        const size_t copy_width = std::min(child_width, width - x),
+                     copy_height = std::min(child_height, height - y);
+        for(size_t row = 0; row < copy_height; ++row)
+          std::memcpy( &src[(y + row) * src_stride + 4 * x],
+                       child.constData() + row * 4 * child_width,
+                       4 * copy_width );
+      }
+
+    for(size_t row = 0; row < height; ++row)
+    {
+      uint8_t* line = &src[row * src_stride];
+      for(size_t col = width; col < src_width; ++col)
+        std::memcpy(line + 4 * col, line + 4 * (width - 1), 4);
+    }
+    for(size_t row = height; row < src_height; ++row)
+      std::memcpy( &src[row * src_stride],
+                   &src[(height - 1) * src_stride],
+                   src_stride );
+
+    QByteArray pixels(4 * job.width * job.height, Qt::Uninitialized);
+    for(size_t row = 0; row < job.height; ++row)
+      boxFilterRows( &src[2 * row * src_stride],
+                     &src[(2 * row + 1) * src_stride],
+                     reinterpret_cast<uint8_t*>(pixels.data())
+                       + 4 * row * job.width,
+                     job.width );
+
+    return pixels;
+  }
+
+  //----------------------------------------------------------------------------
+  void TilePyramid::run()
+  {
+    QMutexLocker lock(&_mutex);
+    while( !_stop )
+    {
+      if( _jobs.empty() )
+      {
+        _cond_jobs.wait(&_mutex);
+        continue;
+      }
+
+      Job job = _jobs.front();
+      _jobs.pop_front();
+
+      lock.unlock();
+      Result result = {
+        job.tile_map,
+        job.map_id,
+        job.level,
+        job.x,
+        job.y,
+        downsample(job)
+      };
+      lock.relock();
+
+      _results.push_back(result);
+      if( _jobs.empty() || _results.size() >= 4 )
+      {
+        // Notify only after a batch of tiles to reduce the number of events
+        lock.unlock();
+        emit tilesBuilt();
+        lock.relock();
+      }
+    }
+  }
+
+} // namespace LinksRouting
@@ -16,6 +16,9 @@
 #include <QProcess>
 #include <QWindow>
 
+#include <algorithm>
+#include <cassert>
+
 //#define WINDOW_MONITOR_LOG_REGION_CHANGES
 
 namespace LinksRouting
@@ -27,11 +30,38 @@ namespace LinksRouting
                 << r.width() << "x" << r.height();
   }
 
+  /**
+   * Compare windows including title and process id (ignored by
+   * WindowInfo::operator==), as they are used for matching clients to windows.
+   */
+  static bool sameWindows(const WindowInfos& lhs, const WindowInfos& rhs)
+  {
+    return lhs.size() == rhs.size()
+        && std::equal
+           (
+             lhs.begin(),
+             lhs.end(),
+             rhs.begin(),
+             [](const WindowInfo& a, const WindowInfo& b)
+             {
+               return a == b && a.pid == b.pid && a.title == b.title;
+             }
+           );
+  }
+
   //----------------------------------------------------------------------------
-  WindowRegions::WindowRegions(const WindowInfos& windows):
-    _windows(windows)
+  WindowRegions::WindowRegions( const WindowInfosPtr& windows,
+                                uint64_t generation ):
+    _windows(windows),
+    _generation(generation)
   {
+    assert(_windows);
+  }
 
+  //----------------------------------------------------------------------------
+  uint64_t WindowRegions::generation() const
+  {
+    return _generation;
   }
 
   //----------------------------------------------------------------------------
@@ -39,8 +69,8 @@ namespace LinksRouting
   {
     return std::find_if
     (
-      _windows.begin(),
-      _windows.end(),
+      _windows->begin(),
+      _windows->end(),
       [wid](const WindowInfo& winfo)
       {
         return winfo.id == wid;
@@ -57,8 +87,8 @@ namespace LinksRouting
 
     return std::find_if
     (
-      _windows.begin(),
-      _windows.end(),
+      _windows->begin(),
+      _windows->end(),
       [pid, &title](const WindowInfo& winfo)
       {
         return winfo.pid == pid
@@ -75,7 +105,7 @@ namespace LinksRouting
                                            << title.toStdString() << "'" );
 
     WindowInfoIterators its;
-    for(auto w = _windows.begin(); w != _windows.end(); ++w)
+    for(auto w = _windows->begin(); w != _windows->end(); ++w)
       if( w->pid == pid && (title.isEmpty() || w->title.startsWith(title)) )
         its.push_back(w);
 
@@ -88,7 +118,7 @@ namespace LinksRouting
     LOG_DEBUG("Find all windows by title '" << title.toStdString() << "'");
 
     WindowInfoIterators its;
-    for(auto w = _windows.begin(); w != _windows.end(); ++w)
+    for(auto w = _windows->begin(); w != _windows->end(); ++w)
       if( w->title.startsWith(title) )
         its.push_back(w);
 
@@ -101,8 +131,8 @@ namespace LinksRouting
     LOG_DEBUG("Find window by title '" << title.toStdString() << "'");
     return std::find_if
     (
-      _windows.begin(),
-      _windows.end(),
+      _windows->begin(),
+      _windows->end(),
       [&title](const WindowInfo& winfo)
       {
         return winfo.title.startsWith(title);
@@ -114,7 +144,7 @@ namespace LinksRouting
   WId WindowRegions::findId(const QString& title) const
   {
     auto win = find(title);
-    if( win != _windows.end() )
+    if( win != _windows->end() )
       return win->id;
     return 0;
   }
@@ -123,7 +153,7 @@ namespace LinksRouting
   WId WindowRegions::findId(uint32_t pid, const QString& title) const
   {
     auto win = find(pid, title);
-    if( win != _windows.end() )
+    if( win != _windows->end() )
       return win->id;
     return 0;
   }
@@ -131,44 +161,44 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   WindowInfos::const_iterator WindowRegions::begin() const
   {
-    return _windows.begin();
+    return _windows->begin();
   }
 
   //----------------------------------------------------------------------------
   WindowInfos::const_iterator WindowRegions::end() const
   {
-    return _windows.end();
+    return _windows->end();
   }
 
   //----------------------------------------------------------------------------
   WindowInfos::const_reverse_iterator WindowRegions::rbegin() const
   {
-    return _windows.rbegin();
+    return _windows->rbegin();
   }
 
   //----------------------------------------------------------------------------
   WindowInfos::const_reverse_iterator WindowRegions::rend() const
   {
-    return _windows.rend();
+    return _windows->rend();
   }
 
   //----------------------------------------------------------------------------
   WindowInfos::const_reverse_iterator
   WindowRegions::windowAt(const QPoint& pos) const
   {
-    for( auto reg = _windows.rbegin(); reg != _windows.rend(); ++reg )
+    for( auto reg = _windows->rbegin(); reg != _windows->rend(); ++reg )
     {
       if( reg->region.contains(pos) )
         return reg;
     }
-    return _windows.rend();
+    return _windows->rend();
   }
 
   //----------------------------------------------------------------------------
   WId WindowRegions::windowIdAt(const QPoint& point) const
   {
     auto window = windowAt(point);
-    if( window != _windows.rend() )
+    if( window != _windows->rend() )
       return window->id;
 
     return 0;
@@ -180,7 +210,7 @@ namespace LinksRouting
                            Rect* reg,
                            WId* wid ) const
   {
-    for(auto it = first_above; it != _windows.end(); ++it)
+    for(auto it = first_above; it != _windows->end(); ++it)
       if( !it->minimized && it->region.contains(point) )
       {
         if( reg )
@@ -196,16 +226,23 @@ namespace LinksRouting
   WindowMonitor::WindowMonitor(RegionsCallback cb_regions_changed):
 	_timeout(-1),
 	_cb_regions_changed(cb_regions_changed),
-	_launcher_size(0)
+	_launcher_size(0),
+	_generation(0)
   {
 	connect(&_timer, SIGNAL(timeout()), this, SLOT(check()));
 	_timer.start(150);
   }
 
   //----------------------------------------------------------------------------
-  WindowRegions WindowMonitor::getWindows() const
+  WindowRegions WindowMonitor::getWindows(bool refresh) const
   {
-    return WindowRegions( getWindowInfos() );
+    {
+      QMutexLocker lock(&_snapshot_mutex);
+      if( _snapshot && !refresh )
+        return WindowRegions(_snapshot, _generation);
+    }
+
+    return publish( getWindowInfos() );
   }
 
   //----------------------------------------------------------------------------
@@ -333,6 +370,19 @@ namespace LinksRouting
     return regions;
   }
 
+  //----------------------------------------------------------------------------
+  WindowRegions WindowMonitor::publish(const WindowInfos& windows) const
+  {
+    QMutexLocker lock(&_snapshot_mutex);
+    if( !_snapshot || !sameWindows(*_snapshot, windows) )
+    {
+      _snapshot = std::make_shared<WindowInfos>(windows);
+      _generation += 1;
+    }
+
+    return WindowRegions(_snapshot, _generation);
+  }
+
   //----------------------------------------------------------------------------
   void WindowMonitor::check()
   {
@@ -346,6 +396,8 @@ namespace LinksRouting
 #endif
 
     WindowInfos regions = getWindowInfos();
+    publish(regions);
+
     if( regions != _last_regions )
       _timeout = 2;
     _last_regions = regions;
@@ -367,7 +419,7 @@ namespace LinksRouting
     if( launchers != _launchers )
     {
       _launchers = launchers;
-      _cb_regions_changed( getWindows() );
+      _cb_regions_changed( publish(getWindowInfos()) );
     }
 #endif
 
@@ -389,7 +441,7 @@ namespace LinksRouting
                     << std::endl;
         }
 #endif
-        _cb_regions_changed( WindowRegions(regions) );
+        _cb_regions_changed( publish(regions) );
       }
       _timeout -= 1;
     }
@@ -0,0 +1,211 @@
+/*
+ * tile_pyramid_test.cpp
+ *
+ * Compare TilePyramid::downsample (assembling the children and the SIMD box
+ * filter) with a straightforward per pixel implementation on random tiles,
+ * and check that compressed (cold) children are used instead of requesting
+ * the tile from the client again.
+ */
+
+#include "tile_pyramid.hpp"
+#include "TileCompressor.hpp"
+
+#include <QThread>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using LinksRouting::TilePyramid;
+
+namespace
+{
+  /**
+   * Build the given tile from random children and compare it with averaging
+   * every 2x2 block of the combined children (last column/row repeated).
+   *
+   * @return Whether the result matches
+   */
+  bool testDownsample(std::mt19937& rng)
+  {
+    std::uniform_int_distribution<int> rand_byte(0, 255);
+    const size_t tile_width = rng() % 40 + 1,
+                 tile_height = rng() % 12 + 1;
+
+    TilePyramid::Job job;
+    job.width = rng() % tile_width + 1;
+    job.height = rng() % tile_height + 1;
+
+    // Only the children in the last column/row can be smaller (or missing),
+    // but there are always enough pixels for all except the last column/row.
+    job.child_width[0] = tile_width;
+    job.child_width[1] = std::max<size_t>( rng() % (tile_width + 1),
+                                           2 * job.width > tile_width + 1
+                                             ? 2 * job.width - tile_width - 1
+                                             : 0 );
+    job.child_height[0] = tile_height;
+    job.child_height[1] = std::max<size_t>( rng() % (tile_height + 1),
+                                            2 * job.height > tile_height + 1
+                                              ? 2 * job.height - tile_height - 1
+                                              : 0 );
+
+    const size_t width = job.child_width[0] + job.child_width[1],
+                 height = job.child_height[0] + job.child_height[1];
+    std::vector<uint8_t> src(4 * width * height);
+    for(auto& val: src)
+      val = rand_byte(rng);
+
+    for(size_t i = 0; i < 2; ++i)
+      for(size_t j = 0; j < 2; ++j)
+      {
+        const size_t child_width = job.child_width[i],
+                     child_height = job.child_height[j];
+        if( !child_width || !child_height )
+          continue;
+
+        QByteArray child(4 * child_width * child_height, Qt::Uninitialized);
+        for(size_t y = 0; y < child_height; ++y)
+          std::copy_n( &src[4 * ( (j * tile_height + y) * width
+                                + i * tile_width )],
+                       4 * child_width,
+                       child.data() + 4 * y * child_width );
+        job.children[i][j] = child;
+      }
+
+    const QByteArray pixels = TilePyramid::downsample(job);
+    if( static_cast<size_t>(pixels.size()) != 4 * job.width * job.height )
+    {
+      std::printf( "%dx%d: got %d bytes\n",
+                   static_cast<int>(job.width),
+                   static_cast<int>(job.height),
+                   pixels.size() );
+      return false;
+    }
+
+    const size_t w = std::min(width, 2 * job.width),
+                 h = std::min(height, 2 * job.height);
+    auto srcPixel = [&](size_t x, size_t y, size_t c) -> int
+    {
+      return src[4 * (std::min(y, h - 1) * width + std::min(x, w - 1)) + c];
+    };
+
+    for(size_t y = 0; y < job.height; ++y)
+      for(size_t x = 0; x < job.width; ++x)
+        for(size_t c = 0; c < 4; ++c)
+        {
+          const int expected = ( srcPixel(2 * x,     2 * y,     c)
+                               + srcPixel(2 * x + 1, 2 * y,     c)
+                               + srcPixel(2 * x,     2 * y + 1, c)
+                               + srcPixel(2 * x + 1, 2 * y + 1, c)
+                               + 2 ) >> 2;
+          const int val = static_cast<uint8_t>(
+            pixels.constData()[4 * (y * job.width + x) + c]
+          );
+          if( val != expected )
+          {
+            std::printf( "%dx%d: pixel (%d, %d)[%d] = %d (expected %d)\n",
+                         static_cast<int>(job.width),
+                         static_cast<int>(job.height),
+                         static_cast<int>(x),
+                         static_cast<int>(y),
+                         static_cast<int>(c),
+                         val,
+                         expected );
+            return false;
+          }
+        }
+
+    return true;
+  }
+
+  /**
+   * Build the single tile of level 0 from four compressed tiles of level 1
+   *
+   * @return Whether the tile has been built from the cold children
+   */
+  bool testColdChildren()
+  {
+    const unsigned int tile_size = 16;
+    auto tile_map = std::make_shared<HierarchicTileMap>( 2 * tile_size,
+                                                         2 * tile_size,
+                                                         tile_size,
+                                                         tile_size );
+
+    // Initialize level 0 (zoom = level)
+    tile_map->requestRect(Rect(float2(0, 0), float2(1, 1)), 0);
+
+    // One color per child
+    const uint8_t colors[2][2] = {{10, 50}, {90, 130}};
+    for(size_t i = 0; i < 2; ++i)
+      for(size_t j = 0; j < 2; ++j)
+      {
+        const QByteArray data(4 * tile_size * tile_size, colors[i][j]);
+        tile_map->setTileData(i, j, 1, data.constData(), data.size());
+
+        std::vector<uint8_t> compressed;
+        if(    !TileCompressor::compress(data, compressed)
+            || !tile_map->setCompressedTile(i, j, 1, compressed) )
+        {
+          std::printf("Failed to compress tile (%d, %d)\n", (int)i, (int)j);
+          return false;
+        }
+      }
+
+    TilePyramid pyramid;
+    pyramid.start();
+    if( !pyramid.enqueue(tile_map, 0, 0, 0) )
+    {
+      std::printf("Tile with cold children not built\n");
+      return false;
+    }
+
+    TilePyramid::Results results;
+    for(int wait = 0; wait < 500 && results.empty(); ++wait)
+    {
+      QThread::msleep(10);
+      results = pyramid.takeResults();
+    }
+
+    if( results.size() != 1 )
+    {
+      std::printf("Got %d results\n", static_cast<int>(results.size()));
+      return false;
+    }
+
+    const QByteArray& pixels = results.front().pixels;
+    const size_t half = tile_size / 2;
+    for(size_t i = 0; i < 2; ++i)
+      for(size_t j = 0; j < 2; ++j)
+      {
+        const size_t pos = 4 * ((j * half + half / 2) * tile_size
+                              + i * half + half / 2);
+        if( static_cast<uint8_t>(pixels.constData()[pos]) != colors[i][j] )
+        {
+          std::printf("Wrong pixels of child (%d, %d)\n", (int)i, (int)j);
+          return false;
+        }
+      }
+
+    return true;
+  }
+}
+
+int main()
+{
+  std::mt19937 rng(42);
+
+  int failures = 0;
+  for(int test = 0; test < 2000; ++test)
+    if( !testDownsample(rng) )
+      ++failures;
+
+  if( !testColdChildren() )
+    ++failures;
+
+  if( failures )
+    std::printf("%d tests failed\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -6,6 +6,7 @@
 
 #include "fbo.h"
 #include "glsl/glsl.h"
+#include "LinkGeometry.hpp"
 #include "slots.hpp"
 #include "slotdata/image.hpp"
 #include "slotdata/text_popup.hpp"
@@ -48,6 +49,7 @@ namespace LinksRouting
 
       /** Subscribe to the routed links */
       slot_t<LinkDescription::LinkList>::type _subscribe_links;
+      slot_t<uint32_t>::type _subscribe_links_revision;
       slot_t<SlotType::TextPopup>::type _subscribe_popups;
       slot_t<SlotType::XRayPopup>::type _subscribe_xray;
       slot_t<SlotType::CoveredOutline>::type _subscribe_outlines;
@@ -64,6 +66,9 @@ namespace LinksRouting
       cwc::glShader*        _blur_x_shader;
       cwc::glShader*        _blur_y_shader;
 
+      /** Publish the retained geometry of links and regions */
+      slot_t<LinkGeometry>::type _slot_link_geometry;
+
       typedef std::queue<const LinkDescription::HyperEdge*> HyperEdgeQueue;
       typedef std::set<const LinkDescription::HyperEdge*> HyperEdgeSet;
 
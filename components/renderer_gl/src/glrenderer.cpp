@@ -45,6 +45,10 @@ namespace LinksRouting
 
     _slot_xray = slot_collector.create<SlotType::Image>("/rendered-xray");
     _slot_xray->_data->type = SlotType::Image::OpenGLTexture;
+
+    _slot_link_geometry =
+      slot_collector.create<LinkGeometry>("/rendered-links/geometry");
+    _slot_link_geometry->setValid(true);
   }
 
   //----------------------------------------------------------------------------
@@ -52,6 +56,8 @@ namespace LinksRouting
   {
     _subscribe_links =
       slot_subscriber.getSlot<LinkDescription::LinkList>("/links");
+    _subscribe_links_revision =
+      slot_subscriber.getSlot<uint32_t>("/links/revision");
     _subscribe_popups =
       slot_subscriber.getSlot<SlotType::TextPopup>("/popups");
     _subscribe_xray =
@@ -128,6 +134,10 @@ namespace LinksRouting
 
     if( _subscribe_links->_data->empty() )
     {
+      // Still publish the (now empty) geometry, so that the bounds of removed
+      // links are damaged
+      _slot_link_geometry->_data->update( *_subscribe_links->_data,
+                                          *_subscribe_links_revision->_data );
       _links_fbo.unbind();
       return 0;
     }
@@ -284,8 +294,17 @@ namespace LinksRouting
   bool GlRenderer::renderLinks( const LinkDescription::LinkList& links,
                                 int pass )
   {
+    if( pass > 0 )
+    {
+      // Links and regions are only extruded again if anything has changed
+      LinkGeometry& geometry = *_slot_link_geometry->_data;
+      geometry.update(links, *_subscribe_links_revision->_data);
+      return geometry.render(true);
+    }
+
+    // First pass renders the highlights of hovered covered regions, which
+    // change with every animation step and are therefore not retained.
     bool rendered_anything = false;
-    _color_cur = QColor(255, 50, 50);
 
     NodeRenderer renderer;
     renderer.setUseStencil(true);
@@ -310,11 +329,6 @@ namespace LinksRouting
         if( hedges_done.find(hedge) != hedges_done.end() )
           continue;
 
-        if( hedge->get<bool>("covered") || hedge->get<bool>("outside") )
-          qtGlColor(_color_covered_cur);
-        else
-          qtGlColor(_color_cur);
-
         auto fork = hedge->getHyperEdgeDescription();
         if( !fork )
         {
@@ -327,72 +341,12 @@ namespace LinksRouting
         }
         else
         {
-          // Don't draw where region highlights already have been drawn
-          glStencilFunc(GL_EQUAL, 0, 1);
-          glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-
-          LinkDescription::nodes_t nodes;
           for( auto& segment: fork->outgoing )
-          {
-            if(     pass == 1
-                && !segment.trail.empty()
-                /*&& segment.trail.front().x >= 0
-                && segment.trail.front().y >= 24*/ )
-            {
-              // Draw path
-              float widen_size = 0.f;
-              if(   !segment.nodes.empty()
-                  && segment.nodes.back()->getChildren().empty()
-                  && segment.get<bool>("widen-end", true) )
-              {
-                if( !segment.nodes.back()
-                            ->get<std::string>("virtual-outside").empty() )
-                  widen_size = 13;
-                else
-                  widen_size = 55;
-              }
-              line_borders_t region = calcLineBorders( segment.trail,
-                                                       3,
-                                                       false,
-                                                       widen_size );
-
-              qtGlColor(   segment.get<bool>("covered")
-                        ? _color_covered_cur
-                        : _color_cur );
-              glBegin(GL_TRIANGLE_STRIP);
-              for( auto first = std::begin(region.first),
-                        second = std::begin(region.second);
-                   first != std::end(region.first);
-                   ++first,
-                   ++second )
-              {
-                glVertex2f(first->x, first->y);
-                glVertex2f(second->x, second->y);
-              }
-              glEnd();
-            }
-
-            // Collect nodes for drawing them after the links to prevent links
-            // crossing regions.
-//            nodes.insert( nodes.end(),
-//                          segment.nodes.begin(),
-//                          segment.nodes.end() );
-
             rendered_anything |= renderer.renderNodes( segment.nodes,
                                                        &hedges_open,
                                                        &hedges_done,
                                                        false,
                                                        pass );
-
-//            std::cout << "addSegmentNodes" << std::endl;
-//            LinkDescription::printNodeList(segment.nodes);
-          }
-
-          rendered_anything |= renderer.renderNodes( nodes,
-                                                     &hedges_open,
-                                                     &hedges_done,
-                                                     false,
-                                                     pass );
         }
 
         hedges_done.insert(hedge);
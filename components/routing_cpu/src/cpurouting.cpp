@@ -61,7 +61,7 @@ namespace LinksRouting
       points.push_back(center += 9 * normal);
     }
 
-    auto node = std::make_shared<LinkDescription::Node>(
+    auto node = make_pooled<LinkDescription::Node>(
       points,
       link_points,
       link_points_children
@@ -470,7 +470,7 @@ namespace LinksRouting
     bool no_route = hedge->get<bool>("no-route");
 
     auto fork =
-      std::make_shared<LinkDescription::HyperEdgeDescriptionForkation>();
+      make_pooled<LinkDescription::HyperEdgeDescriptionForkation>();
     hedge->setHyperEdgeDescription(fork);
     fork->position = hedge->getCenter();
 
@@ -550,7 +550,7 @@ namespace LinksRouting
       assert( !group.second.empty() );
       float2 center;
 
-      std::set<segment_iterator, cmp_by_angle> group_segments;
+      OrderedSegments group_segments;
 
       if( link_covered )
       {
@@ -645,8 +645,8 @@ namespace LinksRouting
            s2 = ++group_segments.begin();
       for(; s2 != group_segments.end(); ++s1, ++s2)
       {
-        if( normalizePi( cmp_by_angle::getAngle(*s2)
-                       - cmp_by_angle::getAngle(*s1) ) > M_PI / 2 )
+        if( normalizePi( getAngle((*s2)->trail)
+                       - getAngle((*s1)->trail) ) > M_PI / 2 )
           continue;
 
         float2 const& p1 = (*s1)->trail.back(),
@@ -716,7 +716,7 @@ namespace LinksRouting
     bool no_route = hedge->get<bool>("no-route");
 
     auto fork =
-      std::make_shared<LinkDescription::HyperEdgeDescriptionForkation>();
+      make_pooled<LinkDescription::HyperEdgeDescriptionForkation>();
     hedge->setHyperEdgeDescription(fork);
     fork->position = hedge->getCenter();
 
@@ -815,6 +815,7 @@ namespace LinksRouting
     // Danny Holten and Jarke J. van Wijk
 
     std::vector<std::vector<float2>> segment_forces(segments.size());
+    std::vector<float> angles(segments.size());
 
     int num_iterations = _initial_iterations;
     float step_size = _initial_step_size;
@@ -847,6 +848,10 @@ namespace LinksRouting
 
       for(int iter = 0; iter < num_iterations; ++iter)
       {
+        // Directions only change after applying the forces
+        for(size_t i = 0; i < segments.size(); ++i)
+          angles[i] = getAngle(segments[i]->trail);
+
         // Calculate forces
         for(int i = 0; i < static_cast<int>(segments.size()); ++i)
         {
@@ -871,9 +876,7 @@ namespace LinksRouting
                 continue;
 
               int other_i = (i + offset) % segments.size();
-              float delta_angle =
-                normalizePi( cmp_by_angle::getAngle(segments[i]->trail)
-                           - cmp_by_angle::getAngle(segments[other_i]->trail) );
+              float delta_angle = normalizePi(angles[i] - angles[other_i]);
 
               if( std::fabs(delta_angle) > 0.7 * M_PI )
                 continue;
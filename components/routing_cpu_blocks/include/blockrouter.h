@@ -0,0 +1,260 @@
+#ifndef LR_BLOCKROUTER
+#define LR_BLOCKROUTER
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace LinksRouting
+{
+namespace Blocks
+{
+  /** Cost of unreachable positions */
+  const float MAX_COST = 1e30f;
+
+  /**
+   * Rectangle in cost map pixels ([x0, x1) x [y0, y1))
+   */
+  struct Target
+  {
+    int x0, y0, x1, y1;
+
+    Target(int _x0 = 0, int _y0 = 0, int _x1 = 0, int _y1 = 0):
+      x0(_x0), y0(_y0), x1(_x1), y1(_y1)
+    { }
+
+    bool contains(int x, int y) const
+    {
+      return x >= x0 && x < x1 && y >= y0 && y < y1;
+    }
+  };
+
+  /**
+   * Queues of work items (one per worker thread). Workers take items from
+   * the front of their own queue and steal from the back of other queues if
+   * they run out of work. Every item is queued at most once at a time.
+   */
+  class WorkQueue
+  {
+    public:
+
+      WorkQueue();
+
+      void reset(size_t num_items, size_t num_queues);
+
+      /**
+       * @return false if the item is already queued
+       */
+      bool push(size_t queue, uint32_t item);
+      bool pop(size_t queue, uint32_t& item);
+
+      /** Mark a popped item as processed */
+      void done();
+
+      /** No items queued and none in progress */
+      bool finished() const;
+
+    private:
+
+      struct Queue
+      {
+        std::mutex            mutex;
+        std::deque<uint32_t>  items;
+      };
+
+      std::unique_ptr<Queue[]>              _queues;
+      size_t                                _num_queues;
+      std::unique_ptr<std::atomic<bool>[]>  _queued;
+      size_t                                _num_items;
+      std::atomic<size_t>                   _pending;
+  };
+
+  /**
+   * Worker threads kept alive between calls to run(), which executes a
+   * function on all workers and the calling thread at once.
+   */
+  class ThreadPool
+  {
+    public:
+
+      typedef std::function<void(size_t thread)> Func;
+
+      ThreadPool();
+      ~ThreadPool();
+
+      /**
+       * @param num_threads   Number of threads including the calling thread
+       */
+      void resize(size_t num_threads);
+      size_t size() const { return _threads.size() + 1; }
+
+      /**
+       * Run func(thread) on all threads (the calling thread is thread 0) and
+       * wait until it has returned on every thread.
+       */
+      void run(const Func& func);
+
+    private:
+
+      std::vector<std::thread>  _threads;
+      std::mutex                _mutex;
+      std::condition_variable   _cond_start,
+                                _cond_done;
+      const Func               *_func;
+      size_t                    _generation,  //!< Incremented for every run
+                                _num_running;
+      bool                      _stop;
+
+      void work(size_t thread, size_t generation);
+
+      ThreadPool(const ThreadPool&) /* = delete */;
+      ThreadPool& operator=(const ThreadPool&) /* = delete */;
+  };
+
+  /**
+   * Cost-aware routing on blocks of the cost map (same algorithm as the
+   * OpenCL GPURouting, running on all CPU cores).
+   *
+   * The cost map is split into blocks which overlap by one pixel. For every
+   * block the costs between all of its border pixels are precomputed (route
+   * map). Routing to a target only has to propagate costs between the
+   * borders of neighbouring blocks, which is done on a queue of blocks shared
+   * by all threads.
+   */
+  class Router
+  {
+    public:
+
+      typedef std::pair<int, int> Pos;
+      typedef std::vector<Pos> Path;
+
+      Router();
+
+      /**
+       * @param num_threads   Number of worker threads (0 = number of cores)
+       * @param block_x       Block width (including the shared border)
+       * @param block_y       Block height (including the shared border)
+       * @param cost_factor   Weight of the cost map relative to the distance
+       */
+      void configure( int num_threads,
+                      int block_x,
+                      int block_y,
+                      float cost_factor );
+
+      /**
+       * Set the cost map and update the route maps of all blocks whose costs
+       * have changed.
+       *
+       * @return Number of updated blocks
+       */
+      size_t updateCostMap(const float* costs, int width, int height);
+
+      /**
+       * Calculate the cost to reach every block border from each target (one
+       * cost slice per target).
+       */
+      void route(const std::vector<Target>& targets);
+
+      /**
+       * Find the position with the minimal sum of the costs to all targets.
+       *
+       * @return false if no target can be reached
+       */
+      bool findMinimum(Pos& pos);
+
+      /**
+       * Get the cheapest path from the given position to a target.
+       */
+      Path trace(size_t target, const Pos& pos);
+
+      int width() const  { return _width; }
+      int height() const { return _height; }
+
+    protected:
+
+      /** Temporary buffers (one per thread) */
+      struct Scratch
+      {
+        std::vector<float>  costs,
+                            field,
+                            in,
+                            out;
+        std::vector<std::pair<float, int>> heap;
+      };
+
+      int     _num_threads,
+              _block_x,
+              _block_y;
+      float   _cost_factor;
+
+      int     _width,
+              _height,
+              _blocks_x,
+              _blocks_y,
+              _border,      //!< Border pixels per block
+              _stride;      //!< _border rounded up for SIMD
+
+      std::vector<float>    _costs;
+      std::vector<float>    _route_maps;    //!< _border x _stride per block
+      std::vector<uint32_t> _element_ids;   //!< Global border id per block
+      std::vector<int>      _border_pixels; //!< Border id -> block pixel
+      std::vector<uint8_t>  _border_dirs;   //!< Border id -> neighbour blocks
+
+      size_t                                _num_elements,
+                                            _slices_size;
+      std::unique_ptr<std::atomic<float>[]> _slices;
+      std::vector<Target>                   _targets;
+
+      std::vector<Scratch>  _scratch;    //!< One per thread of _pool
+      WorkQueue             _queue;
+      ThreadPool            _pool;
+
+      void layout(int width, int height);
+      size_t numBlocks() const { return _blocks_x * _blocks_y; }
+      size_t numThreads() const { return _pool.size(); }
+
+      std::atomic<float>* slice(size_t target)
+      {
+        return &_slices[target * _num_elements];
+      }
+
+      /** Costs of the pixels of a block (outside of the map is blocked) */
+      void blockCosts(size_t block, std::vector<float>& costs) const;
+
+      /** Shortest paths inside a block from all pixels with finite cost */
+      void localField(Scratch& scratch) const;
+
+      /** Costs of all pixels of a block to reach a target */
+      void blockField(size_t target, size_t block, Scratch& scratch);
+
+      void updateRouteMap(size_t block, Scratch& scratch);
+      void seed(size_t target, Scratch& scratch);
+      void relax(size_t target, size_t block, size_t thread, Scratch& scratch);
+
+      /** Queue the neighbours of a block sharing the given borders */
+      void pushNeighbours( size_t target,
+                           size_t block,
+                           uint8_t dirs,
+                           size_t thread );
+
+      /**
+       * Run workers on all threads until the queue is empty
+       *
+       * @param func  void(size_t thread, uint32_t item)
+       */
+      template<class Func>
+      void runQueue(const Func& func);
+  };
+
+} // namespace Blocks
+} // namespace LinksRouting
+
+#endif //LR_BLOCKROUTER
@@ -0,0 +1,84 @@
+#ifndef LR_CPUROUTING_BLOCKS
+#define LR_CPUROUTING_BLOCKS
+
+#include "routing.h"
+#include "common/componentarguments.h"
+
+#include "slots.hpp"
+#include "slotdata/image.hpp"
+
+#include "blockrouter.h"
+
+#ifndef QWINDOWDEFS_H
+#ifdef _WIN32
+# include <windows.h>
+  typedef HWND WId;
+#else
+  typedef unsigned long WId;
+#endif
+#endif
+
+namespace LinksRouting
+{
+namespace Blocks
+{
+  /**
+   * Cost-aware routing on the CPU using the block based algorithm of the
+   * OpenCL GPURouting (see Blocks::Router).
+   *
+   * Uses the cost map from /costmap if it is available in memory
+   * (ImageGray32F, eg. from CpuCostAnalysis), otherwise routes on a grid with
+   * uniform costs.
+   */
+  class CPURouting: public Routing, public ComponentArguments
+  {
+    public:
+
+      typedef std::map<WId, std::vector<LinkDescription::NodePtr>> RegionGroups;
+
+      CPURouting();
+
+      void publishSlots(SlotCollector& slots);
+      void subscribeSlots(SlotSubscriber& slot_subscriber);
+
+      bool startup(Core* core, unsigned int type);
+      void init();
+      void shutdown();
+      bool supports(unsigned int type) const
+      {
+        return (type & Component::Routing);
+      }
+
+      uint32_t process(unsigned int type) override;
+
+    private:
+
+      int    _block_size_x,
+             _block_size_y,
+             _num_threads,   //!< Worker threads (0 = number of cores)
+             _grid_size;     //!< Cell size without cost map (desktop pixels)
+      double _cost_factor;
+
+      slot_t<LinkDescription::LinkList>::type _subscribe_links;
+      slot_t<SlotType::Image>::type           _subscribe_costmap;
+
+      /* Drawable desktop region */
+      slot_t<Rect>::type _subscribe_desktop_rect;
+
+      RegionGroups        _global_route_nodes;
+      Router              _router;
+      std::vector<float>  _uniform_costs;
+
+      /**
+       * Update the router with the current cost map
+       *
+       * @return Size of cost map pixels (desktop pixels)
+       */
+      float updateCostMap();
+
+      void collectNodes(LinkDescription::HyperEdge* hedge);
+  };
+}
+}
+
+#endif //LR_CPUROUTING_BLOCKS
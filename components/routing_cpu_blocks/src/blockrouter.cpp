@@ -0,0 +1,810 @@
+#include "blockrouter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#ifdef __SSE__
+# include <xmmintrin.h>
+#endif
+
+namespace LinksRouting
+{
+namespace Blocks
+{
+  namespace
+  {
+    /** Penalty of pixels outside of the cost map (never routed through) */
+    const float OUTSIDE_COST = 1e9f;
+
+    /** Minimal improvement to propagate a border cost (as in routing.cl) */
+    const float COST_EPS = 0.0001f;
+
+    /** Minimal change of the cost map to update a route map (as GPURouting) */
+    const float COST_MAP_EPS = 0.01f;
+
+    const float SQRT2 = 1.41421356f;
+
+    // Directions to neighbour blocks/pixels
+    const int DIR_X[8] = { -1, 1,  0, 0, -1,  1, -1, 1 };
+    const int DIR_Y[8] = {  0, 0, -1, 1, -1, -1,  1, 1 };
+
+    int divup(int x, int y)
+    {
+      return (x + y - 1) / y;
+    }
+
+    /**
+     * Lower a shared cost
+     *
+     * @return true if the cost has been lowered
+     */
+    bool lowerTo(std::atomic<float>& cost, float value)
+    {
+      float cur = cost.load(std::memory_order_relaxed);
+      while( value < cur )
+        if( cost.compare_exchange_weak(cur, value, std::memory_order_relaxed) )
+          return true;
+      return false;
+    }
+
+    /**
+     * out[i] = min(out[i], value + row[i])  (n multiple of 4)
+     */
+    void relaxRow(float* out, const float* row, float value, int n)
+    {
+#ifdef __SSE__
+      const __m128 v = _mm_set1_ps(value);
+      for(int i = 0; i < n; i += 4)
+        _mm_storeu_ps( out + i,
+                       _mm_min_ps( _mm_loadu_ps(out + i),
+                                   _mm_add_ps(v, _mm_loadu_ps(row + i)) ) );
+#else
+      for(int i = 0; i < n; ++i)
+        out[i] = std::min(out[i], value + row[i]);
+#endif
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  ThreadPool::ThreadPool():
+    _func(nullptr),
+    _generation(0),
+    _num_running(0),
+    _stop(false)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  ThreadPool::~ThreadPool()
+  {
+    resize(1);
+  }
+
+  //----------------------------------------------------------------------------
+  void ThreadPool::resize(size_t num_threads)
+  {
+    num_threads = std::max<size_t>(num_threads, 1);
+    if( num_threads == size() )
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _cond_start.notify_all();
+    for(auto& thread: _threads)
+      thread.join();
+    _threads.clear();
+
+    _stop = false;
+    for(size_t i = 1; i < num_threads; ++i)
+      _threads.push_back(std::thread(&ThreadPool::work, this, i, _generation));
+  }
+
+  //----------------------------------------------------------------------------
+  void ThreadPool::run(const Func& func)
+  {
+    if( _threads.empty() )
+    {
+      func(0);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _func = &func;
+      _num_running = _threads.size();
+      ++_generation;
+    }
+    _cond_start.notify_all();
+
+    func(0);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cond_done.wait(lock, [this]{ return !_num_running; });
+    _func = nullptr;
+  }
+
+  //----------------------------------------------------------------------------
+  void ThreadPool::work(size_t thread, size_t generation)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for(;;)
+    {
+      _cond_start.wait(lock, [&]{ return _stop || _generation != generation; });
+      if( _stop )
+        return;
+
+      generation = _generation;
+      const Func& func = *_func;
+
+      lock.unlock();
+      func(thread);
+      lock.lock();
+
+      if( !--_num_running )
+        _cond_done.notify_one();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  WorkQueue::WorkQueue():
+    _num_queues(0),
+    _num_items(0),
+    _pending(0)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  void WorkQueue::reset(size_t num_items, size_t num_queues)
+  {
+    if( num_queues != _num_queues )
+    {
+      _queues.reset(new Queue[num_queues]);
+      _num_queues = num_queues;
+    }
+
+    if( num_items > _num_items )
+    {
+      _queued.reset(new std::atomic<bool>[num_items]);
+      _num_items = num_items;
+    }
+
+    for(size_t i = 0; i < _num_items; ++i)
+      _queued[i].store(false, std::memory_order_relaxed);
+    for(size_t i = 0; i < _num_queues; ++i)
+      _queues[i].items.clear();
+    _pending = 0;
+  }
+
+  //----------------------------------------------------------------------------
+  bool WorkQueue::push(size_t queue, uint32_t item)
+  {
+    if( _queued[item].exchange(true) )
+      return false;
+
+    ++_pending;
+
+    Queue& q = _queues[queue % _num_queues];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.items.push_back(item);
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool WorkQueue::pop(size_t queue, uint32_t& item)
+  {
+    for(size_t i = 0; i < _num_queues; ++i)
+    {
+      Queue& q = _queues[(queue + i) % _num_queues];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if( q.items.empty() )
+        continue;
+
+      // Own queue in order, steal from the other end
+      if( i == 0 )
+      {
+        item = q.items.front();
+        q.items.pop_front();
+      }
+      else
+      {
+        item = q.items.back();
+        q.items.pop_back();
+      }
+
+      // Allow queuing again if costs change while processing
+      _queued[item] = false;
+      return true;
+    }
+
+    return false;
+  }
+
+  //----------------------------------------------------------------------------
+  void WorkQueue::done()
+  {
+    --_pending;
+  }
+
+  //----------------------------------------------------------------------------
+  bool WorkQueue::finished() const
+  {
+    return _pending == 0;
+  }
+
+  //----------------------------------------------------------------------------
+  template<class Func>
+  void Router::runQueue(const Func& func)
+  {
+    _pool.run([&](size_t thread)
+    {
+      uint32_t item;
+      for(;;)
+      {
+        if( _queue.pop(thread, item) )
+        {
+          func(thread, item);
+          _queue.done();
+        }
+        else if( _queue.finished() )
+          break;
+        else
+          std::this_thread::yield();
+      }
+    });
+  }
+
+  //----------------------------------------------------------------------------
+  Router::Router():
+    _num_threads(-1),
+    _block_x(0),
+    _block_y(0),
+    _cost_factor(0),
+    _width(0),
+    _height(0),
+    _blocks_x(0),
+    _blocks_y(0),
+    _border(0),
+    _stride(0),
+    _num_elements(0),
+    _slices_size(0)
+  {
+    configure(0, 8, 8, 100);
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::configure( int num_threads,
+                          int block_x,
+                          int block_y,
+                          float cost_factor )
+  {
+    block_x = std::max(block_x, 2);
+    block_y = std::max(block_y, 2);
+
+    if(    block_x != _block_x
+        || block_y != _block_y
+        || cost_factor != _cost_factor )
+    {
+      _block_x = block_x;
+      _block_y = block_y;
+      _cost_factor = cost_factor;
+
+      // Force recalculating all route maps
+      _width = _height = 0;
+    }
+
+    if( num_threads != _num_threads )
+    {
+      _num_threads = num_threads;
+      size_t threads = num_threads > 0 ? num_threads
+                                       : std::thread::hardware_concurrency();
+      _pool.resize( std::max<size_t>(threads, 1) );
+      _scratch.resize( _pool.size() );
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::layout(int width, int height)
+  {
+    const int step_x = _block_x - 1,
+              step_y = _block_y - 1;
+
+    _width = width;
+    _height = height;
+    _blocks_x = divup(std::max(width - 1, 1), step_x);
+    _blocks_y = divup(std::max(height - 1, 1), step_y);
+    _border = 2 * (_block_x + _block_y - 2);
+    _stride = (_border + 3) & ~3;
+
+    // Border pixels in clockwise order (top, right, bottom, left)
+    _border_pixels.clear();
+    for(int x = 0; x < _block_x; ++x)
+      _border_pixels.push_back(x);
+    for(int y = 1; y < _block_y; ++y)
+      _border_pixels.push_back(y * _block_x + step_x);
+    for(int x = step_x - 1; x >= 0; --x)
+      _border_pixels.push_back(step_y * _block_x + x);
+    for(int y = step_y - 1; y > 0; --y)
+      _border_pixels.push_back(y * _block_x);
+
+    // Neighbour blocks sharing each border pixel
+    _border_dirs.clear();
+    for(int pixel: _border_pixels)
+    {
+      const int x = pixel % _block_x,
+                y = pixel / _block_x;
+      uint8_t dirs = 0;
+      for(int d = 0; d < 8; ++d)
+        if(    (!DIR_X[d] || x == (DIR_X[d] < 0 ? 0 : step_x))
+            && (!DIR_Y[d] || y == (DIR_Y[d] < 0 ? 0 : step_y)) )
+          dirs |= 1 << d;
+      _border_dirs.push_back(dirs);
+    }
+
+    // Global ids of border pixels (shared between neighbouring blocks)
+    const int grid_w = _blocks_x * step_x + 1,
+              grid_h = _blocks_y * step_y + 1;
+    std::vector<uint32_t> ids(grid_w * grid_h, 0);
+    _num_elements = 0;
+    for(int y = 0; y < grid_h; ++y)
+      for(int x = 0; x < grid_w; ++x)
+        if( x % step_x == 0 || y % step_y == 0 )
+          ids[y * grid_w + x] = _num_elements++;
+
+    _element_ids.resize(numBlocks() * _border);
+    for(size_t block = 0; block < numBlocks(); ++block)
+    {
+      const int x0 = (block % _blocks_x) * step_x,
+                y0 = (block / _blocks_x) * step_y;
+      for(int i = 0; i < _border; ++i)
+      {
+        const int pixel = _border_pixels[i];
+        _element_ids[block * _border + i] =
+          ids[ (y0 + pixel / _block_x) * grid_w + x0 + pixel % _block_x ];
+      }
+    }
+
+    _route_maps.assign(numBlocks() * _border * _stride, MAX_COST);
+    _costs.assign(width * height, 0.f);
+  }
+
+  //----------------------------------------------------------------------------
+  size_t Router::updateCostMap(const float* costs, int width, int height)
+  {
+    if( width <= 0 || height <= 0 )
+      return 0;
+
+    std::vector<uint32_t> dirty;
+    if( width != _width || height != _height )
+    {
+      layout(width, height);
+      for(size_t block = 0; block < numBlocks(); ++block)
+        dirty.push_back(block);
+    }
+    else
+    {
+      for(size_t block = 0; block < numBlocks(); ++block)
+      {
+        const int x0 = (block % _blocks_x) * (_block_x - 1),
+                  y0 = (block / _blocks_x) * (_block_y - 1),
+                  x1 = std::min(x0 + _block_x, _width),
+                  y1 = std::min(y0 + _block_y, _height);
+
+        bool changed = false;
+        for(int y = y0; y < y1 && !changed; ++y)
+          for(int x = x0; x < x1 && !changed; ++x)
+            changed = std::abs(costs[y * _width + x] - _costs[y * _width + x])
+                    > COST_MAP_EPS;
+
+        if( changed )
+          dirty.push_back(block);
+      }
+    }
+
+    if( dirty.empty() )
+      return 0;
+
+    std::copy(costs, costs + width * height, _costs.begin());
+
+    _queue.reset(numBlocks(), numThreads());
+    for(size_t i = 0; i < dirty.size(); ++i)
+      _queue.push(i, dirty[i]);
+
+    runQueue([this](size_t thread, uint32_t block)
+    {
+      updateRouteMap(block, _scratch[thread]);
+    });
+
+    return dirty.size();
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::route(const std::vector<Target>& targets)
+  {
+    _targets.clear();
+    if( !numBlocks() )
+      return;
+
+    // Clip to the map (but keep at least one pixel)
+    for(auto const& target: targets)
+    {
+      Target t( std::min(std::max(target.x0, 0), _width - 1),
+                std::min(std::max(target.y0, 0), _height - 1),
+                std::min(target.x1, _width),
+                std::min(target.y1, _height) );
+      t.x1 = std::max(t.x1, t.x0 + 1);
+      t.y1 = std::max(t.y1, t.y0 + 1);
+      _targets.push_back(t);
+    }
+
+    const size_t size = _targets.size() * _num_elements;
+    if( size > _slices_size )
+    {
+      _slices.reset(new std::atomic<float>[size]);
+      _slices_size = size;
+    }
+    for(size_t i = 0; i < size; ++i)
+      _slices[i].store(MAX_COST, std::memory_order_relaxed);
+
+    _queue.reset(_targets.size() * numBlocks(), numThreads());
+    for(size_t target = 0; target < _targets.size(); ++target)
+      seed(target, _scratch[0]);
+
+    runQueue([this](size_t thread, uint32_t item)
+    {
+      relax(item / numBlocks(), item % numBlocks(), thread, _scratch[thread]);
+    });
+  }
+
+  //----------------------------------------------------------------------------
+  bool Router::findMinimum(Pos& pos)
+  {
+    if( _targets.empty() )
+      return false;
+
+    // Lower bound for the costs inside every block: Every path to a target
+    // outside of the block has to leave through the border.
+    typedef std::pair<float, uint32_t> Bound;
+    std::vector<Bound> bounds;
+    for(size_t block = 0; block < numBlocks(); ++block)
+    {
+      const int x0 = (block % _blocks_x) * (_block_x - 1),
+                y0 = (block / _blocks_x) * (_block_y - 1);
+      const uint32_t* ids = &_element_ids[block * _border];
+
+      float bound = 0;
+      for(size_t target = 0; target < _targets.size(); ++target)
+      {
+        const Target& t = _targets[target];
+        if(    t.x0 < x0 + _block_x && t.x1 > x0
+            && t.y0 < y0 + _block_y && t.y1 > y0 )
+          continue;
+
+        const std::atomic<float>* data = slice(target);
+        float min_cost = MAX_COST;
+        for(int i = 0; i < _border; ++i)
+          min_cost = std::min(min_cost, data[ ids[i] ].load());
+        bound += min_cost;
+      }
+
+      if( bound < MAX_COST )
+        bounds.push_back(Bound(bound, block));
+    }
+    std::sort(bounds.begin(), bounds.end());
+
+    // Evaluate blocks in order of their bound until no better position can be
+    // found anymore
+    std::mutex mutex;
+    std::atomic<size_t> next(0);
+    float min_cost = MAX_COST;
+    bool found = false;
+
+    _pool.run([&](size_t thread)
+    {
+      Scratch& scratch = _scratch[thread];
+      for(size_t i = next++; i < bounds.size(); i = next++)
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if( bounds[i].first > min_cost )
+            break;
+        }
+
+        const size_t block = bounds[i].second;
+        scratch.out.assign(_block_x * _block_y, 0.f);
+        for(size_t target = 0; target < _targets.size(); ++target)
+        {
+          blockField(target, block, scratch);
+          for(size_t p = 0; p < scratch.out.size(); ++p)
+            scratch.out[p] += scratch.field[p];
+        }
+
+        const int x0 = (block % _blocks_x) * (_block_x - 1),
+                  y0 = (block / _blocks_x) * (_block_y - 1);
+        float block_cost = MAX_COST;
+        Pos block_pos;
+        for(int y = 0; y < _block_y && y0 + y < _height; ++y)
+          for(int x = 0; x < _block_x && x0 + x < _width; ++x)
+          {
+            const float cost = scratch.out[y * _block_x + x];
+            if( cost < block_cost )
+            {
+              block_cost = cost;
+              block_pos = Pos(x0 + x, y0 + y);
+            }
+          }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(    block_cost < min_cost
+            || (found && block_cost == min_cost && block_pos < pos) )
+        {
+          min_cost = block_cost;
+          pos = block_pos;
+          found = true;
+        }
+      }
+    });
+
+    return found;
+  }
+
+  //----------------------------------------------------------------------------
+  Router::Path Router::trace(size_t target, const Pos& start)
+  {
+    Path path;
+    if( target >= _targets.size() )
+      return path;
+
+    Scratch& scratch = _scratch[0];
+    std::map<size_t, std::vector<float>> fields;
+
+    auto cost = [&](int x, int y) -> float
+    {
+      const int col = std::min(x / (_block_x - 1), _blocks_x - 1),
+                row = std::min(y / (_block_y - 1), _blocks_y - 1);
+      const size_t block = row * _blocks_x + col;
+
+      auto field = fields.find(block);
+      if( field == fields.end() )
+      {
+        blockField(target, block, scratch);
+        field = fields.insert(std::make_pair(block, scratch.field)).first;
+      }
+
+      return field->second[ (y - row * (_block_y - 1)) * _block_x
+                          + (x - col * (_block_x - 1)) ];
+    };
+
+    const Target& t = _targets[target];
+    Pos pos( std::min(std::max(start.first, 0), _width - 1),
+             std::min(std::max(start.second, 0), _height - 1) );
+    float cur_cost = cost(pos.first, pos.second);
+
+    // Follow the cheapest neighbour (as routeConstruct in routing.cl)
+    for(int steps = 0; steps < _width * _height; ++steps)
+    {
+      path.push_back(pos);
+      if( t.contains(pos.first, pos.second) || cur_cost >= MAX_COST )
+        break;
+
+      const float pos_cost = _costs[pos.second * _width + pos.first];
+      float min_cost = MAX_COST,
+            next_cost = MAX_COST;
+      Pos next = pos;
+      for(int d = 0; d < 8; ++d)
+      {
+        const int x = pos.first + DIR_X[d],
+                  y = pos.second + DIR_Y[d];
+        if( x < 0 || y < 0 || x >= _width || y >= _height )
+          continue;
+
+        const float step = (DIR_X[d] && DIR_Y[d]) ? SQRT2 : 1.f,
+                    other = cost(x, y),
+                    total = other + step * (1 + _cost_factor * 0.5f
+                                          * (pos_cost + _costs[y * _width + x]));
+        if( total < min_cost )
+        {
+          min_cost = total;
+          next_cost = other;
+          next = Pos(x, y);
+        }
+      }
+
+      if( next_cost >= cur_cost )
+        break;
+
+      pos = next;
+      cur_cost = next_cost;
+    }
+
+    return path;
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::blockCosts(size_t block, std::vector<float>& costs) const
+  {
+    const int x0 = (block % _blocks_x) * (_block_x - 1),
+              y0 = (block / _blocks_x) * (_block_y - 1);
+
+    costs.resize(_block_x * _block_y);
+    for(int y = 0; y < _block_y; ++y)
+      for(int x = 0; x < _block_x; ++x)
+        costs[y * _block_x + x] = (x0 + x < _width && y0 + y < _height)
+                                ? _costs[(y0 + y) * _width + x0 + x]
+                                : OUTSIDE_COST;
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::localField(Scratch& scratch) const
+  {
+    const std::vector<float>& costs = scratch.costs;
+    std::vector<float>& field = scratch.field;
+    std::vector<std::pair<float, int>>& heap = scratch.heap;
+    const std::greater<std::pair<float, int>> cmp;
+
+    heap.clear();
+    for(size_t i = 0; i < field.size(); ++i)
+      if( field[i] < MAX_COST )
+        heap.push_back(std::make_pair(field[i], i));
+    std::make_heap(heap.begin(), heap.end(), cmp);
+
+    while( !heap.empty() )
+    {
+      std::pop_heap(heap.begin(), heap.end(), cmp);
+      const float cost = heap.back().first;
+      const int i = heap.back().second;
+      heap.pop_back();
+
+      if( cost > field[i] )
+        continue;
+
+      const int x = i % _block_x,
+                y = i / _block_x;
+      for(int d = 0; d < 8; ++d)
+      {
+        const int nx = x + DIR_X[d],
+                  ny = y + DIR_Y[d];
+        if( nx < 0 || ny < 0 || nx >= _block_x || ny >= _block_y )
+          continue;
+
+        const int n = ny * _block_x + nx;
+        const float step = (DIR_X[d] && DIR_Y[d]) ? SQRT2 : 1.f,
+                    new_cost = cost + step * (1 + _cost_factor * 0.5f
+                                                * (costs[i] + costs[n]));
+        if( new_cost < field[n] )
+        {
+          field[n] = new_cost;
+          heap.push_back(std::make_pair(new_cost, n));
+          std::push_heap(heap.begin(), heap.end(), cmp);
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::blockField(size_t target, size_t block, Scratch& scratch)
+  {
+    blockCosts(block, scratch.costs);
+    scratch.field.assign(_block_x * _block_y, MAX_COST);
+
+    const std::atomic<float>* data = slice(target);
+    const uint32_t* ids = &_element_ids[block * _border];
+    for(int i = 0; i < _border; ++i)
+      scratch.field[ _border_pixels[i] ] = data[ ids[i] ].load();
+
+    const Target& t = _targets[target];
+    const int x0 = (block % _blocks_x) * (_block_x - 1),
+              y0 = (block / _blocks_x) * (_block_y - 1);
+    for(int y = std::max(t.y0 - y0, 0); y < std::min(t.y1 - y0, _block_y); ++y)
+      for(int x = std::max(t.x0 - x0, 0); x < std::min(t.x1 - x0, _block_x); ++x)
+        scratch.field[y * _block_x + x] = 0;
+
+    localField(scratch);
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::updateRouteMap(size_t block, Scratch& scratch)
+  {
+    blockCosts(block, scratch.costs);
+
+    float* route_map = &_route_maps[block * _border * _stride];
+    for(int i = 0; i < _border; ++i)
+    {
+      scratch.field.assign(_block_x * _block_y, MAX_COST);
+      scratch.field[ _border_pixels[i] ] = 0;
+      localField(scratch);
+
+      float* row = route_map + i * _stride;
+      for(int j = 0; j < _border; ++j)
+        row[j] = scratch.field[ _border_pixels[j] ];
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::seed(size_t target, Scratch& scratch)
+  {
+    const Target& t = _targets[target];
+    const int step_x = _block_x - 1,
+              step_y = _block_y - 1,
+              col0 = std::max(t.x0 - 1, 0) / step_x,
+              row0 = std::max(t.y0 - 1, 0) / step_y,
+              col1 = std::min((t.x1 - 1) / step_x, _blocks_x - 1),
+              row1 = std::min((t.y1 - 1) / step_y, _blocks_y - 1);
+
+    std::atomic<float>* data = slice(target);
+    for(int row = row0; row <= row1; ++row)
+      for(int col = col0; col <= col1; ++col)
+      {
+        const size_t block = row * _blocks_x + col;
+        blockField(target, block, scratch);
+
+        const uint32_t* ids = &_element_ids[block * _border];
+        for(int i = 0; i < _border; ++i)
+          lowerTo(data[ ids[i] ], scratch.field[ _border_pixels[i] ]);
+
+        // Borders of the seed block are final, so relaxing it would not
+        // reach any neighbours.
+        _queue.push(block, target * numBlocks() + block);
+        pushNeighbours(target, block, 0xff, block);
+      }
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::relax( size_t target,
+                      size_t block,
+                      size_t thread,
+                      Scratch& scratch )
+  {
+    std::atomic<float>* data = slice(target);
+    const uint32_t* ids = &_element_ids[block * _border];
+
+    scratch.in.assign(_stride, MAX_COST);
+    for(int i = 0; i < _border; ++i)
+      scratch.in[i] = data[ ids[i] ].load(std::memory_order_relaxed);
+    scratch.out = scratch.in;
+
+    // Cheapest way to every border pixel through any other border pixel
+    const float* route_map = &_route_maps[block * _border * _stride];
+    for(int i = 0; i < _border; ++i)
+      if( scratch.in[i] < MAX_COST )
+        relaxRow(&scratch.out[0], route_map + i * _stride, scratch.in[i], _stride);
+
+    uint8_t dirs = 0;
+    for(int i = 0; i < _border; ++i)
+      if(    scratch.out[i] + COST_EPS < scratch.in[i]
+          && lowerTo(data[ ids[i] ], scratch.out[i]) )
+        dirs |= _border_dirs[i];
+
+    if( dirs )
+      pushNeighbours(target, block, dirs, thread);
+  }
+
+  //----------------------------------------------------------------------------
+  void Router::pushNeighbours( size_t target,
+                               size_t block,
+                               uint8_t dirs,
+                               size_t thread )
+  {
+    const int col = block % _blocks_x,
+              row = block / _blocks_x;
+
+    for(int d = 0; d < 8; ++d)
+    {
+      if( !(dirs & (1 << d)) )
+        continue;
+
+      const int x = col + DIR_X[d],
+                y = row + DIR_Y[d];
+      if( x < 0 || y < 0 || x >= _blocks_x || y >= _blocks_y )
+        continue;
+
+      _queue.push(thread, target * numBlocks() + y * _blocks_x + x);
+    }
+  }
+
+} // namespace Blocks
+} // namespace LinksRouting
@@ -0,0 +1,224 @@
+#include "cpurouting-blocks.h"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace LinksRouting
+{
+namespace Blocks
+{
+  typedef LinkDescription::HyperEdgeDescriptionSegment segment_t;
+
+  //----------------------------------------------------------------------------
+  CPURouting::CPURouting() :
+    Configurable("CPURoutingBlocks")
+  {
+    registerArg("BlockSizeX", _block_size_x = 8);
+    registerArg("BlockSizeY", _block_size_y = 8);
+    registerArg("NumThreads", _num_threads = 0);
+    registerArg("GridSize", _grid_size = 16);
+    registerArg("CostFactor", _cost_factor = 100);
+  }
+
+  //------------------------------------------------------------------------------
+  void CPURouting::publishSlots(SlotCollector& slots)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  void CPURouting::subscribeSlots(SlotSubscriber& slot_subscriber)
+  {
+    _subscribe_links =
+      slot_subscriber.getSlot<LinkDescription::LinkList>("/links");
+
+    _subscribe_costmap =
+      slot_subscriber.getSlot<SlotType::Image>("/costmap");
+
+    _subscribe_desktop_rect =
+      slot_subscriber.getSlot<Rect>("/desktop/rect");
+  }
+
+  //----------------------------------------------------------------------------
+  bool CPURouting::startup(Core* core, unsigned int type)
+  {
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void CPURouting::init()
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  void CPURouting::shutdown()
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  float CPURouting::updateCostMap()
+  {
+    _router.configure( _num_threads,
+                       _block_size_x,
+                       _block_size_y,
+                       _cost_factor );
+
+    const Rect& desktop = *_subscribe_desktop_rect->_data;
+    const SlotType::Image& costmap = *_subscribe_costmap->_data;
+
+    if(    _subscribe_costmap->isValid()
+        && costmap.type == SlotType::Image::ImageGray32F
+        && costmap.pdata
+        && costmap.width && costmap.height )
+    {
+      _router.updateCostMap( reinterpret_cast<const float*>(costmap.pdata),
+                             costmap.width,
+                             costmap.height );
+      return desktop.size.x / costmap.width;
+    }
+
+    // No cost map in memory -> only avoid long routes
+    const int grid_size = std::max(_grid_size, 1),
+              width = std::ceil(desktop.size.x / grid_size),
+              height = std::ceil(desktop.size.y / grid_size);
+    _uniform_costs.assign(std::max(width * height, 0), 0.f);
+    _router.updateCostMap(_uniform_costs.data(), width, height);
+
+    return grid_size;
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t CPURouting::process(unsigned int type)
+  {
+    if( !_subscribe_links->isValid() )
+    {
+      LOG_DEBUG("No valid routing data available.");
+      return 0;
+    }
+
+    const float scale = updateCostMap();
+    if( !_router.width() || !_router.height() )
+      return 0;
+
+    const float2 origin = _subscribe_desktop_rect->_data->pos;
+
+    _global_route_nodes.clear();
+
+    LinkDescription::LinkList& links = *_subscribe_links->_data;
+    for( auto it = links.begin(); it != links.end(); ++it )
+    {
+      collectNodes(it->_link.get());
+    }
+
+    for(const auto& group: _global_route_nodes)
+    {
+      // Route to the bounding box of every region
+      std::vector<Target> targets;
+      for(auto const& node: group.second)
+      {
+        float2 const& offset =
+          node->getParent()->get<float2>("screen-offset");
+
+        float2 min( std::numeric_limits<float>::max(),
+                    std::numeric_limits<float>::max() ),
+               max = -min;
+        for(auto const& vert: node->getVertices())
+        {
+          const float2 p = (vert + offset - origin) / scale;
+          min = float2(std::min(min.x, p.x), std::min(min.y, p.y));
+          max = float2(std::max(max.x, p.x), std::max(max.y, p.y));
+        }
+
+        targets.push_back(Target( std::floor(min.x),
+                                  std::floor(min.y),
+                                  std::floor(max.x) + 1,
+                                  std::floor(max.y) + 1 ));
+      }
+
+      _router.route(targets);
+
+      Router::Pos min_pos;
+      if( !_router.findMinimum(min_pos) )
+        continue;
+
+      float2 center = origin + float2( min_pos.first + .5f,
+                                       min_pos.second + .5f ) * scale;
+
+      for(size_t i = 0; i < group.second.size(); ++i)
+      {
+        auto const& node = group.second[i];
+        auto const& p = node->getParent();
+        auto const& fork = p->getHyperEdgeDescription();
+        float2 const& offset = p->get<float2>("screen-offset");
+
+        segment_t segment;
+        segment.set("covered", node->get<bool>("covered") && !node->get<bool>("hover"));
+        segment.set("widen-end", node->get<bool>("widen-end", false));
+        segment.nodes.push_back(node);
+
+        for(auto const& pos: _router.trace(i, min_pos))
+          segment.trail.push_back( origin + float2( pos.first + .5f,
+                                                    pos.second + .5f ) * scale );
+
+        segment.trail.back() = offset + node->getBestLinkPoint(center - offset);
+        segment.trail = smooth(segment.trail, 0.2, 2);
+
+        for(size_t i = 0; i < 2; ++i)
+        {
+          subdivide(segment.trail);
+          segment.trail = smooth(segment.trail, 0.4, 4);
+        }
+
+        fork->outgoing.insert(fork->outgoing.end(), segment);
+      }
+    }
+
+    return RENDER_DIRTY | MASK_DIRTY;
+  }
+
+  WId getCoveringWId(const LinkDescription::Node& node)
+  {
+    return node.get<bool>("covered") ? node.get<WId>("covering-wid") : 0;
+  }
+
+  //----------------------------------------------------------------------------
+  void CPURouting::collectNodes(LinkDescription::HyperEdge* hedge)
+  {
+    bool no_route = hedge->get<bool>("no-route");
+
+    auto fork =
+      make_pooled<LinkDescription::HyperEdgeDescriptionForkation>();
+    hedge->setHyperEdgeDescription(fork);
+    fork->position = hedge->getCenter();
+
+    for( auto& node: hedge->getNodes() )
+    {
+      if(    node->get<bool>("hidden")
+          || (no_route && !node->get<bool>("always-route")) )
+        continue;
+
+      // add children (hyperedges)
+      for( auto& child: node->getChildren() )
+        collectNodes(child.get());
+
+      if( node->getVertices().empty() )
+      {
+        segment_t segment;
+        segment.nodes.push_back(node);
+
+        fork->outgoing.push_back(segment);
+        continue;
+      }
+
+      // Store all nodes for global routing (grouped by covering window)
+      if( !node->get<bool>("outside") )
+        _global_route_nodes[ getCoveringWId(*node) ].push_back(node);
+    }
+  }
+
+}
+}
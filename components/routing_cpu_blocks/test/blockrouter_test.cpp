@@ -0,0 +1,117 @@
+/*
+ * blockrouter_test.cpp
+ *
+ * Route between random pairs of targets on the default grid of the
+ * CPURoutingBlocks component (1920x1088 desktop, GridSize 16) and check that
+ * both targets are reached (also across distant blocks).
+ */
+
+#include "blockrouter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace LinksRouting::Blocks;
+
+namespace
+{
+  const int WIDTH = 120,
+            HEIGHT = 68;
+
+  /**
+   * @return Number of failed routes
+   */
+  int routePairs( Router& router,
+                  const std::vector<float>& costs,
+                  size_t num_pairs,
+                  bool check_length )
+  {
+    router.updateCostMap(costs.data(), WIDTH, HEIGHT);
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> rand_x(0, WIDTH - 1),
+                                       rand_y(0, HEIGHT - 1);
+
+    int failures = 0;
+    for(size_t i = 0; i < num_pairs; ++i)
+    {
+      std::vector<Target> targets;
+      for(size_t t = 0; t < 2; ++t)
+      {
+        int x, y;
+        do
+        {
+          x = rand_x(rng);
+          y = rand_y(rng);
+        } while( costs[y * WIDTH + x] > 0 );
+        targets.push_back(Target(x, y, x + 1, y + 1));
+      }
+
+      router.route(targets);
+
+      Router::Pos pos;
+      if( !router.findMinimum(pos) )
+      {
+        std::printf( "no minimum: (%d %d) -> (%d %d)\n",
+                     targets[0].x0, targets[0].y0,
+                     targets[1].x0, targets[1].y0 );
+        ++failures;
+        continue;
+      }
+
+      size_t num_steps = 0;
+      bool reached = true;
+      for(size_t t = 0; t < targets.size(); ++t)
+      {
+        const Router::Path path = router.trace(t, pos);
+        reached = reached
+               && !path.empty()
+               && targets[t].contains(path.back().first, path.back().second);
+        num_steps += path.size() - 1;
+      }
+
+      // Without costs the shortest route needs one (diagonal) step per pixel
+      // along the longer axis.
+      const size_t min_steps =
+        std::max( std::abs(targets[0].x0 - targets[1].x0),
+                  std::abs(targets[0].y0 - targets[1].y0) );
+      if( !reached || (check_length && num_steps != min_steps) )
+      {
+        std::printf( "%s: (%d %d) -> (%d %d) via (%d %d), %d steps\n",
+                     reached ? "detour" : "target not reached",
+                     targets[0].x0, targets[0].y0,
+                     targets[1].x0, targets[1].y0,
+                     pos.first, pos.second,
+                     static_cast<int>(num_steps) );
+        ++failures;
+      }
+    }
+
+    return failures;
+  }
+}
+
+int main()
+{
+  int failures = 0;
+  for(int num_threads = 1; num_threads <= 4; num_threads *= 2)
+  {
+    Router router;
+    router.configure(num_threads, 8, 8, 100);
+
+    std::vector<float> costs(WIDTH * HEIGHT, 0.f);
+    failures += routePairs(router, costs, 200, true);
+
+    // Wall with a single gap (routes have to leave the direct line)
+    for(int y = 0; y < HEIGHT; ++y)
+      if( y != HEIGHT - 3 )
+        costs[y * WIDTH + WIDTH / 2] = 1;
+    failures += routePairs(router, costs, 50, false);
+  }
+
+  if( failures )
+    std::printf("%d routes failed\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
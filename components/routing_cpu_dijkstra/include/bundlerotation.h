@@ -0,0 +1,113 @@
+#ifndef LR_BUNDLEROTATION
+#define LR_BUNDLEROTATION
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace LinksRouting
+{
+namespace Dijkstra
+{
+  /**
+   * Find the rotation (by up to +-2 directions) of every bundle with the
+   * minimum total costs (costs of all links plus costs for every used
+   * direction).
+   *
+   * The costs of a rotation only depend on the bundle itself and on the set
+   * of directions already in use, so instead of checking all 5^8
+   * combinations the minimum costs of the remaining bundles are calculated
+   * once for every bundle and every set of used directions (8 * 256 states).
+   */
+  struct BundleRotation
+  {
+    size_t costs[8][5],     //!< Costs of every bundle rotated by -2 to +2
+                            //   (0 = empty bundle)
+           dir_costs[8],    //!< Costs for using a direction
+           min_cost,
+           min_pos[8];      //!< Target direction of every bundle
+
+    BundleRotation():
+      min_cost(size_t(-1))
+    {
+      std::memset(costs, 0, sizeof(costs));
+      std::memset(dir_costs, 0, sizeof(dir_costs));
+      std::memset(min_pos, 0, sizeof(min_pos));
+    }
+
+    void run()
+    {
+      // remaining[bundle][used] = minimum costs of all bundles starting at
+      //                           'bundle' with the directions in 'used'
+      //                           already taken by the previous bundles
+      size_t remaining[9][256];
+      for(size_t used = 0; used < 256; ++used)
+      {
+        remaining[8][used] = 0;
+        for(int dir = 0; dir < 8; ++dir)
+          if( used & (1 << dir) )
+            remaining[8][used] += dir_costs[dir];
+      }
+
+      for(int bundle = 7; bundle >= 0; --bundle)
+        for(size_t used = 0; used < 256; ++used)
+        {
+          size_t min = size_t(-1);
+          for(size_t i = 0; i < numRotations(bundle); ++i)
+            min = std::min( min,
+                            costs[bundle][i]
+                          + remaining[bundle + 1][use(used, bundle, i)] );
+          remaining[bundle][used] = min;
+        }
+
+      // Select the first optimal rotation for every bundle (same result as
+      // an exhaustive search in ascending order)
+      min_cost = remaining[0][0];
+
+      size_t used = 0;
+      for(int bundle = 0; bundle < 8; ++bundle)
+        for(size_t i = 0; i < numRotations(bundle); ++i)
+        {
+          size_t next = use(used, bundle, i);
+          if(    costs[bundle][i] + remaining[bundle + 1][next]
+              == remaining[bundle][used] )
+          {
+            min_pos[bundle] = dest(bundle, i);
+            used = next;
+            break;
+          }
+        }
+    }
+
+    /** Target direction of @a bundle for rotation @a i */
+    static size_t dest(int bundle, size_t i)
+    {
+      return (i + bundle + 8 - 2) % 8;
+    }
+
+    /**
+     * Number of rotations to check. Rotations after the first one without
+     * costs (eg. empty bundle) are ignored.
+     */
+    size_t numRotations(int bundle) const
+    {
+      for(size_t i = 0; i < 5; ++i)
+        if( !costs[bundle][i] )
+          return i + 1;
+      return 5;
+    }
+
+    /** Directions in use after rotating @a bundle by @a i */
+    size_t use(size_t used, int bundle, size_t i) const
+    {
+      // Rotations without costs do not use a direction
+      if( !costs[bundle][i] )
+        return used;
+      return used | (1 << dest(bundle, i));
+    }
+  };
+
+} // namespace Dijkstra
+} // namespace LinksRouting
+
+#endif //LR_BUNDLEROTATION
@@ -1,6 +1,8 @@
 #include "cpurouting-dijkstra.h"
+#include "bundlerotation.h"
 #include "log.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <limits>
@@ -272,7 +274,7 @@ namespace Dijkstra
     bool no_route = hedge->get<bool>("no-route");
 
     auto fork =
-      std::make_shared<LinkDescription::HyperEdgeDescriptionForkation>();
+      make_pooled<LinkDescription::HyperEdgeDescriptionForkation>();
     hedge->setHyperEdgeDescription(fork);
     fork->position = hedge->getCenter();
 
@@ -397,90 +399,19 @@ namespace Dijkstra
       }
     }
 
-    struct MiniumFinder
+    // Precalculate costs for rotating the max 8 edge bundles by +-2 fields
+    const float2 min_pos(min_node.x, min_node.y);
+    BundleRotation min_finder;
+    for(int i = 0; i < 8; ++i)
     {
-      size_t costs[8][5],
-             num_bundles[8],
-             cur_cost = 0,
-             cur_pos[8],
-             min_cost = size_t(-1),
-             min_pos[8];
-
-      MiniumFinder( Outgoings const& outgoings,
-                    Grids const& grids,
-                    float2 const& pos )
+      min_finder.dir_costs[i] = getCostForDir(offsetFromIndex(i));
+      for(int offset = -2; offset <= 2; ++offset)
       {
-        memset(num_bundles, 0, sizeof(num_bundles));
-        memset(cur_pos, 0, sizeof(cur_pos));
-        memset(min_pos, 0, sizeof(min_pos));
-
-        // Precalculate costs for rotating the max 8 edge bundles by +-2
-        // fields
-        for(int i = 0; i < 8; ++i)
-        {
-          for(int offset = -2; offset <= 2; ++offset)
-          {
-            int other = (i + offset + 8) % 8;
-            costs[i][offset + 2] = getCost
-            (
-              outgoings[i],
-              pos + offsetFromIndex(other),
-              grids
-            );
-          }
-
-#if 0
-          std::cout << "costs[" << i << "] = {";
-          for(size_t j = 0; j < 5; ++j)
-            std::cout << (j ? "," : "") << costs[i][j];
-          std::cout << "}" << std::endl;
-#endif
-        }
-
-      }
-
-      void run(int bundle = 0)
-      {
-        for(size_t i = 0; i < 5; ++i)
-        {
-          size_t cost = costs[bundle][i];
-          size_t cur_i = (i + bundle + 8 - 2) % 8;
-          cur_pos[bundle] = cur_i;
-
-          if( cost )
-          {
-            cur_cost += cost;
-            num_bundles[cur_i] += 1;
-          }
-
-          if( bundle < 7 )
-            run(bundle + 1);
-          else
-          {
-            size_t bundle_costs = 0;
-            for(size_t i = 0; i < 8; ++i)
-              if( num_bundles[i] )
-                bundle_costs += getCostForDir(offsetFromIndex(i));
-
-            if( cur_cost + bundle_costs < min_cost )
-            {
-              min_cost = cur_cost + bundle_costs;
-              memcpy(min_pos, cur_pos, sizeof(min_pos));
-            }
-          }
-
-          if( cost )
-          {
-            cur_cost -= cost;
-            num_bundles[cur_i] -= 1;
-          }
-          else
-            break;
-        }
+        int other = (i + offset + 8) % 8;
+        min_finder.costs[i][offset + 2] =
+          getCost(outgoings[i], min_pos + offsetFromIndex(other), _grids);
       }
-    };
-
-    MiniumFinder min_finder(outgoings, this->_grids, float2(min_node.x, min_node.y));
+    }
     min_finder.run();
 
 //    std::cout << "min_cost = " << min_finder.min_cost
@@ -0,0 +1,129 @@
+/*
+ * bundlerotation_test.cpp
+ *
+ * Compare the dynamic programming solution of BundleRotation with an
+ * exhaustive search over all rotations (the previous implementation) on
+ * random cost tables.
+ */
+
+#include "bundlerotation.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+using LinksRouting::Dijkstra::BundleRotation;
+
+namespace
+{
+  /**
+   * Check all combinations of rotations in ascending order, stopping after
+   * the first rotation without costs of every bundle.
+   */
+  struct ExhaustiveSearch
+  {
+    const BundleRotation& problem;
+    size_t num_bundles[8],
+           cur_cost,
+           cur_pos[8],
+           min_cost,
+           min_pos[8];
+
+    explicit ExhaustiveSearch(const BundleRotation& p):
+      problem(p),
+      cur_cost(0),
+      min_cost(size_t(-1))
+    {
+      std::memset(num_bundles, 0, sizeof(num_bundles));
+      std::memset(cur_pos, 0, sizeof(cur_pos));
+      std::memset(min_pos, 0, sizeof(min_pos));
+    }
+
+    void run(int bundle = 0)
+    {
+      for(size_t i = 0; i < 5; ++i)
+      {
+        size_t cost = problem.costs[bundle][i];
+        size_t cur_i = BundleRotation::dest(bundle, i);
+        cur_pos[bundle] = cur_i;
+
+        if( cost )
+        {
+          cur_cost += cost;
+          num_bundles[cur_i] += 1;
+        }
+
+        if( bundle < 7 )
+          run(bundle + 1);
+        else
+        {
+          size_t bundle_costs = 0;
+          for(size_t dir = 0; dir < 8; ++dir)
+            if( num_bundles[dir] )
+              bundle_costs += problem.dir_costs[dir];
+
+          if( cur_cost + bundle_costs < min_cost )
+          {
+            min_cost = cur_cost + bundle_costs;
+            std::memcpy(min_pos, cur_pos, sizeof(min_pos));
+          }
+        }
+
+        if( cost )
+        {
+          cur_cost -= cost;
+          num_bundles[cur_i] -= 1;
+        }
+        else
+          break;
+      }
+    }
+  };
+}
+
+int main()
+{
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> rand_bundles(0, 8),
+                                     rand_cost(0, 20),
+                                     rand_percent(0, 99);
+
+  int failures = 0;
+  for(int test = 0; test < 2000; ++test)
+  {
+    BundleRotation dp;
+    for(int dir = 0; dir < 8; ++dir)
+      dp.dir_costs[dir] = dir % 2 ? 2 : 3; // Axis aligned/diagonal
+
+    // Some empty bundles, and some rotations without costs
+    const int num_used = rand_bundles(rng);
+    for(int bundle = 0; bundle < num_used; ++bundle)
+      for(int i = 0; i < 5; ++i)
+        dp.costs[bundle][i] = rand_percent(rng) < 5 ? 0 : rand_cost(rng) + 1;
+    std::shuffle(dp.costs, dp.costs + 8, rng);
+
+    ExhaustiveSearch reference(dp);
+    reference.run();
+    dp.run();
+
+    bool pos_matches = true;
+    for(int bundle = 0; bundle < 8; ++bundle)
+      pos_matches = pos_matches
+                 && dp.min_pos[bundle] == reference.min_pos[bundle];
+
+    if( dp.min_cost != reference.min_cost || !pos_matches )
+    {
+      std::printf( "test %d: cost %d (expected %d)%s\n",
+                   test,
+                   static_cast<int>(dp.min_cost),
+                   static_cast<int>(reference.min_cost),
+                   pos_matches ? "" : ", different directions" );
+      ++failures;
+    }
+  }
+
+  if( failures )
+    std::printf("%d tests failed\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
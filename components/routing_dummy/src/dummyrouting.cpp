@@ -47,7 +47,7 @@ namespace LinksRouting
     bool no_route = hedge->get<bool>("no-route");
 
     auto fork =
-      std::make_shared<LinkDescription::HyperEdgeDescriptionForkation>();
+      make_pooled<LinkDescription::HyperEdgeDescriptionForkation>();
     hedge->setHyperEdgeDescription(fork);
     fork->position = hedge->getCenter();
 
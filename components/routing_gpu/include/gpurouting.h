@@ -21,7 +21,9 @@
 # include <CL/cl.hpp>
 #endif
 
+#include <map>
 #include <string>
+#include <vector>
 
 namespace LinksRouting
 {
@@ -45,7 +47,7 @@ namespace LinksRouting
         return (type & Component::Routing);
       }
 
-      void process(unsigned int type);
+      uint32_t process(unsigned int type) override;
 
     private:
 
@@ -121,11 +123,53 @@ namespace LinksRouting
       int _routingLocalWorkersWarpSize;
 
       size_t _buffer_width, _buffer_height;
+      bool _gl_sharing,     //!< Cost map shared with OpenGL (else uploaded)
+           _profile,        //!< Print kernel timings (waits for every batch)
+           _dump_buffers;
       cl::Buffer  _cl_lastCostMap_buffer;
       cl::Buffer  _cl_routeMap_buffer;
-      
+
+      /* Cost map upload without OpenGL sharing (eg. POCL) */
+      cl::Image2D         _cl_costmap_image;
+      std::vector<float>  _costmap_staging;
+      cl::Event           _costmap_upload;
+
+      /**
+       * Device buffers reused across calls. They only grow, and uploads are
+       * enqueued without blocking from a host copy kept alive until the
+       * transfer has finished.
+       */
+      struct PooledBuffer
+      {
+        cl::Buffer        buffer;
+        size_t            size;
+        std::vector<char> staging;
+        cl::Event         upload;
+
+        PooledBuffer(): size(0) {}
+      };
+      std::map<std::string, PooledBuffer> _buffer_pool;
+      std::vector<std::pair<std::string, cl::Event>> _profile_events;
+
+      cl::Buffer& getBuffer(const std::string& name, size_t size);
+      cl::Buffer& uploadBuffer( const std::string& name,
+                                const void* data,
+                                size_t size );
+      template<typename T>
+      cl::Buffer& uploadBuffer( const std::string& name,
+                                const std::vector<T>& data )
+      {
+        return uploadBuffer(name, data.data(), data.size() * sizeof(T));
+      }
+
+      /**
+       * @return Event to pass to an enqueue call (NULL if profiling is off)
+       */
+      cl::Event* profileEvent(const char* name);
+      void printProfile();
+
       void updateRouteMap();
-      void createRoutes(LinksRouting::LinkDescription::HyperEdge& ld);
+      void createRoutes(const std::vector<LinkDescription::HyperEdge*>& hedges);
 
       
       friend std::ostream& operator<<( std::ostream&,
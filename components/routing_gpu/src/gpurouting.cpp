@@ -36,7 +36,8 @@ namespace LinksRouting
   GPURouting::GPURouting() :
     Configurable("GPURouting"),
     _buffer_width(0),
-    _buffer_height(0)
+    _buffer_height(0),
+    _gl_sharing(false)
   {
     registerArg("BlockSizeX", _blockSize[0] = 8);
     registerArg("BlockSizeY", _blockSize[1] = 8);
@@ -44,6 +45,8 @@ namespace LinksRouting
     registerArg("NumLocalWorkers", _routingNumLocalWorkers = 4);
     registerArg("WorkersWarpSize", _routingLocalWorkersWarpSize = 32);
     registerArg("BValue",_Bvalue = 1.0);
+    registerArg("Profile", _profile = false);
+    registerArg("DumpBuffers", _dump_buffers = false);
   }
 
   //------------------------------------------------------------------------------
@@ -110,7 +113,15 @@ namespace LinksRouting
                   << std::endl;
 
         std::vector<cl::Device> devices;
-        tplatform.getDevices(CL_DEVICE_TYPE_GPU, &devices);
+        try
+        {
+          tplatform.getDevices(CL_DEVICE_TYPE_GPU, &devices);
+        }
+        catch(cl::Error& err)
+        {
+          // CL_DEVICE_NOT_FOUND (eg. CPU only platforms)
+          continue;
+        }
         //for (cl::Device &tdevice : devices)
         for (size_t j = 0; j < devices.size(); ++j)
         {
@@ -137,33 +148,52 @@ namespace LinksRouting
       }
 
 
+      // Without a device sharing OpenGL objects (eg. CPU implementations like
+      // POCL) use any device and upload the cost map from memory.
+      _gl_sharing = !use_devices.empty();
+      for(size_t i = 0; i < platforms.size() && use_devices.empty(); ++i)
+      {
+        use_platform = platforms[i];
+        use_platform.getDevices(CL_DEVICE_TYPE_ALL, &use_devices);
+        use_devices.resize( std::min<size_t>(use_devices.size(), 1) );
+      }
+
+      if( !_gl_sharing )
+        LOG_INFO("No OpenCL device with OpenGL sharing. Using "
+                 << (use_devices.empty() ? std::string("none")
+                                         : use_devices[0].getInfo<CL_DEVICE_NAME>())
+                 << " without sharing.");
+
       // -----------------------------
       // OpenCL context
 
       std::vector<cl_context_properties> properties;
 
+      if( _gl_sharing )
+      {
 #if defined(__APPLE__) || defined(__MACOSX)
 # error "Not implemented yet."
 
-      // TODO check
-      properties.push_back( CL_CONTEXT_PROPERTY_USE_CGL_SHAREGROUP_APPLE );
-      properties.push_back( (cl_context_properties)CGLGetShareGroup(CGLGetCurrentContext()) );
+        // TODO check
+        properties.push_back( CL_CONTEXT_PROPERTY_USE_CGL_SHAREGROUP_APPLE );
+        properties.push_back( (cl_context_properties)CGLGetShareGroup(CGLGetCurrentContext()) );
 #else
 
 # ifdef _WIN32
-      properties.push_back( CL_GL_CONTEXT_KHR );
-      properties.push_back( (cl_context_properties)wglGetCurrentContext() );
+        properties.push_back( CL_GL_CONTEXT_KHR );
+        properties.push_back( (cl_context_properties)wglGetCurrentContext() );
 
-      properties.push_back( CL_WGL_HDC_KHR );
-      properties.push_back( (cl_context_properties)wglGetCurrentDC() );
+        properties.push_back( CL_WGL_HDC_KHR );
+        properties.push_back( (cl_context_properties)wglGetCurrentDC() );
 # else
-      properties.push_back( CL_GLX_DISPLAY_KHR );
-      properties.push_back( (cl_context_properties)glXGetCurrentDisplay() );
+        properties.push_back( CL_GLX_DISPLAY_KHR );
+        properties.push_back( (cl_context_properties)glXGetCurrentDisplay() );
 
-      properties.push_back( CL_GL_CONTEXT_KHR );
-      properties.push_back( cl_context_properties(glXGetCurrentContext()) );
+        properties.push_back( CL_GL_CONTEXT_KHR );
+        properties.push_back( cl_context_properties(glXGetCurrentContext()) );
 # endif
 #endif
+      }
 
       properties.push_back( CL_CONTEXT_PLATFORM );
       properties.push_back( (cl_context_properties)use_platform() );
@@ -279,6 +309,74 @@ namespace LinksRouting
 
   }
 
+  //----------------------------------------------------------------------------
+  cl::Buffer& GPURouting::getBuffer(const std::string& name, size_t size)
+  {
+    PooledBuffer& pooled = _buffer_pool[name];
+    size = std::max<size_t>(size, 1);
+    if( pooled.size < size )
+    {
+      // Kernels still using the old buffer keep a reference to it
+      pooled.buffer = cl::Buffer(_cl_context, CL_MEM_READ_WRITE, size);
+      pooled.size = size;
+    }
+    return pooled.buffer;
+  }
+
+  //----------------------------------------------------------------------------
+  cl::Buffer& GPURouting::uploadBuffer( const std::string& name,
+                                        const void* data,
+                                        size_t size )
+  {
+    cl::Buffer& buffer = getBuffer(name, size);
+    if( !size )
+      return buffer;
+
+    // The last upload might still read from the staging memory
+    PooledBuffer& pooled = _buffer_pool[name];
+    if( pooled.upload() )
+      pooled.upload.wait();
+
+    const char* bytes = static_cast<const char*>(data);
+    pooled.staging.assign(bytes, bytes + size);
+    _cl_command_queue.enqueueWriteBuffer( buffer,
+                                          CL_FALSE,
+                                          0,
+                                          size,
+                                          &pooled.staging[0],
+                                          0,
+                                          &pooled.upload );
+    return buffer;
+  }
+
+  //----------------------------------------------------------------------------
+  cl::Event* GPURouting::profileEvent(const char* name)
+  {
+    if( !_profile )
+      return 0;
+
+    _profile_events.push_back(std::make_pair(name, cl::Event()));
+    return &_profile_events.back().second;
+  }
+
+  //----------------------------------------------------------------------------
+  void GPURouting::printProfile()
+  {
+    if( _profile_events.empty() )
+      return;
+
+    std::cout << "CLInfo:\n";
+    for(auto it = _profile_events.begin(); it != _profile_events.end(); ++it)
+    {
+      cl_ulong start, end;
+      it->second.wait();
+      it->second.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
+      it->second.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
+      std::cout << " - " << it->first << ": " << (end-start)/1000000.0  << "ms\n";
+    }
+    _profile_events.clear();
+  }
+
   //----------------------------------------------------------------------------
   template<typename T>
   void printfBuffer( cl::CommandQueue& cl_queue,
@@ -458,7 +556,7 @@ namespace LinksRouting
   }
 
   //----------------------------------------------------------------------------
-  void GPURouting::process(unsigned int type)
+  uint32_t GPURouting::process(unsigned int type)
   {
 
     //----------------------
@@ -467,32 +565,36 @@ namespace LinksRouting
     if( !_subscribe_costmap->isValid() )
     {
       std::cerr << "GPURouting: No valid costmap received." << std::endl;
-      return;
+      return 0;
     }
 
     if( !_subscribe_desktop->isValid() )
     {
       std::cerr << "GPURouting: No valid desktop image received." << std::endl;
-      return;
+      return 0;
     }
 
-    if( _subscribe_costmap->_data->type != SlotType::Image::OpenGLTexture )
+    if( _subscribe_costmap->_data->type != (_gl_sharing
+                                             ? SlotType::Image::OpenGLTexture
+                                             : SlotType::Image::ImageGray32F) )
     {
-      std::cerr << "GPURouting: No OpenGL texture costmap received." << std::endl;
-      return;
+      std::cerr << "GPURouting: No "
+                << (_gl_sharing ? "OpenGL texture" : "ImageGray32F")
+                << " costmap received." << std::endl;
+      return 0;
     }
 
     if(    !_subscribe_costmap->_data->width
         || !_subscribe_costmap->_data->height )
     {
       std::cerr << "GPURouting: Invalide costmap dimensions (=0)." << std::endl;
-      return;
+      return 0;
     }
 
     if( !_subscribe_links->isValid() )
     {
       LOG_DEBUG("No valid routing data available.");
-      return;
+      return 0;
     }
 
     try
@@ -502,14 +604,9 @@ namespace LinksRouting
     // now start analyzing the links
 
     LinkDescription::LinkList& links = *_subscribe_links->_data;
-//    unsigned int width = _subscribe_costmap->_data->width,
-//              height = _subscribe_costmap->_data->height,
-//              num_points = width * height;
-//    int dim[] = {width, height, num_points};
-//    int downsample = _subscribe_desktop->_data->width / _subscribe_costmap->_data->width;
-//    unsigned int numBlocks[2] = {divup<unsigned>(width,_blockSize[0]),divup<unsigned>(height,_blockSize[1])};
-//    unsigned int sumBlocks = numBlocks[0]*numBlocks[1];
 
+    // Route all changed links in a single pass of the pipeline
+    std::vector<LinkDescription::HyperEdge*> hedges;
     for( auto it = links.begin(); it != links.end(); ++it )
     {
       auto info = _link_infos.find(it->_id);
@@ -521,470 +618,8 @@ namespace LinksRouting
         //TODO: check if screen has changed -> update
         continue;
 
-      LOG_INFO("NEW DATA to route: "
-               << it->_id
-               << " using routing kernel with" <<  (_noQueue ? "out" : "")
-               << " queue.");
-
-      // --------------------------------------------------------
-      createRoutes(*it->_link.get());
-
-#if 0
-      {
-      //ROUTING
-      cl::Buffer queue_info(_cl_context, CL_MEM_READ_WRITE, sizeof(cl_QueueGlobal));
-      cl::Buffer idbuffer(_cl_context, CL_MEM_READ_WRITE, sizeof(cl_ushort2)*256);
-
-
-      std::vector<int4Aug<const LinkDescription::Node*> > h_targets;
-      h_targets.reserve(it->_link.getNodes().size());
-      for( auto node = it->_link.getNodes().begin();
-           node != it->_link.getNodes().end();
-           ++node )
-      {
-        if( node->get<bool>("hidden", false) )
-          continue;
-
-        //std::cout << "Polygon: (" << node->getVertices().size() << " points)\n";
-        //compute min max for poly
-        int4Aug<const LinkDescription::Node*> target(width-1, height-1,0,0, &*node);
-
-        for( auto p = node->getVertices().begin();
-             p != node->getVertices().end();
-             ++p )
-        {
-          target.x = std::min<int>(target.x, p->x/downsample);
-          target.y = std::min<int>(target.y, p->y/downsample);
-          target.z = std::max<int>(target.z, p->x/downsample);
-          target.w = std::max<int>(target.w, p->y/downsample);
-        }
-
-        target.x = std::max(target.x, 0);
-        target.y = std::max(target.y, 0);
-        target.z = std::min(target.z, ((int)width-1));
-        target.w = std::min(target.w, ((int)height-1));
-
-        if(target.z - target.x <= 0 || target.w - target.y <= 0)
-          continue;
-        h_targets.push_back(target);
-      }
-
-      //remove duplicates
-      std::set<int4Aug<const LinkDescription::Node*> > dups(h_targets.begin(), h_targets.end());
-      h_targets = std::vector<int4Aug<const LinkDescription::Node*> >(dups.begin(), dups.end());
-
-      int numtargets = h_targets.size();
-
-      // prepare storage for result
-      LinkDescription::HyperEdgeDescriptionForkation* fork = new LinkDescription::HyperEdgeDescriptionForkation();
-      it->_link.setHyperEdgeDescription(fork);
-
-      if(h_targets.size() < 2)
-      {
-        if( h_targets.empty() )
-        {
-          std::cout << "No target!" << std::endl;
-        }
-        else
-        {
-          std::cout << "Only 1 target!" << std::endl;
-          // TODO do we need position?
-//          fork->position.x = startingpoint[0] * downsample;
-//          fork->position.y = startingpoint[1] * downsample;
-
-          // copy only the single region
-          fork->outgoing.push_back(LinkDescription::HyperEdgeDescriptionSegment());
-          fork->outgoing.back().parent = fork;
-          fork->outgoing.back().nodes.push_back(h_targets[0].aug);
-        }
-      }
-      else
-      {
-        // there is something on screen -> call routing
-
-        // setup queue
-        unsigned int overAllBlocks = sumBlocks * numtargets;
-        unsigned int blockProcessThreshold = overAllBlocks * 128;
-        cl::Buffer buf(_cl_context, CL_MEM_READ_WRITE, num_points * numtargets * sizeof(float));
-
-        cl::Buffer queue_priority(_cl_context, CL_MEM_READ_WRITE, overAllBlocks * sizeof(cl_float));
-        cl::Buffer queue(_cl_context, CL_MEM_READ_WRITE, overAllBlocks *sizeof(cl_QueueElement));
-        cl::Buffer targets(_cl_context, CL_MEM_READ_WRITE,numtargets*sizeof(cl_uint4));
-        unsigned int blockborder =  2*(_blockSize[0] + _blockSize[1] - 2);
-        cl::Buffer routing_block_inout(_cl_context, CL_MEM_READ_WRITE, numtargets*(1 + sumBlocks * blockborder ) * sizeof(cl_uint));
-        cl::Buffer routing_inter_block(_cl_context, CL_MEM_READ_WRITE, numtargets*(1 + sumBlocks) * sizeof(cl_uint2));
-
-        std::vector<int4> h_target_plain(h_targets.begin(), h_targets.end());
-        _cl_command_queue.enqueueWriteBuffer(targets, true, 0, numtargets*sizeof(cl_uint4), &h_target_plain[0]);
-
-        cl_QueueGlobal baseQueueInfo(std::min<int>(overAllBlocks + 1, 128*1024));
-        _cl_command_queue.enqueueWriteBuffer(queue_info, true, 0, sizeof(cl_QueueGlobal), &baseQueueInfo);
-
-        //clear data
-        _cl_clearQueueLink_kernel.setArg(0, queue_priority);
-        cl::Event clearQueueLink_Event;
-        _cl_command_queue.enqueueNDRangeKernel
-        (
-          _cl_clearQueueLink_kernel,
-          cl::NullRange,
-          cl::NDRange(numBlocks[0]*numBlocks[1]*numtargets),
-          cl::NullRange,
-          0,
-          &clearQueueLink_Event
-        );
-
-        _cl_clearQueue_kernel.setArg(0, queue);
-        _cl_command_queue.enqueueNDRangeKernel
-        (
-          _cl_clearQueue_kernel,
-          cl::NullRange,
-          cl::NDRange(overAllBlocks),
-          cl::NullRange,
-          0,
-          0
-        );
-
-
-        //insert nodes and prepare data
-        _cl_prepare_kernel.setArg(0, memory_gl[0]);
-        _cl_prepare_kernel.setArg(1, buf);
-        _cl_prepare_kernel.setArg(2, queue);
-        _cl_prepare_kernel.setArg(3, queue_priority);
-        _cl_prepare_kernel.setArg(4, queue_info);
-        _cl_prepare_kernel.setArg(5, sizeof(unsigned int), &overAllBlocks);
-        _cl_prepare_kernel.setArg(6, targets);
-        _cl_prepare_kernel.setArg(7, sizeof(int), &numtargets);
-        _cl_prepare_kernel.setArg(8, 2 * sizeof(int), dim);
-        _cl_prepare_kernel.setArg(9, 2 * sizeof(int), numBlocks);
-
-        cl::Event prepare_kernel_Event;
-        _cl_command_queue.enqueueNDRangeKernel
-        (
-          _cl_prepare_kernel,
-          cl::NullRange,
-          cl::NDRange(_blockSize[0]*numBlocks[0],_blockSize[1]*numBlocks[1],numtargets),
-          cl::NDRange(_blockSize[0], _blockSize[1], 1),
-          0,
-          &prepare_kernel_Event
-        );
-
-        dumpBuffer<float>(_cl_command_queue, buf, width, height * numtargets, "prepare");
-
-        _cl_command_queue.finish();
-        _cl_command_queue.enqueueReadBuffer(queue_info, true, 0, sizeof(cl_QueueGlobal), &baseQueueInfo);
-
-        std::cout << "front: " << baseQueueInfo.front << " "
-                  << "back: " << baseQueueInfo.back << " "
-                  << "filllevel: " << baseQueueInfo.filllevel << " "
-                  << "activeBlocks: " << baseQueueInfo.activeBlocks << " "
-                  << "processedBlocks: " << baseQueueInfo.processedBlocks << " "
-                  << "debug: " << baseQueueInfo.debug << "\n";
-
-        //compute shortest paths
-        size_t localmem = std::max
-        (
-          sizeof(cl_float) * (_blockSize[0] + 2) * (_blockSize[1] + 2),
-          _blockSize[0] * _blockSize[1] * 2 * (sizeof(cl_float) + sizeof(cl_uint))
-        );
-
-        if( _noQueue )
-        {
-          _cl_shortestpath_kernel.setArg(0, memory_gl[0]);
-          _cl_shortestpath_kernel.setArg(1, buf);
-          _cl_shortestpath_kernel.setArg(2, 2 * sizeof(int), dim);
-          _cl_shortestpath_kernel.setArg(3, localmem, NULL);
-        }
-        else
-        {
-          _cl_shortestpath_kernel.setArg(0, memory_gl[0]);
-          _cl_shortestpath_kernel.setArg(1, buf);
-          _cl_shortestpath_kernel.setArg(2, queue);
-          _cl_shortestpath_kernel.setArg(3, queue_priority);
-          _cl_shortestpath_kernel.setArg(4, queue_info);
-          _cl_shortestpath_kernel.setArg(5, sizeof(unsigned int), &overAllBlocks);
-          _cl_shortestpath_kernel.setArg(6, 2 * sizeof(int), dim);
-          _cl_shortestpath_kernel.setArg(7, 2 * sizeof(int), numBlocks);
-          _cl_shortestpath_kernel.setArg(8, sizeof(unsigned int), &blockProcessThreshold);
-          _cl_shortestpath_kernel.setArg(9, localmem, NULL);
-        }
-
-        cl::Event shortestpath_Event;
-        cl_ulong routing_time = 0;
-        size_t num_iterations = std::max(40/numtargets, 10) * std::max(numBlocks[0], numBlocks[1]);
-        if( _noQueue )
-          std::cout << "num_iterations=" << num_iterations << std::endl;
-        for( int i = 0; i < (_noQueue ? num_iterations : 1); ++i )
-        {
-          _cl_command_queue.enqueueNDRangeKernel
-          (
-            _cl_shortestpath_kernel,
-            cl::NullRange,
-            cl::NDRange(_blockSize[0]*numBlocks[0],_blockSize[1]*numBlocks[1],numtargets),
-            cl::NDRange(_blockSize[0], _blockSize[1], 1),
-            0,
-            &shortestpath_Event
-          );
-          _cl_command_queue.finish();
-
-          cl_ulong start, end;
-          shortestpath_Event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          shortestpath_Event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          routing_time += end - start;
-        }
-
-        dumpBuffer<float>(_cl_command_queue, buf, width, height * numtargets, "shortestpath");
-
-        if( !_noQueue )
-        {
-          _cl_command_queue.finish();
-          _cl_command_queue.enqueueReadBuffer(queue_info, true, 0, sizeof(cl_QueueGlobal), &baseQueueInfo);
-
-          std::cout << "front: " << baseQueueInfo.front << " "
-                    << "back: " << baseQueueInfo.back << " "
-                    << "filllevel: " << baseQueueInfo.filllevel << " "
-                    << "activeBlocks: " << baseQueueInfo.activeBlocks << " "
-                    << "processedBlocks: " << baseQueueInfo.processedBlocks << " "
-                    << "debug: " << baseQueueInfo.debug << "\n";
-
-
-          //_cl_command_queue.enqueueReadBuffer(queue_info, true, 0, sizeof(cl_QueueGlobal), &baseQueueInfo);
-          //std::cout << "front: " << baseQueueInfo.front << " "
-          //          << "back: " << baseQueueInfo.back << " "
-          //          << "filllevel: " << baseQueueInfo.filllevel << " "
-          //          << "activeBlocks: " << baseQueueInfo.activeBlocks << " "
-          //          << "processedBlocks: " << baseQueueInfo.processedBlocks << " "
-          //          << "debug: " << baseQueueInfo.debug << "\n";
-          std::cout << "overAllBlocks=" << overAllBlocks << std::endl;
-
-          std::vector<cl_QueueElement> queue_data =
-            dumpRingBuffer<cl_QueueElement>
-            (
-              _cl_command_queue,
-              queue,
-              baseQueueInfo.front,
-              baseQueueInfo.back,
-              overAllBlocks,
-              "queue.txt"
-            );
-          dumpRingBuffer<cl_float>
-          (
-            _cl_command_queue,
-            queue_priority,
-            baseQueueInfo.front,
-            baseQueueInfo.back,
-            overAllBlocks,
-            "queue_priorities.txt"
-          );
-          dumpRingBuffer<cl_float>
-          (
-            _cl_command_queue,
-            queue_priority,
-            0,
-            overAllBlocks - 1,
-            overAllBlocks,
-            "queue_priorities_all.txt"
-          );
-
-          for(size_t i = 0; i < h_targets.size(); ++i)
-            std::cout << h_targets[i].x/_blockSize[0] << "->" <<  h_targets[i].z/_blockSize[0]
-                      << " " << h_targets[i].y/_blockSize[1] << "->" <<  h_targets[i].w/_blockSize[1]
-                      << std::endl;
-
-          std::set<int4> cleanup;
-          for(unsigned int i = 0; i < queue_data.size(); ++i)
-            if(!cleanup.insert(int4(queue_data[i].s[0],queue_data[i].s[1],queue_data[i].s[2],0)).second)
-            {
-              std::cout << "duplicated queue entry: ";
-              for(int j = 0; j < 4; ++j)
-              std::cout << queue_data[i].s[j] << " ";
-              std::cout << "\n";
-            }
-        }
-
-        //search for minimum
-        _cl_command_queue.finish();
-
-        _cl_getMinimum_kernel.setArg(0, buf);
-        _cl_getMinimum_kernel.setArg(1, queue_info);
-        _cl_getMinimum_kernel.setArg(2, idbuffer);
-        _cl_getMinimum_kernel.setArg(3, 2 * sizeof(cl_int), dim);
-        _cl_getMinimum_kernel.setArg(4, numtargets);
-
-        cl::Event getmin_Event;
-        _cl_command_queue.enqueueNDRangeKernel
-        (
-          _cl_getMinimum_kernel,
-          cl::NullRange,
-          cl::NDRange(dim[0],dim[1]),
-          cl::NullRange,
-          0,
-          &getmin_Event
-        );
-
-        _cl_command_queue.finish();
-
-        cl_ushort2 us2_dummy;
-        std::vector<cl_ushort2> h_idbuffer(256, us2_dummy);
-        _cl_command_queue.enqueueReadBuffer(idbuffer, true, 0, sizeof(cl_ushort2)*256, &h_idbuffer[0]);
-        _cl_command_queue.enqueueReadBuffer(queue_info, true, 0, sizeof(cl_QueueGlobal), &baseQueueInfo);
-        //cl_uint cleanedcost = (baseQueueInfo.mincost & 0xFFFFFF00) >> 1;
-        cl_uint idbufferoffset = baseQueueInfo.mincost&0xFF;
-        int startingpoint[2] = {h_idbuffer[idbufferoffset].s[0],
-                                h_idbuffer[idbufferoffset].s[1]};
-        ////debug
-        //std::cout << "front: " << baseQueueInfo.front << "\n"
-        //          << "back: " << baseQueueInfo.back << "\n"
-        //          << "filllevel: " << baseQueueInfo.filllevel << "\n"
-        //          << "activeBlocks: " << baseQueueInfo.activeBlocks << "\n"
-        //          << "processedBlocks: " << baseQueueInfo.processedBlocks << "\n"
-        //          << "min: " <<  *(float*)&cleanedcost << " @ " <<  startingpoint[0] << "," << startingpoint[1] << "\n"
-        //          << "debug: " << baseQueueInfo.debug << "\n\n";
-        ////-----
-
-        _cl_command_queue.finish();
-
-        //local route reconstruction
-        _cl_routeInOut_kernel.setArg(0, buf);
-        _cl_routeInOut_kernel.setArg(1, routing_block_inout);
-        _cl_routeInOut_kernel.setArg(2, _blockSize[0]*_blockSize[1]*sizeof(cl_int), NULL);
-        _cl_routeInOut_kernel.setArg(3, _blockSize[0]*_blockSize[1]*sizeof(cl_int), NULL);
-        _cl_routeInOut_kernel.setArg(4, 2 * sizeof(cl_int), startingpoint);
-        _cl_routeInOut_kernel.setArg(5, 2 * sizeof(cl_int), dim);
-
-        cl::Event routeInOut_Event;
-        _cl_command_queue.enqueueNDRangeKernel
-        (
-          _cl_routeInOut_kernel,
-          cl::NullRange,
-          cl::NDRange(_blockSize[0]*numBlocks[0],_blockSize[1]*numBlocks[1],numtargets),
-          cl::NDRange(_blockSize[0], _blockSize[1], 1),
-          0,
-          &routeInOut_Event
-        );
-
-        _cl_command_queue.finish();
-
-        //inter block route reconstruction
-        _cl_routeInterBlock_kernel.setArg(0, routing_block_inout);
-        _cl_routeInterBlock_kernel.setArg(1, routing_inter_block);
-        _cl_routeInterBlock_kernel.setArg(2, 2 * sizeof(cl_int), startingpoint);
-        _cl_routeInterBlock_kernel.setArg(3, 2 * sizeof(cl_int), numBlocks);
-        _cl_routeInterBlock_kernel.setArg(4, 2 * sizeof(cl_int), _blockSize);
-
-        cl::Event routeInterBlock_Event;
-        _cl_command_queue.enqueueNDRangeKernel
-        (
-          _cl_routeInterBlock_kernel,
-          cl::NullRange,
-          cl::NDRange(numtargets),
-          cl::NDRange(1),
-          0,
-          &routeInterBlock_Event
-        );
-
-        _cl_command_queue.finish();
-
-        //copy info
-        cl_uint2 ui2_dummy;
-        std::vector<cl_uint2> interblockinfo(numtargets, ui2_dummy);
-        _cl_command_queue.enqueueReadBuffer(routing_inter_block, true, 0, sizeof(cl_uint2)*numtargets, &interblockinfo[0]);
-
-        //debug
-        //std::vector<cl_uint2> interblockinfo(numtargets*(1 + sumBlocks), ui2_dummy);
-        //_cl_command_queue.enqueueReadBuffer(routing_inter_block, true, 0, sizeof(cl_uint2)*numtargets*(1 + sumBlocks), &interblockinfo[0]);
-
-        //int points = interblockinfo[0].s[1];
-        //int blocks = interblockinfo[0].s[0];
-        //for(int i = 0; i <= blocks; ++i)
-        //{
-        //  int cost = interblockinfo[numtargets + i].s[0];
-        //  int px = interblockinfo[numtargets + i].s[1] >> 16;
-        //  int py = interblockinfo[numtargets + i].s[1] &0xFFFF;
-
-        //  std::cout << cost << " -> (" << px << "," << py << ")\n";
-        //}
-        //
-
-        int maxpoints = 0, maxblocks = 0;
-        for(int i = 0; i < numtargets; ++i)
-        {
-          maxpoints = std::max<int>(maxpoints, interblockinfo[i].s[1]);
-          maxblocks = std::max<int>(maxblocks, interblockinfo[i].s[0]);
-        }
-
-        //these are the routes! the maxpoints info will also be needed!
-        cl::Buffer routes(_cl_context, CL_MEM_READ_WRITE,maxpoints*sizeof(cl_int2)*numtargets);
-
-        _cl_routeConstruct_kernel.setArg(0, buf);
-        _cl_routeConstruct_kernel.setArg(1, routing_inter_block);
-        _cl_routeConstruct_kernel.setArg(2, routes);
-        _cl_routeConstruct_kernel.setArg(3, maxblocks);
-        _cl_routeConstruct_kernel.setArg(4, maxpoints);
-        _cl_routeConstruct_kernel.setArg(5, numtargets);
-        _cl_routeConstruct_kernel.setArg(6, 2 * sizeof(cl_int), dim);
-        _cl_routeConstruct_kernel.setArg(7, 2 * sizeof(cl_int), numBlocks);
-
-        cl::Event routeConstruct_Event;
-        _cl_command_queue.enqueueNDRangeKernel
-        (
-          _cl_routeConstruct_kernel,
-          cl::NullRange,
-          cl::NDRange(numtargets*maxblocks),
-          cl::NullRange,
-          0,
-          &routeConstruct_Event
-        );
-
-        _cl_command_queue.finish();
-        //copy results to cpu
-        std::vector<cl_int2> outroutes(maxpoints * numtargets);
-        _cl_command_queue.enqueueReadBuffer(routes, true, 0, maxpoints*sizeof(cl_int2)*numtargets, &outroutes[0]);
-
-        //copy routes to hyperedge
-        fork->position.x = (startingpoint[0] + 0.5) * downsample;
-        fork->position.y = (startingpoint[1] + 0.5) * downsample;
-        for(int i = 0; i < numtargets; ++i)
-        {
-          fork->outgoing.push_back(LinkDescription::HyperEdgeDescriptionSegment());
-          fork->outgoing.back().parent = fork;
-          fork->outgoing.back().trail.reserve(interblockinfo[i].s[1]);
-          for(unsigned int j = 0; j < interblockinfo[i].s[1]; ++j)
-          {
-            fork->outgoing.back().trail.push_back
-            (
-              float2( (outroutes[i*maxpoints +j].s[0] + 0.5) * downsample,
-                      (outroutes[i*maxpoints +j].s[1] + 0.5) * downsample )
-            );
-          }
-          fork->outgoing.back().nodes.push_back(h_targets[i].aug);
-        }
-
-        cl_ulong start, end;
-        std::cout << "CLInfo:\n";
-        clearQueueLink_Event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-        clearQueueLink_Event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-        std::cout << " - clearing data: " << (end-start)/1000000.0 << "ms\n";
-        prepare_kernel_Event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-        prepare_kernel_Event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-        std::cout << " - preparing data: " << (end-start)/1000000.0  << "ms\n";
-        std::cout << " - routing: " << routing_time/1000000.0  << "ms\n";
-        getmin_Event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-        getmin_Event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-        std::cout << " - get minimum: " << (end-start)/1000000.0  << "ms\n";
-        routeInOut_Event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-        routeInOut_Event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-        std::cout << " - local route reconstruction: " << (end-start)/1000000.0  << "ms\n";
-        routeInterBlock_Event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-        routeInterBlock_Event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-        std::cout << " - inter block route reconstruction: " << (end-start)/1000000.0  << "ms\n";
-        routeConstruct_Event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-        routeConstruct_Event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-        std::cout << " - route construction: " << (end-start)/1000000.0  << "ms\n";
-      }
-      }
-#endif
-
-      // --------------------------------------------------------
+      LOG_INFO("NEW DATA to route: " << it->_id);
+      hedges.push_back(it->_link.get());
 
       // set as handled
       if( info == _link_infos.end() )
@@ -994,17 +629,23 @@ namespace LinksRouting
         info->second._stamp = it->_stamp;
         info->second._revision = it->_link->getRevision();
       }
-
-      //throw std::runtime_error("Done routing!");
     }
 
+    if( !hedges.empty() )
+      createRoutes(hedges);
+
+    printProfile();
 
+    if( hedges.empty() )
+      return 0;
     }
     catch(cl::Error& err)
     {
       std::cerr << err.err() << "->" << err.what() << std::endl;
       throw;
     }
+
+    return RENDER_DIRTY | MASK_DIRTY;
   }
   //kernel test
 
@@ -2311,7 +1952,8 @@ void calcInterBlockRouteDummy(const float* routecost,
 
   void GPURouting::updateRouteMap()
   {
-    glFinish();
+    if( _gl_sharing )
+      glFinish();
     int computeAll = false;
 
     //update / create buffers
@@ -2335,21 +1977,56 @@ void calcInterBlockRouteDummy(const float* routecost,
 
 
     //------------------------------
-    // get buffer from opengl
+    // get buffer from opengl (or upload it from memory)
     std::vector<cl::Memory> memory_gl;
-    memory_gl.push_back
-    (
-      cl::Image2DGL
+    if( _gl_sharing )
+    {
+      memory_gl.push_back
       (
-         _cl_context,
-         CL_MEM_READ_ONLY,
-         GL_TEXTURE_2D,
-         0,
-         _subscribe_costmap->_data->id
-       )
-    );
+        cl::Image2DGL
+        (
+           _cl_context,
+           CL_MEM_READ_ONLY,
+           GL_TEXTURE_2D,
+           0,
+           _subscribe_costmap->_data->id
+         )
+      );
 
-    _cl_command_queue.enqueueAcquireGLObjects(&memory_gl);
+      _cl_command_queue.enqueueAcquireGLObjects(&memory_gl);
+    }
+    else
+    {
+      if( computeAll )
+        _cl_costmap_image = cl::Image2D( _cl_context,
+                                         CL_MEM_READ_ONLY,
+                                         cl::ImageFormat(CL_R, CL_FLOAT),
+                                         _buffer_width,
+                                         _buffer_height );
+
+      // The last upload might still read from the staging memory
+      if( _costmap_upload() )
+        _costmap_upload.wait();
+
+      const float* costs =
+        reinterpret_cast<const float*>(_subscribe_costmap->_data->pdata);
+      _costmap_staging.assign(costs, costs + _buffer_width * _buffer_height);
+
+      cl::size_t<3> origin, region;
+      region[0] = _buffer_width;
+      region[1] = _buffer_height;
+      region[2] = 1;
+      _cl_command_queue.enqueueWriteImage( _cl_costmap_image,
+                                           CL_FALSE,
+                                           origin,
+                                           region,
+                                           0,
+                                           0,
+                                           &_costmap_staging[0],
+                                           0,
+                                           &_costmap_upload );
+      memory_gl.push_back(_cl_costmap_image);
+    }
 
     cl_int bufferDim[2] = {
       static_cast<cl_int>(_buffer_width),
@@ -2369,7 +2046,6 @@ void calcInterBlockRouteDummy(const float* routecost,
     _cl_updateRouteMap_kernel.setArg(6, sizeof(int), NULL);
 
 
-    cl::Event updateRouteMap_Event;
     _cl_command_queue.enqueueNDRangeKernel
     (
       _cl_updateRouteMap_kernel,
@@ -2377,11 +2053,12 @@ void calcInterBlockRouteDummy(const float* routecost,
       cl::NDRange(_blocks[0]*_blockSize[0], _blocks[1]*_blockSize[1]),
       cl::NDRange(_blockSize[0], _blockSize[1]),
       0,
-      &updateRouteMap_Event
+      profileEvent("updateRouteMap")
     );
 
-    _cl_command_queue.enqueueReleaseGLObjects(&memory_gl);
-    _cl_command_queue.finish();
+    // No need to wait, all following commands use the same (in-order) queue
+    if( _gl_sharing )
+      _cl_command_queue.enqueueReleaseGLObjects(&memory_gl);
 
 
     ////debug
@@ -2415,21 +2092,17 @@ void calcInterBlockRouteDummy(const float* routecost,
     ////
 
 
-    static int count = 0;
-    std::stringstream fname;
-    fname << "costmap" << count++;
-    dumpBuffer<float>(_cl_command_queue, _cl_lastCostMap_buffer, _buffer_width, _buffer_height, fname.str());
-    std::stringstream fname2;
-    fname2 << "routemap" << count;
-    int boundaryElements = 2*(_blockSize[0] + _blockSize[1]-2);
-    dumpBuffer<float>(_cl_command_queue, _cl_routeMap_buffer, _blocks[0]*boundaryElements, _blocks[1]*boundaryElements/2, fname2.str());
-
-
-    cl_ulong start, end;
-    std::cout << "CLInfo:\n";
-    updateRouteMap_Event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-    updateRouteMap_Event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-    std::cout << " - updateRouteMap: " << (end-start)/1000000.0  << "ms\n";
+    if( _dump_buffers )
+    {
+      static int count = 0;
+      std::stringstream fname;
+      fname << "costmap" << count++;
+      dumpBuffer<float>(_cl_command_queue, _cl_lastCostMap_buffer, _buffer_width, _buffer_height, fname.str());
+      std::stringstream fname2;
+      fname2 << "routemap" << count;
+      int boundaryElements = 2*(_blockSize[0] + _blockSize[1]-2);
+      dumpBuffer<float>(_cl_command_queue, _cl_routeMap_buffer, _blocks[0]*boundaryElements, _blocks[1]*boundaryElements/2, fname2.str());
+    }
   }
 
   bool getTargetRect(const std::vector<float2> &vertices, int4& target, int downsample, int buffer_width, int buffer_height)
@@ -2483,7 +2156,7 @@ void calcInterBlockRouteDummy(const float* routecost,
       ++it;
     }
   }
-  void GPURouting::createRoutes(LinksRouting::LinkDescription::HyperEdge& hedge)
+  void GPURouting::createRoutes(const std::vector<LinkDescription::HyperEdge*>& hedges)
   {
 
     //int2 test;
@@ -2510,11 +2183,12 @@ void calcInterBlockRouteDummy(const float* routecost,
 
     int downsample = _subscribe_desktop->_data->width / _subscribe_costmap->_data->width;
     int boundaryElements = 2*(_blockSize[0] + _blockSize[1]-2);
-    cl_ulong start, end;
 
     //there can be loops due to hyperedges connecting the same nodes, so we have to avoid double entries
     //the same way, one node could be put on different levels, so we need to analyse the nodes level first
-    checkLevels(levelNodeMap, levelHyperEdgeMap, hedge);
+    //all changed links are routed together to fill the device with one batch
+    for(auto hedge = hedges.begin(); hedge != hedges.end(); ++hedge)
+      checkLevels(levelNodeMap, levelHyperEdgeMap, **hedge);
 
     //remove routing info
     for(auto edgeIt = levelHyperEdgeMap.begin(); edgeIt != levelHyperEdgeMap.end(); ++edgeIt)
@@ -2553,7 +2227,7 @@ void calcInterBlockRouteDummy(const float* routecost,
     int colelements = (_blocks[0]+1)*(_blockSize[1]-2);
 
     int requiredElements = (_blocks[1]+1)*rowelements + _blocks[1]*colelements;
-    cl::Buffer d_routingData(_cl_context, CL_MEM_READ_WRITE, sizeof(cl_float)*requiredElements*slices);
+    cl::Buffer& d_routingData = getBuffer("routingData", sizeof(cl_float)*requiredElements*slices);
 
 
 
@@ -2587,7 +2261,6 @@ void calcInterBlockRouteDummy(const float* routecost,
 
     _cl_prepareBorderCosts_kernel.setArg(0,d_routingData);
 
-    cl::Event prepareBorderCostsEvent;
     _cl_command_queue.enqueueNDRangeKernel
     (
       _cl_prepareBorderCosts_kernel,
@@ -2595,12 +2268,8 @@ void calcInterBlockRouteDummy(const float* routecost,
       cl::NDRange(requiredElements, slices),
       cl::NullRange,
       0,
-      &prepareBorderCostsEvent
+      profileEvent("prepareBorderCosts")
     );
-    _cl_command_queue.finish();
-    prepareBorderCostsEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-    prepareBorderCostsEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-    std::cout << " - prepareBorderCosts: " << (end-start)/1000000.0  << "ms\n";
 
 
     //bottom up routing -> for every level do:
@@ -2674,11 +2343,11 @@ void calcInterBlockRouteDummy(const float* routecost,
           startBlockRange.push_back(int4(0,0, _blocks[0], _blocks[1]));
         }
 
-        cl::Buffer d_routingIds(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, routingIds.size()*sizeof(cl_uint), &routingIds[0]);
+        cl::Buffer& d_routingIds = uploadBuffer("routingIds", routingIds);
 
         if(routingPoints.size() > 0)
         {
-          cl::Buffer d_routingPoints(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, routingPoints.size()*sizeof(uint4), &routingPoints[0]);
+          cl::Buffer& d_routingPoints = uploadBuffer("routingPoints", routingPoints);
           // init all nodes with geometry
           std::vector<cl_int4> startingBlocks;
           //determine requ. blocks
@@ -2693,7 +2362,7 @@ void calcInterBlockRouteDummy(const float* routecost,
                 startingBlocks.push_back(nblock);
               }
           }
-          cl::Buffer d_prepareIndividualRoutingMapping(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, startingBlocks.size()*sizeof(cl_int4), &startingBlocks[0]);
+          cl::Buffer& d_prepareIndividualRoutingMapping = uploadBuffer("prepareIndividualRoutingMapping", startingBlocks);
 
 
           ////debug
@@ -2724,7 +2393,6 @@ void calcInterBlockRouteDummy(const float* routecost,
           _cl_prepareIndividualRouting_kernel.setArg(7, 2*(_blockSize[0]+2)*(_blockSize[1]+2)*sizeof(float), NULL);
           _cl_prepareIndividualRouting_kernel.setArg(8, sizeof(int), NULL);
 
-          cl::Event prepareIndividualRoutingEvent;
           _cl_command_queue.enqueueNDRangeKernel
           (
             _cl_prepareIndividualRouting_kernel,
@@ -2732,14 +2400,9 @@ void calcInterBlockRouteDummy(const float* routecost,
             cl::NDRange(_blockSize[0]*startingBlocks.size(),_blockSize[1]),
             cl::NDRange(_blockSize[0],_blockSize[1]),
             0,
-            &prepareIndividualRoutingEvent
+            profileEvent("prepareIndividualRouting")
           );
 
-          _cl_command_queue.finish();
-          prepareIndividualRoutingEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          prepareIndividualRoutingEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - prepareIndividualRouting: " << (end-start)/1000000.0  << "ms\n";
-
           ////debug:
           //std::vector<float> mem(requiredElements*slices);
           // _cl_command_queue.enqueueReadBuffer(d_routingData, true, 0, mem.size() * sizeof(float), &mem[0]);
@@ -2761,8 +2424,8 @@ void calcInterBlockRouteDummy(const float* routecost,
             routingSourcesData.insert(routingSourcesData.end(), it->begin(), it->end());
           routingSourcesOffset.push_back(routingSourcesData.size());
 
-          cl::Buffer d_routingSourcesData(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, routingSourcesData.size()*sizeof(cl_uint), &routingSourcesData[0]);
-          cl::Buffer d_routingSourcesOffset(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, routingSourcesOffset.size()*sizeof(cl_uint), &routingSourcesOffset[0]);
+          cl::Buffer& d_routingSourcesData = uploadBuffer("routingSourcesData", routingSourcesData);
+          cl::Buffer& d_routingSourcesOffset = uploadBuffer("routingSourcesOffset", routingSourcesOffset);
 
 
           _cl_prepareIndividualRoutingParent_kernel.setArg(0, d_routingData);
@@ -2773,7 +2436,6 @@ void calcInterBlockRouteDummy(const float* routecost,
           _cl_prepareIndividualRoutingParent_kernel.setArg(5, requiredElements);
           _cl_prepareIndividualRoutingParent_kernel.setArg<float>(6, _Bvalue);
 
-          cl::Event prepareIndividualRoutingParentEvent;
           _cl_command_queue.enqueueNDRangeKernel
           (
             _cl_prepareIndividualRoutingParent_kernel,
@@ -2781,13 +2443,8 @@ void calcInterBlockRouteDummy(const float* routecost,
             cl::NDRange(requiredElements,routingSources.size()),
             cl::NullRange,
             0,
-            &prepareIndividualRoutingParentEvent
+            profileEvent("prepareIndividualRoutingParent")
           );
-
-          _cl_command_queue.finish();
-          prepareIndividualRoutingParentEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          prepareIndividualRoutingParentEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - prepareIndividualRoutingParent: " << (end-start)/1000000.0  << "ms\n";
           //dumpBuffer<float>(_cl_command_queue, d_routingData, requiredElements, slices, "routingPrepareFromParent");
         }
 
@@ -2813,7 +2470,7 @@ void calcInterBlockRouteDummy(const float* routecost,
               br_it->w = center + maxInitDim/2+1;
             }
           }
-          cl::Buffer d_startBlockRange(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, startBlockRange.size()*sizeof(cl_int4), &startBlockRange[0]);
+          cl::Buffer& d_startBlockRange = uploadBuffer("startBlockRange", startBlockRange);
 
 
           ////debug
@@ -2850,11 +2507,10 @@ void calcInterBlockRouteDummy(const float* routecost,
 
           //active buffers
           cl_uint activeBufferSize[] = {divup(_blocks[0],8), divup(_blocks[1],8)};
-          cl::Buffer d_routeActive(_cl_context, CL_MEM_READ_WRITE, 2*activeBufferSize[0]*activeBufferSize[1]*startBlockRange.size()*sizeof(cl_uint));
+          cl::Buffer& d_routeActive = getBuffer("routeActive", 2*activeBufferSize[0]*activeBufferSize[1]*startBlockRange.size()*sizeof(cl_uint));
           _cl_initMem_kernel.setArg(0, d_routeActive);
           _cl_initMem_kernel.setArg(1, 0);
 
-          cl::Event clearActiveBufferEvent;
           _cl_command_queue.enqueueNDRangeKernel
           (
            _cl_initMem_kernel,
@@ -2862,12 +2518,8 @@ void calcInterBlockRouteDummy(const float* routecost,
             cl::NDRange(2*activeBufferSize[0],startBlockRange.size()*activeBufferSize[1]),
             cl::NullRange,
             0,
-            &clearActiveBufferEvent
+            profileEvent("clearActiveBuffer")
           );
-          _cl_command_queue.finish();
-          clearActiveBufferEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          clearActiveBufferEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - clearActiveBuffer: " << (end-start)/1000000.0  << "ms\n";
 
 
 
@@ -2887,7 +2539,6 @@ void calcInterBlockRouteDummy(const float* routecost,
 
           int localWorkerSize = divup(boundaryElements,_routingLocalWorkersWarpSize)*_routingLocalWorkersWarpSize;
 
-          cl::Event routingRoutingEvent;
           _cl_command_queue.enqueueNDRangeKernel
           (
             _cl_routing_kernel,
@@ -2895,12 +2546,8 @@ void calcInterBlockRouteDummy(const float* routecost,
             cl::NDRange(localWorkerSize*startBlockRange.size(),_routingNumLocalWorkers),
             cl::NDRange(localWorkerSize,_routingNumLocalWorkers),
             0,
-            &routingRoutingEvent
+            profileEvent("routingRouting")
           );
-          _cl_command_queue.finish();
-          routingRoutingEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingRoutingEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingRouting: " << (end-start)/1000000.0  << "ms\n";
           //printfBuffer<uint>(_cl_command_queue, d_routeActive, 2*activeBufferSize[0], activeBufferSize[1]*startBlockRange.size(), "activeBuffer");
           //dumpBuffer<float>(_cl_command_queue, d_routingData, requiredElements, slices, "routingRouting");
         }
@@ -2967,12 +2614,12 @@ void calcInterBlockRouteDummy(const float* routecost,
 
         if(needMinSearchIds.size() > 0)
         {
-          cl::Buffer d_needMinSearchIds(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, needMinSearchIds.size()*sizeof(uint), &needMinSearchIds[0]);
-          cl::Buffer d_needMinSearchOffsets(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, needMinSearchOffsets.size()*sizeof(uint), &needMinSearchOffsets[0]);
-          cl::Buffer d_needMinSearchChildren(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, needMinSearchChildren.size()*sizeof(uint), &needMinSearchChildren[0]);
+          cl::Buffer& d_needMinSearchIds = uploadBuffer("needMinSearchIds", needMinSearchIds);
+          cl::Buffer& d_needMinSearchOffsets = uploadBuffer("needMinSearchOffsets", needMinSearchOffsets);
+          cl::Buffer& d_needMinSearchChildren = uploadBuffer("needMinSearchChildren", needMinSearchChildren);
 
           std::vector<float> voteMin(needMinSearchIds.size(), 99999999.f);
-          cl::Buffer d_voteMin(_cl_context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, voteMin.size()*sizeof(float), &voteMin[0]);
+          cl::Buffer& d_voteMin = uploadBuffer("voteMin", voteMin);
 
           _cl_voteMinimum_kernel.setArg(0, d_routingData);
           _cl_voteMinimum_kernel.setArg(1, d_needMinSearchIds);
@@ -2982,7 +2629,6 @@ void calcInterBlockRouteDummy(const float* routecost,
           _cl_voteMinimum_kernel.setArg(5, d_voteMin);
           _cl_voteMinimum_kernel.setArg(6, sizeof(float)*boundaryElements, NULL);
 
-          cl::Event routingVoteMinEvent;
           _cl_command_queue.enqueueNDRangeKernel
           (
             _cl_voteMinimum_kernel,
@@ -2990,22 +2636,15 @@ void calcInterBlockRouteDummy(const float* routecost,
             cl::NDRange(boundaryElements*_blocks[0],_blocks[1],needMinSearchIds.size()),
             cl::NDRange(boundaryElements,1,1),
             0,
-            &routingVoteMinEvent
+            profileEvent("routingVoteMin")
           );
-          _cl_command_queue.finish();
-          //debug
-          _cl_command_queue.enqueueReadBuffer(d_voteMin, true, 0, voteMin.size()*sizeof(float), &voteMin[0]);
-          //
-          routingVoteMinEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingVoteMinEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingVoteMin: " << (end-start)/1000000.0  << "ms\n";
 
 
           int maxResults = 3*32+1;
           std::vector<uint> minSearchResults(needMinSearchIds.size()*maxResults, 0xFFFFFFFF);
           for(size_t i = 0; i < needMinSearchIds.size(); ++i)
             minSearchResults[i*maxResults] = 1;
-          cl::Buffer d_minSearchResults(_cl_context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, minSearchResults.size()*sizeof(uint), &minSearchResults[0]);
+          cl::Buffer& d_minSearchResults = uploadBuffer("minSearchResults", minSearchResults);
 
           _cl_getMinimum_kernel.setArg(0, _cl_lastCostMap_buffer);
           _cl_getMinimum_kernel.setArg(1, d_routingData);
@@ -3024,7 +2663,6 @@ void calcInterBlockRouteDummy(const float* routecost,
           _cl_getMinimum_kernel.setArg(14, sizeof(float)*_blockSize[0]*_blockSize[1], NULL);
           _cl_getMinimum_kernel.setArg(15, sizeof(int), NULL);
 
-          cl::Event routingGetMinEvent;
           _cl_command_queue.enqueueNDRangeKernel
           (
             _cl_getMinimum_kernel,
@@ -3032,12 +2670,8 @@ void calcInterBlockRouteDummy(const float* routecost,
             cl::NDRange(_blockSize[0]*_blocks[0],_blockSize[1]*_blocks[1],needMinSearchIds.size()),
             cl::NDRange(_blockSize[0],_blockSize[1],1),
             0,
-            &routingGetMinEvent
+            profileEvent("routingGetMin")
           );
-          _cl_command_queue.finish();
-          routingGetMinEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingGetMinEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingGetMin: " << (end-start)/1000000.0  << "ms\n";
 
           _cl_command_queue.enqueueReadBuffer(d_minSearchResults, true, 0, minSearchResults.size()*sizeof(uint), &minSearchResults[0]);
           auto thisdatastart = minSearchResults.begin();
@@ -3180,12 +2814,12 @@ void calcInterBlockRouteDummy(const float* routecost,
           //}
           ////
 
-          cl::Buffer d_needRouteConstructionInfo(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, needRouteConstructionInfo.size()*sizeof(uint4), &needRouteConstructionInfo[0]);
-          cl::Buffer d_needRouteConstructionEndElements(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, needRouteConstructionEndElements.size()*sizeof(uint4), &needRouteConstructionEndElements[0]);
-          cl::Buffer d_needRouteConstructionElements(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, needRouteConstructionElements.size()*sizeof(uint4), &needRouteConstructionElements[0]);
+          cl::Buffer& d_needRouteConstructionInfo = uploadBuffer("needRouteConstructionInfo", needRouteConstructionInfo);
+          cl::Buffer& d_needRouteConstructionEndElements = uploadBuffer("needRouteConstructionEndElements", needRouteConstructionEndElements);
+          cl::Buffer& d_needRouteConstructionElements = uploadBuffer("needRouteConstructionElements", needRouteConstructionElements);
 
           int maxBlocksForRoute = _blocks[0]*_blocks[1]/4;
-          cl::Buffer d_blockRoutes(_cl_context, CL_MEM_READ_WRITE, needRouteConstructionElements.size()*maxBlocksForRoute*sizeof(uint));
+          cl::Buffer& d_blockRoutes = getBuffer("blockRoutes", needRouteConstructionElements.size()*maxBlocksForRoute*sizeof(uint));
 
           _cl_routeInterBlock_kernel.setArg(0, d_routingData);
           _cl_routeInterBlock_kernel.setArg(1, _cl_routeMap_buffer);
@@ -3206,7 +2840,6 @@ void calcInterBlockRouteDummy(const float* routecost,
           _cl_routeInterBlock_kernel.setArg(16, sizeof(float)*4, NULL);
           _cl_routeInterBlock_kernel.setArg(17, sizeof(cl_int2)*3, NULL);
 
-          cl::Event routingRouteInterBlockEvent;
           _cl_command_queue.enqueueNDRangeKernel
           (
             _cl_routeInterBlock_kernel,
@@ -3214,12 +2847,8 @@ void calcInterBlockRouteDummy(const float* routecost,
             cl::NDRange(_blockSize[0],_blockSize[1],needRouteConstructionElements.size()),
             cl::NDRange(_blockSize[0],_blockSize[1],1),
             0,
-            &routingRouteInterBlockEvent
+            profileEvent("routingRouteInterBlock")
           );
-          _cl_command_queue.finish();
-          routingRouteInterBlockEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingRouteInterBlockEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingRouteInterBlock: " << (end-start)/1000000.0  << "ms\n";
 
           std::vector<uint> blockRoutes(needRouteConstructionElements.size()*maxBlocksForRoute);
           _cl_command_queue.enqueueReadBuffer(d_blockRoutes, true, 0, blockRoutes.size()*sizeof(uint), &blockRoutes[0]);
@@ -3255,9 +2884,18 @@ void calcInterBlockRouteDummy(const float* routecost,
           }
 
           uint innerBlockRoutesSize = sumBlocks*(4 + 3*(_blockSize[0] + _blockSize[1])/2);
-          cl::Buffer d_innerBlockRoutes(_cl_context, CL_MEM_READ_WRITE, innerBlockRoutesSize*sizeof(uint));
-          uint one = 1;
-          _cl_command_queue.enqueueWriteBuffer(d_innerBlockRoutes, true, 0, sizeof(uint), &one);
+          cl::Buffer& d_innerBlockRoutes = getBuffer("innerBlockRoutes", innerBlockRoutesSize*sizeof(uint));
+
+          // set the first element (allocation counter) without a blocking write
+          _cl_initMem_kernel.setArg(0, d_innerBlockRoutes);
+          _cl_initMem_kernel.setArg(1, 1);
+          _cl_command_queue.enqueueNDRangeKernel
+          (
+            _cl_initMem_kernel,
+            cl::NullRange,
+            cl::NDRange(1),
+            cl::NullRange
+          );
 
           _cl_routeConstruct_kernel.setArg(0, d_routingData);
           _cl_routeConstruct_kernel.setArg(1, _cl_lastCostMap_buffer);
@@ -3274,7 +2912,6 @@ void calcInterBlockRouteDummy(const float* routecost,
           _cl_routeConstruct_kernel.setArg(12, sizeof(float)*(_blockSize[0]+2)*(_blockSize[1]+2), NULL);
           _cl_routeConstruct_kernel.setArg(13, sizeof(int), NULL);
 
-          cl::Event routingRouteConstructEvent;
           _cl_command_queue.enqueueNDRangeKernel
           (
             _cl_routeConstruct_kernel,
@@ -3282,12 +2919,8 @@ void calcInterBlockRouteDummy(const float* routecost,
             cl::NDRange(_blockSize[0]*maxBlocks,_blockSize[1],needRouteConstructionElements.size()),
             cl::NDRange(_blockSize[0],_blockSize[1],1),
             0,
-            &routingRouteConstructEvent
+            profileEvent("routingRouteConstruct")
           );
-          _cl_command_queue.finish();
-          routingRouteConstructEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingRouteConstructEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingRouteConstruct: " << (end-start)/1000000.0  << "ms\n";
 
           std::vector<uint> innerBlockRoutes(innerBlockRoutesSize);
           _cl_command_queue.enqueueReadBuffer(d_innerBlockRoutes, true, 0, innerBlockRoutesSize*sizeof(uint), &innerBlockRoutes[0]);
@@ -3347,7 +2980,7 @@ void calcInterBlockRouteDummy(const float* routecost,
               if((*childrenIt)->getHyperEdgeDescription() == 0)
                 (*childrenIt)->setHyperEdgeDescription
                 (
-                  std::make_shared<LinkDescription::HyperEdgeDescriptionForkation>()
+                  make_pooled<LinkDescription::HyperEdgeDescriptionForkation>()
                 );
               LinkDescription::HyperEdgeDescriptionForkationPtr fork = (*childrenIt)->getHyperEdgeDescription();
               fork->incoming.trail.clear();
@@ -3372,7 +3005,7 @@ void calcInterBlockRouteDummy(const float* routecost,
             if((*needRouteEdgesIt)->getHyperEdgeDescription() == 0)
                 (*needRouteEdgesIt)->setHyperEdgeDescription
                 (
-                  std::make_shared<LinkDescription::HyperEdgeDescriptionForkation>()
+                  make_pooled<LinkDescription::HyperEdgeDescriptionForkation>()
                 );
             LinkDescription::HyperEdgeDescriptionForkationPtr fork = (*needRouteEdgesIt)->getHyperEdgeDescription();
             fork->position = idToPos(hyperEdgeCenters.find((*needRouteEdgesIt))->second, downsample);
@@ -0,0 +1,335 @@
+/*
+ * GLTileCache.cxx
+ *
+ * Per context LRU cache for tile textures.
+ */
+
+#include "GLTileCache.hpp"
+#include "HierarchicTileMap.hpp"
+
+#include <algorithm>
+#include <tuple>
+
+/** Maximum size of an atlas texture (if tiles are not larger) */
+static const size_t ATLAS_SIZE = 2048;
+
+size_t GLTileCache::_max_bytes = 128 * 1024 * 1024;
+size_t GLTileCache::_total_used_bytes = 0;
+
+//------------------------------------------------------------------------------
+bool GLTileCache::Key::operator<(const Key& rhs) const
+{
+  return std::tie(map_id, level, x, y)
+       < std::tie(rhs.map_id, rhs.level, rhs.x, rhs.y);
+}
+
+//------------------------------------------------------------------------------
+GLTileCache::GLTileCache():
+  _used_bytes(0),
+  _frame(0)
+{
+
+}
+
+//------------------------------------------------------------------------------
+GLTileCache::~GLTileCache()
+{
+  _total_used_bytes -= _used_bytes;
+}
+
+//------------------------------------------------------------------------------
+void GLTileCache::setMaxBytes(size_t max_bytes)
+{
+  _max_bytes = max_bytes;
+}
+
+//------------------------------------------------------------------------------
+size_t GLTileCache::getMaxBytes()
+{
+  return _max_bytes;
+}
+
+//------------------------------------------------------------------------------
+size_t GLTileCache::getUsedBytes()
+{
+  return _total_used_bytes;
+}
+
+//------------------------------------------------------------------------------
+void GLTileCache::beginFrame()
+{
+  ++_frame;
+}
+
+//------------------------------------------------------------------------------
+bool GLTileCache::contains( unsigned int map_id,
+                            size_t level, size_t x, size_t y,
+                            unsigned int change_id ) const
+{
+  const Key key = {map_id, level, x, y};
+  auto entry_it = _entries.find(key);
+  return entry_it != _entries.end()
+      && entry_it->second->change_id == change_id;
+}
+
+//------------------------------------------------------------------------------
+const GLTileCache::TexRegion*
+GLTileCache::request( unsigned int map_id,
+                      size_t level, size_t x, size_t y,
+                      const Tile& tile,
+                      size_t slot_width,
+                      size_t slot_height )
+{
+  const bool has_data = tile.type == Tile::ImageRGBA8;
+  const Key key = {map_id, level, x, y};
+
+  EntryList::iterator entry;
+  auto entry_it = _entries.find(key);
+  if( entry_it != _entries.end() )
+  {
+    entry = entry_it->second;
+    _lru.splice(_lru.begin(), _lru, entry);
+    entry->frame = _frame;
+
+    // Keep showing an outdated texture until the new data is available
+    if( entry->change_id == tile.change_id || !has_data )
+      return &entry->region;
+  }
+  else
+  {
+    if( !has_data )
+      return nullptr;
+
+    size_t page_index, slot;
+    if( !allocSlot(slot_width, slot_height, page_index, slot) )
+      return nullptr;
+
+    Entry new_entry;
+    new_entry.key = key;
+    new_entry.page = page_index;
+    new_entry.slot = slot;
+    new_entry.frame = _frame;
+
+    _lru.push_front(new_entry);
+    entry = _entries[key] = _lru.begin();
+  }
+
+  // Map tile into its slot
+  const Page& page = _pages[entry->page];
+  const float page_width = page.num_cols * page.slot_width,
+              page_height = page.num_rows * page.slot_height;
+  const size_t slot_x = (entry->slot % page.num_cols) * page.slot_width,
+               slot_y = (entry->slot / page.num_cols) * page.slot_height;
+
+  TexRegion& region = entry->region;
+  region.tex_id = page.tex_id;
+  region.pos = float2(slot_x / page_width, slot_y / page_height);
+  region.size = float2(tile.width / page_width, tile.height / page_height);
+  region.min = float2( (slot_x + 0.5f) / page_width,
+                       (slot_y + 0.5f) / page_height );
+  region.max = float2( (slot_x + tile.width - 0.5f) / page_width,
+                       (slot_y + tile.height - 0.5f) / page_height );
+
+  entry->change_id = tile.change_id;
+
+  Upload upload = {
+    page.tex_id,
+    static_cast<GLint>(slot_x),
+    static_cast<GLint>(slot_y),
+    static_cast<GLsizei>(tile.width),
+    static_cast<GLsizei>(tile.height),
+    tile.pdata
+  };
+  _uploads.push_back(upload);
+
+  return &region;
+}
+
+//------------------------------------------------------------------------------
+void GLTileCache::flushUploads()
+{
+  if( _uploads.empty() )
+    return;
+
+  std::stable_sort(_uploads.begin(), _uploads.end());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  GLuint bound_tex = 0;
+  for(auto const& upload: _uploads)
+  {
+    if( upload.tex_id != bound_tex )
+    {
+      bound_tex = upload.tex_id;
+      glBindTexture(GL_TEXTURE_2D, bound_tex);
+    }
+
+    glTexSubImage2D( GL_TEXTURE_2D,
+                     0,
+                     upload.x,
+                     upload.y,
+                     upload.width,
+                     upload.height,
+                     GL_RGBA,
+                     GL_UNSIGNED_BYTE,
+                     upload.pdata );
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  _uploads.clear();
+}
+
+//------------------------------------------------------------------------------
+void GLTileCache::clear()
+{
+  for(auto const& page: _pages)
+    if( page.tex_id )
+      glDeleteTextures(1, &page.tex_id);
+
+  _pages.clear();
+  _entries.clear();
+  _lru.clear();
+  _uploads.clear();
+  _total_used_bytes -= _used_bytes;
+  _used_bytes = 0;
+}
+
+//------------------------------------------------------------------------------
+bool GLTileCache::allocSlot( size_t slot_width, size_t slot_height,
+                             size_t& page_index, size_t& slot )
+{
+  if( !slot_width || !slot_height )
+    return false;
+
+  // Evicting may also free a slot of the requested size
+  const size_t slot_bytes = slotBytes(slot_width, slot_height);
+  while(    _max_bytes
+         && _total_used_bytes + slot_bytes > _max_bytes
+         && evict() )
+    ;
+
+  size_t num_slots = 0;
+  for(size_t i = 0; i < _pages.size(); ++i)
+  {
+    Page& page = _pages[i];
+    if(    !page.tex_id
+        || page.slot_width != slot_width
+        || page.slot_height != slot_height )
+      continue;
+
+    num_slots += page.num_cols * page.num_rows;
+    if( page.free_slots.empty() )
+      continue;
+
+    page_index = i;
+    slot = page.free_slots.back();
+    page.free_slots.pop_back();
+
+    _used_bytes += slot_bytes;
+    _total_used_bytes += slot_bytes;
+    return true;
+  }
+
+  // Start with a single slot and double the number of slots of this size with
+  // every new page (up to the maximum atlas size)
+  const size_t max_cols = std::max<size_t>(ATLAS_SIZE / slot_width, 1),
+               max_rows = std::max<size_t>(ATLAS_SIZE / slot_height, 1);
+
+  Page page;
+  page.tex_id = 0;
+  page.slot_width = slot_width;
+  page.slot_height = slot_height;
+  page.num_cols = 1;
+  page.num_rows = 1;
+  while( page.num_cols * page.num_rows < num_slots )
+  {
+    if(    page.num_cols < max_cols
+        && (page.num_cols <= page.num_rows || page.num_rows >= max_rows) )
+      page.num_cols = std::min(2 * page.num_cols, max_cols);
+    else if( page.num_rows < max_rows )
+      page.num_rows = std::min(2 * page.num_rows, max_rows);
+    else
+      break;
+  }
+
+  glGenTextures(1, &page.tex_id);
+  if( !page.tex_id )
+    return false;
+
+  glBindTexture(GL_TEXTURE_2D, page.tex_id);
+  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP );
+  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP );
+  glTexImage2D(
+    GL_TEXTURE_2D,
+    0,
+    GL_RGBA,
+    page.num_cols * slot_width,
+    page.num_rows * slot_height,
+    0,
+    GL_RGBA,
+    GL_UNSIGNED_BYTE,
+    0
+  );
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Hand out slots in row major order
+  const size_t page_slots = page.num_cols * page.num_rows;
+  page.free_slots.reserve(page_slots);
+  for(size_t i = page_slots; i-- > 1;)
+    page.free_slots.push_back(i);
+
+  // Reuse index of a deleted page to keep indices of other pages stable
+  page_index = std::find_if( _pages.begin(),
+                             _pages.end(),
+                             [](const Page& p){ return !p.tex_id; } )
+             - _pages.begin();
+  if( page_index == _pages.size() )
+    _pages.push_back(page);
+  else
+    _pages[page_index] = page;
+
+  _used_bytes += slot_bytes;
+  _total_used_bytes += slot_bytes;
+  slot = 0;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void GLTileCache::freeSlot(size_t page_index, size_t slot)
+{
+  Page& page = _pages[page_index];
+  page.free_slots.push_back(slot);
+
+  const size_t slot_bytes = slotBytes(page.slot_width, page.slot_height);
+  _used_bytes -= slot_bytes;
+  _total_used_bytes -= slot_bytes;
+
+  if( page.free_slots.size() < page.num_cols * page.num_rows )
+    return;
+
+  glDeleteTextures(1, &page.tex_id);
+
+  page.tex_id = 0;
+  std::vector<size_t>().swap(page.free_slots);
+}
+
+//------------------------------------------------------------------------------
+bool GLTileCache::evict()
+{
+  if( _lru.empty() || _lru.back().frame == _frame )
+    return false;
+
+  const Entry& entry = _lru.back();
+  freeSlot(entry.page, entry.slot);
+  _entries.erase(entry.key);
+  _lru.pop_back();
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+size_t GLTileCache::slotBytes(size_t slot_width, size_t slot_height)
+{
+  return slot_width * slot_height * 4;
+}
@@ -6,17 +6,25 @@
  */
 
 #include "HierarchicTileMap.hpp"
+#include "GLTileCache.hpp"
+#include "TileCache.hpp"
 
 #include <GL/gl.h>
 #include <QDebug>
+#include <zlib.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 
+/** Source of unique map ids (see HierarchicTileMap::getMapId) */
+static std::atomic<unsigned int> next_map_id(0);
+
 //----------------------------------------------------------------------------
-Layer::Layer(HierarchicTileMap* map):
-  _map(map)
+Layer::Layer(HierarchicTileMap* map, size_t level):
+  _map(map),
+  _level(level)
 {
 
 }
@@ -68,6 +76,12 @@ HierarchicTileMap* Layer::getMap() const
   return _map;
 }
 
+//------------------------------------------------------------------------------
+size_t Layer::getLevel() const
+{
+  return _level;
+}
+
 //------------------------------------------------------------------------------
 size_t Layer::sizeX() const
 {
@@ -81,9 +95,9 @@ size_t Layer::sizeY() const
 }
 
 //------------------------------------------------------------------------------
-MapRect::QuadList MapRect::getQuads() const
+void MapRect::getQuads(QuadList& quads) const
 {
-  QuadList ret;
+  quads.clear();
   size_t tile_width = layer.getMap()->getTileWidth(),
          tile_height = layer.getMap()->getTileHeight();
 
@@ -94,30 +108,19 @@ MapRect::QuadList MapRect::getQuads() const
            max_x = std::min<float>(max[0] + 0.5, x * tile_width + tile.width),
            max_y = std::min<float>(max[1] + 0.5, y * tile_height + tile.height);
 
-    float2 tex_min( float(min_x - x * tile_width) / tile.width,
-                    float(min_y - y * tile_height) / tile.height ),
-           tex_max( float(max_x - x * tile_width) / tile.width,
-                    float(max_y - y * tile_height) / tile.height );
-
-    size_t left = min_x - min[0],
-           top = min_y - min[1],
-           right = max_x - min[0],
-           bottom = max_y - min[1];
-
-    Quads quads;
-    quads._tex_coords.push_back(float2(tex_min.x, tex_min.y));
-    quads._tex_coords.push_back(float2(tex_max.x, tex_min.y));
-    quads._tex_coords.push_back(float2(tex_max.x, tex_max.y));
-    quads._tex_coords.push_back(float2(tex_min.x, tex_max.y));
-
-    quads._coords.push_back(float2(left,  top));
-    quads._coords.push_back(float2(right, top));
-    quads._coords.push_back(float2(right, bottom));
-    quads._coords.push_back(float2(left,  bottom));
-
-    ret[ &tile ] = quads;
+    Quad quad;
+    quad.tile = &tile;
+    quad.tile_x = x;
+    quad.tile_y = y;
+    quad.tex_min = float2( float(min_x - x * tile_width) / tile.width,
+                           float(min_y - y * tile_height) / tile.height );
+    quad.tex_max = float2( float(max_x - x * tile_width) / tile.width,
+                           float(max_y - y * tile_height) / tile.height );
+    quad.min = float2( size_t(min_x - min[0]), size_t(min_y - min[1]) );
+    quad.max = float2( size_t(max_x - min[0]), size_t(max_y - min[1]) );
+
+    quads.push_back(quad);
   });
-  return ret;
 }
 
 //------------------------------------------------------------------------------
@@ -158,6 +161,7 @@ HierarchicTileMap::HierarchicTileMap( unsigned int width,
                                       unsigned int tile_height ):
    margin_left(0),
    margin_right(0),
+  _map_id( ++next_map_id ),
   _width( width ),
   _height( height ),
   _tile_width( tile_width ),
@@ -170,7 +174,7 @@ HierarchicTileMap::HierarchicTileMap( unsigned int width,
 //------------------------------------------------------------------------------
 HierarchicTileMap::~HierarchicTileMap()
 {
-
+  clearLayers();
 }
 
 //------------------------------------------------------------------------------
@@ -207,21 +211,75 @@ MapRect HierarchicTileMap::requestRect(const Rect& rect, size_t zoom)
 //------------------------------------------------------------------------------
 void HierarchicTileMap::setTileData( size_t x, size_t y, size_t zoom,
                                      const char* data,
-                                     size_t data_size )
+                                     size_t data_size,
+                                     bool prefetched )
 {
-  Tile& tile = getLayer(zoom).getTile(x, y);
+  Layer& layer = getLayer(zoom);
+  Tile& tile = layer.getTile(x, y);
 
   assert( tile.width * tile.height * 4 == data_size );
 
-  if( tile.type == Tile::ImageRGBA8 )
-    delete[] tile.pdata;
+  freeTileData(tile);
   tile.pdata = new uint8_t[data_size];
   memcpy(tile.pdata, data, data_size);
 
   tile.type = Tile::ImageRGBA8;
+  tile.prefetched = prefetched;
+  tile.change_id = ++_change_id;
 
-  ++_change_id;
   emit tileChanged(x, y, zoom);
+
+  // Might evict other tiles (also of this map), so insert only after the tile
+  // is completely set up.
+  TileCache::instance().insert(this, x, y, layer.getLevel(), data_size);
+}
+
+//------------------------------------------------------------------------------
+bool HierarchicTileMap::releaseTile(size_t x, size_t y, size_t level)
+{
+  if( level >= _layers.size() )
+    return false;
+
+  Layer& layer = _layers[level];
+  if( x >= layer.sizeX() || y >= layer.sizeY() )
+    return false;
+
+  Tile& tile = layer.getTile(x, y);
+  if( tile.type != Tile::ImageRGBA8 && tile.compressed.empty() )
+    return false;
+
+  freeTileData(tile);
+
+  ++_change_id;
+  emit tileChanged(x, y, level);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+Tile* HierarchicTileMap::findTile(size_t x, size_t y, size_t level)
+{
+  if( level >= _layers.size() )
+    return nullptr;
+
+  Layer& layer = _layers[level];
+  if( x >= layer.sizeX() || y >= layer.sizeY() )
+    return nullptr;
+
+  return &layer.getTile(x, y);
+}
+
+//------------------------------------------------------------------------------
+size_t HierarchicTileMap::setCompressedTile( size_t x, size_t y, size_t level,
+                                             std::vector<uint8_t>& compressed )
+{
+  Tile* tile = findTile(x, y, level);
+  if( !tile || tile->type != Tile::ImageRGBA8 || compressed.empty() )
+    return 0;
+
+  freeTileData(*tile);
+  tile->compressed.swap(compressed);
+
+  return tile->compressed.size();
 }
 
 //------------------------------------------------------------------------------
@@ -231,72 +289,123 @@ bool HierarchicTileMap::render( const Rect& src_region,
                                 size_t zoom,
                                 bool auto_center,
                                 double alpha,
-                                GLImageCache* cache )
+                                GLTileCache* cache )
 {
   MapRect rect = requestRect(src_region, zoom);
   float2 rect_size = rect.getSize();
-  MapRect::QuadList quads = rect.getQuads();
-  for(auto quad = quads.begin(); quad != quads.end(); ++quad)
+  rect.getQuads(_quads);
+
+  const size_t level = rect.layer.getLevel();
+
+  // Restore pixel data of all tiles first, as this might evict tiles from the
+  // TileCache (Queued texture uploads need valid data).
+  for(auto const& quad: _quads)
   {
+    Tile& tile = *quad.tile;
+    if(    cache
+        && cache->contains( _map_id, level, quad.tile_x, quad.tile_y,
+                            tile.change_id ) )
+      continue;
+
+    if( tile.type == Tile::NONE && !tile.compressed.empty() )
+      decompressTile(tile, quad.tile_x, quad.tile_y, level);
+  }
+
+  if( cache )
+    cache->beginFrame();
+
+  _draw_order.clear();
+  for(size_t i = 0; i < _quads.size(); ++i)
+  {
+    MapRect::Quad& quad = _quads[i];
+    Tile& tile = *quad.tile;
     GLuint tex_id = 0;
 
-    if( quad->first->type == Tile::ImageRGBA8 )
-    {
-      if( cache )
-      {
-        auto cache_it = cache->find(quad->first->pdata);
-        if( cache_it != cache->end() )
-          tex_id = cache_it->second;
-      }
+    if( tile.type == Tile::ImageRGBA8 )
+      TileCache::instance().touch(this, quad.tile_x, quad.tile_y, level);
 
-      if( !tex_id )
+    if( cache )
+    {
+      const GLTileCache::TexRegion* region =
+        cache->request( _map_id, level, quad.tile_x, quad.tile_y,
+                        tile,
+                        _tile_width, _tile_height );
+      if( !region )
+        continue;
+
+      // Map to atlas coordinates
+      for(float2* tex: {&quad.tex_min, &quad.tex_max})
       {
-        std::cout << "load tile to GPU (" << quad->first->width
-                                   << "x" << quad->first->height
-                                   << ")" << std::endl;
-        glGenTextures(1, &tex_id);
-        glBindTexture(GL_TEXTURE_2D, tex_id);
-
-        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP );
-        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP );
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-
-        glTexImage2D(
-          GL_TEXTURE_2D,
-          0,
-          GL_RGBA,
-          quad->first->width,
-          quad->first->height,
-          0,
-          GL_RGBA,
-          GL_UNSIGNED_BYTE,
-          quad->first->pdata
-        );
-
-        if( cache )
-        {
-          (*cache)[ quad->first->pdata ] = tex_id;
-        }
-        else
-        {
-          delete[] quad->first->pdata;
-          quad->first->id = tex_id;
-          quad->first->type = Tile::OpenGLTexture;
-        }
+        tex->x = std::min( std::max( region->pos.x + tex->x * region->size.x,
+                                     region->min.x ),
+                           region->max.x );
+        tex->y = std::min( std::max( region->pos.y + tex->y * region->size.y,
+                                     region->min.y ),
+                           region->max.y );
       }
+      tex_id = region->tex_id;
     }
-    else if( quad->first->type == Tile::OpenGLTexture )
+    else if( tile.type == Tile::ImageRGBA8 )
     {
-      tex_id = quad->first->id;
+      glGenTextures(1, &tex_id);
+      glBindTexture(GL_TEXTURE_2D, tex_id);
+
+      glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+      glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+      glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP );
+      glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP );
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+      glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        GL_RGBA,
+        tile.width,
+        tile.height,
+        0,
+        GL_RGBA,
+        GL_UNSIGNED_BYTE,
+        tile.pdata
+      );
+
+      // Pixel data is not needed anymore once it lives on the GPU
+      TileCache::instance().remove(this, quad.tile_x, quad.tile_y, level);
+      freeTileData(tile);
+      tile.id = tex_id;
+      tile.type = Tile::OpenGLTexture;
+    }
+    else if( tile.type == Tile::OpenGLTexture )
+    {
+      tex_id = tile.id;
     }
 
-    if( !tex_id )
-      continue;
+    if( tex_id )
+      _draw_order.push_back(std::make_pair(tex_id, i));
+  }
+
+  if( cache )
+    cache->flushUploads();
+
+  // Draw all quads sharing a texture at once
+  std::sort(_draw_order.begin(), _draw_order.end());
+
+  _vertices.clear();
+  for(auto const& entry: _draw_order)
+  {
+    const MapRect::Quad& quad = _quads[entry.second];
+    _vertices.push_back(float2(quad.tex_min.x, quad.tex_min.y));
+    _vertices.push_back(float2(quad.min.x,     quad.min.y));
+    _vertices.push_back(float2(quad.tex_max.x, quad.tex_min.y));
+    _vertices.push_back(float2(quad.max.x,     quad.min.y));
+    _vertices.push_back(float2(quad.tex_max.x, quad.tex_max.y));
+    _vertices.push_back(float2(quad.max.x,     quad.max.y));
+    _vertices.push_back(float2(quad.tex_min.x, quad.tex_max.y));
+    _vertices.push_back(float2(quad.min.x,     quad.max.y));
+  }
 
+  if( !_draw_order.empty() )
+  {
     glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, tex_id);
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
     float offset_x = 0;
@@ -309,15 +418,25 @@ bool HierarchicTileMap::render( const Rect& src_region,
                   0 );
 
     glColor4f(alpha,alpha,alpha,alpha);
-    glBegin(GL_QUADS);
-    for(size_t i = 0; i < quad->second._coords.size(); ++i)
+
+    const GLsizei stride = 2 * sizeof(float2);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, stride, _vertices[0].ptr());
+    glVertexPointer(2, GL_FLOAT, stride, _vertices[1].ptr());
+
+    for(size_t first = 0, last = 0; first < _draw_order.size(); first = last)
     {
-      glTexCoord2fv(quad->second._tex_coords[i].ptr());
-      glVertex2fv(quad->second._coords[i].ptr());
+      const GLuint tex_id = _draw_order[first].first;
+      while( last < _draw_order.size() && _draw_order[last].first == tex_id )
+        ++last;
 
-//      std::cout << "    " << quad->second._coords[i] << ", tex: " << quad->second._tex_coords[i] << "\n";
+      glBindTexture(GL_TEXTURE_2D, tex_id);
+      glDrawArrays(GL_QUADS, 4 * first, 4 * (last - first));
     }
-    glEnd();
+
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
 
     glPopMatrix();
 
@@ -381,7 +500,7 @@ float HierarchicTileMap::getLayerScale(size_t zoom) const
 //------------------------------------------------------------------------------
 void HierarchicTileMap::setWidth(size_t width)
 {
-  _layers.clear();
+  clearLayers();
   _width = width;
 
   ++_change_id;
@@ -390,7 +509,7 @@ void HierarchicTileMap::setWidth(size_t width)
 //------------------------------------------------------------------------------
 void HierarchicTileMap::setHeight(size_t height)
 {
-  _layers.clear();
+  clearLayers();
   _height = height;
 
   ++_change_id;
@@ -400,8 +519,8 @@ void HierarchicTileMap::setHeight(size_t height)
 Layer& HierarchicTileMap::getLayer(size_t zoom)
 {
   size_t level = (zoom != static_cast<size_t>(-1)) ? zoom : 0;
-  if( level >= _layers.size() )
-    _layers.resize(level + 1, Layer(this));
+  while( level >= _layers.size() )
+    _layers.push_back(Layer(this, _layers.size()));
 
   Layer& layer = _layers.at(level);
   if( !layer.isInit() )
@@ -418,3 +537,59 @@ Layer& HierarchicTileMap::getLayer(size_t zoom)
 
   return layer;
 }
+
+//------------------------------------------------------------------------------
+void HierarchicTileMap::clearLayers()
+{
+  TileCache::instance().removeMap(this);
+
+  for(auto& layer: _layers)
+    for(size_t x = 0; x < layer.sizeX(); ++x)
+      for(size_t y = 0; y < layer.sizeY(); ++y)
+        freeTileData(layer.getTile(x, y));
+
+  _layers.clear();
+}
+
+//------------------------------------------------------------------------------
+void HierarchicTileMap::freeTileData(Tile& tile)
+{
+  std::vector<uint8_t>().swap(tile.compressed);
+  tile.prefetched = false;
+
+  if( tile.type != Tile::ImageRGBA8 )
+    return;
+
+  delete[] tile.pdata;
+
+  tile.pdata = 0;
+  tile.type = Tile::NONE;
+}
+
+//------------------------------------------------------------------------------
+bool HierarchicTileMap::decompressTile( Tile& tile,
+                                        size_t x, size_t y, size_t level )
+{
+  uLongf data_size = tile.width * tile.height * 4;
+  uint8_t* data = new uint8_t[data_size];
+
+  if(    uncompress( data, &data_size,
+                     tile.compressed.data(), tile.compressed.size() ) != Z_OK
+      || data_size != tile.width * tile.height * 4 )
+  {
+    qWarning() << "Failed to decompress tile" << x << y << level;
+    delete[] data;
+
+    // Drop broken data to get the tile requested again
+    TileCache::instance().remove(this, x, y, level);
+    freeTileData(tile);
+    return false;
+  }
+
+  std::vector<uint8_t>().swap(tile.compressed);
+  tile.pdata = data;
+  tile.type = Tile::ImageRGBA8;
+
+  TileCache::instance().insert(this, x, y, level, data_size);
+  return true;
+}
@@ -0,0 +1,548 @@
+/*
+ * LinkGeometry.cxx
+ *
+ * Retained (VBO based) geometry of all routed links.
+ */
+
+#ifdef WIN32
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif
+# include <windows.h>
+# include <GL/glew.h>
+#else
+# define GL_GLEXT_PROTOTYPES 1
+# include <GL/gl.h>
+# include <GL/glext.h>
+#endif
+
+#include "LinkGeometry.hpp"
+#include "color_helpers.h"
+
+#include <cstddef>
+#include <functional>
+
+namespace LinksRouting
+{
+  namespace
+  {
+    /**
+     * Appearance of a single node (same rules as NodeRenderer::renderNodes)
+     */
+    struct NodeStyle
+    {
+      bool    fill,   //!< Invisible fill (marks region in stencil buffer)
+              filled; //!< Filled instead of outlined
+      QColor  color;
+    };
+
+    //--------------------------------------------------------------------------
+    void hashCombine(size_t& seed, size_t val)
+    {
+      seed ^= val + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    //--------------------------------------------------------------------------
+    void hashFloat(size_t& seed, float val)
+    {
+      hashCombine(seed, std::hash<float>()(val));
+    }
+
+    //--------------------------------------------------------------------------
+    void hashPoints(size_t& seed, const LinkDescription::points_t& points)
+    {
+      hashCombine(seed, points.size());
+      for(auto const& p: points)
+      {
+        hashFloat(seed, p.x);
+        hashFloat(seed, p.y);
+      }
+    }
+
+    /**
+     * Visit all visible nodes and trails of the given links in the same order
+     * as LinkRenderer::renderLinks.
+     *
+     * @param node_func   void(const Node&, const float2& offset,
+     *                         const NodeStyle&)
+     * @param trail_func  void(const HyperEdgeDescriptionSegment&,
+     *                         float widen_size, const QColor&)
+     */
+    template<class NodeFunc, class TrailFunc>
+    void foreachElement( const LinkDescription::LinkList& links,
+                         const NodeFunc& node_func,
+                         const TrailFunc& trail_func )
+    {
+      for(auto const& link: links)
+      {
+        const QColor color = link._color,
+                     color_covered = 0.4f * color;
+
+        HyperEdgeQueue hedges_open;
+        HyperEdgeSet   hedges_done;
+
+        auto visitNodes = [&](const LinkDescription::nodes_t& nodes)
+        {
+          float2 offset;
+          if( !nodes.empty() && nodes.front()->getParent() )
+            offset = nodes.front()->getParent()->get<float2>("screen-offset");
+
+          for(auto const& node: nodes)
+          {
+            bool hover = node->get<bool>("hover");
+            float alpha = node->get<float>("alpha", hover ? 1 : 0);
+            if( alpha > 0.01 )
+              hover = true;
+
+            if( !hover && node->get<bool>("hidden") )
+              continue;
+
+            for(auto const& child: node->getChildren())
+              hedges_open.push(child.get());
+
+            if( node->getVertices().empty() )
+              continue;
+
+            NodeStyle style;
+            style.color = (  ( node->get<bool>("covered")
+                            && !node->get<bool>("hover") )
+                          || node->get<bool>("outside") )
+                        ? color_covered
+                        : color;
+            if( node->get<bool>("outline-title") )
+              style.color *= 0.5;
+
+            style.filled = node->get<bool>("filled", false);
+            style.fill = !style.filled
+                      && !node->get<bool>("outline-only")
+                      && !node->get<bool>("is-window-outline");
+
+            node_func(*node, offset, style);
+          }
+        };
+
+        hedges_open.push(link._link.get());
+        do
+        {
+          const LinkDescription::HyperEdge* hedge = hedges_open.front();
+          hedges_open.pop();
+
+          if( hedges_done.find(hedge) != hedges_done.end() )
+            continue;
+
+          auto fork = hedge->getHyperEdgeDescription();
+          if( !fork )
+            visitNodes(hedge->getNodes());
+          else
+          {
+            for( auto& segment: fork->outgoing )
+            {
+              if( !segment.trail.empty() )
+              {
+                float widen_size = 0.f;
+                if(   !segment.nodes.empty()
+                    && segment.nodes.back()->getChildren().empty()
+                    && segment.get<bool>("widen-end", true) )
+                {
+                  if( !segment.nodes.back()
+                              ->get<std::string>("virtual-outside").empty() )
+                    widen_size = 13;
+                  else
+                    widen_size = 55;
+                }
+
+                trail_func( segment,
+                            widen_size,
+                            segment.get<bool>("covered") ? color_covered
+                                                         : color );
+              }
+
+              visitNodes(segment.nodes);
+            }
+          }
+
+          hedges_done.insert(hedge);
+        } while( !hedges_open.empty() );
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  LinkGeometry::LinkGeometry():
+    _line_width(3),
+    _links_revision(0),
+    _revision(0),
+    _valid(false),
+    _upload(false),
+    _vbo(0),
+    _num_vertices(0),
+    _src(nullptr),
+    _src_bucket(0),
+    _src_revision(0)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  LinkGeometry::~LinkGeometry()
+  {
+    // Buffers can only be freed with the according context being current, so
+    // owners need to call release() before.
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::setLineWidth(float w)
+  {
+    if( w == _line_width )
+      return;
+
+    _line_width = w;
+    _valid = false;
+  }
+
+  //----------------------------------------------------------------------------
+  bool LinkGeometry::update( const LinkDescription::LinkList& links,
+                             uint32_t links_revision )
+  {
+    if( _valid && !_src && links_revision == _links_revision )
+      return false;
+
+    build(links);
+    _links_revision = links_revision;
+    _src = nullptr;
+    _valid = true;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool LinkGeometry::update(const LinkGeometry& src, size_t bucket)
+  {
+    if(    _valid
+        && _src == &src
+        && _src_bucket == bucket
+        && _src_revision == src._revision )
+      return false;
+
+    _vertices.clear();
+    _ranges.clear();
+    _elements.clear();
+
+    if( bucket < src._buckets.size() )
+      for(auto const& range: src._buckets[bucket].ranges)
+      {
+        addRange(_ranges, _vertices.size(), range.count, range.type);
+        _vertices.insert( _vertices.end(),
+                          src._vertices.begin() + range.first,
+                          src._vertices.begin() + range.first + range.count );
+      }
+    updateBuckets();
+
+    _src = &src;
+    _src_bucket = bucket;
+    _src_revision = src._revision;
+    _valid = true;
+    _upload = true;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::setBuckets(const std::vector<Rect>& regions)
+  {
+    _buckets.clear();
+    for(auto const& region: regions)
+    {
+      Bucket bucket;
+      bucket.region = region;
+      _buckets.push_back(bucket);
+    }
+    updateBuckets();
+  }
+
+  //----------------------------------------------------------------------------
+  bool LinkGeometry::isBucketEmpty(size_t bucket) const
+  {
+    return bucket >= _buckets.size()
+        || _buckets[bucket].ranges.empty();
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::getBounds(std::vector<Rect>& bounds) const
+  {
+    for(auto const& el: _elements)
+      bounds.push_back(el.bbox);
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t LinkGeometry::getRevision() const
+  {
+    return _revision;
+  }
+
+  //----------------------------------------------------------------------------
+  bool LinkGeometry::render(bool use_stencil)
+  {
+    if( _upload )
+      upload();
+
+    if( !_num_vertices )
+      return false;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glVertexPointer( 2,
+                     GL_FLOAT,
+                     sizeof(Vertex),
+                     reinterpret_cast<const GLvoid*>(offsetof(Vertex, pos)) );
+    glColorPointer( 4,
+                    GL_UNSIGNED_BYTE,
+                    sizeof(Vertex),
+                    reinterpret_cast<const GLvoid*>(offsetof(Vertex, color)) );
+
+    for(auto const& range: _ranges)
+    {
+      if( use_stencil )
+      {
+        if( range.type == REGION )
+        {
+          // Mask every region covered by a highlight to prevent drawing links
+          // on top of them
+          glStencilFunc(GL_ALWAYS, 1, 1);
+          glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        }
+        else
+        {
+          glStencilFunc(GL_EQUAL, 0, 1);
+          glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        }
+      }
+
+      glDrawArrays(GL_TRIANGLES, range.first, range.count);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::release()
+  {
+    if( _vbo )
+      glDeleteBuffers(1, &_vbo);
+    _vbo = 0;
+    _num_vertices = 0;
+    _border_cache.clear();
+
+    // Ensure everything is uploaded again if rendered afterwards
+    _valid = false;
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::build(const LinkDescription::LinkList& links)
+  {
+    _vertices.clear();
+    _ranges.clear();
+    _elements.clear();
+    for(auto& cached: _border_cache)
+      cached.second.used = false;
+
+    foreachElement
+    (
+      links,
+      [&]( const LinkDescription::Node& node,
+           const float2& offset,
+           const NodeStyle& style )
+      {
+        const size_t first = _vertices.size();
+        if( style.fill )
+          addFan(node.getVertices(), offset, QColor(0, 0, 0, 0));
+
+        const line_borders_t& region =
+          getBorders(&node, node.getVertices(), _line_width, true);
+
+        if( style.filled )
+          addFan(region.second, offset, style.color);
+        else
+          addStrip(region.first, region.second, offset, style.color);
+
+        addElement(REGION, first);
+      },
+      [&]( const LinkDescription::HyperEdgeDescriptionSegment& segment,
+           float widen_size,
+           const QColor& color )
+      {
+        const line_borders_t& region =
+          getBorders(&segment, segment.trail, 3, false, widen_size);
+        const size_t first = _vertices.size();
+        addStrip(region.first, region.second, float2(), color);
+        addElement(TRAIL, first);
+      }
+    );
+
+    // Forget about nodes and segments which are gone
+    for(auto it = _border_cache.begin(); it != _border_cache.end();)
+    {
+      if( it->second.used )
+        ++it;
+      else
+        it = _border_cache.erase(it);
+    }
+
+    updateBuckets();
+    _upload = true;
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::updateBuckets()
+  {
+    for(auto& bucket: _buckets)
+    {
+      bucket.ranges.clear();
+      for(auto const& el: _elements)
+        if( el.bbox.intersects(bucket.region) )
+          addRange(bucket.ranges, el.first, el.count, el.type);
+    }
+
+    ++_revision;
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::addElement(ElementType type, size_t first)
+  {
+    if( first >= _vertices.size() )
+      return;
+
+    Element el;
+    el.first = first;
+    el.count = _vertices.size() - first;
+    el.type = type;
+    for(size_t i = first; i < _vertices.size(); ++i)
+      el.bbox.expand( float2(_vertices[i].pos[0], _vertices[i].pos[1]) );
+
+    _elements.push_back(el);
+    addRange(_ranges, el.first, el.count, el.type);
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::addRange( Ranges& ranges,
+                               size_t first,
+                               size_t count,
+                               ElementType type )
+  {
+    // Merge adjacent elements to keep the number of copies (and draw calls)
+    // low.
+    if(    !ranges.empty()
+        && ranges.back().type == type
+        && ranges.back().first + ranges.back().count == first )
+      ranges.back().count += count;
+    else
+      ranges.push_back({first, count, type});
+  }
+
+  //----------------------------------------------------------------------------
+  const line_borders_t&
+  LinkGeometry::getBorders( const void* key,
+                            const LinkDescription::points_t& points,
+                            float width,
+                            bool closed,
+                            float widen_end )
+  {
+    // The address alone is not enough, as the same node or segment might have
+    // been modified in place or the memory might have been reused.
+    size_t hash = closed;
+    hashFloat(hash, width);
+    hashFloat(hash, widen_end);
+    hashPoints(hash, points);
+
+    auto cached = _border_cache.find(key);
+    if( cached == _border_cache.end() )
+      cached = _border_cache.insert({key, CachedBorders()}).first;
+    else if( cached->second.hash == hash )
+    {
+      cached->second.used = true;
+      return cached->second.borders;
+    }
+
+    _extruder.extrude(points, width, closed, widen_end, cached->second.borders);
+    cached->second.hash = hash;
+    cached->second.used = true;
+
+    return cached->second.borders;
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::upload()
+  {
+    _num_vertices = _vertices.size();
+    _upload = false;
+
+    if( !_num_vertices )
+      return;
+
+    if( !_vbo )
+      glGenBuffers(1, &_vbo);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData( GL_ARRAY_BUFFER,
+                  _vertices.size() * sizeof(Vertex),
+                  _vertices.data(),
+                  GL_STATIC_DRAW );
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::addStrip( const std::vector<float2>& first,
+                               const std::vector<float2>& second,
+                               const float2& offset,
+                               const QColor& color )
+  {
+    // Triangle strip as independent triangles to allow batching everything
+    // into a single draw call.
+    for(size_t i = 1; i < first.size() && i < second.size(); ++i)
+    {
+      addVertex(offset + first[i - 1], color);
+      addVertex(offset + second[i - 1], color);
+      addVertex(offset + first[i], color);
+
+      addVertex(offset + second[i - 1], color);
+      addVertex(offset + second[i], color);
+      addVertex(offset + first[i], color);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  template<class Points>
+  void LinkGeometry::addFan( const Points& points,
+                             const float2& offset,
+                             const QColor& color )
+  {
+    // Regions are convex (same as required for GL_POLYGON)
+    for(size_t i = 2; i < points.size(); ++i)
+    {
+      addVertex(offset + points[0], color);
+      addVertex(offset + points[i - 1], color);
+      addVertex(offset + points[i], color);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void LinkGeometry::addVertex(const float2& pos, const QColor& color)
+  {
+    Vertex v = {
+      {pos.x, pos.y},
+      { static_cast<uint8_t>(color.red()),
+        static_cast<uint8_t>(color.green()),
+        static_cast<uint8_t>(color.blue()),
+        static_cast<uint8_t>(color.alpha()) }
+    };
+    _vertices.push_back(v);
+  }
+
+} // namespace LinksRouting
@@ -134,9 +134,9 @@ namespace LinksRouting
       }
 
       qtGlColor(color_cur);
-      line_borders_t region = calcLineBorders( (*node)->getVertices(),
-                                               _line_width,
-                                               true );
+      const line_borders_t& region = _extruder.extrude( (*node)->getVertices(),
+                                                        _line_width,
+                                                        true );
       glBegin(filled ? GL_POLYGON : GL_TRIANGLE_STRIP);
       for( auto first = std::begin(region.first),
                 second = std::begin(region.second);
@@ -265,32 +265,22 @@ namespace LinksRouting
 #if 1
     if( _partitions_dest && _partitions_src )
     {
-      float last_src = 0,
-            last_dest = 0,
-            ref_y = y;
-      for( auto src = _partitions_src->begin(),
-                dest = _partitions_dest->begin();
-                src != _partitions_src->end() &&
-                dest != _partitions_dest->end();
-              ++src,
-              ++dest )
+      const float ref_y = y;
+      const size_t i = findPartition(*_partitions_src, ref_y)
+                     - _partitions_src->begin();
+      if( i < _partitions_dest->size() )
       {
-        if( ref_y <= src->x )
+        const float2& src = (*_partitions_src)[i],
+                    & dest = (*_partitions_dest)[i];
+        if( ref_y <= src.x )
         {
-          float t = (ref_y - last_src) / (src->x - last_src);
-          y = (1 - t) * last_dest + t * dest->x;
-        }
-        else if( ref_y <= src->y )
-        {
-          y -= src->x - dest->x;
+          float last_src = i ? (*_partitions_src)[i - 1].y : 0,
+                last_dest = i ? (*_partitions_dest)[i - 1].y : 0;
+          float t = (ref_y - last_src) / (src.x - last_src);
+          y = (1 - t) * last_dest + t * dest.x;
         }
         else
-        {
-          last_src = src->y;
-          last_dest = dest->y;
-          continue;
-        }
-        break;
+          y -= src.x - dest.x;
       }
 
       x -= _margin_left;
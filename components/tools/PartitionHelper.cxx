@@ -7,78 +7,91 @@
 
 #include "PartitionHelper.hxx"
 #include <algorithm>
+#include <sstream>
+
+//------------------------------------------------------------------------------
+static bool endsBefore(const float2& part, float pos)
+{
+  return part.y < pos;
+}
 
 //------------------------------------------------------------------------------
 void PartitionHelper::add(const float2& interval)
 {
   // Keep intervals always ordered and merge if overlapping
-  for( auto part = _partitions.begin();
-            part != _partitions.end();
-          ++part )
-  {
-    // Completely before current interval
-    if( interval.y < part->x )
-    {
-      _partitions.insert(part, interval);
-      return;
-    }
+  auto part = std::lower_bound( _partitions.begin(),
+                                _partitions.end(),
+                                interval.x,
+                                &endsBefore );
 
-    // Completely after current interval
-    if( interval.x > part->y )
-      continue;
+  // Completely before current interval (or after all intervals)
+  if( part == _partitions.end() || interval.y < part->x )
+  {
+    _partitions.insert(part, interval);
+    return;
+  }
 
-    // Merge
-    *part = float2( std::min(part->x, interval.x),
-                    std::max(part->y, interval.y) );
+  // Merge
+  *part = float2( std::min(part->x, interval.x),
+                  std::max(part->y, interval.y) );
 
-    // Merge all following, overlapping intervals
-    auto part2 = part;
-    for( ++part2;
-           part2 != _partitions.end();
-           part2 = _partitions.erase(part2) )
-    {
-      if( part2->x > part->y )
-        break;
+  // Merge all following, overlapping intervals
+  auto last = part + 1;
+  for(; last != _partitions.end() && last->x <= part->y; ++last)
+    part->y = std::max(part->y, last->y);
 
-      part->y = std::max(part->y, part2->y);
-    }
+  _partitions.erase(part + 1, last);
+}
 
-    return;
+//------------------------------------------------------------------------------
+void PartitionHelper::assign(std::vector<float2> intervals)
+{
+  std::sort( intervals.begin(),
+             intervals.end(),
+             [](const float2& lhs, const float2& rhs)
+             {
+               return lhs.x < rhs.x;
+             } );
+
+  _partitions.clear();
+  for(auto const& interval: intervals)
+  {
+    if( !_partitions.empty() && interval.x <= _partitions.back().y )
+      _partitions.back().y = std::max(_partitions.back().y, interval.y);
+    else
+      _partitions.push_back(interval);
   }
-
-  _partitions.push_back(interval);
 }
 
 //------------------------------------------------------------------------------
 void PartitionHelper::clip(float min, float max, float cut)
 {
-  Partitions::iterator part = _partitions.begin();
-  if( part == _partitions.end() )
-    return;
-
-  if( part->x <= 0 )
-    part->x = 0;
-  else
-    part->x += cut;
-  part->y -= cut;
-
-  if( part->y <= part->x )
-    part = _partitions.erase(part);
-  if( part == _partitions.end() )
-    return;
-
-  for(++part; part != _partitions.end(); ++part)
+  size_t num_parts = 0;
+  for(size_t i = 0; i < _partitions.size(); ++i)
   {
-    part->x += cut;
-
-    if( part->y >= max )
-      part->y = max;
+    float2 part = _partitions[i];
+    if( i == 0 )
+    {
+      if( part.x <= 0 )
+        part.x = 0;
+      else
+        part.x += cut;
+      part.y -= cut;
+    }
     else
-      part->y -= cut;
+    {
+      part.x += cut;
+
+      if( part.y >= max )
+        part.y = max;
+      else
+        part.y -= cut;
+    }
 
-    if( part->y <= part->x )
-      part = _partitions.erase(part);
+    if( part.y > part.x )
+      _partitions[num_parts++] = part;
   }
+  _partitions.resize(num_parts);
 }
 
 //------------------------------------------------------------------------------
@@ -123,6 +136,12 @@ Partitions PartitionHelper::getInverted(float min, float max)
 }
 #endif
 
+//------------------------------------------------------------------------------
+Partitions::const_iterator findPartition(const Partitions& p, float pos)
+{
+  return std::lower_bound(p.begin(), p.end(), pos, &endsBefore);
+}
+
 //------------------------------------------------------------------------------
 std::string to_string(const Partitions& p)
 {
@@ -0,0 +1,237 @@
+/*
+ * TileCache.cxx
+ *
+ * Global LRU cache for tile pixel data.
+ */
+
+#include "TileCache.hpp"
+#include "HierarchicTileMap.hpp"
+
+#include <tuple>
+
+//------------------------------------------------------------------------------
+bool TileCache::Key::operator<(const Key& rhs) const
+{
+  return std::tie(map, level, x, y)
+       < std::tie(rhs.map, rhs.level, rhs.x, rhs.y);
+}
+
+//------------------------------------------------------------------------------
+TileCache& TileCache::instance()
+{
+  static TileCache cache;
+  return cache;
+}
+
+//------------------------------------------------------------------------------
+TileCache::TileCache():
+  _max_bytes(256 * 1024 * 1024),
+  _used_bytes(0),
+  _compressing_bytes(0),
+  _next_serial(0),
+  _compress_cold(false)
+{
+  QObject::connect( &_compressor, &TileCompressor::tilesCompressed,
+                    &_compressor, [this](){ onTilesCompressed(); },
+                    Qt::QueuedConnection );
+}
+
+//------------------------------------------------------------------------------
+void TileCache::setMaxBytes(size_t max_bytes)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _max_bytes = max_bytes;
+  evict();
+}
+
+//------------------------------------------------------------------------------
+size_t TileCache::getMaxBytes() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _max_bytes;
+}
+
+//------------------------------------------------------------------------------
+size_t TileCache::getUsedBytes() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _used_bytes;
+}
+
+//------------------------------------------------------------------------------
+void TileCache::setCompressCold(bool compress)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _compress_cold = compress;
+}
+
+//------------------------------------------------------------------------------
+bool TileCache::getCompressCold() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _compress_cold;
+}
+
+//------------------------------------------------------------------------------
+void TileCache::insert( HierarchicTileMap* map,
+                        size_t x, size_t y, size_t level,
+                        size_t num_bytes )
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  Key key = {map, level, x, y};
+  auto it = _entries.find(key);
+  if( it != _entries.end() )
+    erase(it);
+
+  Entry entry = {key, num_bytes, RAW, _next_serial++};
+  _lru.push_front(entry);
+  _entries[key] = _lru.begin();
+  _used_bytes += num_bytes;
+
+  evict();
+}
+
+//------------------------------------------------------------------------------
+void TileCache::touch(HierarchicTileMap* map, size_t x, size_t y, size_t level)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  Key key = {map, level, x, y};
+  auto it = _entries.find(key);
+  if( it == _entries.end() || it->second == _lru.begin() )
+    return;
+
+  _lru.splice(_lru.begin(), _lru, it->second);
+}
+
+//------------------------------------------------------------------------------
+void TileCache::remove(HierarchicTileMap* map, size_t x, size_t y, size_t level)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  Key key = {map, level, x, y};
+  auto it = _entries.find(key);
+  if( it == _entries.end() )
+    return;
+
+  erase(it);
+}
+
+//------------------------------------------------------------------------------
+void TileCache::removeMap(HierarchicTileMap* map)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  Key first = {map, 0, 0, 0};
+  for( auto it = _entries.lower_bound(first);
+            it != _entries.end() && it->first.map == map; )
+    it = erase(it);
+}
+
+//------------------------------------------------------------------------------
+void TileCache::evict()
+{
+  if( !_max_bytes )
+    return;
+
+  if( _compress_cold )
+  {
+    // Queue compressing tiles starting with the least recently used one, but
+    // never the most recently used tile, as it is probably just about to be
+    // rendered. Tiles being compressed are expected to free most of their
+    // memory, so the budget may be exceeded until the results arrive.
+    auto it = _lru.end();
+    while(    _used_bytes - _compressing_bytes > _max_bytes
+           && !_lru.empty()
+           && --it != _lru.begin() )
+    {
+      if( it->state != RAW )
+        continue;
+
+      Tile* tile = it->key.map->findTile(it->key.x, it->key.y, it->key.level);
+      if( !tile || tile->type != Tile::ImageRGBA8 )
+        continue;
+
+      TileCompressor::Job job = {
+        it->key.map,
+        it->key.x,
+        it->key.y,
+        it->key.level,
+        it->serial,
+        QByteArray( reinterpret_cast<const char*>(tile->pdata),
+                    tile->width * tile->height * 4 )
+      };
+      _compressor.enqueue(job);
+
+      it->state = COMPRESSING;
+      _compressing_bytes += it->num_bytes;
+    }
+  }
+
+  // Always keep the most recently used tile, even if it alone exceeds the
+  // budget. Otherwise it would be requested again immediately.
+  while( _used_bytes - _compressing_bytes > _max_bytes && _lru.size() > 1 )
+  {
+    const Entry& entry = _lru.back();
+    entry.key.map->releaseTile(entry.key.x, entry.key.y, entry.key.level);
+    erase(_entries.find(entry.key));
+  }
+}
+
+//------------------------------------------------------------------------------
+TileCache::EntryMap::iterator TileCache::erase(EntryMap::iterator it)
+{
+  const Entry& entry = *it->second;
+  _used_bytes -= entry.num_bytes;
+  if( entry.state == COMPRESSING )
+    _compressing_bytes -= entry.num_bytes;
+
+  _lru.erase(it->second);
+  return _entries.erase(it);
+}
+
+//------------------------------------------------------------------------------
+void TileCache::onTilesCompressed()
+{
+  TileCompressor::Results results = _compressor.takeResults();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  for(auto& result: results)
+  {
+    Key key = {result.map, result.level, result.x, result.y};
+    auto it = _entries.find(key);
+    if(    it == _entries.end()
+        || it->second->serial != result.serial
+        || it->second->state != COMPRESSING )
+      continue;
+
+    Entry& entry = *it->second;
+    _compressing_bytes -= entry.num_bytes;
+
+    if( it->second == _lru.begin() )
+    {
+      // Rendered again meanwhile
+      entry.state = RAW;
+      continue;
+    }
+
+    size_t num_bytes =
+      entry.key.map->setCompressedTile( entry.key.x,
+                                        entry.key.y,
+                                        entry.key.level,
+                                        result.compressed );
+    if( !num_bytes )
+    {
+      entry.state = INCOMPRESSIBLE;
+      continue;
+    }
+
+    _used_bytes = _used_bytes - entry.num_bytes + num_bytes;
+    entry.num_bytes = num_bytes;
+    entry.state = COMPRESSED;
+  }
+
+  // Drop tiles which could not be compressed (or did not save enough memory)
+  evict();
+}
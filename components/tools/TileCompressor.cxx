@@ -0,0 +1,113 @@
+/*
+ * TileCompressor.cxx
+ *
+ * Compress cold tiles in a background thread.
+ */
+
+#include "TileCompressor.hpp"
+
+#include <zlib.h>
+
+//------------------------------------------------------------------------------
+TileCompressor::TileCompressor():
+  _stop(false)
+{
+
+}
+
+//------------------------------------------------------------------------------
+TileCompressor::~TileCompressor()
+{
+  stop();
+}
+
+//------------------------------------------------------------------------------
+void TileCompressor::enqueue(const Job& job)
+{
+  QMutexLocker lock(&_mutex);
+  if( _stop )
+    return;
+
+  _jobs.push_back(job);
+  _cond_jobs.wakeOne();
+  lock.unlock();
+
+  if( !isRunning() )
+    start(QThread::LowPriority);
+}
+
+//------------------------------------------------------------------------------
+TileCompressor::Results TileCompressor::takeResults()
+{
+  Results results;
+
+  QMutexLocker lock(&_mutex);
+  results.swap(_results);
+
+  return results;
+}
+
+//------------------------------------------------------------------------------
+void TileCompressor::stop()
+{
+  {
+    QMutexLocker lock(&_mutex);
+    _stop = true;
+    _cond_jobs.wakeAll();
+  }
+  wait();
+}
+
+//------------------------------------------------------------------------------
+bool TileCompressor::compress( const QByteArray& pixels,
+                               std::vector<uint8_t>& compressed )
+{
+  uLong src_size = pixels.size();
+  uLongf dest_size = compressBound(src_size);
+  compressed.resize(dest_size);
+
+  if(    compress2( compressed.data(), &dest_size,
+                    reinterpret_cast<const Bytef*>(pixels.constData()),
+                    src_size,
+                    Z_BEST_SPEED ) != Z_OK
+      || dest_size >= src_size )
+  {
+    std::vector<uint8_t>().swap(compressed);
+    return false;
+  }
+
+  compressed.resize(dest_size);
+  compressed.shrink_to_fit();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void TileCompressor::run()
+{
+  QMutexLocker lock(&_mutex);
+  while( !_stop )
+  {
+    if( _jobs.empty() )
+    {
+      _cond_jobs.wait(&_mutex);
+      continue;
+    }
+
+    Job job = _jobs.front();
+    _jobs.pop_front();
+
+    lock.unlock();
+    Result result = {job.map, job.x, job.y, job.level, job.serial, {}};
+    compress(job.pixels, result.compressed);
+    lock.relock();
+
+    _results.push_back(result);
+    if( _jobs.empty() || _results.size() >= 4 )
+    {
+      // Notify only after a batch of tiles to reduce the number of events
+      lock.unlock();
+      emit tilesCompressed();
+      lock.relock();
+    }
+  }
+}
@@ -26,6 +26,7 @@ struct is_container:
   {};
 
 IS_CONTAINER_T(std::vector)
+IS_CONTAINER(LinksRouting::LinkDescription::points_t)
 
 IS_CONTAINER_T(QList)
 IS_CONTAINER_T(QSet)
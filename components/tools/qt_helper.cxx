@@ -6,6 +6,10 @@
  */
 
 #include "qt_helper.hxx"
+#include "log.hpp"
+
+#include <QtGlobal>
+#include <cstdlib>
 
 //------------------------------------------------------------------------------
 std::string to_string(const QString& str)
@@ -24,3 +28,41 @@ std::ostream& operator<<(std::ostream& strm, const QString& str)
 {
   return strm << to_string(str);
 }
+
+//------------------------------------------------------------------------------
+static void logMessageHandler( QtMsgType type,
+                               const QMessageLogContext& context,
+                               const QString& msg )
+{
+  using namespace LinksRouting;
+
+  Log::Level level;
+  switch( type )
+  {
+    case QtDebugMsg:    level = Log::LEVEL_DEBUG; break;
+    case QtWarningMsg:  level = Log::LEVEL_WARN;  break;
+    case QtCriticalMsg:
+    case QtFatalMsg:    level = Log::LEVEL_ERROR; break;
+    default:            level = Log::LEVEL_INFO;  break;
+  }
+
+  if( type != QtFatalMsg && !Log::enabled(level) )
+    return;
+
+  Log::write( level,
+              to_string(msg),
+              std::string(),
+              context.function ? context.function : "Qt" );
+
+  if( type == QtFatalMsg )
+  {
+    Log::shutdown();
+    std::abort();
+  }
+}
+
+//------------------------------------------------------------------------------
+void installLogMessageHandler()
+{
+  qInstallMessageHandler(&logMessageHandler);
+}
@@ -7,22 +7,25 @@
 
 #include "routing.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace LinksRouting
 {
 
   //----------------------------------------------------------------------------
-  bool
-  Routing::cmp_by_angle::operator()
-  (
-    Routing::segment_iterator const& lhs,
-    Routing::segment_iterator const& rhs
-  ) const
+  void Routing::OrderedSegments::insert(segment_iterator const& segment)
   {
-    return getAngle(lhs->trail) < getAngle(rhs->trail);
+    const float key = getPseudoAngle(segment->trail);
+    const size_t index =
+      std::upper_bound(_keys.begin(), _keys.end(), key) - _keys.begin();
+
+    _keys.insert(_keys.begin() + index, key);
+    _segments.insert(_segments.begin() + index, segment);
   }
 
   //----------------------------------------------------------------------------
-  float Routing::cmp_by_angle::getAngle(LinkDescription::points_t const& trail)
+  float Routing::getAngle(LinkDescription::points_t const& trail)
   {
     if( trail.size() < 2 )
       return 0;
@@ -30,6 +33,22 @@ namespace LinksRouting
     return std::atan2(dir.y, dir.x);
   }
 
+  //----------------------------------------------------------------------------
+  float Routing::getPseudoAngle(LinkDescription::points_t const& trail)
+  {
+    if( trail.size() < 2 )
+      return 0;
+    const float2 dir = trail.at(1) - trail.at(0);
+    const float sum = std::fabs(dir.x) + std::fabs(dir.y);
+    if( sum == 0 )
+      return 0;
+
+    // Position on the unit diamond: 1 -> 0 (0), 0 -> 1 (pi/2), -1 -> 2 (pi)
+    // and mirrored to negative values for the lower half
+    const float p = dir.x / sum;
+    return dir.y < 0 ? p - 1 : 1 - p;
+  }
+
   //----------------------------------------------------------------------------
   Routing::Routing():
    Configurable("Routing")
@@ -50,7 +69,6 @@ namespace LinksRouting
     }
   }
 
-#if 0
   //----------------------------------------------------------------------------
   void Routing::checkLevels( LevelNodeMap& levelNodeMap,
                              LevelHyperEdgeMap& levelHyperEdgeMap,
@@ -81,6 +99,5 @@ namespace LinksRouting
         checkLevels(levelNodeMap, levelHyperEdgeMap, *(*it), level + 1);
     }
   }
-#endif
 
 } // namespace LinksRouting
@@ -0,0 +1,127 @@
+/*
+ * partitionhelper_test.cpp
+ *
+ * Compare inserting intervals one by one and assigning them at once with a
+ * naive union of all intervals, and the binary search of findPartition with
+ * a linear search.
+ */
+
+#include "PartitionHelper.hxx"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+namespace
+{
+  /**
+   * Merge overlapping (or touching) intervals until nothing changes anymore
+   */
+  Partitions naiveUnion(Partitions intervals)
+  {
+    for(bool merged = true; merged;)
+    {
+      merged = false;
+      for(size_t i = 0; i < intervals.size() && !merged; ++i)
+        for(size_t j = i + 1; j < intervals.size() && !merged; ++j)
+        {
+          float2& a = intervals[i];
+          const float2& b = intervals[j];
+          if( a.x > b.y || b.x > a.y )
+            continue;
+
+          a = float2(std::min(a.x, b.x), std::max(a.y, b.y));
+          intervals.erase(intervals.begin() + j);
+          merged = true;
+        }
+    }
+
+    std::sort( intervals.begin(),
+               intervals.end(),
+               [](const float2& lhs, const float2& rhs)
+               {
+                 return lhs.x < rhs.x;
+               } );
+    return intervals;
+  }
+
+  bool equal(const Partitions& lhs, const Partitions& rhs)
+  {
+    if( lhs.size() != rhs.size() )
+      return false;
+
+    for(size_t i = 0; i < lhs.size(); ++i)
+      if( lhs[i].x != rhs[i].x || lhs[i].y != rhs[i].y )
+        return false;
+    return true;
+  }
+}
+
+int main()
+{
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> rand_count(0, 30),
+                                     rand_pos(0, 500),
+                                     rand_width(0, 40);
+
+  int failures = 0;
+  for(int test = 0; test < 2000; ++test)
+  {
+    Partitions intervals;
+    PartitionHelper added;
+
+    const int count = rand_count(rng);
+    for(int i = 0; i < count; ++i)
+    {
+      const float x = rand_pos(rng);
+      const float2 interval(x, x + rand_width(rng));
+
+      intervals.push_back(interval);
+      added.add(interval);
+    }
+
+    PartitionHelper assigned;
+    assigned.assign(intervals);
+
+    const Partitions expected = naiveUnion(intervals);
+    if( !equal(added.getPartitions(), expected) )
+    {
+      std::printf( "test %d: add() gives %s (expected %s)\n",
+                   test,
+                   to_string(added.getPartitions()).c_str(),
+                   to_string(expected).c_str() );
+      ++failures;
+    }
+    if( !equal(assigned.getPartitions(), expected) )
+    {
+      std::printf( "test %d: assign() gives %s (expected %s)\n",
+                   test,
+                   to_string(assigned.getPartitions()).c_str(),
+                   to_string(expected).c_str() );
+      ++failures;
+    }
+
+    for(int pos = -1; pos <= 560; pos += 3)
+    {
+      size_t index = 0;
+      while( index < expected.size() && expected[index].y < pos )
+        ++index;
+
+      const size_t found = findPartition(expected, pos) - expected.begin();
+      if( found != index )
+      {
+        std::printf( "test %d: findPartition(%d) = %d (expected %d)\n",
+                     test,
+                     pos,
+                     static_cast<int>(found),
+                     static_cast<int>(index) );
+        ++failures;
+      }
+    }
+  }
+
+  if( failures )
+    std::printf("%d tests failed\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
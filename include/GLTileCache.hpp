@@ -0,0 +1,172 @@
+/*
+ * Per OpenGL context cache of tile textures for HierarchicTileMap::render.
+ *
+ * Tiles are identified by map id, level, position and the change id of their
+ * pixel data, so releasing the pixel data (or reusing its address) does not
+ * invalidate the texture, while updated tiles are uploaded again. Tiles of
+ * equal size share atlas textures (one slot per tile), which start with a
+ * single slot and double in size for every further atlas of the same slot
+ * size. Slots are reused in least recently used order as soon as the budget
+ * shared by all caches is exceeded.
+ */
+
+#ifndef GL_TILE_CACHE_HPP_
+#define GL_TILE_CACHE_HPP_
+
+#include "float2.hpp"
+
+#include <GL/gl.h>
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <vector>
+
+struct Tile;
+class GLTileCache
+{
+  public:
+
+    /**
+     * Location of a tile inside an atlas texture
+     */
+    struct TexRegion
+    {
+      GLuint  tex_id;
+      float2  pos,    //!< Texture coordinates of the tile origin
+              size;   //!< Size of the tile in texture coordinates
+      float2  min,    //!< Inset by half a texel to avoid bleeding from
+              max;    //   neighbouring slots with linear filtering
+    };
+
+    GLTileCache();
+
+    /**
+     * Textures are not deleted (they are released together with the context)
+     */
+    ~GLTileCache();
+
+    /**
+     * Set maximum number of bytes used for the tiles of all caches
+     * (0 = unlimited). Each cache only evicts its own tiles, once it needs
+     * another slot, and never those used during its current frame.
+     */
+    static void setMaxBytes(size_t max_bytes);
+    static size_t getMaxBytes();
+
+    /**
+     * Get number of bytes used by the tiles of all caches
+     */
+    static size_t getUsedBytes();
+
+    /**
+     * Start a new frame (Textures requested afterwards are kept until the
+     * next frame)
+     */
+    void beginFrame();
+
+    /**
+     * Check if the current version of the tile is available as texture
+     */
+    bool contains( unsigned int map_id,
+                   size_t level, size_t x, size_t y,
+                   unsigned int change_id ) const;
+
+    /**
+     * Get texture region of the given tile, or queue uploading its pixel data
+     * if not available in its current version (see Tile::change_id).
+     *
+     * @param slot_width  Maximum tile width of the map (slot size)
+     * @param slot_height Maximum tile height of the map (slot size)
+     * @return nullptr if neither a texture nor pixel data is available
+     */
+    const TexRegion* request( unsigned int map_id,
+                              size_t level, size_t x, size_t y,
+                              const Tile& tile,
+                              size_t slot_width,
+                              size_t slot_height );
+
+    /**
+     * Upload all pixel data queued by request() (grouped by atlas texture).
+     * Pixel data has to be valid until this call.
+     */
+    void flushUploads();
+
+    /**
+     * Delete all textures (context has to be current)
+     */
+    void clear();
+
+  protected:
+
+    struct Key
+    {
+      unsigned int map_id;
+      size_t level, x, y;
+
+      bool operator<(const Key& rhs) const;
+    };
+
+    struct Page
+    {
+      GLuint  tex_id;
+      size_t  slot_width,
+              slot_height,
+              num_cols,
+              num_rows;
+      std::vector<size_t> free_slots;
+    };
+
+    struct Entry
+    {
+      Key           key;
+      unsigned int  change_id;
+      size_t        page,
+                    slot;
+      unsigned int  frame;      //!< Last frame the entry has been used
+      TexRegion     region;
+    };
+
+    struct Upload
+    {
+      GLuint        tex_id;
+      GLint         x, y;
+      GLsizei       width, height;
+      const void*   pdata;
+
+      bool operator<(const Upload& rhs) const { return tex_id < rhs.tex_id; }
+    };
+
+    typedef std::list<Entry> EntryList;
+    typedef std::map<Key, EntryList::iterator> EntryMap;
+
+    EntryList           _lru;     //!< Most recently used at front
+    EntryMap            _entries;
+    std::vector<Page>   _pages;   //!< Empty pages have tex_id 0
+    std::vector<Upload> _uploads;
+    size_t              _used_bytes;  //!< Bytes of all used slots
+    unsigned int        _frame;
+
+    static size_t       _max_bytes,
+                        _total_used_bytes;
+
+    /**
+     * Find a free slot for a tile of the given size (evicting other tiles or
+     * allocating a new atlas texture twice as large as all existing atlases
+     * of the same slot size if required)
+     *
+     * @return Whether a slot has been found
+     */
+    bool allocSlot( size_t slot_width, size_t slot_height,
+                    size_t& page_index, size_t& slot );
+    void freeSlot(size_t page_index, size_t slot);
+
+    /**
+     * Evict least recently used tile not used in the current frame
+     */
+    bool evict();
+
+    static size_t slotBytes(size_t slot_width, size_t slot_height);
+};
+
+#endif /* GL_TILE_CACHE_HPP_ */
@@ -8,27 +8,46 @@
 #include <QObject>
 
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <functional>
 #include <map>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include <iostream>
 
-typedef std::map<unsigned char*, unsigned int> GLImageCache;
+class GLTileCache;
 
 struct Tile:
   public LinksRouting::SlotType::Image
 {
+  /** Deflate compressed pixel data of a cold tile (type is NONE meanwhile) */
+  std::vector<uint8_t> compressed;
 
+  /** Data has been requested ahead of time and not been needed so far */
+  bool prefetched;
+
+  /** Change id of the map when the data has been set (0 = never set) */
+  unsigned int change_id;
+
+  Tile():
+    prefetched(false),
+    change_id(0)
+  { }
+
+  bool hasData() const
+  {
+    return type != NONE || !compressed.empty();
+  }
 };
 
 class HierarchicTileMap;
 class Layer
 {
   public:
-    Layer(HierarchicTileMap* map);
+    Layer(HierarchicTileMap* map, size_t level);
     bool isInit() const;
     void init( size_t num_tiles_x,
                size_t num_tiles_y,
@@ -39,12 +58,14 @@ class Layer
 
     Tile& getTile(size_t x, size_t y);
     HierarchicTileMap* getMap() const;
+    size_t getLevel() const;
 
     size_t sizeX() const;
     size_t sizeY() const;
   
   private:
     HierarchicTileMap* _map;
+    size_t _level;
     std::vector<std::vector<Tile>> _tiles;
 };
 
@@ -56,14 +77,20 @@ struct MapRect
         max[2];
   Layer& layer;
 
-  struct Quads
+  struct Quad
   {
-    std::vector<float2> _coords;
-    std::vector<float2> _tex_coords;
+    Tile   *tile;
+    size_t  tile_x, tile_y;
+    float2  min, max,         //!< Position relative to the rect
+            tex_min, tex_max; //!< Texture coordinates relative to the tile
   };
-  typedef std::map<Tile*, Quads> QuadList;
+  typedef std::vector<Quad> QuadList;
 
-  QuadList getQuads() const;
+  /**
+   * Get quads of all tiles covered by the rect (replacing the content of the
+   * given list to reuse its memory)
+   */
+  void getQuads(QuadList& quads) const;
   float2 getSize() const;
 
   typedef std::function<void(Tile&,size_t x,size_t y)> tile_callback_t;
@@ -86,9 +113,51 @@ class HierarchicTileMap:
     MapRect requestRect( const Rect& rect,
                          size_t zoom = -1 );
 
+    /**
+     * @param prefetched  Mark data as prefetched (see Tile::prefetched)
+     */
     void setTileData( size_t x, size_t y, size_t zoom,
                       const char* data,
-                      size_t data_size );
+                      size_t data_size,
+                      bool prefetched = false );
+
+    /**
+     * Release pixel data of the given tile (eg. if evicted from the
+     * TileCache). The tile will be requested again if needed.
+     *
+     * @param level   Layer index (not the zoom passed to requestRect)
+     */
+    bool releaseTile(size_t x, size_t y, size_t level);
+
+    /**
+     * Get tile of an already initialized layer
+     *
+     * @param level   Layer index (not the zoom passed to requestRect)
+     * @return nullptr if the layer is not initialized or the tile is out of
+     *         range
+     */
+    Tile* findTile(size_t x, size_t y, size_t level);
+
+    /**
+     * Replace pixel data of the given tile with a compressed copy (see
+     * TileCompressor). The data is decompressed again once the tile is
+     * rendered.
+     *
+     * @param level       Layer index (not the zoom passed to requestRect)
+     * @param compressed  Deflate compressed pixels (moved into the tile)
+     * @return Size of the compressed data (0 if the tile has no pixel data)
+     */
+    size_t setCompressedTile( size_t x, size_t y, size_t level,
+                              std::vector<uint8_t>& compressed );
+
+    /**
+     * Restore the pixel data of a tile compressed by setCompressedTile. Broken
+     * data is dropped, so that the tile is requested again.
+     *
+     * @param level   Layer index (not the zoom passed to requestRect)
+     * @return Whether the tile has been decompressed
+     */
+    bool decompressTile(Tile& tile, size_t x, size_t y, size_t level);
 
     /**
      *
@@ -104,7 +173,7 @@ class HierarchicTileMap:
                  size_t zoom = -1,
                  bool auto_center = false,
                  double alpha = 1.,
-                 GLImageCache* cache = nullptr );
+                 GLTileCache* cache = nullptr );
 
     float getLayerScale(size_t level) const;
 
@@ -119,6 +188,9 @@ class HierarchicTileMap:
 
     unsigned int getChangeId() const { return _change_id; }
 
+    /** Unique id of this map (unlike its address never reused) */
+    unsigned int getMapId() const { return _map_id; }
+
     Partitions partitions_src,
                partitions_dest;
 
@@ -131,6 +203,7 @@ class HierarchicTileMap:
                       size_t zoom );
 
   private:
+    const unsigned int _map_id;
     unsigned int _width,
                  _height,
                  _tile_width,
@@ -139,7 +212,15 @@ class HierarchicTileMap:
                  _change_id; //!< tracking map changes (eg. tile image updates)
 
     std::vector<Layer> _layers;
+    // Buffers reused by render()
+    MapRect::QuadList   _quads;
+    std::vector<std::pair<unsigned int, size_t>> _draw_order; //!< tex, quad
+    std::vector<float2> _vertices;  //!< Interleaved tex coord and position
+
     Layer& getLayer(size_t level);
+
+    void clearLayers();
+    void freeTileData(Tile& tile);
 };
 
 typedef std::shared_ptr<HierarchicTileMap> HierarchicTileMapPtr;
@@ -0,0 +1,207 @@
+/*
+ * Retained geometry of all routed links and highlighted regions.
+ *
+ * Trails and region outlines are extruded only if the links have changed
+ * since the last update (see the "/links/revision" slot) and are kept in a
+ * vertex buffer object afterwards, so unchanged links are drawn with just a
+ * few draw calls per frame. Regions and trails are kept in the order of
+ * LinkRenderer::renderLinks, so each trail is only hidden by the regions drawn
+ * before it.
+ *
+ * The geometry can additionally be sorted into buckets (eg. one per screen),
+ * allowing renderers responsible for only a part of the desktop to upload and
+ * draw just the geometry intersecting their region.
+ */
+
+#ifndef LR_LINKGEOMETRY_HPP_
+#define LR_LINKGEOMETRY_HPP_
+
+#include "linkdescription.h"
+#include "NodeRenderer.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace LinksRouting
+{
+  class LinkGeometry
+  {
+    public:
+      LinkGeometry();
+      ~LinkGeometry();
+
+      void setLineWidth(float w);
+
+      /**
+       * Rebuild geometry if the links have changed since the last call.
+       *
+       * @param links_revision  Changes with every modification of the links
+       *                        or their routes (see "/links/revision")
+       * @return Whether the geometry has been rebuilt
+       */
+      bool update( const LinkDescription::LinkList& links,
+                   uint32_t links_revision );
+
+      /**
+       * Use the geometry of another instance intersecting one of its
+       * buckets instead of building it from the links.
+       *
+       * @return Whether the geometry has changed since the last call
+       */
+      bool update(const LinkGeometry& src, size_t bucket);
+
+      /**
+       * Set regions (eg. screens) into which the geometry is sorted after
+       * every rebuild.
+       */
+      void setBuckets(const std::vector<Rect>& regions);
+
+      /**
+       * Check if nothing of the current geometry intersects the given bucket
+       */
+      bool isBucketEmpty(size_t bucket) const;
+
+      /**
+       * Get bounding boxes of all nodes and trail segments
+       */
+      void getBounds(std::vector<Rect>& bounds) const;
+
+      /**
+       * Get a number which changes every time the geometry changes
+       */
+      uint32_t getRevision() const;
+
+      /**
+       * Draw the geometry of the last update (needs a current GL context)
+       *
+       * @param use_stencil   Mark regions in the stencil buffer and do not
+       *                      draw trails on top of regions drawn before
+       * @return Whether anything has been drawn
+       */
+      bool render(bool use_stencil = false);
+
+      /**
+       * Free GL buffers (needs the GL context used for rendering to be
+       * current)
+       */
+      void release();
+
+    protected:
+
+      struct Vertex
+      {
+        float   pos[2];
+        uint8_t color[4];
+      };
+      typedef std::vector<Vertex> Vertices;
+
+      /**
+       * Extruded outline of a single trail or region, kept as long as its
+       * points and the extrusion parameters do not change.
+       */
+      struct CachedBorders
+      {
+        size_t          hash;     //!< Hash of points and extrusion parameters
+        bool            used;     //!< Used by the last build
+        line_borders_t  borders;
+      };
+      typedef std::unordered_map<const void*, CachedBorders> BorderCache;
+
+      enum ElementType
+      {
+        REGION, //!< Marks the stencil buffer
+        TRAIL   //!< Masked by the regions drawn before
+      };
+
+      /**
+       * Vertices of a single node or trail segment
+       */
+      struct Element
+      {
+        size_t      first,
+                    count;
+        ElementType type;
+        Rect        bbox;
+      };
+      typedef std::vector<Element> Elements;
+
+      /**
+       * Consecutive vertices of elements of the same type (one draw call)
+       */
+      struct Range
+      {
+        size_t      first,
+                    count;
+        ElementType type;
+      };
+      typedef std::vector<Range> Ranges;
+
+      struct Bucket
+      {
+        Rect    region;
+        Ranges  ranges; //!< Merged ranges of intersecting elements
+      };
+      typedef std::vector<Bucket> Buckets;
+
+      float         _line_width;
+      uint32_t      _links_revision;  //!< Revision of the last built links
+      uint32_t      _revision;        //!< Incremented on every change
+      bool          _valid,           //!< Geometry has been built at least
+                                      //   once
+                    _upload;          //!< Buffer needs to be (re)uploaded
+      Vertices      _vertices;
+      Ranges        _ranges;          //!< Draw calls in rendering order
+      unsigned int  _vbo;
+      size_t        _num_vertices;
+      LineExtruder  _extruder;
+      BorderCache   _border_cache;    //!< Keyed by node/segment
+      Elements      _elements;
+      Buckets       _buckets;
+
+      const LinkGeometry *_src;         //!< Source of bucket geometry
+      size_t              _src_bucket;
+      uint32_t            _src_revision;
+
+      void build(const LinkDescription::LinkList& links);
+      void updateBuckets();
+      void addElement(ElementType type, size_t first);
+
+      /**
+       * Append a range, merging it with the last one if adjacent and of the
+       * same type
+       */
+      static void addRange( Ranges& ranges,
+                            size_t first,
+                            size_t count,
+                            ElementType type );
+
+      /**
+       * Get borders of the given points, extruding them only if they have
+       * changed since the last build.
+       */
+      const line_borders_t& getBorders( const void* key,
+                                        const LinkDescription::points_t& points,
+                                        float width,
+                                        bool closed,
+                                        float widen_end = 0.f );
+      void upload();
+
+      void addStrip( const std::vector<float2>& first,
+                     const std::vector<float2>& second,
+                     const float2& offset,
+                     const QColor& color );
+      template<class Points>
+      void addFan( const Points& points,
+                   const float2& offset,
+                   const QColor& color );
+      void addVertex(const float2& pos, const QColor& color);
+
+    private:
+      LinkGeometry(const LinkGeometry&) = delete;
+      LinkGeometry& operator=(const LinkGeometry&) = delete;
+  };
+
+} // namespace LinksRouting
+
+#endif /* LR_LINKGEOMETRY_HPP_ */
@@ -8,6 +8,7 @@
 #ifndef LR_LINKRENDERER_HPP_
 #define LR_LINKRENDERER_HPP_
 
+#include "LinkGeometry.hpp"
 #include "linkdescription.h"
 
 namespace LinksRouting
@@ -15,13 +16,34 @@ namespace LinksRouting
   class LinkRenderer
   {
     public:
-      bool renderLinks(const LinkDescription::LinkList& links);
+      /**
+       * Render links (geometry is only rebuilt if the links have changed
+       * since the last call)
+       *
+       * @param links_revision  See LinkGeometry::update
+       */
+      bool renderLinks( const LinkDescription::LinkList& links,
+                        uint32_t links_revision );
+
+      /**
+       * Render only the part of already built geometry intersecting the given
+       * bucket (uploaded again only if it has changed since the last call)
+       */
+      bool renderLinks(const LinkGeometry& geometry, size_t bucket);
+
+      /**
+       * Free GL resources (GL context needs to be current)
+       */
+      void release();
 
       /**
        * Check if anything would be rendered inside the given bounding box
        */
       bool wouldRenderLinks( const Rect& bbox,
                              const LinkDescription::LinkList& links );
+
+    protected:
+      LinkGeometry _geometry;
   };
 
 } // namespace LinksRouting
@@ -11,6 +11,7 @@
 #include "PartitionHelper.hxx"
 #include "linkdescription.h"
 
+#include <cmath>
 #include <queue>
 #include <set>
 
@@ -20,6 +21,148 @@ namespace LinksRouting
   typedef std::queue<const LinkDescription::HyperEdge*> HyperEdgeQueue;
   typedef std::set<const LinkDescription::HyperEdge*> HyperEdgeSet;
 
+  typedef std::pair<std::vector<float2>, std::vector<float2>> line_borders_t;
+
+  /**
+   * Extrude lines to a given width, reusing the storage of previous calls.
+   *
+   * Keep an instance around (eg. as member of a renderer) to get allocation
+   * free extrusion once the buffers have grown to the size of the largest
+   * line.
+   */
+  class LineExtruder
+  {
+    public:
+
+      /**
+       * Calculate the two borders of a line which gets extruded to the given
+       * width
+       *
+       * @param points    Points of the line (random access)
+       * @param width     Width of the line (in pixels)
+       * @param closed    Connect last with first point
+       * @param widen_end Length of arrow head at the end of open lines
+       * @param borders   Output (previous content is replaced)
+       */
+      template<typename Collection>
+      void extrude( const Collection& points,
+                    float width,
+                    bool closed,
+                    float widen_end,
+                    line_borders_t& borders );
+
+      /**
+       * Extrude into internal storage, which is valid until the next call
+       */
+      template<typename Collection>
+      const line_borders_t& extrude( const Collection& points,
+                                     float width,
+                                     bool closed = false,
+                                     float widen_end = 0.f )
+      {
+        extrude(points, width, closed, widen_end, _borders);
+        return _borders;
+      }
+
+    protected:
+      std::vector<float2> _dirs;    //!< Normalized segment directions
+      line_borders_t      _borders;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename Collection>
+  void LineExtruder::extrude( const Collection& points,
+                              float width,
+                              bool closed,
+                              float widen_end,
+                              line_borders_t& ret )
+  {
+    ret.first.clear();
+    ret.second.clear();
+
+    auto begin = std::begin(points);
+    const size_t num_points = std::end(points) - begin;
+    if( num_points < 2 )
+      return;
+
+    const float w = 0.5f * width;
+
+    // Normalize every segment only once (and not twice as each segment is
+    // used by both of its end points). If the line is not closed, the last
+    // point continues in the direction of the last segment.
+    const size_t num_segments = closed ? num_points : num_points - 1;
+    _dirs.resize(num_points + 1);
+    for(size_t i = 0; i < num_segments; ++i)
+    {
+      const float2& p0 = *(begin + i),
+                    p1 = *(begin + (i + 1 < num_points ? i + 1 : 0));
+      _dirs[i + 1] = (p1 - p0).normalize();
+    }
+    if( !closed )
+      _dirs[num_points] = _dirs[num_points - 1];
+    _dirs[0] = _dirs[closed ? num_points : 1];
+
+    // Miter at every point (independent of each other): project the normal
+    // of the mean direction onto the normal of the incoming segment and limit
+    // the length to twice the line width.
+    ret.first.resize(num_points);
+    ret.second.resize(num_points);
+    for(size_t i = 0; i < num_points; ++i)
+    {
+      const float2& dir_in = _dirs[i],
+                    dir_out = _dirs[i + 1];
+      const float2 normal_in(dir_in.y, -dir_in.x),
+                   normal(  0.5f * (dir_in.y + dir_out.y),
+                           -0.5f * (dir_in.x + dir_out.x) );
+
+      float proj = normal.dot(normal_in);
+      float2 offset = std::fabs(proj) > 1e-6f ? (w / proj) * normal
+                                             : w * normal_in;
+
+      float len_sq = offset.dot(offset);
+      if( len_sq > 4 * w * w )
+        offset *= 2 * w / std::sqrt(len_sq);
+
+      const float2& p = *(begin + i);
+      ret.first[i] = p + offset;
+      ret.second[i] = p - offset;
+    }
+
+    if( closed )
+    {
+      ret.first.push_back( ret.first.front() );
+      ret.second.push_back( ret.second.front() );
+      return;
+    }
+
+    widen_end = std::min( widen_end,
+                          (*(begin + (num_points - 2))
+                         - *(begin + (num_points - 1))).length() );
+    if( widen_end > 1.f )
+    {
+      const float2& dir = _dirs[num_points];
+      const float2 normal = dir.normal();
+      float f = widen_end / 35.f;
+
+      ret.first.back() -= f * 35 * dir;
+      ret.second.back() -= f * 35 * dir;
+
+      const float offsets[][2] = {
+        {16, 1.5},
+        {11, 2},
+        { 8, 2.5}
+      };
+
+      for(size_t i = 0; i < sizeof(offsets)/sizeof(offsets[0]); ++i)
+      {
+        ret.first.push_back( ret.first.back() + f * offsets[i][0] * dir
+                                              + offsets[i][1] * normal );
+        ret.second.push_back( ret.second.back() + f * offsets[i][0] * dir
+                                                - offsets[i][1] * normal );
+      }
+    }
+  }
+
   class NodeRenderer
   {
     public:
@@ -62,13 +205,15 @@ namespace LinksRouting
       QColor       _color,
                    _color_covered;
       float        _line_width;
+      LineExtruder _extruder;
   };
 
-  typedef std::pair<std::vector<float2>, std::vector<float2>> line_borders_t;
-
   /**
    * Calculate the two borders of a line which gets extruded to the given width
    *
+   * @note Allocates new storage on every call. Use a LineExtruder for
+   *       repeated extrusion.
+   *
    * @param points
    * @param width TODO which unit should be used?
    */
@@ -78,87 +223,8 @@ namespace LinksRouting
                                   bool closed = false,
                                   float widen_end = 0.f )
   {
-    auto begin = std::begin(points),
-         end = std::end(points);
-
-    decltype(begin) p0 = begin,
-                     p1 = p0 + 1;
-
-    if( p0 == end || p1 == end )
-      return line_borders_t();
-
-    widen_end = std::min(widen_end, (*(end - 2) - *(end - 1)).length());
-
     line_borders_t ret;
-    float w_out = 0.5 * width,
-          w_in = 0.5 * width;
-
-    float2 prev_dir = (closed ? (*p0 - *(end - 1)) : (*p1 - *p0)).normalize(),
-           prev_normal = float2( prev_dir.y, -prev_dir.x );
-
-    for( ; p0 != end; ++p0 )
-    {
-      float2 normal, dir;
-
-      if( closed || p1 != end )
-      {
-        dir = (((closed && p1 == end) ? *begin : *p1) - *p0).normalize();
-        float2 mean_dir = 0.5f * (prev_dir + dir);
-        normal = float2( mean_dir.y, -mean_dir.x );
-
-        prev_dir = dir;
-      }
-      else // !closed && p1 == end
-      {
-        normal = float2( prev_dir.y, -prev_dir.x );
-      }
-
-      // project on normal
-      float2 offset_out = normal / normal.dot(prev_normal / (w_out)),
-             offset_in = normal / normal.dot(prev_normal / (w_in));
-
-      if( offset_out.length() > 2 * w_out )
-        offset_out *= 2 * w_out / offset_out.length();
-
-      if( offset_in.length() > 2 * w_in )
-        offset_in *= 2 * w_in / offset_in.length();
-
-      ret.first.push_back(  *p0 + offset_out );
-      ret.second.push_back( *p0 - offset_in );
-
-      prev_normal = prev_dir.normal();
-
-      if(p1 != end)
-        ++p1;
-    }
-
-    if( closed )
-    {
-      ret.first.push_back( ret.first.front() );
-      ret.second.push_back( ret.second.front() );
-    }
-    else if( widen_end > 1.f )
-    {
-      float f = widen_end / 35.f;
-
-      ret.first.back() -= f * 35 * prev_dir;
-      ret.second.back() -= f * 35 * prev_dir;
-
-      const float offsets[][2] = {
-        {16, 1.5},
-        {11, 2},
-        { 8, 2.5}
-      };
-
-      for(size_t i = 0; i < sizeof(offsets)/sizeof(offsets[0]); ++i)
-      {
-        ret.first.push_back( ret.first.back() + f * offsets[i][0] * prev_dir
-                                              + offsets[i][1] * prev_normal );
-        ret.second.push_back( ret.second.back() + f * offsets[i][0] * prev_dir
-                                                - offsets[i][1] * prev_normal );
-      }
-    }
-
+    LineExtruder().extrude(points, width, closed, widen_end, ret);
     return ret;
   }
 
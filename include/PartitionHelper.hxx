@@ -1,15 +1,29 @@
 #ifndef PARTITION_HELPER_HXX_
 #define PARTITION_HELPER_HXX_
 
-#include <list>
+#include <vector>
 #include "float2.hpp"
 #include <iostream>
+#include <string>
 
-typedef std::list<float2> Partitions;
+/**
+ * Sorted, non-overlapping intervals [x, y] stored contiguously
+ */
+typedef std::vector<float2> Partitions;
 class PartitionHelper
 {
   public:
+    /**
+     * Insert a single interval (merged with all overlapping intervals)
+     */
     void add(const float2& interval);
+
+    /**
+     * Replace all intervals with the union of the given intervals (sort and
+     * sweep, cheaper than adding them one by one)
+     */
+    void assign(std::vector<float2> intervals);
+
     void clip(float min, float max, float cut = 0);
     void print();
     const Partitions& getPartitions() const;
@@ -18,6 +32,11 @@ class PartitionHelper
     Partitions _partitions;
 };
 
+/**
+ * Binary search for the first interval ending at or after the given position
+ */
+Partitions::const_iterator findPartition(const Partitions& p, float pos);
+
 std::string to_string(const Partitions& p);
 
 #endif /* PARTITION_HELPER_HXX_ */
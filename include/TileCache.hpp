@@ -0,0 +1,120 @@
+/*
+ * Global, size limited cache for the pixel data of all HierarchicTileMaps.
+ *
+ * Tiles are evicted in least recently used order as soon as the configured
+ * budget is exceeded. Evicted tiles are reset to Tile::NONE and are requested
+ * again by the TileHandler once they are needed for rendering. Optionally cold
+ * tiles are only compressed first (in a background thread, see TileCompressor)
+ * and decompressed again once rendered.
+ */
+
+#ifndef TILE_CACHE_HPP_
+#define TILE_CACHE_HPP_
+
+#include "TileCompressor.hpp"
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <mutex>
+
+class HierarchicTileMap;
+class TileCache
+{
+  public:
+
+    static TileCache& instance();
+
+    /**
+     * Set maximum number of bytes used for tile data (0 = unlimited)
+     */
+    void setMaxBytes(size_t max_bytes);
+    size_t getMaxBytes() const;
+    size_t getUsedBytes() const;
+
+    /**
+     * Enable/disable compressing cold tiles before evicting them completely
+     */
+    void setCompressCold(bool compress);
+    bool getCompressCold() const;
+
+    /**
+     * Add tile (or update size of an already cached tile) and mark it as most
+     * recently used. Evicts other tiles if the budget is exceeded.
+     */
+    void insert( HierarchicTileMap* map,
+                 size_t x, size_t y, size_t level,
+                 size_t num_bytes );
+
+    /**
+     * Mark tile as most recently used
+     */
+    void touch(HierarchicTileMap* map, size_t x, size_t y, size_t level);
+
+    /**
+     * Remove tile without evicting it (eg. if the map has already released
+     * the data)
+     */
+    void remove(HierarchicTileMap* map, size_t x, size_t y, size_t level);
+
+    /**
+     * Remove all tiles of the given map
+     */
+    void removeMap(HierarchicTileMap* map);
+
+  protected:
+
+    struct Key
+    {
+      HierarchicTileMap* map;
+      size_t level, x, y;
+
+      bool operator<(const Key& rhs) const;
+    };
+
+    enum State
+    {
+      RAW,
+      COMPRESSING,    //!< Queued for compressing (still uncompressed)
+      COMPRESSED,
+      INCOMPRESSIBLE  //!< Compressing did not save any memory
+    };
+
+    struct Entry
+    {
+      Key           key;
+      size_t        num_bytes;
+      State         state;
+      unsigned int  serial;   //!< Unique for every insert (to detect
+                              //   outdated compression results)
+    };
+
+    typedef std::list<Entry> EntryList;
+    typedef std::map<Key, EntryList::iterator> EntryMap;
+
+    mutable std::mutex  _mutex;
+    EntryList           _lru;     //!< Most recently used at front
+    EntryMap            _entries;
+    size_t              _max_bytes,
+                        _used_bytes,
+                        _compressing_bytes; //!< Bytes of tiles queued for
+                                            //   compressing
+    unsigned int        _next_serial;
+    bool                _compress_cold;
+    TileCompressor      _compressor;
+
+    TileCache();
+    TileCache(const TileCache&) = delete;
+    TileCache& operator=(const TileCache&) = delete;
+
+    void evict();
+    EntryMap::iterator erase(EntryMap::iterator it);
+
+    /**
+     * Store the results of the TileCompressor (called in the thread the cache
+     * has been created in)
+     */
+    void onTilesCompressed();
+};
+
+#endif /* TILE_CACHE_HPP_ */
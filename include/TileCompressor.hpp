@@ -0,0 +1,82 @@
+/*
+ * Compress the pixel data of cold tiles for the TileCache in a background
+ * thread, so that evicting tiles does not block rendering.
+ */
+
+#ifndef TILE_COMPRESSOR_HPP_
+#define TILE_COMPRESSOR_HPP_
+
+#include <QByteArray>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class HierarchicTileMap;
+class TileCompressor:
+  public QThread
+{
+  Q_OBJECT
+
+  public:
+
+    struct Job
+    {
+      HierarchicTileMap  *map;
+      size_t              x, y, level;
+      unsigned int        serial;     //!< TileCache entry the job belongs to
+      QByteArray          pixels;     //!< Copy of the uncompressed pixels
+    };
+
+    struct Result
+    {
+      HierarchicTileMap    *map;
+      size_t                x, y, level;
+      unsigned int          serial;
+      std::vector<uint8_t>  compressed; //!< Empty if not compressible
+    };
+    typedef std::vector<Result> Results;
+
+    TileCompressor();
+    virtual ~TileCompressor();
+
+    /**
+     * Queue tile for compressing (starts the thread if not running yet).
+     * tilesCompressed() is emitted once the result is available.
+     */
+    void enqueue(const Job& job);
+
+    /**
+     * Get (and remove) all available results
+     */
+    Results takeResults();
+
+    void stop();
+
+    /**
+     * Compress the given pixels in the current thread
+     *
+     * @return Whether the compressed data is smaller than the input
+     */
+    static bool compress( const QByteArray& pixels,
+                          std::vector<uint8_t>& compressed );
+
+  signals:
+
+    void tilesCompressed();
+
+  protected:
+
+    QMutex            _mutex;
+    QWaitCondition    _cond_jobs;
+    std::deque<Job>   _jobs;
+    Results           _results;
+    bool              _stop;
+
+    virtual void run();
+};
+
+#endif /* TILE_COMPRESSOR_HPP_ */
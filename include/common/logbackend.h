@@ -0,0 +1,356 @@
+#ifndef LR_LOGBACKEND
+#define LR_LOGBACKEND
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Messages below this level are removed at compile time
+ * (0 = debug, 1 = info, 2 = warning, 3 = error)
+ */
+#ifndef LOG_COMPILE_LEVEL
+# define LOG_COMPILE_LEVEL 0
+#endif
+
+namespace LinksRouting
+{
+namespace Log
+{
+  enum Level
+  {
+    LEVEL_DEBUG = 0,
+    LEVEL_INFO,
+    LEVEL_WARN,
+    LEVEL_ERROR,
+    LEVEL_NONE
+  };
+
+  /**
+   * Key/value pairs attached to a message, eg.
+   *
+   *   LOG_FIELDS(Log::LEVEL_INFO, "Client connected", ("id", id)("port", p));
+   */
+  class Fields
+  {
+    public:
+
+      template<class T>
+      Fields& operator()(const char* key, const T& val)
+      {
+        _strm << ' ' << key << '=' << val;
+        return *this;
+      }
+
+      std::string str() const
+      {
+        return _strm.str();
+      }
+
+    private:
+      std::ostringstream _strm;
+  };
+
+  struct Record
+  {
+    Level       level;
+    std::string msg,
+                fields;
+    const char *function; //!< Static string (eg. BOOST_CURRENT_FUNCTION)
+  };
+
+  /**
+   * Bounded lock-free queue for multiple producers and consumers (based on
+   * the algorithm by Dmitry Vyukov). Size has to be a power of two.
+   */
+  template<class T>
+  class RingBuffer
+  {
+    public:
+
+      explicit RingBuffer(size_t size):
+        _cells(size),
+        _mask(size - 1),
+        _push_pos(0),
+        _pop_pos(0)
+      {
+        for(size_t i = 0; i < size; ++i)
+          _cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+
+      /**
+       * @return false if the buffer is full
+       */
+      bool push(T& val)
+      {
+        size_t pos = _push_pos.load(std::memory_order_relaxed);
+        for(;;)
+        {
+          Cell& cell = _cells[pos & _mask];
+          const intptr_t diff =
+              static_cast<intptr_t>(cell.sequence.load(std::memory_order_acquire))
+            - static_cast<intptr_t>(pos);
+
+          if( diff == 0 )
+          {
+            if( _push_pos.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed) )
+            {
+              cell.data = std::move(val);
+              cell.sequence.store(pos + 1, std::memory_order_release);
+              return true;
+            }
+          }
+          else if( diff < 0 )
+            return false;
+          else
+            pos = _push_pos.load(std::memory_order_relaxed);
+        }
+      }
+
+      /**
+       * @return false if the buffer is empty
+       */
+      bool pop(T& val)
+      {
+        size_t pos = _pop_pos.load(std::memory_order_relaxed);
+        for(;;)
+        {
+          Cell& cell = _cells[pos & _mask];
+          const intptr_t diff =
+              static_cast<intptr_t>(cell.sequence.load(std::memory_order_acquire))
+            - static_cast<intptr_t>(pos + 1);
+
+          if( diff == 0 )
+          {
+            if( _pop_pos.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed) )
+            {
+              val = std::move(cell.data);
+              cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+              return true;
+            }
+          }
+          else if( diff < 0 )
+            return false;
+          else
+            pos = _pop_pos.load(std::memory_order_relaxed);
+        }
+      }
+
+    private:
+
+      struct Cell
+      {
+        std::atomic<size_t> sequence;
+        T                   data;
+      };
+
+      std::vector<Cell>   _cells;
+      const size_t        _mask;
+      std::atomic<size_t> _push_pos,
+                          _pop_pos;
+
+      RingBuffer(const RingBuffer&) /* = delete */;
+      RingBuffer& operator=(const RingBuffer&) /* = delete */;
+  };
+
+  /**
+   * Asynchronous log output. Messages are queued by the logging threads
+   * without locking and written to std::cout (errors to std::cerr) by a
+   * background thread.
+   *
+   * The runtime level is initialized from the environment variable
+   * LINKS_LOG_LEVEL (debug, info, warn, error, none).
+   */
+  class Backend
+  {
+    public:
+
+      static Backend& instance()
+      {
+        // Never destroyed, so that logging during program exit still works.
+        // Pending messages are written by shutdown() (called at exit).
+        static Backend* backend = new Backend;
+        return *backend;
+      }
+
+      bool enabled(Level level) const
+      {
+        return level >= _level.load(std::memory_order_relaxed);
+      }
+
+      void setLevel(Level level)
+      {
+        _level.store(level, std::memory_order_relaxed);
+      }
+
+      void write( Level level,
+                  std::string msg,
+                  std::string fields,
+                  const char* function )
+      {
+        Record rec = {level, std::move(msg), std::move(fields), function};
+        if( !_running.load(std::memory_order_acquire) )
+        {
+          std::lock_guard<std::mutex> lock(_print_mutex);
+          print(rec);
+          flushStreams();
+        }
+        else if( !_queue.push(rec) )
+          _dropped.fetch_add(1, std::memory_order_relaxed);
+        else
+        {
+          // shutdown() may have drained the queue between checking _running
+          // and pushing the message, so write it now.
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          if( !_running.load(std::memory_order_seq_cst) )
+            drain();
+        }
+      }
+
+      /**
+       * Stop the background thread and write all pending messages. Later
+       * messages are written synchronously.
+       */
+      void shutdown()
+      {
+        if( !_running.exchange(false) )
+          return;
+
+        _thread.join();
+        drain();
+      }
+
+    private:
+
+      static const size_t QUEUE_SIZE = 16384;
+
+      RingBuffer<Record>  _queue;
+      std::atomic<int>    _level;
+      std::atomic<bool>   _running;
+      std::atomic<size_t> _dropped;
+      std::mutex          _print_mutex;
+      std::thread         _thread;
+
+      Backend():
+        _queue(QUEUE_SIZE),
+        _level(initialLevel()),
+        _running(true),
+        _dropped(0)
+      {
+        _thread = std::thread(&Backend::run, this);
+        std::atexit(&Backend::shutdownAtExit);
+      }
+
+      static void shutdownAtExit()
+      {
+        instance().shutdown();
+      }
+
+      static int initialLevel()
+      {
+        const char* env = std::getenv("LINKS_LOG_LEVEL");
+        if( env )
+        {
+          const char* names[] = {"debug", "info", "warn", "error", "none"};
+          for(int i = LEVEL_DEBUG; i <= LEVEL_NONE; ++i)
+            if( std::strncmp(env, names[i], std::strlen(names[i])) == 0 )
+              return i;
+        }
+#ifdef NDEBUG
+        return LEVEL_INFO;
+#else
+        return LEVEL_DEBUG;
+#endif
+      }
+
+      void run()
+      {
+        while( _running.load(std::memory_order_acquire) )
+        {
+          if( !drain() )
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+      }
+
+      /**
+       * @return Whether any message has been written
+       */
+      bool drain()
+      {
+        std::lock_guard<std::mutex> lock(_print_mutex);
+
+        bool written = false;
+        if( size_t dropped = _dropped.exchange(0) )
+        {
+          std::cerr << "[WARNING] '" << dropped << " log messages dropped'\n";
+          written = true;
+        }
+
+        Record rec;
+        while( _queue.pop(rec) )
+        {
+          print(rec);
+          written = true;
+        }
+
+        if( written )
+          flushStreams();
+        return written;
+      }
+
+      static void print(const Record& rec)
+      {
+        static const char* names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+        (rec.level >= LEVEL_ERROR ? std::cerr : std::cout)
+          << "[" << names[rec.level] << "] '" << rec.msg << "'" << rec.fields
+          << " in " << rec.function << '\n';
+      }
+
+      static void flushStreams()
+      {
+        std::cout.flush();
+        std::cerr.flush();
+      }
+  };
+
+  inline bool enabled(Level level)
+  {
+    return level >= LOG_COMPILE_LEVEL && Backend::instance().enabled(level);
+  }
+
+  inline void setLevel(Level level)
+  {
+    Backend::instance().setLevel(level);
+  }
+
+  inline void write( Level level,
+                     std::string msg,
+                     std::string fields,
+                     const char* function )
+  {
+    Backend::instance().write( level,
+                               std::move(msg),
+                               std::move(fields),
+                               function );
+  }
+
+  inline void shutdown()
+  {
+    Backend::instance().shutdown();
+  }
+
+} // namespace Log
+} // namespace LinksRouting
+
+#endif //LR_LOGBACKEND
@@ -0,0 +1,186 @@
+#ifndef LR_POOLALLOCATOR
+#define LR_POOLALLOCATOR
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace LinksRouting
+{
+  /**
+   * Pool of equally sized memory blocks. Blocks are taken from large chunks
+   * and returned to a free list, so that objects which are recreated on
+   * every update (nodes, hyperedges, segments, ...) reuse the memory of their
+   * predecessors instead of going through the heap allocator.
+   *
+   * Chunks are never released but reused. The pool itself is never destroyed
+   * either, so that objects destroyed during program exit can still return
+   * their memory.
+   */
+  template<size_t Size, size_t Align>
+  class FixedSizePool
+  {
+    public:
+
+      static FixedSizePool& instance()
+      {
+        static FixedSizePool* pool = new FixedSizePool;
+        return *pool;
+      }
+
+      void* allocate()
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if( !_free )
+          addChunk();
+
+        Block* block = _free;
+        _free = block->next;
+        return block;
+      }
+
+      void deallocate(void* p)
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Block* block = static_cast<Block*>(p);
+        block->next = _free;
+        _free = block;
+      }
+
+    private:
+
+      union Block
+      {
+        Block* next;
+        typename std::aligned_storage<Size, Align>::type storage;
+      };
+
+      static const size_t BLOCKS_PER_CHUNK = 256;
+
+      std::mutex  _mutex;
+      Block*      _free;
+
+      FixedSizePool():
+        _free(0)
+      {}
+
+      FixedSizePool(const FixedSizePool&) /* = delete */;
+      FixedSizePool& operator=(const FixedSizePool&) /* = delete */;
+
+      void addChunk()
+      {
+        Block* chunk = static_cast<Block*>(
+          ::operator new(BLOCKS_PER_CHUNK * sizeof(Block))
+        );
+
+        // Link blocks in address order to keep consecutive allocations close
+        for(size_t i = BLOCKS_PER_CHUNK; i-- > 0;)
+        {
+          chunk[i].next = _free;
+          _free = chunk + i;
+        }
+      }
+  };
+
+  /**
+   * STL allocator taking single objects from a FixedSizePool (eg. list nodes,
+   * std::allocate_shared control blocks). Arrays use the default heap.
+   */
+  template<class T>
+  class PoolAllocator
+  {
+    public:
+
+      typedef T         value_type;
+      typedef T*        pointer;
+      typedef const T*  const_pointer;
+      typedef T&        reference;
+      typedef const T&  const_reference;
+      typedef size_t    size_type;
+      typedef std::ptrdiff_t difference_type;
+
+      template<class U>
+      struct rebind
+      {
+        typedef PoolAllocator<U> other;
+      };
+
+      PoolAllocator() {}
+
+      template<class U>
+      PoolAllocator(const PoolAllocator<U>&) {}
+
+      T* allocate(size_t n)
+      {
+        if( n != 1 )
+          return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(pool().allocate());
+      }
+
+      void deallocate(T* p, size_t n)
+      {
+        if( n != 1 )
+          ::operator delete(p);
+        else
+          pool().deallocate(p);
+      }
+
+      template<class U, class... Args>
+      void construct(U* p, Args&&... args)
+      {
+        ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+      }
+
+      template<class U>
+      void destroy(U* p)
+      {
+        p->~U();
+      }
+
+      size_t max_size() const
+      {
+        return size_t(-1) / sizeof(T);
+      }
+
+      template<class U>
+      bool operator==(const PoolAllocator<U>&) const { return true; }
+      template<class U>
+      bool operator!=(const PoolAllocator<U>&) const { return false; }
+
+    private:
+
+      static FixedSizePool<sizeof(T), alignof(T)>& pool()
+      {
+        return FixedSizePool<sizeof(T), alignof(T)>::instance();
+      }
+  };
+
+  /**
+   * Deleter for objects constructed in memory from PoolAllocator<T>
+   */
+  template<class T>
+  struct PoolDeleter
+  {
+    void operator()(T* p) const
+    {
+      p->~T();
+      PoolAllocator<T>().deallocate(p, 1);
+    }
+  };
+
+  /**
+   * Create a shared object with the object and its reference count taken from
+   * a FixedSizePool.
+   */
+  template<class T, class... Args>
+  std::shared_ptr<T> make_pooled(Args&&... args)
+  {
+    return std::allocate_shared<T>( PoolAllocator<T>(),
+                                    std::forward<Args>(args)... );
+  }
+
+} // namespace LinksRouting
+
+#endif //LR_POOLALLOCATOR
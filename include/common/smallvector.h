@@ -0,0 +1,366 @@
+#ifndef LR_SMALLVECTOR
+#define LR_SMALLVECTOR
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace LinksRouting
+{
+  /**
+   * Vector storing up to N elements inline (without heap allocation). Only
+   * if more elements are added the elements are moved to the heap.
+   *
+   * Provides the subset of the std::vector interface used for link geometry
+   * (eg. the typical region with 4 vertices).
+   */
+  template<class T, size_t N>
+  class SmallVector
+  {
+    public:
+
+      typedef T                 value_type;
+      typedef size_t            size_type;
+      typedef std::ptrdiff_t    difference_type;
+      typedef T&                reference;
+      typedef const T&          const_reference;
+      typedef T*                pointer;
+      typedef const T*          const_pointer;
+      typedef T*                iterator;
+      typedef const T*          const_iterator;
+      typedef std::reverse_iterator<iterator>       reverse_iterator;
+      typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+      SmallVector():
+        _data(inlineData()),
+        _size(0),
+        _capacity(N)
+      {}
+
+      explicit SmallVector(size_t size, const T& val = T()):
+        SmallVector()
+      {
+        resize(size, val);
+      }
+
+      template<class InputIterator>
+      SmallVector( InputIterator first,
+                   InputIterator last,
+                   typename std::enable_if<
+                     !std::is_integral<InputIterator>::value
+                   >::type* = 0 ):
+        SmallVector()
+      {
+        insert(end(), first, last);
+      }
+
+      SmallVector(std::initializer_list<T> list):
+        SmallVector(list.begin(), list.end())
+      {}
+
+      SmallVector(const SmallVector& rhs):
+        SmallVector(rhs.begin(), rhs.end())
+      {}
+
+      SmallVector(SmallVector&& rhs):
+        SmallVector()
+      {
+        *this = std::move(rhs);
+      }
+
+      ~SmallVector()
+      {
+        clear();
+        release();
+      }
+
+      SmallVector& operator=(const SmallVector& rhs)
+      {
+        if( this != &rhs )
+          assign(rhs.begin(), rhs.end());
+        return *this;
+      }
+
+      SmallVector& operator=(SmallVector&& rhs)
+      {
+        if( this == &rhs )
+          return *this;
+
+        clear();
+        if( !rhs.isInline() )
+        {
+          // Steal heap storage
+          release();
+          _data = rhs._data;
+          _size = rhs._size;
+          _capacity = rhs._capacity;
+
+          rhs._data = rhs.inlineData();
+          rhs._size = 0;
+          rhs._capacity = N;
+        }
+        else
+        {
+          reserve(rhs._size);
+          for(size_t i = 0; i < rhs._size; ++i)
+            new (_data + i) T(std::move(rhs._data[i]));
+          _size = rhs._size;
+          rhs.clear();
+        }
+        return *this;
+      }
+
+      SmallVector& operator=(std::initializer_list<T> list)
+      {
+        assign(list.begin(), list.end());
+        return *this;
+      }
+
+      template<class InputIterator>
+      void assign(InputIterator first, InputIterator last)
+      {
+        clear();
+        insert(end(), first, last);
+      }
+
+      iterator begin()              { return _data; }
+      const_iterator begin() const  { return _data; }
+      const_iterator cbegin() const { return _data; }
+      iterator end()                { return _data + _size; }
+      const_iterator end() const    { return _data + _size; }
+      const_iterator cend() const   { return _data + _size; }
+
+      reverse_iterator rbegin()       { return reverse_iterator(end()); }
+      const_reverse_iterator rbegin() const
+      {
+        return const_reverse_iterator(end());
+      }
+      reverse_iterator rend()         { return reverse_iterator(begin()); }
+      const_reverse_iterator rend() const
+      {
+        return const_reverse_iterator(begin());
+      }
+
+      size_t size() const     { return _size; }
+      size_t capacity() const { return _capacity; }
+      bool empty() const      { return !_size; }
+
+      T* data()             { return _data; }
+      const T* data() const { return _data; }
+
+      T& operator[](size_t i)             { return _data[i]; }
+      const T& operator[](size_t i) const { return _data[i]; }
+
+      T& at(size_t i)
+      {
+        if( i >= _size )
+          throw std::out_of_range("SmallVector::at");
+        return _data[i];
+      }
+      const T& at(size_t i) const
+      {
+        if( i >= _size )
+          throw std::out_of_range("SmallVector::at");
+        return _data[i];
+      }
+
+      T& front()              { return _data[0]; }
+      const T& front() const  { return _data[0]; }
+      T& back()               { return _data[_size - 1]; }
+      const T& back() const   { return _data[_size - 1]; }
+
+      void reserve(size_t capacity)
+      {
+        if( capacity <= _capacity )
+          return;
+
+        T* data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+        for(size_t i = 0; i < _size; ++i)
+        {
+          new (data + i) T(std::move(_data[i]));
+          _data[i].~T();
+        }
+        release();
+
+        _data = data;
+        _capacity = capacity;
+      }
+
+      void resize(size_t size, const T& val = T())
+      {
+        if( size > _size )
+        {
+          reserve(size);
+          for(; _size < size; ++_size)
+            new (_data + _size) T(val);
+        }
+        else
+          erase(begin() + size, end());
+      }
+
+      void clear()
+      {
+        erase(begin(), end());
+      }
+
+      void push_back(const T& val)
+      {
+        emplace_back(val);
+      }
+
+      void push_back(T&& val)
+      {
+        emplace_back(std::move(val));
+      }
+
+      template<class... Args>
+      void emplace_back(Args&&... args)
+      {
+        if( _size == _capacity )
+        {
+          // Construct first, args may refer to an element of this vector
+          T val(std::forward<Args>(args)...);
+          grow(_size + 1);
+          new (_data + _size) T(std::move(val));
+        }
+        else
+          new (_data + _size) T(std::forward<Args>(args)...);
+        ++_size;
+      }
+
+      void pop_back()
+      {
+        _data[--_size].~T();
+      }
+
+      iterator insert(const_iterator pos, const T& val)
+      {
+        return insert(pos, &val, &val + 1);
+      }
+
+      template<class InputIterator>
+      iterator insert( const_iterator pos,
+                       InputIterator first,
+                       InputIterator last )
+      {
+        const size_t index = pos - begin();
+
+        // Append at the end and rotate into place afterwards
+        const size_t old_size = _size;
+        appendRange( first,
+                     last,
+                     typename std::iterator_traits<InputIterator>
+                                 ::iterator_category() );
+        std::rotate(begin() + index, begin() + old_size, end());
+
+        return begin() + index;
+      }
+
+      iterator erase(const_iterator pos)
+      {
+        return erase(pos, pos + 1);
+      }
+
+      iterator erase(const_iterator first, const_iterator last)
+      {
+        iterator dest = begin() + (first - begin());
+        if( first == last )
+          return dest;
+
+        iterator new_end = std::move(begin() + (last - begin()), end(), dest);
+        for(iterator it = new_end; it != end(); ++it)
+          it->~T();
+        _size = new_end - begin();
+
+        return dest;
+      }
+
+      void swap(SmallVector& rhs)
+      {
+        SmallVector tmp(std::move(rhs));
+        rhs = std::move(*this);
+        *this = std::move(tmp);
+      }
+
+      bool operator==(const SmallVector& rhs) const
+      {
+        return _size == rhs._size && std::equal(begin(), end(), rhs.begin());
+      }
+
+      bool operator!=(const SmallVector& rhs) const
+      {
+        return !(*this == rhs);
+      }
+
+    private:
+
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type _inline[N];
+      T*      _data;
+      size_t  _size,
+              _capacity;
+
+      T* inlineData()
+      {
+        return reinterpret_cast<T*>(_inline);
+      }
+
+      bool isInline() const
+      {
+        return _data == reinterpret_cast<const T*>(_inline);
+      }
+
+      /** Free heap storage (elements have to be destroyed already) */
+      void release()
+      {
+        if( !isInline() )
+          ::operator delete(_data);
+        _data = inlineData();
+        _capacity = N;
+      }
+
+      void grow(size_t min_capacity)
+      {
+        reserve(std::max(min_capacity, 2 * _capacity));
+      }
+
+      template<class InputIterator>
+      void appendRange( InputIterator first,
+                        InputIterator last,
+                        std::input_iterator_tag )
+      {
+        for(; first != last; ++first)
+          emplace_back(*first);
+      }
+
+      template<class ForwardIterator>
+      void appendRange( ForwardIterator first,
+                        ForwardIterator last,
+                        std::forward_iterator_tag )
+      {
+        const size_t count = std::distance(first, last);
+        if( _size + count > _capacity )
+        {
+          // Copy everything, the range may be part of this vector
+          SmallVector tmp;
+          tmp.reserve(std::max(_size + count, 2 * _capacity));
+          for(iterator it = begin(); it != end(); ++it)
+            tmp.emplace_back(*it);
+          for(; first != last; ++first)
+            tmp.emplace_back(*first);
+          *this = std::move(tmp);
+          return;
+        }
+
+        for(; first != last; ++first, ++_size)
+          new (_data + _size) T(*first);
+      }
+  };
+
+} // namespace LinksRouting
+
+#endif //LR_SMALLVECTOR
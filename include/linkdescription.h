@@ -11,6 +11,8 @@
 #include "datatypes.h"
 #include "float2.hpp"
 #include "string_utils.h"
+#include "common/poolallocator.h"
+#include "common/smallvector.h"
 
 #include <functional>
 #include <list>
@@ -47,7 +49,8 @@ namespace LinkDescription
   typedef std::shared_ptr<const HyperEdgeDescriptionForkation>
           HyperEdgeDescriptionForkationConstPtr;
 
-  typedef std::vector<float2> points_t;
+  /** Regions mostly have 4 vertices, so keep them inline */
+  typedef SmallVector<float2, 4> points_t;
   typedef std::map<std::string, std::string> props_t;
   typedef std::vector<HyperEdgePtr> hedges_t;
 
@@ -245,7 +248,7 @@ namespace LinkDescription
 
   typedef std::shared_ptr<Node> NodePtr;
   typedef std::weak_ptr<Node> NodeWeakPtr;
-  typedef std::list<NodePtr> nodes_t;
+  typedef std::list<NodePtr, PoolAllocator<NodePtr>> nodes_t;
   typedef std::vector<NodePtr> node_vec_t;
 
   class HyperEdge:
@@ -257,7 +260,19 @@ namespace LinkDescription
       template<typename... _Args>
       static HyperEdgePtr make_shared(_Args&&... __args)
       {
-        HyperEdgePtr p( new HyperEdge(std::forward<_Args>(__args)...) );
+        PoolAllocator<HyperEdge> alloc;
+        HyperEdge* mem = alloc.allocate(1);
+        try
+        {
+          new (mem) HyperEdge(std::forward<_Args>(__args)...);
+        }
+        catch(...)
+        {
+          alloc.deallocate(mem, 1);
+          throw;
+        }
+
+        HyperEdgePtr p(mem, PoolDeleter<HyperEdge>(), alloc);
         p->_self = p;
         p->resetNodeParents();
         return p;
@@ -317,7 +332,9 @@ namespace LinkDescription
       nodes_t nodes;
       points_t trail;
   };
-  typedef std::list<HyperEdgeDescriptionSegment> HedgeSegmentList;
+  typedef std::list< HyperEdgeDescriptionSegment,
+                     PoolAllocator<HyperEdgeDescriptionSegment> >
+          HedgeSegmentList;
 
   struct HyperEdgeDescriptionForkation
   {
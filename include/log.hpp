@@ -9,16 +9,40 @@
 #ifndef _LOG_HPP_
 #define _LOG_HPP_
 
+#include "common/logbackend.h"
+
 #include <boost/current_function.hpp>
 #include <iostream>
 #include <sstream>
 
-#define LOG_MSG(strm, type, msg)\
-  strm << "[" << type << "] '" << msg << "' in " << BOOST_CURRENT_FUNCTION << std::endl
+/**
+ * Log a message with additional key/value fields. Neither message nor fields
+ * are formatted if the level is disabled (at compile time with
+ * LOG_COMPILE_LEVEL or at runtime with Log::setLevel/LINKS_LOG_LEVEL).
+ */
+#define LOG_FIELDS(level, msg, fields)\
+  do\
+  {\
+    if(    (level) >= LOG_COMPILE_LEVEL\
+        && ::LinksRouting::Log::enabled(level) )\
+    {\
+      std::ostringstream log_strm_;\
+      log_strm_ << msg;\
+      ::LinksRouting::Log::write\
+      (\
+        level,\
+        log_strm_.str(),\
+        (::LinksRouting::Log::Fields() fields).str(),\
+        BOOST_CURRENT_FUNCTION\
+      );\
+    }\
+  } while(0)
+
+#define LOG_MSG(level, msg) LOG_FIELDS(level, msg, )
 
-#define LOG_DEBUG(msg) LOG_MSG(std::cout,  "DEBUG", msg)
-#define LOG_INFO(msg) LOG_MSG(std::cout,  "INFO", msg)
-#define LOG_WARN(msg) LOG_MSG(std::cout,  "WARNING", msg)
+#define LOG_DEBUG(msg) LOG_MSG(::LinksRouting::Log::LEVEL_DEBUG, msg)
+#define LOG_INFO(msg) LOG_MSG(::LinksRouting::Log::LEVEL_INFO, msg)
+#define LOG_WARN(msg) LOG_MSG(::LinksRouting::Log::LEVEL_WARN, msg)
 #if 0
   {\
     LOG_MSG(std::cout,  "WARNING", msg);\
@@ -27,5 +51,5 @@
     system(str.str().c_str());\
   }
 #endif
-#define LOG_ERROR(msg) LOG_MSG(std::cerr,  "ERROR", msg)
+#define LOG_ERROR(msg) LOG_MSG(::LinksRouting::Log::LEVEL_ERROR, msg)
 #endif /* _LOG_HPP_ */
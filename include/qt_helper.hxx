@@ -30,4 +30,10 @@ std::string to_string(const QString& str);
  */
 std::ostream& operator<<(std::ostream& strm, const QString& str);
 
+/**
+ * Route qDebug/qWarning/qCritical/qFatal output through the asynchronous log
+ * backend (see log.hpp)
+ */
+void installLogMessageHandler();
+
 #endif /* QT_HELPER_HXX_ */
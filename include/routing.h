@@ -4,6 +4,7 @@
 #include <linkdescription.h>
 #include <map>
 #include <set>
+#include <vector>
 
 namespace LinksRouting
 {
@@ -18,16 +19,38 @@ namespace LinksRouting
       typedef std::vector<segment_iterator> SegmentIterators;
 
       /**
-       * Compare hedge segments by angle
+       * Hedge segments ordered by the direction of the first section of their
+       * trail. The sort key is calculated once on insertion, so modifying the
+       * trails afterwards does not affect the order. Segments with the same
+       * direction are kept in insertion order.
        */
-      struct cmp_by_angle
+      class OrderedSegments
       {
-        bool operator()( segment_iterator const& lhs,
-                         segment_iterator const& rhs ) const;
-        static float getAngle(LinkDescription::points_t const& trail);
+        public:
+          typedef SegmentIterators::const_iterator const_iterator;
+
+          void insert(segment_iterator const& segment);
+
+          const_iterator begin() const { return _segments.begin(); }
+          const_iterator end() const   { return _segments.end(); }
+          size_t size() const          { return _segments.size(); }
+          bool empty() const           { return _segments.empty(); }
+
+        private:
+          std::vector<float> _keys;
+          SegmentIterators   _segments;
       };
 
-      typedef std::set<segment_iterator, cmp_by_angle> OrderedSegments;
+      /**
+       * Angle of the first section of a trail (radians, [-pi, pi])
+       */
+      static float getAngle(LinkDescription::points_t const& trail);
+
+      /**
+       * Pseudo angle of the first section of a trail. Cheaper than getAngle
+       * but with the same order (diamond angle, [-2, 2]).
+       */
+      static float getPseudoAngle(LinkDescription::points_t const& trail);
 
     protected:
 
@@ -44,14 +67,13 @@ namespace LinksRouting
        * @param iterations
        */
       template<typename Collection>
-      static std::vector<float2> smooth( const Collection& points,
-                                         float smoothing_factor,
-                                         unsigned int iterations );
+      static LinkDescription::points_t smooth( const Collection& points,
+                                               float smoothing_factor,
+                                               unsigned int iterations );
 
       typedef std::map<LinkDescription::Node*, size_t> LevelNodeMap;
       typedef std::map<LinkDescription::HyperEdge*, size_t> LevelHyperEdgeMap;
 
-#if 0
       /**
        * There can be loops due to hyperedges connecting the same nodes, so we
        * have to avoid double entries the same way, one node could be put on
@@ -61,13 +83,12 @@ namespace LinksRouting
                         LevelHyperEdgeMap& levelHyperEdgeMap,
                         LinkDescription::HyperEdge& hedge,
                         size_t level = 0 );
-#endif
   };
 
   template<typename Collection>
-  std::vector<float2> Routing::smooth( const Collection& points,
-                                       float smoothing_factor,
-                                       unsigned int iterations )
+  LinkDescription::points_t Routing::smooth( const Collection& points,
+                                             float smoothing_factor,
+                                             unsigned int iterations )
 
   {
     // internal helper...
@@ -97,7 +118,7 @@ namespace LinksRouting
     std::vector<float2> in(std::begin(points), std::end(points));
 
     if( in.size() < 3 )
-      return in;
+      return LinkDescription::points_t(in.begin(), in.end());
 
     std::vector<float2> out;
     out.reserve(in.size());
@@ -111,7 +132,7 @@ namespace LinksRouting
       smoothIteration(in, out, smoothing_factor);
     }
 
-    return out;
+    return LinkDescription::points_t(out.begin(), out.end());
   }
 }
 
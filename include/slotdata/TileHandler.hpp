@@ -20,10 +20,24 @@ namespace SlotType
                                  float2 center = float2(-9999, -9999),
                                  float2 rel_pos = float2() ) = 0;
       virtual bool updateRegion( XRayPopup::HoverRect& popup ) = 0;
+
+      /**
+       * Request all missing tiles of the given region
+       *
+       * @param owner   Optional owner (eg. popup) of the request. Pending
+       *                requests of the same owner not covered by the new
+       *                region are dropped.
+       */
       virtual bool updateTileMap( const HierarchicTileMapPtr& tile_map,
                                   ClientRef client,
                                   const Rect& rect,
-                                  int zoom ) = 0;
+                                  int zoom,
+                                  const void* owner = nullptr ) = 0;
+
+      /**
+       * Drop all not yet sent requests of the given owner
+       */
+      virtual void cancelRequests(const void* owner) = 0;
   };
 
 } // namespace SlotType
@@ -0,0 +1,74 @@
+/*!
+ * @file damage.hpp
+ * @brief Changed regions of images and change counters of tiled maps
+ * @details Used to only update the parts of derived images (eg. the cost map)
+ *          which are affected by changes of their source.
+ */
+
+#ifndef _SLOTDATA_DAMAGE_HPP_
+#define _SLOTDATA_DAMAGE_HPP_
+
+#include <vector>
+#include <stdint.h>
+
+namespace LinksRouting
+{
+namespace SlotType
+{
+
+  /**
+   * Regions of an image which have changed since its last update. The slot
+   * is only valid if the damage is known, otherwise everything has to be
+   * treated as changed.
+   */
+  struct Damage
+  {
+    struct Rect
+    {
+      int x, y, width, height;
+      Rect(int _x, int _y, int _w, int _h):
+        x(_x), y(_y), width(_w), height(_h)
+      { }
+    };
+
+    std::vector<Rect> rects; //!< In pixels of the damaged image
+  };
+
+  /**
+   * Change tracking for the tiles of a map (eg. the cost map). Each tile
+   * stores the revision of its last change, so a consumer which has seen
+   * revision r only needs to update the tiles with a version greater than r.
+   */
+  struct TileVersions
+  {
+    unsigned int tile_size,   //!< Width and height of tiles (in map pixels)
+                 cols,
+                 rows;
+    uint32_t     revision;    //!< Incremented on every update of the map
+    std::vector<uint32_t> versions;
+
+    TileVersions():
+      tile_size(0),
+      cols(0),
+      rows(0),
+      revision(0)
+    { }
+
+    uint32_t get(unsigned int col, unsigned int row) const
+    {
+      return versions[row * cols + col];
+    }
+
+    /**
+     * Get the version of the tile containing the given map pixel
+     */
+    uint32_t getAt(unsigned int x, unsigned int y) const
+    {
+      return get(x / tile_size, y / tile_size);
+    }
+  };
+
+} // namespace SlotType
+} // namespace LinksRouting
+
+#endif /* _SLOTDATA_DAMAGE_HPP_ */
@@ -8,6 +8,7 @@
 #ifndef QTFULLSCREENSYSTEM_INCLUDE_GLWINDOW_HPP_
 #define QTFULLSCREENSYSTEM_INCLUDE_GLWINDOW_HPP_
 
+#include <LinkRenderer.hpp>
 #include <slots.hpp>
 #include <slotdata/mouse_event.hpp>
 #include <slotdata/text_popup.hpp>
@@ -30,13 +31,24 @@ namespace qtfullscreensystem
 
       void subscribeSlots(LR::SlotSubscriber& slot_subscriber);
 
+      /**
+       * Set geometry shared by all windows, which has been bucketed for the
+       * region of this window with the given index.
+       */
+      void setLinkGeometry(const LR::LinkGeometry* geometry, size_t bucket);
+
     protected:
       QRect     _geometry;
 
       LR::slot_t<LR::LinkDescription::LinkList>::type _subscribe_links;
+      LR::slot_t<uint32_t                     >::type _subscribe_links_revision;
       LR::slot_t<LR::SlotType::CoveredOutline >::type _subscribe_outlines;
       LR::slot_t<LR::SlotType::XRayPopup      >::type _subscribe_xray;
 
+      LR::LinkRenderer        _link_renderer;
+      const LR::LinkGeometry *_link_geometry;
+      size_t                  _link_bucket;
+
       void paintGL() override;
 //      virtual void moveEvent(QMoveEvent *event);
 //      virtual void paintEvent(QPaintEvent* e);
@@ -9,6 +9,7 @@
 #define QTF_PREVIEW_WINDOW_HPP_
 
 #include <common/PreviewWindow.hpp>
+#include <GLTileCache.hpp>
 #include <slots.hpp>
 #include <slotdata/mouse_event.hpp>
 #include <slotdata/text_popup.hpp>
@@ -56,7 +57,7 @@ namespace qtfullscreensystem
       bool    _do_drag;
       float2  _last_mouse_pos;
 
-      GLImageCache _image_cache;
+      GLTileCache  _tile_textures;
       unsigned int _tile_map_change_id;
 
       LR::slot_t<LR::SlotType::MouseEvent>::type  _subscribe_mouse;
@@ -14,6 +14,7 @@
 
 #include <QWidget>
 #include <memory>
+#include <vector>
 
 namespace qtfullscreensystem
 {
@@ -29,10 +30,21 @@ namespace qtfullscreensystem
 
       void setImage(QImage const* img);
 
+      /**
+       * Repaint the part of the window showing the given region of the image
+       *
+       * @param damage          Changed region (image coordinates)
+       * @param image_offset    Position of the image on the desktop
+       */
+      void updateDamage(const QRegion& damage, const QPoint& image_offset);
+
     protected:
       QRect     _geometry;
       QImage const *_img;
 
+      QImage              _mask_img;    //!< Shape mask (if no image is set)
+      std::vector<QRect>  _mask_rects;  //!< Rectangles cleared in the mask
+
       bool    _do_drag;
       float2  _last_mouse_pos;
 
@@ -41,6 +53,12 @@ namespace qtfullscreensystem
       LR::slot_t<LR::SlotType::CoveredOutline>::type _subscribe_outlines;
       LR::slot_t<LR::SlotType::XRayPopup>::type _subscribe_xray;
 
+      /**
+       * Update the shape mask to only include the given rectangles (in
+       * local coordinates)
+       */
+      void updateMask(const QSize& size, std::vector<QRect>& rects);
+
       virtual void moveEvent(QMoveEvent *event);
       virtual void paintEvent(QPaintEvent* e);
 
@@ -18,17 +18,23 @@
 #include "ipc_server.hpp"
 #include "cpurouting.h"
 #include "cpurouting-dijkstra.h"
+#include "cpurouting-blocks.h"
 #include "dummyrouting.h"
 #if USE_GPU_ROUTING
 # include "glcostanalysis.h"
 # include "gpurouting.h"
+#else
+# include "cpucostanalysis.h"
 #endif
 #include "glrenderer.h"
+#include "slotdata/damage.hpp"
 
 #include <QApplication>
 #include <QOffscreenSurface>
+#include <QOpenGLBuffer>
 #include <QOpenGLContext>
 #include <QOpenGLFramebufferObject>
+#include <QRegion>
 #include <QTimer>
 
 namespace qtfullscreensystem
@@ -82,6 +88,7 @@ namespace qtfullscreensystem
 
       LR::slot_t<LR::SlotType::Image>::type             _slot_desktop;
       LR::slot_t<Rect>::type                            _slot_desktop_rect;
+      LR::slot_t<LR::SlotType::Damage>::type            _slot_desktop_damage;
       LR::slot_t<LR::SlotType::MouseEvent>::type        _slot_mouse;
       LR::slot_t<LR::SlotType::TextPopup>::type         _slot_popups;
       LR::slot_t<LR::SlotType::Preview>::type           _slot_previews;
@@ -91,8 +98,10 @@ namespace qtfullscreensystem
                                                         _subscribe_xray_fbo,
                                                         _subscribe_costmap;
       LR::slot_t<LR::LinkDescription::LinkList>::type   _subscribe_routed_links;
+      LR::slot_t<uint32_t                     >::type   _subscribe_links_revision;
       LR::slot_t<LR::SlotType::CoveredOutline >::type   _subscribe_outlines;
       LR::slot_t<LR::SlotType::TextPopup      >::type   _subscribe_popups;
+      LR::slot_t<LR::LinkGeometry             >::type   _subscribe_link_geometry;
 
       // ----------
       // Components
@@ -104,10 +113,13 @@ namespace qtfullscreensystem
       LR::IPCServer             _server;
       LR::CPURouting            _routing_cpu;
       LR::Dijkstra::CPURouting  _routing_cpu_dijkstra;
+      LR::Blocks::CPURouting    _routing_cpu_blocks;
       LR::DummyRouting          _routing_dummy;
 #if USE_GPU_ROUTING
       LR::GlCostAnalysis        _cost_analysis;
       LR::GPURouting            _routing_gpu;
+#else
+      LR::CpuCostAnalysis       _cost_analysis;
 #endif
       LR::GlRenderer            _renderer;
 
@@ -122,11 +134,28 @@ namespace qtfullscreensystem
       QOpenGLContext                            _gl_ctx;
       std::unique_ptr<QOpenGLFramebufferObject> _fbo;
       QImage                                    _fbo_image;
+      QImage                                    _desktop_image; //!< Captured
+                                                                //   at startup
       ShaderPtr                                 _shader_blend;
 
+      /** Double buffered pixel buffers for asynchronous readback of the
+       *  composited image. Each frame reads back into one buffer while the
+       *  other one, filled during the previous frame, is copied. */
+      QOpenGLBuffer     _readback_pbos[2];
+      QRegion           _readback_damage[2]; //!< Pending region of each
+                                             //   buffer (image coords)
+      size_t            _readback_index;     //!< Buffer used by next readback
+
+      std::vector<Rect> _link_bounds;     //!< Extents of the rendered links
+      uint32_t          _link_bounds_revision;
+      std::vector<Rect> _frame_rects;     //!< Regions drawn in the last frame
+                                          //   except links (desktop coords)
+
       std::vector<WindowRef>    _windows;
       std::vector<WindowRef>    _mask_windows;
       std::vector<GLWindowRef>  _render_windows;
+      LR::LinkGeometry          _screen_link_geometry; //!< Shared by all
+                                                       //   render windows
 
       // Locks/Mutex
       QMutex            _mutex_slot_links;
@@ -137,6 +166,19 @@ namespace qtfullscreensystem
       void updateNoRendering();
       void updateRendererPerScreen();
       void updateGlobalRenderer();
+
+      /**
+       * Copy the pixels read back into the given pixel buffer into the
+       * composited image and repaint the damaged parts of the render windows
+       * (GL context needs to be current).
+       */
+      void finishReadback(size_t index);
+
+      /**
+       * Get the region of the composited image (in image coordinates) which
+       * has changed since the last frame.
+       */
+      QRegion collectDamage(const QRect& image_rect);
   };
 
 } // namespace qtfullscreensystem
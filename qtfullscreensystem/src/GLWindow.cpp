@@ -21,7 +21,9 @@ namespace qtfullscreensystem
 {
   //----------------------------------------------------------------------------
   GLWindow::GLWindow(const QRect& geometry):
-    _geometry(geometry)
+    _geometry(geometry),
+    _link_geometry(nullptr),
+    _link_bucket(0)
   {
     qDebug() << "new window" << geometry;
     setGeometry(geometry);
@@ -50,15 +52,20 @@ namespace qtfullscreensystem
   //----------------------------------------------------------------------------
   GLWindow::~GLWindow()
   {
-
+    makeCurrent();
+    _link_renderer.release();
+    doneCurrent();
   }
 
   //----------------------------------------------------------------------------
   uint32_t GLWindow::process()
   {
-    if( LinksRouting::LinkRenderer()
-          .wouldRenderLinks( Rect(geometry()),
-                             *_subscribe_links->_data ) )
+    bool render = _link_geometry
+                ? !_link_geometry->isBucketEmpty(_link_bucket)
+                : LinksRouting::LinkRenderer()
+                    .wouldRenderLinks( Rect(geometry()),
+                                       *_subscribe_links->_data );
+    if( render )
     {
       if( !isVisible() )
         show();
@@ -76,12 +83,22 @@ namespace qtfullscreensystem
   {
     _subscribe_links =
       slot_subscriber.getSlot<LR::LinkDescription::LinkList>("/links");
+    _subscribe_links_revision =
+      slot_subscriber.getSlot<uint32_t>("/links/revision");
     _subscribe_outlines =
       slot_subscriber.getSlot<LR::SlotType::CoveredOutline>("/covered-outlines");
     _subscribe_xray =
       slot_subscriber.getSlot<LR::SlotType::XRayPopup>("/xray");
   }
 
+  //----------------------------------------------------------------------------
+  void GLWindow::setLinkGeometry( const LR::LinkGeometry* geometry,
+                                  size_t bucket )
+  {
+    _link_geometry = geometry;
+    _link_bucket = bucket;
+  }
+
   //----------------------------------------------------------------------------
   void GLWindow::paintGL()
   {
@@ -94,8 +111,11 @@ namespace qtfullscreensystem
     QRect geom = geometry();
     glOrtho(geom.left(), geom.right(), geom.bottom(), geom.top(), -1.0, 1.0);
 
-    LinksRouting::LinkRenderer renderer;
-    renderer.renderLinks(*_subscribe_links->_data);
+    if( _link_geometry )
+      _link_renderer.renderLinks(*_link_geometry, _link_bucket);
+    else
+      _link_renderer.renderLinks( *_subscribe_links->_data,
+                                  *_subscribe_links_revision->_data );
   }
 
 } // namespace qtfullscreensystem
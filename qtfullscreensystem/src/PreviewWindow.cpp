@@ -284,7 +284,7 @@ namespace qtfullscreensystem
                         _popup->hover_region.zoom,
                         _popup->auto_resize,
                         _popup->hover_region.getAlpha(),
-                        &_image_cache );
+                        &_tile_textures );
 
 //    glMatrixMode(GL_PROJECTION);
 //    glPushMatrix();
@@ -424,7 +424,7 @@ namespace qtfullscreensystem
                       -1,
                       false,
                       1,
-                      &_image_cache );
+                      &_tile_textures );
   }
 
   //----------------------------------------------------------------------------
@@ -507,7 +507,11 @@ namespace qtfullscreensystem
                                 //      area (move upwards if pos + size > scroll
                                 //      area size).
 
-    _subscribe_tile_handler->_data->updateTileMap(tile_map, client, src_reg, zoom);
+    _subscribe_tile_handler->_data->updateTileMap( tile_map,
+                                                  client,
+                                                  src_reg,
+                                                  zoom,
+                                                  this );
 
     //      renderRect( preview.preview_region );
     tile_map->render( src_reg,
@@ -516,7 +520,7 @@ namespace qtfullscreensystem
                       zoom,
                       false,
                       1.,
-                      &_image_cache );
+                      &_tile_textures );
   }
 
   //----------------------------------------------------------------------------
@@ -20,6 +20,7 @@
 #include <QTimer>
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
 
 namespace qtfullscreensystem
@@ -83,42 +84,93 @@ namespace qtfullscreensystem
   }
 
   //----------------------------------------------------------------------------
-  QBitmap createMaskFromColor( const QImage& img,
-                               QRgb color,
-                               const QRect& region )
+  void RenderWindow::updateDamage( const QRegion& damage,
+                                   const QPoint& image_offset )
   {
-    QImage maskImage(region.size(), QImage::Format_MonoLSB);
-    maskImage.fill(0);
-    uchar *s = maskImage.bits();
+    QRegion local = damage.translated(image_offset - _geometry.topLeft())
+                          .intersected(QRect(QPoint(0, 0), size()));
+    if( !local.isEmpty() )
+      update(local);
+  }
 
-    for(int h = region.top(); h < region.bottom(); h++)
+  //----------------------------------------------------------------------------
+  /**
+   * Set or clear all bits of a mask (QImage::Format_MonoLSB) inside the given
+   * rectangle, writing whole bytes wherever possible.
+   */
+  void maskFillRect( QImage& mask_img,
+                     const QRect& rect_in,
+                     bool value = false )
+  {
+    const QRect rect = rect_in.intersected(mask_img.rect());
+    if( rect.isEmpty() )
+      return;
+
+    const int l = rect.left(),
+              r = rect.right() + 1,
+              first_byte = l >> 3,
+              last_byte = (r - 1) >> 3;
+    const uchar first_bits = 0xff << (l & 7),
+                last_bits = 0xff >> (7 - ((r - 1) & 7));
+
+    for(int h = rect.top(); h <= rect.bottom(); ++h)
     {
-      const uint *sl = (uint *)img.scanLine(h);
-      for(int w = region.left(); w < region.right(); w++)
+      uchar *s = mask_img.scanLine(h);
+      if( first_byte == last_byte )
       {
-        if( sl[w] == color )
-          *(s + ((w - region.left()) >> 3)) |= (1 << ((w - region.left()) & 7));
+        const uchar bits = first_bits & last_bits;
+        s[first_byte] = value ? (s[first_byte] | bits) : (s[first_byte] & ~bits);
+        continue;
       }
-      s += maskImage.bytesPerLine();
-    }
 
-    return QBitmap::fromImage(maskImage);
+      s[first_byte] = value ? (s[first_byte] | first_bits)
+                            : (s[first_byte] & ~first_bits);
+      std::memset( s + first_byte + 1,
+                   value ? 0xff : 0,
+                   last_byte - first_byte - 1 );
+      s[last_byte] = value ? (s[last_byte] | last_bits)
+                           : (s[last_byte] & ~last_bits);
+    }
   }
 
-  void maskFillRect( QImage& mask_img,
-                     const QRect& rect )
+  //----------------------------------------------------------------------------
+  void RenderWindow::updateMask( const QSize& size,
+                                 std::vector<QRect>& rects )
   {
-    int b = std::min(rect.bottom(), mask_img.height()),
-        r = std::min(rect.right(), mask_img.width());
+    // No rectangles means the (almost) empty mask set in the constructor
+    if( rects.empty() )
+    {
+      if( _mask_rects.empty() )
+        return;
 
-    uchar *s = mask_img.scanLine(rect.top());
-    for(int h = rect.top(); h < b; ++h)
+      _mask_rects.clear();
+      _mask_img = QImage();
+      setMask(QRegion(width() - 2, height() - 2, 1, 1));
+      return;
+    }
+
+    // Nothing to do if no popup/preview has changed
+    if( rects == _mask_rects && _mask_img.size() == size )
+      return;
+
+    if( _mask_img.size() != size )
     {
-      for(int w = rect.left(); w < r; w++)
-        // TODO optimize: fill contiguous regions at once...
-        *(s + (w >> 3)) &= ~(1 << (w & 7));
-      s += mask_img.bytesPerLine();
+      _mask_img = QImage(size, QImage::Format_MonoLSB);
+      _mask_img.fill(1);
+      _mask_rects.clear();
     }
+
+    // Only restore the previous and clear the new rectangles instead of
+    // building the whole mask again.
+    for(auto const& rect: _mask_rects)
+      maskFillRect(_mask_img, rect, true);
+    for(auto const& rect: rects)
+      maskFillRect(_mask_img, rect);
+
+    _mask_rects.swap(rects);
+    setMask(QBitmap::fromImage(_mask_img));
+//      static size_t counter = 0;
+//      QBitmap::fromImage(_mask_img).save(QString("mask-%1-%2.png").arg((uint64_t)this).arg(counter++));
   }
 
   //----------------------------------------------------------------------------
@@ -164,8 +216,8 @@ namespace qtfullscreensystem
     );
     QRect local_reg(QPoint(0,0), size());
 
-    QImage mask_img;
-    bool mask_empty = true;
+    const bool build_mask = !_img;
+    std::vector<QRect> mask_rects;
     if( _img )
     {
       if( _img->isNull() )
@@ -175,23 +227,15 @@ namespace qtfullscreensystem
       assert( _img->height() >= reg.bottom() );
       assert( _img->width()  >= reg.right()  );
     }
-    else // TODO add switch to create full window mask?
-    {
-      mask_img = QImage(reg.size(), QImage::Format_MonoLSB);
-      mask_img.fill(1);
-    }
 
     QPainter painter(this);
 //    qDebug() << "paint" << geometry() << _geometry << reg;
 
-    // TODO const QBitmap& mask = createMaskFromColor(*_img, qRgba(0,0,0, 0), reg);
-    //mask.save(QString("mask-%1-%2.png").arg((uint64_t)this).arg(counter++));
-
-    //setMask(mask);
+    // Only copy the damaged part (everything else is clipped anyway)
     if( _img )
-      painter.drawImage( QRectF(0, 0, -1, -1),
+      painter.drawImage( e->rect(),
                          *_img,
-                         QRectF(reg) );
+                         e->rect().translated(reg.topLeft()) );
 
     for( auto popup = _subscribe_popups->_data->popups.begin();
               popup != _subscribe_popups->_data->popups.end();
@@ -214,11 +258,10 @@ namespace qtfullscreensystem
         QString::fromStdString(popup->text)
       );
 
-      if(    !mask_img.isNull()
+      if(    build_mask
           && !text_rect.isNull() )
       {
-        maskFillRect(mask_img, text_rect);
-        mask_empty = false;
+        mask_rects.push_back(text_rect);
       }
     }
 
@@ -248,16 +291,15 @@ namespace qtfullscreensystem
         title
       );
 
-      if(    !mask_img.isNull()
+      if(    build_mask
           && !text_rect.isEmpty()
           &&  text_rect.intersects(local_reg) )
       {
-        maskFillRect(mask_img, text_rect);
-        mask_empty = false;
+        mask_rects.push_back(text_rect);
       }
     }
 
-    if( !mask_img.isNull() )
+    if( build_mask )
     {
       for( auto const& popup: _subscribe_popups->_data->popups )
       {
@@ -272,8 +314,7 @@ namespace qtfullscreensystem
             || !popup_rect.intersects(local_reg) )
           continue;
 
-        maskFillRect(mask_img, popup_rect);
-        mask_empty = false;
+        mask_rects.push_back(popup_rect);
       }
 
       for(auto const& preview: _subscribe_xray->_data->popups)
@@ -287,16 +328,10 @@ namespace qtfullscreensystem
             || !reg.intersects(local_reg) )
           continue;
 
-        maskFillRect(mask_img, reg);
-        mask_empty = false;
+        mask_rects.push_back(reg);
       }
 
-      if( mask_empty )
-        setMask(QRegion(width() - 2, height() - 2, 1, 1));
-      else
-        setMask(QBitmap::fromImage(mask_img));
-//      static size_t counter = 0;
-//      QBitmap::fromImage(mask_img).save(QString("mask-%1-%2.png").arg((uint64_t)this).arg(counter++));
+      updateMask(reg.size(), mask_rects);
     }
   }
 
@@ -8,6 +8,7 @@
 
 #include "application.hpp"
 #include "qt_helper.hxx"
+#include "NodeRenderer.hpp"
 #include "PreviewWindow.hpp"
 #include "GLWindow.hpp"
 #include "Window.hpp"
@@ -15,13 +16,68 @@
 #include <QCommandLineParser>
 #include <QDesktopWidget>
 #include <QElapsedTimer>
+#include <QPixmap>
 #include <QScreen>
 #include <QSurfaceFormat>
 
+#include <cstring>
 #include <iostream>
 
 namespace qtfullscreensystem
 {
+  /** Extent of blur and anti aliasing around drawn regions */
+  const int DAMAGE_MARGIN = 16;
+
+  /** Read back the whole image if the damage covers more than this fraction */
+  const float DAMAGE_FULL_THRESHOLD = 0.6f;
+
+  //----------------------------------------------------------------------------
+  /**
+   * Collect the highlights of hovered covered regions, which are rendered
+   * additionally to the link geometry (in absolute coordinates).
+   */
+  static void collectHoverRects( const LR::LinkDescription::LinkList& links,
+                                 std::vector<Rect>& rects )
+  {
+    for(auto const& link: links)
+    {
+      LR::HyperEdgeQueue hedges_open;
+      LR::HyperEdgeSet   hedges_done;
+
+      auto visitNodes = [&](const LR::LinkDescription::nodes_t& nodes)
+      {
+        for(auto const& node: nodes)
+        {
+          for(auto const& child: node->getChildren())
+            hedges_open.push(child.get());
+
+          bool hover = node->get<bool>("hover");
+          if( node->get<float>("alpha", hover ? 1 : 0) > 0.01 || hover )
+          {
+            rects.push_back(node->get<Rect>("covered-preview-region"));
+            rects.push_back(node->get<Rect>("covered-region"));
+          }
+        }
+      };
+
+      hedges_open.push(link._link.get());
+      do
+      {
+        const LR::LinkDescription::HyperEdge* hedge = hedges_open.front();
+        hedges_open.pop();
+
+        if( !hedges_done.insert(hedge).second )
+          continue;
+
+        auto fork = hedge->getHyperEdgeDescription();
+        if( !fork )
+          visitNodes(hedge->getNodes());
+        else
+          for(auto const& segment: fork->outgoing)
+            visitNodes(segment.nodes);
+      } while( !hedges_open.empty() );
+    }
+  }
 
   class QtPreview:
     public LinksRouting::SlotType::Preview
@@ -93,12 +149,16 @@ namespace qtfullscreensystem
     Configurable("Application"),
     QApplication(argc, argv),
     _server(&_mutex_slot_links, &_cond_render),
+    _readback_index(0),
+    _link_bounds_revision(0),
     _mutex_slot_links(QMutex::Recursive)
   {
 //    _cur_fbo(0),
 //    _do_drag(false),
 //    _flags(0),
 
+    installLogMessageHandler();
+
     setOrganizationDomain("icg.tugraz.at");
     setOrganizationName("icg.tugraz.at");
     setApplicationName("VisLinks");
@@ -170,11 +230,34 @@ namespace qtfullscreensystem
 
     if( !_disable_rendering )
     {
+#ifdef USE_GPU_ROUTING
+      // Cost analysis before routing, so routers get the current cost map
+      _core.attachComponent(&_cost_analysis);
+#else
+      // The cost map is calculated from the desktop as it is visible before
+      // our windows cover it.
+      QScreen* screen = QGuiApplication::primaryScreen();
+      const QRect desktop_rect = screen->availableVirtualGeometry();
+      _desktop_image = screen->grabWindow( 0,
+                                           desktop_rect.x()
+                                             - screen->geometry().x(),
+                                           desktop_rect.y()
+                                             - screen->geometry().y(),
+                                           desktop_rect.width(),
+                                           desktop_rect.height() )
+                             .toImage()
+                             .convertToFormat(QImage::Format_RGBA8888);
+
+      if( !_desktop_image.isNull() )
+        _core.attachComponent(&_cost_analysis);
+      else
+        LOG_WARN("Failed to capture desktop. Routing without cost map.");
+#endif
       _core.attachComponent(&_routing_cpu);
       _core.attachComponent(&_routing_cpu_dijkstra);
+      _core.attachComponent(&_routing_cpu_blocks);
       _core.attachComponent(&_routing_dummy);
 #ifdef USE_GPU_ROUTING
-      _core.attachComponent(&_cost_analysis);
       _core.attachComponent(&_routing_gpu);
 #endif
       if( !_use_renderer_per_screen )
@@ -221,12 +304,17 @@ namespace qtfullscreensystem
       }
       else
       {
+        // Links are extruded only once and sorted into one bucket per screen
+        std::vector<Rect> screen_regions;
         for(QScreen* s: QGuiApplication::screens())
         {
           auto w = std::make_shared<GLWindow>(s->availableGeometry());
+          w->setLinkGeometry(&_screen_link_geometry, screen_regions.size());
           w->show();
           _render_windows.push_back(w);
+          screen_regions.push_back( Rect(s->availableGeometry()) );
         }
+        _screen_link_geometry.setBuckets(screen_regions);
       }
     }
 
@@ -248,7 +336,20 @@ namespace qtfullscreensystem
   {
     _slot_desktop =
       slot_collector.create<LR::SlotType::Image>("/desktop");
+#ifdef USE_GPU_ROUTING
     _slot_desktop->_data->type = LR::SlotType::Image::OpenGLTexture;
+#else
+    if( !_desktop_image.isNull() )
+    {
+      *_slot_desktop->_data = LR::SlotType::Image(
+        _desktop_image.width(),
+        _desktop_image.height(),
+        _desktop_image.bits(),
+        LR::SlotType::Image::ImageRGBA8
+      );
+      _slot_desktop->setValid(true);
+    }
+#endif
 
     _slot_desktop_rect =
       slot_collector.create<Rect>("/desktop/rect");
@@ -256,6 +357,13 @@ namespace qtfullscreensystem
       QGuiApplication::primaryScreen()->availableVirtualGeometry();
     _slot_desktop_rect->setValid(true);
 
+    // Changed regions of the desktop image. The desktop image is not updated
+    // after startup, so nothing ever changes (the cost analysis processes the
+    // whole image once after it has been resized).
+    _slot_desktop_damage =
+      slot_collector.create<LR::SlotType::Damage>("/desktop/damage");
+    _slot_desktop_damage->setValid(true);
+
     _slot_mouse =
       slot_collector.create<LR::SlotType::MouseEvent>("/mouse");
     _slot_popups =
@@ -276,23 +384,25 @@ namespace qtfullscreensystem
 #endif
     _subscribe_routed_links =
       slot_subscriber.getSlot<LR::LinkDescription::LinkList>("/links");
+    _subscribe_links_revision =
+      slot_subscriber.getSlot<uint32_t>("/links/revision");
     _subscribe_outlines =
       slot_subscriber.getSlot<LR::SlotType::CoveredOutline>("/covered-outlines");
+    _subscribe_popups =
+      slot_subscriber.getSlot<LR::SlotType::TextPopup>("/popups");
 
     for(auto& w: _render_windows)
       w->subscribeSlots(slot_subscriber);
 
     if( _use_renderer_per_screen )
-    {
-      _subscribe_popups =
-        slot_subscriber.getSlot<LR::SlotType::TextPopup>("/popups");
       return;
-    }
 
     _subscribe_links =
       slot_subscriber.getSlot<LR::SlotType::Image>("/rendered-links");
     _subscribe_xray_fbo =
       slot_subscriber.getSlot<LR::SlotType::Image>("/rendered-xray");
+    _subscribe_link_geometry =
+      slot_subscriber.getSlot<LR::LinkGeometry>("/rendered-links/geometry");
 
     for(auto& w: _windows)
       w->subscribeSlots(slot_subscriber);
@@ -351,6 +461,8 @@ namespace qtfullscreensystem
                  | Component::DataServer
                  | Component::Routing );
 
+    _screen_link_geometry.update( *_subscribe_routed_links->_data,
+                                  *_subscribe_links_revision->_data );
     for(GLWindowRef& win: _render_windows)
       win->process();
 
@@ -427,6 +539,23 @@ namespace qtfullscreensystem
       qDebug() << "initFBO" << size;
       _fbo.reset(new QOpenGLFramebufferObject(size));
 
+      _fbo_image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+      _fbo_image.fill(0);
+
+      for(auto& pbo: _readback_pbos)
+      {
+        pbo = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+        pbo.setUsagePattern(QOpenGLBuffer::StreamRead);
+        if( !pbo.create() )
+          qFatal("Failed to create pixel buffer.");
+        pbo.bind();
+        pbo.allocate(size.width() * size.height() * 4);
+        pbo.release();
+      }
+
+      // Everything needs to be read back initially
+      _frame_rects.push_back( Rect( float2(-1e6, -1e6), float2(2e6, 2e6) ) );
+
       _shader_blend = Shader::loadFromFiles("simple.vert", "blend.frag");
       if( !_shader_blend )
         qFatal("Failed to load blend shader.");
@@ -451,7 +580,8 @@ namespace qtfullscreensystem
                      ? (Component::Renderer | 64)
                      :   Component::Config
                        | Component::DataServer
-                       | ((_flags & LINKS_DIRTY) ? Component::Routing : 0)
+                       | ((_flags & LINKS_DIRTY) ? Component::Costanalysis
+                                                  | Component::Routing : 0)
                        | ((_flags & RENDER_DIRTY) ? Component::Renderer : 0);
 
 //      std::cout << "types: " << (types & Component::Routing ? "routing " : "")
@@ -481,7 +611,6 @@ namespace qtfullscreensystem
 //      image.save(name);
 //    };
 
-    glFinish();
     //writeTexture(_subscribe_links, QString("links%1.png").arg(counter));
 
     if( !_fbo->bind() )
@@ -497,7 +626,9 @@ namespace qtfullscreensystem
       _subscribe_xray_fbo->_data->id,
       _subscribe_links->_data->id,
 #ifndef USE_DESKTOP_BLEND
-      _slot_desktop->_data->id
+      _slot_desktop->_data->type == LR::SlotType::Image::OpenGLTexture
+        ? _slot_desktop->_data->id
+        : 0
 #endif
     };
     size_t num_textures = sizeof(tex_ids)/sizeof(tex_ids[0]);
@@ -543,17 +674,54 @@ namespace qtfullscreensystem
     if( !_fbo->release() )
       qFatal("Failed to release FBO.");
 
-    glFinish();
+    // Only read back the parts which have changed. The transfer into the
+    // pixel buffer is asynchronous and only waited for in the next frame, once
+    // the readback of this frame has been issued to the other buffer.
+    const QRect image_rect(QPoint(0, 0), _fbo->size());
+    const size_t prev_index = (_readback_index + 1) % 2;
+    QRegion damage = collectDamage(image_rect);
+    if( !damage.isEmpty() )
+    {
+      QOpenGLBuffer& pbo = _readback_pbos[_readback_index];
+
+      const QRect bounds = damage.boundingRect();
+      if(   bounds.width() * bounds.height()
+          > DAMAGE_FULL_THRESHOLD * image_rect.width() * image_rect.height() )
+        damage = image_rect;
+
+      _fbo->bind();
+      pbo.bind();
+      glPixelStorei(GL_PACK_ALIGNMENT, 4);
+      glPixelStorei(GL_PACK_ROW_LENGTH, image_rect.width());
+
+      // Keep the layout of the whole image inside the pixel buffer (bottom up,
+      // as used by OpenGL)
+      for(const QRect& rect: damage.rects())
+      {
+        const int gl_y = image_rect.height() - rect.bottom() - 1;
+        const size_t offset = 4 * (gl_y * image_rect.width() + rect.left());
+        glReadPixels( rect.left(), gl_y,
+                      rect.width(), rect.height(),
+                      GL_BGRA, GL_UNSIGNED_BYTE,
+                      reinterpret_cast<GLvoid*>(offset) );
+      }
+
+      glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+      pbo.release();
+      _fbo->release();
+    }
+    _readback_damage[_readback_index] = damage;
 
-    _fbo_image = _fbo->toImage();
-    //_fbo_image.save(QString("fbo%1.png").arg(counter));
+    // The readback of the previous frame has had a whole frame to complete,
+    // so mapping its buffer does not stall while this one is in flight.
+    finishReadback(prev_index);
+    _readback_index = prev_index;
 
+    // Masks also depend on previews not being part of the composited image
     int timeout = 5;
-    for(size_t i = 0; i < _windows.size(); ++i)
+    for(auto& w: _mask_windows)
     {
-      //w->update();
-      QTimer::singleShot(timeout, _windows[i].get(), SLOT(update()));
-      QTimer::singleShot(timeout, _mask_windows[i].get(), SLOT(update()));
+      QTimer::singleShot(timeout, w.get(), SLOT(update()));
 
       // Waiting a bit between updates seems to reduce artifacts...
       timeout += 30;
@@ -562,4 +730,105 @@ namespace qtfullscreensystem
     _gl_ctx.doneCurrent();
   }
 
+  //----------------------------------------------------------------------------
+  void Application::finishReadback(size_t index)
+  {
+    QRegion& damage = _readback_damage[index];
+    if( damage.isEmpty() )
+      return;
+
+    QOpenGLBuffer& pbo = _readback_pbos[index];
+    pbo.bind();
+
+    const uchar* pixels =
+      static_cast<const uchar*>(pbo.map(QOpenGLBuffer::ReadOnly));
+    if( !pixels )
+    {
+      LOG_WARN("Failed to map pixel buffer.");
+      pbo.release();
+      damage = QRegion();
+      return;
+    }
+
+    // Flip to top down
+    const int w = _fbo_image.width(),
+              h = _fbo_image.height();
+    for(const QRect& rect: damage.rects())
+    {
+      for(int y = rect.top(); y <= rect.bottom(); ++y)
+      {
+        const int gl_y = h - y - 1;
+        std::memcpy( _fbo_image.scanLine(y) + 4 * rect.left(),
+                     pixels + 4 * (gl_y * w + rect.left()),
+                     4 * rect.width() );
+      }
+    }
+
+    pbo.unmap();
+    pbo.release();
+
+    const QPoint desktop_offset =
+      QGuiApplication::primaryScreen()->availableVirtualGeometry().topLeft();
+
+    for(auto& w: _windows)
+      w->updateDamage(damage, desktop_offset);
+
+    damage = QRegion();
+  }
+
+  //----------------------------------------------------------------------------
+  QRegion Application::collectDamage(const QRect& image_rect)
+  {
+    // Links are only compared if the renderer has rebuilt their geometry, all
+    // other regions are small and can change without any visible property
+    // changing (eg. during animations), so they are always assumed to be
+    // damaged.
+    std::vector<Rect> links_changed;
+    const LR::LinkGeometry& link_geometry = *_subscribe_link_geometry->_data;
+    if( link_geometry.getRevision() != _link_bounds_revision )
+    {
+      // Both the old and the new extents need to be redrawn
+      links_changed.swap(_link_bounds);
+      link_geometry.getBounds(_link_bounds);
+      links_changed.insert( links_changed.end(),
+                            _link_bounds.begin(),
+                            _link_bounds.end() );
+      _link_bounds_revision = link_geometry.getRevision();
+    }
+
+    std::vector<Rect> rects;
+    collectHoverRects(*_subscribe_routed_links->_data, rects);
+    for(auto const& popup: _subscribe_popups->_data->popups)
+    {
+      if( !popup.region.isVisible() )
+        continue;
+
+      rects.push_back(popup.region.region);
+      rects.push_back(popup.hover_region.region);
+    }
+    for(auto const& outline: _subscribe_outlines->_data->popups)
+      rects.push_back(outline.region_title);
+
+    const QPoint desktop_offset =
+      QGuiApplication::primaryScreen()->availableVirtualGeometry().topLeft();
+
+    // Regions need to be cleared if they are gone in the new frame
+    QRegion damage;
+    for(auto const* frame: {&links_changed, &_frame_rects, &rects})
+      for(auto const& rect: *frame)
+      {
+        if( !rect.isValid() )
+          continue;
+
+        damage += rect.toQRect()
+                      .translated(-desktop_offset)
+                      .adjusted( -DAMAGE_MARGIN, -DAMAGE_MARGIN,
+                                  DAMAGE_MARGIN,  DAMAGE_MARGIN )
+                      .intersected(image_rect);
+      }
+
+    _frame_rects.swap(rects);
+    return damage;
+  }
+
 } // namespace qtfullscreensystem